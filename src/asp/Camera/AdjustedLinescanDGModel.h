@@ -106,6 +106,59 @@ namespace asp {
     // Return the indices of the largest weights used in interp.
     return smooth_position_adjustments.get_indices_of_largest_weights(bound_t);
   }
+
+  // The weights with which the adjustments with given indices enter
+  // the adjustment interpolated at time t, for num_adjustments
+  // adjustments placed at t0 + k*dt. The interpolation is linear in
+  // the adjustments, so the weight of one is what is interpolated
+  // when it is 1 and the others are 0. Only the num_wts adjustments
+  // nearest to t are used, so that is done on a short window of the
+  // adjustments around t, whose size does not depend on
+  // num_adjustments. Three indices share a window, one per coordinate.
+  inline std::vector<double>
+  get_piecewise_adj_weights(PiecewiseAdjustmentInterpType interp_type,
+                            double t0, double dt, int num_adjustments,
+                            int num_wts, double sigma,
+                            double t, std::vector<int> const& indices) {
+
+    std::vector<double> weights(indices.size(), 0.0);
+    if (indices.empty())
+      return weights;
+
+    // Bound t as when the adjustment is interpolated
+    double tend = t0 + dt*(num_adjustments - 1);
+    double bound_t = std::max(t, t0);
+    bound_t = std::min(bound_t, TINY_ADJ*tend);
+
+    // The window, with a margin beyond the reach of the interpolation
+    int index = (int)floor((bound_t - t0)/dt);
+    int beg = index, end = index + 1;
+    for (size_t k = 0; k < indices.size(); k++) {
+      beg = std::min(beg, indices[k]);
+      end = std::max(end, indices[k]);
+    }
+    beg = std::max(beg - num_wts - 1, 0);
+    end = std::min(end + num_wts + 1, num_adjustments - 1);
+    double win_t0 = t0 + beg*dt;
+    std::vector<vw::Vector3> unit(end - beg + 1);
+
+    for (size_t k0 = 0; k0 < indices.size(); k0 += 3) {
+      std::fill(unit.begin(), unit.end(), vw::Vector3());
+      for (size_t k = k0; k < std::min(k0 + 3, indices.size()); k++) {
+        if (indices[k] >= beg && indices[k] <= end)
+          unit[indices[k] - beg][k - k0] = 1.0;
+      }
+      vw::Vector3 val;
+      if (interp_type == LinearInterp)
+        val = vw::camera::LinearPiecewisePositionInterpolation(unit, win_t0, dt)(bound_t);
+      else
+        val = vw::camera::SmoothPiecewisePositionInterpolation(unit, win_t0, dt,
+                                                               num_wts, sigma)(bound_t);
+      for (size_t k = k0; k < std::min(k0 + 3, indices.size()); k++)
+        weights[k] = val[k - k0];
+    }
+    return weights;
+  }
   
   class AdjustablePosition {
   public:
@@ -113,12 +166,16 @@ namespace asp {
                        vw::Vector2 const& adjustment_bounds,
                        std::vector<vw::Vector3> const& position_adjustments,
                        int num_wts, double sigma):
-      m_interp_type(static_cast<PiecewiseAdjustmentInterpType>(interp_type)) {
+      m_interp_type(static_cast<PiecewiseAdjustmentInterpType>(interp_type)),
+      m_num_adjustments(position_adjustments.size()),
+      m_num_wts(num_wts), m_sigma(sigma) {
 
       // We will need to be able to linearly interpolate into the adjustments.
       double t0, dt;
       compute_t0_dt(adjustment_bounds[0], adjustment_bounds[1],
 		    position_adjustments.size(), t0, dt);
+      m_t0 = t0;
+      m_dt = dt;
 
       // Linear interp
       if (m_interp_type == LinearInterp){
@@ -159,10 +216,19 @@ namespace asp {
 					  m_interp_type, t);
     }
 
+    // The weights with which the adjustments with given indices enter
+    // the adjustment at time t
+    std::vector<double> get_adj_weights(double t, std::vector<int> const& indices) const {
+      return get_piecewise_adj_weights(m_interp_type, m_t0, m_dt, m_num_adjustments,
+                                       m_num_wts, m_sigma, t, indices);
+    }
+
   private:
     PiecewiseAdjustmentInterpType m_interp_type;
     vw::camera::LinearPiecewisePositionInterpolation m_linear_position_adjustments;
     vw::camera::SmoothPiecewisePositionInterpolation m_smooth_position_adjustments;
+    int         m_num_adjustments, m_num_wts;
+    double      m_sigma, m_t0, m_dt;
   };
 
   class AdjustablePose {
@@ -260,6 +326,14 @@ namespace asp {
     std::vector<int> get_closest_adj_indices(double line_pos){
       return m_adj_position.get_closest_adj_indices(line_pos);
     }
+
+    // The weights of these adjustments at the given line. A position
+    // adjustment moves the camera center by its weight times
+    // itself. To first order in the rotations, which are small, so
+    // does a pose adjustment rotate the rays.
+    std::vector<double> get_adj_weights(double line_pos, std::vector<int> const& indices) const {
+      return m_adj_position.get_adj_weights(line_pos, indices);
+    }
     
     vw::Vector3 pixel_to_vector(vw::Vector2 const& pix) const {
       return m_adj_pose(pix.y()).rotate(m_cam->pixel_to_vector(pix));
@@ -323,13 +397,17 @@ namespace asp {
                        std::vector<vw::Vector3> const& position_adjustments,
                        int num_wts, double sigma):
       m_cam_ptr(cam_ptr),
-      m_interp_type(static_cast<PiecewiseAdjustmentInterpType>(interp_type)) {
+      m_interp_type(static_cast<PiecewiseAdjustmentInterpType>(interp_type)),
+      m_num_adjustments(position_adjustments.size()),
+      m_num_wts(num_wts), m_sigma(sigma) {
 
       // We will need to be able to linearly interpolate into the adjustments.
       double t0, dt;
       compute_t0_dt(cam_ptr->get_time_at_line(adjustment_bounds[0]),
 		    cam_ptr->get_time_at_line(adjustment_bounds[1]),
 		    position_adjustments.size(), t0, dt);
+      m_t0 = t0;
+      m_dt = dt;
       
       // Linear interp
       if (m_interp_type == LinearInterp){
@@ -345,6 +423,11 @@ namespace asp {
 
     // Return the original position plus the interpolated adjustment.
     vw::Vector3 operator()(double t) const {
+      return adjustment(t) + m_cam_ptr->get_camera_center_at_time(t);
+    }
+
+    // The interpolated adjustment alone
+    vw::Vector3 adjustment(double t) const {
 
       // The adjustments by design can be applied only to t
       // corresponding to between first and last lines, as that's
@@ -354,13 +437,13 @@ namespace asp {
         double bound_t = t;
         bound_t = std::max(bound_t, m_linear_position_adjustments.get_t0());
         bound_t = std::min(bound_t, TINY_ADJ*m_linear_position_adjustments.get_tend());
-        return m_linear_position_adjustments(bound_t) + m_cam_ptr->get_camera_center_at_time(t);
+        return m_linear_position_adjustments(bound_t);
       }
 
       double bound_t = t;
       bound_t = std::max(bound_t, m_smooth_position_adjustments.get_t0());
       bound_t = std::min(bound_t, TINY_ADJ*m_smooth_position_adjustments.get_tend());
-      return m_smooth_position_adjustments(bound_t) + m_cam_ptr->get_camera_center_at_time(t);
+      return m_smooth_position_adjustments(bound_t);
     }
 
     // Return the closest piecewise adjustment camera indices to given time.
@@ -369,12 +452,21 @@ namespace asp {
 					  m_smooth_position_adjustments,
 					  m_interp_type, t);
     }
+
+    // The weights with which the adjustments with given indices enter
+    // the adjustment at time t, as in AdjustablePosition.
+    std::vector<double> get_adj_weights(double t, std::vector<int> const& indices) const {
+      return get_piecewise_adj_weights(m_interp_type, m_t0, m_dt, m_num_adjustments,
+                                       m_num_wts, m_sigma, t, indices);
+    }
     
   private:
     DGCameraModel const* m_cam_ptr;
     PiecewiseAdjustmentInterpType m_interp_type;
     vw::camera::LinearPiecewisePositionInterpolation m_linear_position_adjustments;
     vw::camera::SmoothPiecewisePositionInterpolation m_smooth_position_adjustments;
+    int         m_num_adjustments, m_num_wts;
+    double      m_sigma, m_t0, m_dt;
   };
 
   class AdjustableDGPose {
@@ -485,6 +577,13 @@ namespace asp {
       return m_position_func.get_closest_adj_indices(t);
     }
 
+    // The weights of these adjustments at the given line, as in
+    // PiecewiseAdjustedLinescanModel.
+    std::vector<double> get_adj_weights(double line_pos, std::vector<int> const& indices) const {
+      double t = m_time_func(line_pos);
+      return m_position_func.get_adj_weights(t, indices);
+    }
+
   private:
     boost::shared_ptr<vw::camera::CameraModel> m_cam;
     vw::Vector2i m_image_size;
@@ -0,0 +1,189 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CCDReprojectionError.h
+///
+/// The ceres cost function of ccd_adjust, projecting a point into a
+/// camera and adding the offset of the CCD the observation is on, with
+/// its analytic derivatives. It is in a header so that it can be
+/// tested on its own. Including it needs ceres.
+
+#ifndef __ASP_CAMERA_CCD_REPROJECTION_ERROR_H__
+#define __ASP_CAMERA_CCD_REPROJECTION_ERROR_H__
+
+#include <vw/Camera/CameraModel.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Thread.h>
+#include <asp/Camera/CameraJacobians.h>
+#include <boost/shared_ptr.hpp>
+
+// Turn off warnings from eigen
+#if defined(__GNUC__) || defined(__GNUG__)
+#define LOCAL_GCC_VERSION (__GNUC__ * 10000                    \
+			   + __GNUC_MINOR__ * 100              \
+			   + __GNUC_PATCHLEVEL__)
+#if LOCAL_GCC_VERSION >= 40600
+#pragma GCC diagnostic push
+#endif
+#if LOCAL_GCC_VERSION >= 40202
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+#endif
+#endif
+
+#include <ceres/ceres.h>
+#include <ceres/loss_function.h>
+
+#if defined(__GNUC__) || defined(__GNUG__)
+#if LOCAL_GCC_VERSION >= 40600
+#pragma GCC diagnostic pop
+#endif
+#undef LOCAL_GCC_VERSION
+#endif
+
+
+namespace asp{
+
+// Print the first errors when computing residuals. Ceres calls the
+// cost functions from several threads.
+inline void report_ccd_error(std::string const& msg) {
+  static int num_errors = 0;
+  static vw::Mutex mutex;
+  vw::Mutex::Lock lock(mutex);
+  num_errors++;
+  if (num_errors < 100) {
+    vw::vw_out(vw::ErrorMessage) << msg << std::endl;
+  }else if (num_errors == 100) {
+    vw::vw_out() << "Will print no more error messages about "
+                 << "failing to compute residuals.\n";
+  }
+}
+
+const int NUM_CCD_OFFSET_PARAMS = 2;
+const int NUM_CCD_POINT_PARAMS  = 3;
+
+// A ceres cost function. We pass in the observation, the model, and
+// the current camera and point indices. The result is the residual,
+// the difference in the observation and the projection of the point
+// into the camera, plus the offset of its CCD, normalized by
+// pixel_sigma.
+//
+// The camera does not change, only the offsets and the points do, so
+// the projection of the point and its derivative are found with one
+// point_to_pixel() call and kept until the point moves. The
+// derivative with respect to the offset is the identity. Numerical
+// differentiation would instead take a linescan point_to_pixel() solve
+// per parameter and per direction at each evaluation.
+class CCDReprojectionError: public ceres::SizedCostFunction<NUM_CCD_OFFSET_PARAMS,
+                                                            NUM_CCD_OFFSET_PARAMS,
+                                                            NUM_CCD_POINT_PARAMS> {
+public:
+  CCDReprojectionError(vw::Vector2 const& observation,
+                       vw::Vector2 const& pixel_sigma,
+                       boost::shared_ptr<vw::camera::CameraModel> cam):
+    m_observation(observation),
+    m_pixel_sigma(pixel_sigma),
+    m_cam(cam),
+    m_has_projection(false){}
+
+  /// Project the point into the camera, unless it was projected
+  /// before. Can be called from several threads.
+  void project(vw::Vector3 const& point, vw::Vector2 & pixel, vw::Matrix<double, 2, 3> & J) const {
+    {
+      vw::Mutex::Lock lock(m_mutex);
+      if (m_has_projection && m_point == point) {
+        pixel = m_pixel;
+        J     = m_jacobian;
+        return;
+      }
+    }
+
+    pixel = asp::point_to_pixel_jacobian(*m_cam, point, J);
+
+    vw::Mutex::Lock lock(m_mutex);
+    m_point          = point;
+    m_pixel          = pixel;
+    m_jacobian       = J;
+    m_has_projection = true;
+  }
+
+  virtual bool Evaluate(double const* const* parameters, double* residuals,
+                        double** jacobians) const {
+
+    try{
+
+      vw::Vector<double, NUM_CCD_POINT_PARAMS> point_vec;
+      for (int c = 0; c < NUM_CCD_POINT_PARAMS; c++)
+        point_vec[c] = parameters[1][c];
+
+      vw::Vector2 pixel;
+      vw::Matrix<double, 2, 3> J;
+      project(point_vec, pixel, J);
+
+      // TODO: Think of the line below!!! + or -!!!
+      vw::Vector2 prediction;
+      for (int c = 0; c < NUM_CCD_OFFSET_PARAMS; c++)
+        prediction[c] = pixel[c] + parameters[0][c];
+
+      // The error is the difference between the predicted and observed position,
+      // normalized by sigma.
+      residuals[0] = (prediction[0] - m_observation[0])/m_pixel_sigma[0];
+      residuals[1] = (prediction[1] - m_observation[1])/m_pixel_sigma[1];
+
+      if (jacobians == NULL)
+        return true;
+
+      for (int r = 0; r < NUM_CCD_OFFSET_PARAMS; r++) {
+        if (jacobians[0] != NULL) {
+          for (int c = 0; c < NUM_CCD_OFFSET_PARAMS; c++)
+            jacobians[0][r*NUM_CCD_OFFSET_PARAMS + c] = (r == c) ? 1.0/m_pixel_sigma[r] : 0.0;
+        }
+        if (jacobians[1] != NULL) {
+          for (int c = 0; c < NUM_CCD_POINT_PARAMS; c++)
+            jacobians[1][r*NUM_CCD_POINT_PARAMS + c] = J(r, c)/m_pixel_sigma[r];
+        }
+      }
+
+    } catch (std::exception const& e) {
+
+      // Failed to compute residuals
+      report_ccd_error(e.what());
+
+      residuals[0] = 1e+20;
+      residuals[1] = 1e+20;
+      return false;
+    }
+
+    return true;
+  }
+
+private:
+  vw::Vector2 m_observation;
+  vw::Vector2 m_pixel_sigma;
+  boost::shared_ptr<vw::camera::CameraModel> m_cam;
+
+  // The last projection
+  mutable vw::Mutex m_mutex;
+  mutable bool  m_has_projection;
+  mutable vw::Vector3 m_point;
+  mutable vw::Vector2 m_pixel;
+  mutable vw::Matrix<double, 2, 3> m_jacobian;
+};
+
+} // namespace asp
+
+#endif//__ASP_CAMERA_CCD_REPROJECTION_ERROR_H__
@@ -0,0 +1,386 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CameraCache.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Cartography/Datum.h>
+#include <asp/Core/LowResCache.h>
+#include <asp/Camera/DG_XML.h>
+#include <asp/Camera/SPOT_XML.h>
+#include <asp/Camera/ASTER_XML.h>
+#include <asp/Camera/RPCModel.h>
+#include <asp/Camera/CameraCache.h>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <fstream>
+#include <list>
+#include <sstream>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+namespace {
+
+  // Bump this when what is stored changes
+  const std::string CACHE_MAGIC = "ASPCAM01";
+
+  // Write and read values in the native binary format. The cache is
+  // only meant for the machines of one cluster, which agree on it.
+  void put(std::ostream & os, double v)     { os.write((const char*)&v, sizeof(v)); }
+  void put(std::ostream & os, vw::int32 v)  { os.write((const char*)&v, sizeof(v)); }
+  void get(std::istream & is, double & v)   { is.read((char*)&v, sizeof(v)); }
+  void get(std::istream & is, vw::int32 & v){ is.read((char*)&v, sizeof(v)); }
+
+  void put(std::ostream & os, std::string const& s) {
+    put(os, vw::int32(s.size()));
+    os.write(s.c_str(), s.size());
+  }
+  void get(std::istream & is, std::string & s) {
+    vw::int32 len = 0;
+    get(is, len);
+    if (!is || len < 0) {
+      is.setstate(std::ios::failbit);
+      return;
+    }
+    s.resize(len);
+    if (len > 0)
+      is.read(&s[0], len);
+  }
+
+  template <class T, int N>
+  void put(std::ostream & os, vw::Vector<T, N> const& v) {
+    for (int i = 0; i < N; i++)
+      put(os, v[i]);
+  }
+  template <class T, int N>
+  void get(std::istream & is, vw::Vector<T, N> & v) {
+    for (int i = 0; i < N; i++)
+      get(is, v[i]);
+  }
+
+  void put(std::ostream & os, vw::Quat const& q) {
+    put(os, q.w()); put(os, q.x()); put(os, q.y()); put(os, q.z());
+  }
+  void get(std::istream & is, vw::Quat & q) {
+    double w = 0, x = 0, y = 0, z = 0;
+    get(is, w); get(is, x); get(is, y); get(is, z);
+    q = vw::Quat(w, x, y, z);
+  }
+
+  template <class A, class B>
+  void put(std::ostream & os, std::pair<A, B> const& p) {
+    put(os, p.first);
+    put(os, p.second);
+  }
+  template <class A, class B>
+  void get(std::istream & is, std::pair<A, B> & p) {
+    get(is, p.first);
+    get(is, p.second);
+  }
+
+  // Declared ahead, since containers may hold containers
+  template <class T> void put(std::ostream & os, std::vector<T> const& v);
+  template <class T> void get(std::istream & is, std::vector<T> & v);
+  template <class T> void put(std::ostream & os, std::list<T> const& v);
+  template <class T> void get(std::istream & is, std::list<T> & v);
+
+  // Both std::vector and std::list
+  template <class ContainerT>
+  void put_seq(std::ostream & os, ContainerT const& c) {
+    put(os, vw::int32(c.size()));
+    for (typename ContainerT::const_iterator it = c.begin(); it != c.end(); it++)
+      put(os, *it);
+  }
+  template <class ContainerT>
+  void get_seq(std::istream & is, ContainerT & c) {
+    vw::int32 len = 0;
+    get(is, len);
+    c.clear();
+    if (!is || len < 0) {
+      is.setstate(std::ios::failbit);
+      return;
+    }
+    for (vw::int32 i = 0; i < len && is; i++) {
+      typename ContainerT::value_type val;
+      get(is, val);
+      c.push_back(val);
+    }
+  }
+
+  template <class T>
+  void put(std::ostream & os, std::vector<T> const& v) { put_seq(os, v); }
+  template <class T>
+  void get(std::istream & is, std::vector<T> & v)      { get_seq(is, v); }
+  template <class T>
+  void put(std::ostream & os, std::list<T> const& v)   { put_seq(os, v); }
+  template <class T>
+  void get(std::istream & is, std::list<T> & v)        { get_seq(is, v); }
+
+  /// Open a cache file and check its header. Return false if it is
+  /// missing, or is not a cache of this kind.
+  bool open_cache(std::string const& cache_file, std::string const& kind,
+                  std::ifstream & is, double & parse_seconds) {
+    if (cache_file == "" || !fs::exists(cache_file))
+      return false;
+    is.open(cache_file.c_str(), std::ios::binary);
+    std::string magic, file_kind;
+    get(is, magic);
+    get(is, file_kind);
+    get(is, parse_seconds);
+    return is.good() && magic == CACHE_MAGIC && file_kind == kind;
+  }
+
+  /// Return true if a cache file was read fully. If not, it is left
+  /// in place, and will be overwritten once the XML file is parsed.
+  bool finish_reading(std::ifstream & is, std::string const& cache_file) {
+    if (is.good())
+      return true;
+    vw::vw_out(vw::WarningMessage) << "Could not read the camera cache file: "
+                                   << cache_file << "\n";
+    return false;
+  }
+
+  /// Write the header, then have the caller write the rest to a
+  /// temporary file. It is moved in place once complete.
+  class CacheWriter {
+    std::string   m_cache_file, m_tmp_file;
+  public:
+    std::ofstream os;
+
+    CacheWriter(std::string const& cache_file, std::string const& kind,
+                double parse_seconds): m_cache_file(cache_file) {
+      std::ostringstream tmp;
+      tmp << cache_file << ".tmp" << getpid();
+      m_tmp_file = tmp.str();
+
+      boost::system::error_code ec;
+      fs::path dir = fs::path(cache_file).parent_path();
+      if (!dir.empty())
+        fs::create_directories(dir, ec);
+      os.open(m_tmp_file.c_str(), std::ios::binary);
+      put(os, CACHE_MAGIC);
+      put(os, kind);
+      put(os, parse_seconds);
+    }
+
+    void commit() {
+      os.close();
+      boost::system::error_code ec;
+      if (!os.fail())
+        fs::rename(m_tmp_file, m_cache_file, ec);
+      if (os.fail() || ec) {
+        vw::vw_out(vw::WarningMessage) << "Could not write the camera cache file: "
+                                       << m_cache_file << "\n";
+        fs::remove(m_tmp_file, ec);
+      }
+    }
+  };
+
+} // end anonymous namespace
+
+std::string camera_cache_file(std::string const& cache_dir, std::string const& xml_path,
+                              std::string const& kind) {
+  if (cache_dir == "")
+    return "";
+  return (fs::path(cache_dir) / (kind + "-" + file_checksum(xml_path) + ".cam")).string();
+}
+
+bool read_dg_camera_cache(std::string const& cache_file,
+                          GeometricXML & geo, AttitudeXML & att,
+                          EphemerisXML & eph, ImageXML    & img,
+                          double & parse_seconds) {
+  std::ifstream is;
+  if (!open_cache(cache_file, "dg", is, parse_seconds))
+    return false;
+
+  // Only what is needed to build the camera model
+  get(is, geo.principal_distance);
+  get(is, geo.perspective_center);
+  get(is, geo.camera_attitude);
+  get(is, geo.detector_origin);
+  get(is, geo.detector_rotation);
+  get(is, geo.detector_pixel_pitch);
+
+  get(is, att.start_time);
+  get(is, att.time_interval);
+  get(is, att.quat_vec);
+
+  get(is, eph.start_time);
+  get(is, eph.time_interval);
+  get(is, eph.position_vec);
+  get(is, eph.velocity_vec);
+
+  get(is, img.tlc_start_time);
+  get(is, img.first_line_start_time);
+  get(is, img.tlc_vec);
+  get(is, img.scan_direction);
+  get(is, img.avg_line_rate);
+  get(is, img.image_size);
+
+  return finish_reading(is, cache_file);
+}
+
+void write_dg_camera_cache(std::string const& cache_file,
+                           GeometricXML const& geo, AttitudeXML const& att,
+                           EphemerisXML const& eph, ImageXML    const& img,
+                           double parse_seconds) {
+  CacheWriter writer(cache_file, "dg", parse_seconds);
+  std::ostream & os = writer.os;
+
+  put(os, geo.principal_distance);
+  put(os, geo.perspective_center);
+  put(os, geo.camera_attitude);
+  put(os, geo.detector_origin);
+  put(os, geo.detector_rotation);
+  put(os, geo.detector_pixel_pitch);
+
+  put(os, att.start_time);
+  put(os, att.time_interval);
+  put(os, att.quat_vec);
+
+  put(os, eph.start_time);
+  put(os, eph.time_interval);
+  put(os, eph.position_vec);
+  put(os, eph.velocity_vec);
+
+  put(os, img.tlc_start_time);
+  put(os, img.first_line_start_time);
+  put(os, img.tlc_vec);
+  put(os, img.scan_direction);
+  put(os, img.avg_line_rate);
+  put(os, img.image_size);
+
+  writer.commit();
+}
+
+bool read_spot5_camera_cache(std::string const& cache_file, SpotXML & xml,
+                             double & parse_seconds) {
+  std::ifstream is;
+  if (!open_cache(cache_file, "spot5", is, parse_seconds))
+    return false;
+
+  get(is, xml.lonlat_corners);
+  get(is, xml.pixel_corners);
+  get(is, xml.look_angles);
+  get(is, xml.pose_logs);
+  get(is, xml.position_logs);
+  get(is, xml.velocity_logs);
+  get(is, xml.image_size);
+  get(is, xml.line_period);
+  get(is, xml.center_time);
+  get(is, xml.center_line);
+  get(is, xml.center_col);
+
+  return finish_reading(is, cache_file);
+}
+
+void write_spot5_camera_cache(std::string const& cache_file, SpotXML const& xml,
+                              double parse_seconds) {
+  CacheWriter writer(cache_file, "spot5", parse_seconds);
+  std::ostream & os = writer.os;
+
+  put(os, xml.lonlat_corners);
+  put(os, xml.pixel_corners);
+  put(os, xml.look_angles);
+  put(os, xml.pose_logs);
+  put(os, xml.position_logs);
+  put(os, xml.velocity_logs);
+  put(os, xml.image_size);
+  put(os, xml.line_period);
+  put(os, xml.center_time);
+  put(os, xml.center_line);
+  put(os, xml.center_col);
+
+  writer.commit();
+}
+
+bool read_ASTER_camera_cache(std::string const& cache_file, ASTERXML & xml,
+                             boost::shared_ptr<RPCModel> & rpc_model,
+                             double & parse_seconds) {
+  std::ifstream is;
+  if (!open_cache(cache_file, "aster", is, parse_seconds))
+    return false;
+
+  get(is, xml.m_lattice_mat);
+  get(is, xml.m_sight_mat);
+  get(is, xml.m_world_sight_mat);
+  get(is, xml.m_sat_pos);
+  get(is, xml.m_image_size);
+
+  std::string name, spheroid_name, meridian_name;
+  double semi_major = 0, semi_minor = 0, meridian_offset = 0;
+  get(is, name);
+  get(is, spheroid_name);
+  get(is, meridian_name);
+  get(is, semi_major);
+  get(is, semi_minor);
+  get(is, meridian_offset);
+
+  RPCModel::CoeffVec line_num, line_den, samp_num, samp_den;
+  vw::Vector2 xy_offset, xy_scale;
+  vw::Vector3 llh_offset, llh_scale;
+  get(is, line_num); get(is, line_den);
+  get(is, samp_num); get(is, samp_den);
+  get(is, xy_offset);  get(is, xy_scale);
+  get(is, llh_offset); get(is, llh_scale);
+
+  if (!finish_reading(is, cache_file))
+    return false;
+
+  vw::cartography::Datum datum(name, spheroid_name, meridian_name,
+                               semi_major, semi_minor, meridian_offset);
+  rpc_model = boost::shared_ptr<RPCModel>
+    (new RPCModel(datum, line_num, line_den, samp_num, samp_den,
+                  xy_offset, xy_scale, llh_offset, llh_scale));
+  return true;
+}
+
+void write_ASTER_camera_cache(std::string const& cache_file, ASTERXML const& xml,
+                              RPCModel const& rpc_model, double parse_seconds) {
+  CacheWriter writer(cache_file, "aster", parse_seconds);
+  std::ostream & os = writer.os;
+
+  put(os, xml.m_lattice_mat);
+  put(os, xml.m_sight_mat);
+  put(os, xml.m_world_sight_mat);
+  put(os, xml.m_sat_pos);
+  put(os, xml.m_image_size);
+
+  vw::cartography::Datum const& datum = rpc_model.datum();
+  put(os, datum.name());
+  put(os, datum.spheroid_name());
+  put(os, datum.meridian_name());
+  put(os, datum.semi_major_axis());
+  put(os, datum.semi_minor_axis());
+  put(os, datum.meridian_offset());
+
+  put(os, rpc_model.line_num_coeff());   put(os, rpc_model.line_den_coeff());
+  put(os, rpc_model.sample_num_coeff()); put(os, rpc_model.sample_den_coeff());
+  put(os, rpc_model.xy_offset());           put(os, rpc_model.xy_scale());
+  put(os, rpc_model.lonlatheight_offset()); put(os, rpc_model.lonlatheight_scale());
+
+  writer.commit();
+}
+
+} // namespace asp
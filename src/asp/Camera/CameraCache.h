@@ -0,0 +1,80 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CameraCache.h
+///
+/// A binary cache of what is read from the XML files of DG, SPOT5 and
+/// ASTER cameras. Parsing these files with Xerces takes much longer
+/// than building the camera models from the values they contain, and
+/// parallel_stereo does it in every process it starts. A cache file is
+/// named after a checksum of the XML file, so it is never used for a
+/// file which changed. It also records how long the XML parsing took,
+/// so that the time saved can be reported.
+
+#ifndef __ASP_CAMERA_CAMERA_CACHE_H__
+#define __ASP_CAMERA_CAMERA_CACHE_H__
+
+#include <boost/shared_ptr.hpp>
+#include <string>
+
+namespace asp {
+
+  class GeometricXML;
+  class AttitudeXML;
+  class EphemerisXML;
+  class ImageXML;
+  class SpotXML;
+  class ASTERXML;
+  class RPCModel;
+
+  /// The cache file for the camera in the given XML file. The kind
+  /// (such as "dg") is part of the name. Return an empty string if
+  /// cache_dir is empty, which means no caching.
+  std::string camera_cache_file(std::string const& cache_dir, std::string const& xml_path,
+                                std::string const& kind);
+
+  // The read functions return false if the cache file does not exist
+  // or cannot be used. The write functions create the cache directory
+  // if needed, and only print a warning on failure. A cache file
+  // appears only once it is complete, so processes loading the same
+  // camera at the same time never see a partial one.
+
+  bool read_dg_camera_cache(std::string const& cache_file,
+                            GeometricXML & geo, AttitudeXML & att,
+                            EphemerisXML & eph, ImageXML    & img,
+                            double & parse_seconds);
+  void write_dg_camera_cache(std::string const& cache_file,
+                             GeometricXML const& geo, AttitudeXML const& att,
+                             EphemerisXML const& eph, ImageXML    const& img,
+                             double parse_seconds);
+
+  bool read_spot5_camera_cache(std::string const& cache_file, SpotXML & xml,
+                               double & parse_seconds);
+  void write_spot5_camera_cache(std::string const& cache_file, SpotXML const& xml,
+                                double parse_seconds);
+
+  /// ASTER cameras also need the RPC model from the same file.
+  bool read_ASTER_camera_cache(std::string const& cache_file, ASTERXML & xml,
+                               boost::shared_ptr<RPCModel> & rpc_model,
+                               double & parse_seconds);
+  void write_ASTER_camera_cache(std::string const& cache_file, ASTERXML const& xml,
+                                RPCModel const& rpc_model, double parse_seconds);
+
+} // namespace asp
+
+#endif//__ASP_CAMERA_CAMERA_CACHE_H__
@@ -0,0 +1,188 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+/// \file CameraJacobians.cc
+///
+
+#include <vw/Camera/CameraModel.h>
+#include <vw/Math/LinearAlgebra.h>
+#include <vw/Math/Quaternion.h>
+#include <asp/Camera/CameraJacobians.h>
+#include <asp/Camera/RPCModel.h>
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+  Matrix3x3 cross_matrix(Vector3 const& v) {
+    Matrix3x3 M;
+    M(0, 1) = -v[2]; M(0, 2) =  v[1];
+    M(1, 0) =  v[2]; M(1, 2) = -v[0];
+    M(2, 0) = -v[1]; M(2, 1) =  v[0];
+    return M;
+  }
+
+  // The derivative of the cartesian coordinates of a point with
+  // respect to its longitude and latitude (in degrees) and height
+  // above the datum.
+  Matrix3x3 geodetic_to_cartesian_jacobian(cartography::Datum const& datum,
+                                           Vector3 const& llh) {
+    double a   = datum.semi_major_axis(), b = datum.semi_minor_axis();
+    double e2  = 1.0 - b*b/(a*a);
+    double lon = llh[0]*M_PI/180.0, lat = llh[1]*M_PI/180.0, h = llh[2];
+    double sl = sin(lon), cl = cos(lon), sp = sin(lat), cp = cos(lat);
+    double w  = sqrt(1.0 - e2*sp*sp);
+    double N  = a/w;                    // prime vertical radius
+    double dN = a*e2*sp*cp/(w*w*w);     // its derivative in latitude
+
+    Matrix3x3 J;
+    J(0, 0) = -(N + h)*cp*sl;  J(0, 1) = (dN*cp - (N + h)*sp)*cl;  J(0, 2) = cp*cl;
+    J(1, 0) =  (N + h)*cp*cl;  J(1, 1) = (dN*cp - (N + h)*sp)*sl;  J(1, 2) = cp*sl;
+    J(2, 0) = 0;               J(2, 1) = dN*(1 - e2)*sp + (N*(1 - e2) + h)*cp;
+                                                                    J(2, 2) = sp;
+    // From radians to degrees
+    for (int row = 0; row < 3; row++) {
+      J(row, 0) *= M_PI/180.0;
+      J(row, 1) *= M_PI/180.0;
+    }
+    return J;
+  }
+
+} // end anonymous namespace
+
+  Matrix<double> implicit_pixel_jacobian(camera::CameraModel const& cam,
+                                         Vector3 const& point, Vector2 const& pix,
+                                         Matrix<double> const& center_jacobian,
+                                         Matrix<double> const& direction_jacobian) {
+
+    // At the pixel, (X - C)/|X - C| - d is zero. Its components
+    // perpendicular to the ray are differentiated.
+    Vector3 ctr = cam.camera_center(pix);
+    Vector3 dir = cam.pixel_to_vector(pix);
+    double  r   = norm_2(point - ctr);
+
+    // Two directions perpendicular to the ray
+    Vector3 u1 = cross_prod(dir, std::abs(dir[0]) < 0.9 ? Vector3(1, 0, 0) : Vector3(0, 1, 0));
+    u1 = normalize(u1);
+    Vector3 u2 = cross_prod(dir, u1);
+
+    // The derivatives with respect to the pixel
+    const double step = 0.5; // pixels
+    Matrix2x2 A;
+    for (int j = 0; j < 2; j++) {
+      Vector2 dp;
+      dp[j] = step;
+      Vector3 dC = (cam.camera_center  (pix + dp) - cam.camera_center  (pix - dp))/(2*step);
+      Vector3 dd = (cam.pixel_to_vector(pix + dp) - cam.pixel_to_vector(pix - dp))/(2*step);
+      A(0, j) = -dot_prod(u1, dC)/r - dot_prod(u1, dd);
+      A(1, j) = -dot_prod(u2, dC)/r - dot_prod(u2, dd);
+    }
+    double det = A(0, 0)*A(1, 1) - A(0, 1)*A(1, 0);
+    if (det == 0)
+      vw_throw( ArgumentErr() << "implicit_pixel_jacobian: Degenerate camera rays.\n" );
+
+    // The derivatives with respect to the parameters
+    size_t num_params = center_jacobian.cols();
+    VW_ASSERT(center_jacobian.rows() == 3 && direction_jacobian.rows() == 3 &&
+              direction_jacobian.cols() == num_params,
+              ArgumentErr() << "implicit_pixel_jacobian: Expecting 3 x n Jacobians.\n");
+    Matrix<double> B(2, num_params);
+    for (size_t j = 0; j < num_params; j++) {
+      Vector3 dC = select_col(center_jacobian,    j);
+      Vector3 dd = select_col(direction_jacobian, j);
+      B(0, j) = -dot_prod(u1, dC)/r - dot_prod(u1, dd);
+      B(1, j) = -dot_prod(u2, dC)/r - dot_prod(u2, dd);
+    }
+
+    return -inverse(A)*B;
+  }
+
+  Vector2 point_to_pixel_jacobian(camera::CameraModel const& cam,
+                                  Vector3 const& point,
+                                  Matrix<double, 2, 3> & J) {
+
+    RPCModel const* rpc = dynamic_cast<RPCModel const*>(&cam);
+    if (rpc != NULL) {
+      Vector3 llh = rpc->datum().cartesian_to_geodetic(point);
+      J = rpc->geodetic_to_pixel_Jacobian(llh)
+        * inverse(geodetic_to_cartesian_jacobian(rpc->datum(), llh));
+      return rpc->geodetic_to_pixel(llh);
+    }
+
+    // Moving the point is the same as moving the camera center the
+    // other way.
+    Vector2 pix = cam.point_to_pixel(point);
+    Matrix<double> dC(3, 3), dd(3, 3);
+    for (int row = 0; row < 3; row++) {
+      for (int col = 0; col < 3; col++) {
+        dC(row, col) = (row == col) ? -1.0 : 0.0;
+        dd(row, col) = 0.0;
+      }
+    }
+    J = implicit_pixel_jacobian(cam, point, pix, dC, dd);
+    return pix;
+  }
+
+  Matrix3x3 inverse_rotation_jacobian(Vector3 const& axis_angle, Vector3 const& v) {
+
+    // With w the axis-angle vector, theta its norm, and [w] its cross
+    // product matrix, this is R^T [v] (I + a [w] + b [w]^2), where
+    // a = (1 - cos theta)/theta^2 and b = (theta - sin theta)/theta^3.
+    double theta = norm_2(axis_angle), a, b;
+    if (theta < 1e-4) {
+      double t2 = theta*theta;
+      a = 0.5 - t2/24.0;
+      b = 1.0/6.0 - t2/120.0;
+    } else {
+      a = (1.0 - cos(theta))/(theta*theta);
+      b = (theta - sin(theta))/(theta*theta*theta);
+    }
+    Matrix3x3 W = cross_matrix(axis_angle);
+    Matrix3x3 Jr = math::identity_matrix<3>() + a*W + b*W*W;
+    Matrix3x3 R  = axis_angle_to_quaternion(axis_angle).rotation_matrix();
+    return transpose(R)*cross_matrix(v)*Jr;
+  }
+
+  Vector2 adjusted_point_to_pixel_jacobian(camera::CameraModel const& cam,
+                                           Vector3 const& rotation_center,
+                                           Vector<double, 6> const& adjustment,
+                                           Vector3 const& point,
+                                           Matrix<double, 2, 6> & J_adjustment,
+                                           Matrix<double, 2, 3> & J_point) {
+
+    // The adjusted camera sees X where the original one sees
+    // R^T (X - c - t) + c.
+    Vector3 translation = subvector(adjustment, 0, 3);
+    Vector3 axis_angle  = subvector(adjustment, 3, 3);
+    Matrix3x3 Rt = transpose(axis_angle_to_quaternion(axis_angle).rotation_matrix());
+    Vector3 v = point - rotation_center - translation;
+    Vector3 cam_point = Rt*v + rotation_center;
+
+    Matrix<double, 2, 3> J;
+    Vector2 pix = point_to_pixel_jacobian(cam, cam_point, J);
+
+    J_point = J*Rt;
+    submatrix(J_adjustment, 0, 0, 2, 3) = -J_point;
+    submatrix(J_adjustment, 0, 3, 2, 3) = J*inverse_rotation_jacobian(axis_angle, v);
+    return pix;
+  }
+
+} // namespace asp
@@ -0,0 +1,82 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+/// \file CameraJacobians.h
+///
+/// Derivatives of the pixel a point projects to in a camera, with
+/// respect to the point, and, for a camera adjusted the way
+/// vw::camera::AdjustedCameraModel does it, with respect to the
+/// translation and axis-angle rotation of the adjustment. These let
+/// bundle adjustment avoid differentiating point_to_pixel numerically,
+/// which for linescan cameras means many iterative solves per
+/// observation.
+
+#ifndef __ASP_CAMERA_CAMERA_JACOBIANS_H__
+#define __ASP_CAMERA_CAMERA_JACOBIANS_H__
+
+#include <vw/Math/Matrix.h>
+#include <vw/Math/Vector.h>
+
+namespace vw { namespace camera {
+  class CameraModel;
+}}
+
+namespace asp {
+
+  /// Project a point into a camera, and find the derivative of the
+  /// pixel with respect to the point. For RPC cameras this is done in
+  /// closed form. For other cameras it is found from the camera
+  /// centers and rays at the pixels next to the projection, which
+  /// needs only one point_to_pixel call. Throws if the point does not
+  /// project into the camera.
+  vw::Vector2 point_to_pixel_jacobian(vw::camera::CameraModel const& cam,
+                                      vw::Vector3 const& point,
+                                      vw::Matrix<double, 2, 3> & J);
+
+  /// The pixel at which a point projects into a camera is where the
+  /// ray from the camera center passes through the point. Given the
+  /// derivatives of the camera center and of the ray direction, at
+  /// that fixed pixel, with respect to some camera parameters (one
+  /// column per parameter), find the derivatives of the pixel with
+  /// respect to them. This needs no more point_to_pixel calls.
+  vw::Matrix<double> implicit_pixel_jacobian(vw::camera::CameraModel const& cam,
+                                             vw::Vector3 const& point, vw::Vector2 const& pix,
+                                             vw::Matrix<double> const& center_jacobian,
+                                             vw::Matrix<double> const& direction_jacobian);
+
+  /// The derivative of R^T v with respect to the axis-angle vector of
+  /// the rotation R.
+  vw::Matrix3x3 inverse_rotation_jacobian(vw::Vector3 const& axis_angle,
+                                          vw::Vector3 const& v);
+
+  /// Project a point into a camera adjusted by a translation and an
+  /// axis-angle rotation about the given center, which is the
+  /// parameterization used by bundle_adjust (the first three entries
+  /// of the adjustment are the translation). Also find the derivatives
+  /// of the pixel with respect to the adjustment and to the point.
+  vw::Vector2 adjusted_point_to_pixel_jacobian(vw::camera::CameraModel const& cam,
+                                               vw::Vector3 const& rotation_center,
+                                               vw::Vector<double, 6> const& adjustment,
+                                               vw::Vector3 const& point,
+                                               vw::Matrix<double, 2, 6> & J_adjustment,
+                                               vw::Matrix<double, 2, 3> & J_point);
+
+} // namespace asp
+
+#endif//__ASP_CAMERA_CAMERA_JACOBIANS_H__
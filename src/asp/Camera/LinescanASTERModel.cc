@@ -250,7 +250,14 @@ vw::Vector3 ASTERCameraModel::pixel_to_vector(vw::Vector2 const& pixel) const{
   // Parse the ASTER XML file
   ASTERXML xml_reader;
   xml_reader.read_xml(path);
-  
+
+  return load_ASTER_camera_model(xml_reader, rpc_model);
+} // End function load_ASTER_camera_model_from_xml()
+
+boost::shared_ptr<ASTERCameraModel>
+load_ASTER_camera_model(ASTERXML const& xml_reader,
+                        boost::shared_ptr<vw::camera::CameraModel> rpc_model){
+
   // Feed everything into a new camera model.
   return boost::shared_ptr<ASTERCameraModel>(new ASTERCameraModel(xml_reader.m_lattice_mat,
 								  xml_reader.m_sight_mat,
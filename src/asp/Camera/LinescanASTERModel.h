@@ -97,6 +97,13 @@ namespace asp {
   load_ASTER_camera_model_from_xml(std::string const& path,
 				   boost::shared_ptr<vw::camera::CameraModel> rpc_model);
 
+  class ASTERXML;
+
+  /// Build an ASTER camera model from the values read from its XML file.
+  boost::shared_ptr<ASTERCameraModel>
+  load_ASTER_camera_model(ASTERXML const& xml_reader,
+                          boost::shared_ptr<vw::camera::CameraModel> rpc_model);
+
 }      // namespace asp
 
 
@@ -28,6 +28,8 @@
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/Extrinsics.h>
 
+#include <vector>
+
 namespace asp {
 
 
@@ -62,7 +64,9 @@ namespace asp {
 		        m_position_func(position), m_velocity_func(velocity),
             m_pose_func(pose),         m_time_func(time),
             m_detector_origin(detector_origin),
-            m_focal_length(focal_length) {} 
+            m_focal_length(focal_length) {
+      build_line_seed_table();
+    }
     virtual ~LinescanDGModel() {}
     virtual std::string type() const { return "LinescanDG"; }
 
@@ -79,6 +83,20 @@ namespace asp {
     
     // Override this implementation with a faster, more specialized implemenation.
     virtual vw::Vector2 point_to_pixel(vw::Vector3 const& point, double starty) const;
+
+    /// The projection used by point_to_pixel(). The line is seeded from
+    /// a table of detector planes and refined with a Newton step
+    /// followed by secant steps. The velocity aberration is then
+    /// accounted for by a few fixed-point updates, each redoing the
+    /// line search with the current aberration offset. Returns false
+    /// if it did not converge. num_iterations is the total number of
+    /// line search iterations.
+    bool point_to_pixel_fast(vw::Vector3 const& point, double starty,
+                             vw::Vector2 & pixel, int & num_iterations) const;
+
+    /// The generic solver, which finds the pixel with Levenberg-Marquardt.
+    /// Much slower, used as a fallback and to check the fast solver.
+    vw::Vector2 point_to_pixel_lma(vw::Vector3 const& point, double starty) const;
     
     // -- These are new functions --
     
@@ -114,6 +132,19 @@ namespace asp {
     /// Low accuracy function used by point_to_pixel to get a good solver starting seed.
     vw::Vector2 point_to_pixel_uncorrected(vw::Vector3 const& point, double starty) const;
 
+    /// Sample the plane through the camera center and the detector line
+    /// at a few hundred lines, to seed the line search.
+    void build_line_seed_table();
+
+    /// A starting line for the given point, from the table above.
+    double seed_line(vw::Vector3 const& point, double starty) const;
+
+    /// The distance in pixels on the focal plane from the detector line
+    /// to the projection of the direction to the point, less the
+    /// aberration offset, when the camera is at the given line.
+    double line_residual(vw::Vector3 const& point, vw::Vector3 const& aberration,
+                         double line) const;
+
   protected: // Variables
   
     // Extrinsics
@@ -130,6 +161,12 @@ namespace asp {
     vw::Vector2  m_detector_origin; 
     double       m_focal_length;    ///< The focal length, also stored in pixels.
 
+    // Camera centers and detector plane normals, in world coordinates,
+    // every m_seed_step lines. Used only for the initial guess, so it
+    // does no harm if the position and pose are adjusted later.
+    double                   m_seed_step;
+    std::vector<vw::Vector3> m_seed_centers, m_seed_normals;
+
 
     // Levenberg Marquardt solver for linescan number
     //
@@ -165,6 +202,17 @@ namespace asp {
   ///   make sure this is done before/after this function is called!
   inline boost::shared_ptr<DGCameraModel> load_dg_camera_model_from_xml(std::string const& path);
 
+  class GeometricXML;
+  class AttitudeXML;
+  class EphemerisXML;
+  class ImageXML;
+
+  /// Build a DG camera model from the values read from its XML file.
+  inline boost::shared_ptr<DGCameraModel> load_dg_camera_model(GeometricXML geo,
+                                                               AttitudeXML  att,
+                                                               EphemerisXML eph,
+                                                               ImageXML     img);
+
 }      // namespace asp
 
 #include <asp/Camera/LinescanDGModel.tcc>
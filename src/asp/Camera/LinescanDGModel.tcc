@@ -51,6 +51,17 @@ vw::Vector3 LinescanDGModel<PositionFuncT, PoseFuncT>::get_local_pixel_vector(vw
 template <class PositionFuncT, class PoseFuncT>
 vw::Vector2 LinescanDGModel<PositionFuncT, PoseFuncT>::point_to_pixel(vw::Vector3 const& point, double starty) const {
 
+  vw::Vector2 pixel;
+  int num_iterations = 0;
+  if (point_to_pixel_fast(point, starty, pixel, num_iterations))
+    return pixel;
+
+  return point_to_pixel_lma(point, starty);
+}
+
+template <class PositionFuncT, class PoseFuncT>
+vw::Vector2 LinescanDGModel<PositionFuncT, PoseFuncT>::point_to_pixel_lma(vw::Vector3 const& point, double starty) const {
+
   // Use the uncorrected function to get a fast but good starting seed.
   vw::camera::CameraGenericLMA model( this, point );
   int status;
@@ -69,6 +80,159 @@ vw::Vector2 LinescanDGModel<PositionFuncT, PoseFuncT>::point_to_pixel(vw::Vector
   return solution;
 }
 
+template <class PositionFuncT, class PoseFuncT>
+bool LinescanDGModel<PositionFuncT, PoseFuncT>::point_to_pixel_fast(vw::Vector3 const& point, double starty,
+                                                                    vw::Vector2 & pixel,
+                                                                    int & num_iterations) const {
+  num_iterations = 0;
+  const int    MAX_LINE_ITER       = 20;
+  const int    MAX_ABERRATION_ITER = 6;
+  const double LINE_TOL            = 1e-9; // lines
+  const double PIXEL_TOL           = 1e-8; // pixels
+
+  try {
+    double line = seed_line(point, starty);
+
+    // The difference between the corrected and uncorrected look
+    // directions. It changes very slowly across the image, so
+    // holding it fixed during the line search and updating it
+    // afterwards converges in two or three passes.
+    vw::Vector3 aberration(0, 0, 0);
+    bool found = false;
+    for (int pass = 0; pass < MAX_ABERRATION_ITER; pass++) {
+
+      // A Newton step using the motion of the camera center, then secant
+      // steps, which also account for the (small) change in attitude.
+      double y0 = line, h0 = line_residual(point, aberration, y0);
+      double t  = m_time_func(y0);
+      double dt = m_time_func(y0 + 1.0) - t; // The TLC is linear between entries
+      vw::Quat    pose = m_pose_func(t);
+      vw::Vector3 w    = point - m_position_func(t);
+      vw::Vector3 dw   = -dt * m_velocity_func(t);
+      vw::Vector3 u    = normalize(w);
+      vw::Vector3 pt   = inverse(pose).rotate(u - aberration);
+      vw::Vector3 dpt  = inverse(pose).rotate((dw - dot_prod(u, dw)*u)/norm_2(w));
+      double dh = m_focal_length*(dpt.y()*pt.z() - pt.y()*dpt.z())/(pt.z()*pt.z());
+      if (dh == 0 || pt.z() <= 0)
+        return false;
+
+      double y1 = y0 - h0/dh;
+      num_iterations++;
+      bool converged = (std::abs(y1 - y0) < LINE_TOL);
+      for (int iter = 0; iter < MAX_LINE_ITER && !converged; iter++) {
+        double h1 = line_residual(point, aberration, y1);
+        num_iterations++;
+        if (h1 == h0)
+          break;
+        double y2 = y1 - h1*(y1 - y0)/(h1 - h0);
+        y0 = y1; h0 = h1;
+        y1 = y2;
+        converged = (std::abs(y1 - y0) < LINE_TOL);
+      }
+      if (!converged || y1 != y1)
+        return false;
+      line = y1;
+
+      // The sample follows from the direction at that line
+      t    = m_time_func(line);
+      pt   = inverse(m_pose_func(t)).rotate(normalize(point - m_position_func(t)) - aberration);
+      if (pt.z() <= 0)
+        return false;
+      vw::Vector2 new_pixel(m_focal_length*pt.x()/pt.z() - m_detector_origin[0], line);
+
+      found = (pass > 0 && norm_2(new_pixel - pixel) < PIXEL_TOL);
+      pixel = new_pixel;
+      if (found)
+        break;
+
+      // Update the aberration at the current pixel
+      aberration = this->pixel_to_vector(pixel)
+                 - m_pose_func(t).rotate(get_local_pixel_vector(pixel));
+    }
+    return found;
+  } catch (...) {
+    // Let the generic solver deal with it
+  }
+  return false;
+}
+
+template <class PositionFuncT, class PoseFuncT>
+void LinescanDGModel<PositionFuncT, PoseFuncT>::build_line_seed_table() {
+
+  m_seed_step = 1.0;
+  m_seed_centers.clear();
+  m_seed_normals.clear();
+  int rows = m_image_size.y();
+  if (rows < 2)
+    return;
+
+  // The normal to the plane containing the detector line and the
+  // camera center, in the camera frame.
+  vw::Vector3 local_normal = normalize(vw::Vector3(0, m_focal_length, -m_detector_origin[1]));
+
+  const int MAX_NUM = 513;
+  int num = std::min(rows, MAX_NUM);
+  m_seed_step = (rows - 1.0)/(num - 1.0);
+  try {
+    for (int i = 0; i < num; i++) {
+      double t = m_time_func(i*m_seed_step);
+      m_seed_centers.push_back(m_position_func(t));
+      m_seed_normals.push_back(m_pose_func(t).rotate(local_normal));
+    }
+  } catch (...) {
+    // Without the table the line search starts from a fixed line
+    m_seed_centers.clear();
+    m_seed_normals.clear();
+  }
+}
+
+template <class PositionFuncT, class PoseFuncT>
+double LinescanDGModel<PositionFuncT, PoseFuncT>::seed_line(vw::Vector3 const& point, double starty) const {
+
+  int num = m_seed_centers.size();
+  if (num < 2) {
+    if (starty >= 0)
+      return starty;
+    return m_image_size.y()/2;
+  }
+
+  // The signed distance from the point to the plane of the detector
+  // changes sign once as the camera sweeps past the point, so do a
+  // binary search for that, then interpolate linearly. Points beyond
+  // the first or last line get extrapolated.
+  double g_beg = dot_prod(m_seed_normals[0],       point - m_seed_centers[0]);
+  double g_end = dot_prod(m_seed_normals[num - 1], point - m_seed_centers[num - 1]);
+  int beg = 0, end = num - 1;
+  if ((g_beg > 0) == (g_end > 0)) {
+    if (std::abs(g_beg) < std::abs(g_end))
+      end = 1;
+    else
+      beg = num - 2;
+  }
+  while (end - beg > 1) {
+    int mid = (beg + end)/2;
+    double g = dot_prod(m_seed_normals[mid], point - m_seed_centers[mid]);
+    if ((g > 0) == (g_beg > 0))
+      beg = mid;
+    else
+      end = mid;
+  }
+  double g0 = dot_prod(m_seed_normals[beg], point - m_seed_centers[beg]);
+  double g1 = dot_prod(m_seed_normals[end], point - m_seed_centers[end]);
+  if (g0 == g1)
+    return beg*m_seed_step;
+  return (beg + g0/(g0 - g1)*(end - beg))*m_seed_step;
+}
+
+template <class PositionFuncT, class PoseFuncT>
+double LinescanDGModel<PositionFuncT, PoseFuncT>::line_residual(vw::Vector3 const& point,
+                                                                vw::Vector3 const& aberration,
+                                                                double line) const {
+  double      t  = m_time_func(line);
+  vw::Vector3 pt = inverse(m_pose_func(t)).rotate(normalize(point - m_position_func(t)) - aberration);
+  return m_focal_length*pt.y()/pt.z() - m_detector_origin[1];
+}
+
 // Computing the uncorrected pixel location is much faster.
 template <class PositionFuncT, class PoseFuncT>
 vw::Vector2 LinescanDGModel<PositionFuncT, PoseFuncT>::point_to_pixel_uncorrected(vw::Vector3 const& point, double starty) const {
@@ -165,6 +329,14 @@ boost::shared_ptr<DGCameraModel> load_dg_camera_model_from_xml(std::string const
   RPCXML       rpc;
   read_xml( path, geo, att, eph, img, rpc );
 
+  return load_dg_camera_model(geo, att, eph, img);
+} // End function load_dg_camera_model_from_xml()
+
+boost::shared_ptr<DGCameraModel> load_dg_camera_model(GeometricXML geo,
+                                                      AttitudeXML  att,
+                                                      EphemerisXML eph,
+                                                      ImageXML     img)
+{
   // Convert measurements in millimeters to pixels.
   geo.principal_distance /= geo.detector_pixel_pitch;
   geo.detector_origin    /= geo.detector_pixel_pitch;
@@ -210,6 +210,11 @@ boost::shared_ptr<SPOTCameraModel> load_spot5_camera_model_from_xml(std::string
   SpotXML xml_reader;
   xml_reader.read_xml(path);
 
+  return load_spot5_camera_model(xml_reader);
+} // End function load_spot5_camera_model_from_xml()
+
+boost::shared_ptr<SPOTCameraModel> load_spot5_camera_model(SpotXML const& xml_reader)
+{
   // Get all the initial functors
   vw::camera::LagrangianInterpolation position_func  = xml_reader.setup_position_func();
   vw::camera::LagrangianInterpolation velocity_func  = xml_reader.setup_velocity_func();
@@ -184,6 +184,11 @@ namespace asp {
   ///   make sure this is done before/after this function is called!
   boost::shared_ptr<SPOTCameraModel> load_spot5_camera_model_from_xml(std::string const& path);
 
+  class SpotXML;
+
+  /// Build a SPOT5 camera model from the values read from its XML file.
+  boost::shared_ptr<SPOTCameraModel> load_spot5_camera_model(SpotXML const& xml_reader);
+
 }      // namespace asp
 
 
@@ -0,0 +1,350 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file PiecewiseReprojectionError.h
+///
+/// The ceres cost function of jitter_adjust, projecting a point into
+/// a linescan camera with piecewise adjustments, with its analytic
+/// derivatives. It is in a header so that it can be tested on its
+/// own. Including it needs ceres.
+
+#ifndef __ASP_CAMERA_PIECEWISE_REPROJECTION_ERROR_H__
+#define __ASP_CAMERA_PIECEWISE_REPROJECTION_ERROR_H__
+
+#include <vw/Core/Log.h>
+#include <vw/Core/Thread.h>
+#include <vw/Math/Quaternion.h>
+#include <asp/Camera/AdjustedLinescanDGModel.h>
+#include <asp/Camera/CameraJacobians.h>
+#include <asp/Core/StereoSettings.h>
+
+// Turn off warnings from eigen
+#if defined(__GNUC__) || defined(__GNUG__)
+#define LOCAL_GCC_VERSION (__GNUC__ * 10000                    \
+			   + __GNUC_MINOR__ * 100              \
+			   + __GNUC_PATCHLEVEL__)
+#if LOCAL_GCC_VERSION >= 40600
+#pragma GCC diagnostic push
+#endif
+#if LOCAL_GCC_VERSION >= 40202
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+#endif
+#endif
+
+#include <ceres/ceres.h>
+#include <ceres/loss_function.h>
+
+#if defined(__GNUC__) || defined(__GNUG__)
+#if LOCAL_GCC_VERSION >= 40600
+#pragma GCC diagnostic pop
+#endif
+#undef LOCAL_GCC_VERSION
+#endif
+
+
+namespace asp{
+
+// Print the first errors when computing residuals. Ceres calls the
+// cost functions from several threads.
+inline void report_piecewise_error(std::string const& msg) {
+  static int num_errors = 0;
+  static vw::Mutex mutex;
+  vw::Mutex::Lock lock(mutex);
+  num_errors++;
+  if (num_errors < 100) {
+    vw::vw_out(vw::ErrorMessage) << msg << std::endl;
+  }else if (num_errors == 100) {
+    vw::vw_out() << "Will print no more error messages about "
+                 << "failing to compute residuals.\n";
+  }
+}
+
+const int NUM_CAMERA_PARAMS = 6;
+const int NUM_POINT_PARAMS = 3;
+
+typedef vw::Vector<double, NUM_CAMERA_PARAMS> camera_vector_t;
+
+// In spite of trying a lot, I could not find a way to make a base class
+// from which both AdjustedLinescanDGModel and PiecewiseAdjustedLinescanModel
+// could inherit. Hence this wrapper.
+class AdjustedModelWrapper {
+public:
+  AdjustedModelWrapper(std::string               const& session,
+                       boost::shared_ptr<vw::camera::CameraModel> cam,
+                       int interp_type,
+                       vw::Vector2               const& adjustment_bounds,
+                       std::vector<vw::Vector3>  const& position_adjustments,
+                       std::vector<vw::Quat>     const& pose_adjustments,
+                       vw::Vector2i              const& image_size):
+    m_session(session)
+  {
+    if (m_session == "dg" || m_session == "dgmaprpc") {
+      m_cam = boost::shared_ptr<vw::camera::CameraModel>
+        (new asp::AdjustedLinescanDGModel(cam, interp_type, adjustment_bounds,
+                                          position_adjustments, pose_adjustments,
+                                          image_size));
+    } else {
+      m_cam = boost::shared_ptr<vw::camera::CameraModel>
+        (new asp::PiecewiseAdjustedLinescanModel(cam, interp_type, adjustment_bounds,
+                                                 position_adjustments, pose_adjustments,
+                                                 image_size));
+    }
+    
+  }
+
+  vw::Vector2 point_to_pixel(vw::Vector3 const& point, double starty) const {
+    if (m_session == "dg" || m_session == "dgmaprpc") 
+      return
+        dynamic_cast<asp::AdjustedLinescanDGModel*>
+	(m_cam.get())->point_to_pixel(point, starty);
+    
+    return
+      dynamic_cast<asp::PiecewiseAdjustedLinescanModel*>
+      (m_cam.get())->point_to_pixel(point, starty);
+  }
+  
+  std::vector<int> get_closest_adj_indices(double t){
+    if (m_session == "dg" || m_session == "dgmaprpc") 
+      return
+        dynamic_cast<asp::AdjustedLinescanDGModel*>(m_cam.get())->get_closest_adj_indices(t);
+    
+    return
+      dynamic_cast<asp::PiecewiseAdjustedLinescanModel*>(m_cam.get())->get_closest_adj_indices(t);
+  }
+
+  std::vector<double> get_adj_weights(double line_pos, std::vector<int> const& indices) const {
+    if (m_session == "dg" || m_session == "dgmaprpc") 
+      return
+        dynamic_cast<asp::AdjustedLinescanDGModel*>(m_cam.get())->get_adj_weights(line_pos, indices);
+    
+    return
+      dynamic_cast<asp::PiecewiseAdjustedLinescanModel*>(m_cam.get())->get_adj_weights(line_pos, indices);
+  }
+
+  vw::camera::CameraModel const& camera() const { return *m_cam; }
+  
+private:
+  std::string m_session;
+  boost::shared_ptr<vw::camera::CameraModel> m_cam;
+
+  
+};
+  
+  
+inline void populate_adjustements(std::vector<double> const& cameras_vec,
+			   int start_index, int end_index,
+			   std::vector<vw::Vector3> & position_adjustments,
+			   std::vector<vw::Quat>    & pose_adjustments){
+
+  // Extract the adjustments for just the current camera, and copy
+  // them in arrays of vectors and quaternions.
+
+  int num_adjustments = cameras_vec.size()/NUM_CAMERA_PARAMS;
+  VW_ASSERT(0 <= start_index && start_index < end_index && end_index <= num_adjustments,
+	    vw::ArgumentErr() << "Book-keeping failure in camera indicies.");
+
+  position_adjustments.clear();
+  pose_adjustments.clear();
+
+  for (int cam_index = start_index; cam_index < end_index; cam_index++) {
+    vw::Vector3 position, pose;
+    for (int b = 0; b < NUM_CAMERA_PARAMS/2; b++) {
+      position[b] = cameras_vec[NUM_CAMERA_PARAMS * cam_index + b + 0];
+      pose[b]     = cameras_vec[NUM_CAMERA_PARAMS * cam_index + b + NUM_CAMERA_PARAMS/2];
+    }
+
+    position_adjustments.push_back(position);
+    pose_adjustments.push_back(vw::axis_angle_to_quaternion(pose));
+  }
+}
+
+// A ceres cost function. We pass in the observation, the model, and
+// the current camera and point indices. The result is the residual,
+// the difference in the observation and the projection of the point
+// into the camera, normalized by pixel_sigma. The parameters are the
+// adjustments closest to the observation, followed by the point.
+//
+// The derivatives are not found numerically, which would take a
+// point_to_pixel() solve per parameter and per direction. The
+// projection is where the ray from the adjusted camera center passes
+// through the point. A position adjustment moves the center by its
+// interpolation weight times itself, and to first order a pose
+// adjustment rotates the ray the same way, so the derivatives follow
+// by implicit differentiation with no more solves.
+class PiecewiseReprojectionError: public ceres::CostFunction {
+public:
+  PiecewiseReprojectionError(vw::Vector2 const& observation, vw::Vector2 const& pixel_sigma,
+			     vw::Vector2 const& adjustment_bounds,
+			     std::vector<double> const& cameras_vec,
+			     boost::shared_ptr<vw::camera::CameraModel> cam,
+			     vw::Vector2i const& image_size,
+			     std::string const& session,
+			     int start_index,
+			     std::vector<int> const& camera_indices,
+			     int end_index,
+			     size_t ipt):
+    m_observation(observation),
+    m_pixel_sigma(pixel_sigma),
+    m_adjustment_bounds(adjustment_bounds),
+    m_cameras_vec(cameras_vec),
+    m_cam(cam),
+    m_image_size(image_size),
+    m_session(session),
+    m_start_index(start_index),
+    m_camera_indices(camera_indices),
+    m_end_index(end_index),
+    m_ipt(ipt){
+
+    VW_ASSERT(!m_camera_indices.empty(),
+              vw::ArgumentErr() << "Expecting at least one camera index.\n");
+    for (size_t i = 0; i < m_camera_indices.size(); i++) {
+      VW_ASSERT(m_start_index <= m_camera_indices[i] && m_camera_indices[i] < m_end_index,
+                vw::ArgumentErr() << "Book-keeping failure in camera indices.\n");
+      mutable_parameter_block_sizes()->push_back(NUM_CAMERA_PARAMS);
+    }
+    mutable_parameter_block_sizes()->push_back(NUM_POINT_PARAMS);
+    set_num_residuals(2);
+  }
+
+  virtual bool Evaluate(double const* const* parameters, double* residuals,
+                        double** jacobians) const {
+
+    int num_adj = m_camera_indices.size();
+    try{
+
+      VW_ASSERT(0 <= m_start_index && m_start_index < m_end_index &&
+                m_end_index*NUM_CAMERA_PARAMS <= (int)m_cameras_vec.size(),
+                vw::ArgumentErr() << "Book-keeping failure in camera indicies");
+
+      // Copy the adjustments of the current camera to local storage,
+      // with the latest values of those being floated.
+      std::vector<double> local_cameras_vec(m_cameras_vec.begin() + NUM_CAMERA_PARAMS*m_start_index,
+                                            m_cameras_vec.begin() + NUM_CAMERA_PARAMS*m_end_index);
+      std::vector<int> local_indices(num_adj);
+      for (int i = 0; i < num_adj; i++) {
+        local_indices[i] = m_camera_indices[i] - m_start_index;
+	for (int p = 0; p < NUM_CAMERA_PARAMS; p++)
+	  local_cameras_vec[NUM_CAMERA_PARAMS*local_indices[i] + p] = parameters[i][p];
+      }
+
+      std::vector<vw::Vector3> position_adjustments;
+      std::vector<vw::Quat>   pose_adjustments;
+      populate_adjustements(local_cameras_vec,
+			    0, m_end_index - m_start_index,
+			    position_adjustments, pose_adjustments);
+
+      // The adjusted camera has just the adjustments, it does not create a full
+      // copy of the camera.
+      int interp_type = stereo_settings().piecewise_adjustment_interp_type;
+
+      asp::AdjustedModelWrapper cam_wrapper(m_session, m_cam,
+                                            interp_type,
+                                            m_adjustment_bounds,
+                                            position_adjustments, pose_adjustments,
+                                            m_image_size);
+      
+      vw::Vector3 point_vec;
+      for (size_t p = 0; p < point_vec.size(); p++)
+	point_vec[p]  = parameters[num_adj][p];
+
+      // Project the current point into the current camera.  Note that
+      // we pass the observation as an initial guess, as the
+      // prediction is hopefully not too far from it.
+      vw::Vector2 prediction = cam_wrapper.point_to_pixel(point_vec, m_observation.y());
+
+      // The error is the difference between the predicted and observed position,
+      // normalized by sigma.
+      residuals[0] = (prediction[0] - m_observation[0])/m_pixel_sigma[0];
+      residuals[1] = (prediction[1] - m_observation[1])/m_pixel_sigma[1];
+
+      if (jacobians == NULL)
+        return true;
+
+      // How the camera center and ray at the predicted pixel change
+      // with the adjustments and the point
+      std::vector<double> weights = cam_wrapper.get_adj_weights(prediction.y(), local_indices);
+      vw::Vector3 dir = cam_wrapper.camera().pixel_to_vector(prediction);
+      int num_params = NUM_CAMERA_PARAMS*num_adj + NUM_POINT_PARAMS;
+      vw::Matrix<double> center_jac(3, num_params), dir_jac(3, num_params);
+      for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < num_params; col++) {
+          center_jac(row, col) = 0.0;
+          dir_jac   (row, col) = 0.0;
+        }
+      }
+      for (int i = 0; i < num_adj; i++) {
+        int col = NUM_CAMERA_PARAMS*i;
+        for (int b = 0; b < 3; b++)
+          center_jac(b, col + b) = weights[i];
+
+        // Rotating the ray by the small angle w: dir + w x dir
+        dir_jac(0, col + 4) =  weights[i]*dir[2]; dir_jac(0, col + 5) = -weights[i]*dir[1];
+        dir_jac(1, col + 3) = -weights[i]*dir[2]; dir_jac(1, col + 5) =  weights[i]*dir[0];
+        dir_jac(2, col + 3) =  weights[i]*dir[1]; dir_jac(2, col + 4) = -weights[i]*dir[0];
+      }
+      // Moving the point is the same as moving the camera center the other way
+      for (int b = 0; b < 3; b++)
+        center_jac(b, NUM_CAMERA_PARAMS*num_adj + b) = -1.0;
+
+      vw::Matrix<double> J = asp::implicit_pixel_jacobian(cam_wrapper.camera(), point_vec,
+                                                      prediction, center_jac, dir_jac);
+
+      for (int i = 0; i <= num_adj; i++) {
+        if (jacobians[i] == NULL) continue;
+        int len = (i < num_adj) ? NUM_CAMERA_PARAMS : NUM_POINT_PARAMS;
+        for (int r = 0; r < 2; r++)
+          for (int c = 0; c < len; c++)
+            jacobians[i][r*len + c] = J(r, NUM_CAMERA_PARAMS*i + c)/m_pixel_sigma[r];
+      }
+
+    } catch (std::exception const& e) {
+
+      // Failed to compute residuals
+
+      report_piecewise_error(e.what());
+
+      residuals[0] = 1e+20;
+      residuals[1] = 1e+20;
+      return false;
+    }
+
+    return true;
+  }
+
+private:
+  vw::Vector2 m_observation;
+  vw::Vector2 m_pixel_sigma;
+  vw::Vector2 m_adjustment_bounds;
+  std::vector<double> const& m_cameras_vec;  // alias
+  boost::shared_ptr<vw::camera::CameraModel> m_cam;
+  vw::Vector2i m_image_size; // TODO: Group this with the above
+  std::string m_session;
+								   
+  // all adjustments for the current camera will be >= this
+  int m_start_index;
+
+  // indices of the current adjustments
+  std::vector<int> m_camera_indices;
+
+  int m_end_index;    // all adjustment indices for current camera will be < this
+  int m_ipt;          // index of the current 3D point in the vector of points
+};
+
+} // namespace asp
+
+#endif//__ASP_CAMERA_PIECEWISE_REPROJECTION_ERROR_H__
@@ -442,6 +442,154 @@ namespace asp {
     P = P_up - dir*LONG_SCALE_UP;
   }
 
+  namespace {
+
+    // The RPC polynomial with the given coefficients, with the terms
+    // in the order of calculate_terms().
+    inline double rpc_poly(const double* c, double x, double y, double z) {
+      return c[0] + c[1]*x + c[2]*y + c[3]*z
+        + x*(c[4]*y + c[5]*z + c[7]*x) + y*(c[6]*z + c[8]*y) + c[9]*z*z
+        + x*(c[10]*y*z + c[11]*x*x + c[12]*y*y + c[13]*z*z + c[14]*x*y + c[17]*x*z)
+        + y*(c[15]*y*y + c[16]*z*z + c[18]*y*z) + c[19]*z*z*z;
+    }
+
+    // The polynomial and its partial derivatives in x and y
+    inline void rpc_poly_and_grad(const double* c, double x, double y, double z,
+                                  double & p, double & px, double & py) {
+      p  = rpc_poly(c, x, y, z);
+      px = c[1] + c[4]*y + c[5]*z + 2.0*c[7]*x + c[10]*y*z + 3.0*c[11]*x*x
+        + c[12]*y*y + c[13]*z*z + 2.0*c[14]*x*y + 2.0*c[17]*x*z;
+      py = c[2] + c[4]*x + c[6]*z + 2.0*c[8]*y + c[10]*x*z + 2.0*c[12]*x*y
+        + c[14]*x*x + 3.0*c[15]*y*y + c[16]*z*z + 2.0*c[18]*y*z;
+    }
+  }
+
+  void RPCModel::geodetic_to_pixel(size_t num, const double* lon, const double* lat,
+                                   const double* height, double* col, double* row) const {
+
+    const double *ln = &m_line_num_coeff[0],   *ld = &m_line_den_coeff[0];
+    const double *sn = &m_sample_num_coeff[0], *sd = &m_sample_den_coeff[0];
+    const double ox = m_lonlatheight_offset[0], sx = 1.0/m_lonlatheight_scale[0];
+    const double oy = m_lonlatheight_offset[1], sy = 1.0/m_lonlatheight_scale[1];
+    const double oz = m_lonlatheight_offset[2], sz = 1.0/m_lonlatheight_scale[2];
+    const double c0 = m_xy_offset[0], c1 = m_xy_scale[0];
+    const double r0 = m_xy_offset[1], r1 = m_xy_scale[1];
+
+    // No branches or calls in the loop body, so it can be vectorized
+    for (size_t i = 0; i < num; i++) {
+      double x = (lon[i]    - ox)*sx;
+      double y = (lat[i]    - oy)*sy;
+      double z = (height[i] - oz)*sz;
+      col[i] = c0 + c1*rpc_poly(sn, x, y, z)/rpc_poly(sd, x, y, z);
+      row[i] = r0 + r1*rpc_poly(ln, x, y, z)/rpc_poly(ld, x, y, z);
+    }
+  }
+
+  void RPCModel::point_to_pixel(std::vector<Vector3> const& points,
+                                std::vector<Vector2> & pixels) const {
+
+    size_t num = points.size();
+    std::vector<double> lon(num), lat(num), height(num), col(num), row(num);
+    for (size_t i = 0; i < num; i++) {
+      Vector3 llh = m_datum.cartesian_to_geodetic(points[i]);
+      lon[i] = llh[0]; lat[i] = llh[1]; height[i] = llh[2];
+    }
+
+    if (num > 0)
+      geodetic_to_pixel(num, &lon[0], &lat[0], &height[0], &col[0], &row[0]);
+
+    pixels.resize(num);
+    for (size_t i = 0; i < num; i++)
+      pixels[i] = Vector2(col[i], row[i]);
+  }
+
+  int RPCModel::image_to_ground(size_t num, const double* col, const double* row,
+                                const double* height, double* lon, double* lat) const {
+
+    // Same tolerance and iteration limit as for a single point
+    const double abs_tolerance = 1e-6;
+    const int    max_iter      = 10;
+
+    const double *ln = &m_line_num_coeff[0],   *ld = &m_line_den_coeff[0];
+    const double *sn = &m_sample_num_coeff[0], *sd = &m_sample_den_coeff[0];
+
+    int total_iter = 0;
+    double x = 0, y = 0; // normalized lon and lat, start at the center
+    for (size_t i = 0; i < num; i++) {
+
+      double u = (col[i] - m_xy_offset[0])/m_xy_scale[0];
+      double v = (row[i] - m_xy_offset[1])/m_xy_scale[1];
+      double z = (height[i] - m_lonlatheight_offset[2])/m_lonlatheight_scale[2];
+
+      // Start from the previous solution, unless it is unreasonable
+      double len = sqrt(x*x + y*y);
+      if (len != len || len > 1.5) {
+        x = 0; y = 0;
+      }
+
+      for (int iter = 0; iter < max_iter; iter++) {
+        total_iter++;
+
+        double a, ax, ay, b, bx, by, c, cx, cy, d, dx, dy;
+        rpc_poly_and_grad(sn, x, y, z, a, ax, ay);
+        rpc_poly_and_grad(sd, x, y, z, b, bx, by);
+        rpc_poly_and_grad(ln, x, y, z, c, cx, cy);
+        rpc_poly_and_grad(ld, x, y, z, d, dx, dy);
+
+        // The normalized pixel, and its Jacobian in (x, y)
+        double p0 = a/b, p1 = c/d;
+        double J00 = (ax*b - a*bx)/(b*b), J01 = (ay*b - a*by)/(b*b);
+        double J10 = (cx*d - c*dx)/(d*d), J11 = (cy*d - c*dy)/(d*d);
+
+        double e0 = p0 - u, e1 = p1 - v;
+        double det = J00*J11 - J01*J10;
+        x -= ( J11*e0 - J01*e1)/det;
+        y -= (-J10*e0 + J00*e1)/det;
+
+        if (sqrt(e0*e0 + e1*e1) < abs_tolerance)
+          break;
+      }
+
+      lon[i] = x*m_lonlatheight_scale[0] + m_lonlatheight_offset[0];
+      lat[i] = y*m_lonlatheight_scale[1] + m_lonlatheight_offset[1];
+    }
+
+    return total_iter;
+  }
+
+  void RPCModel::point_and_dir(std::vector<Vector2> const& pixels,
+                               std::vector<Vector3> & P, std::vector<Vector3> & dir) const {
+
+    // See the single-pixel version for the choice of heights
+    const double VERT_SCALE_FACTOR = 0.9;
+    const double LONG_SCALE_UP     = 10000;
+    double height_up = m_lonlatheight_offset[2] + m_lonlatheight_scale[2]*VERT_SCALE_FACTOR;
+    double height_dn = m_lonlatheight_offset[2] - m_lonlatheight_scale[2]*VERT_SCALE_FACTOR;
+
+    size_t num = pixels.size();
+    P.resize(num);
+    dir.resize(num);
+    if (num == 0)
+      return;
+
+    std::vector<double> col(num), row(num), hup(num, height_up), hdn(num, height_dn);
+    std::vector<double> lon_up(num), lat_up(num), lon_dn(num), lat_dn(num);
+    for (size_t i = 0; i < num; i++) {
+      col[i] = pixels[i][0];
+      row[i] = pixels[i][1];
+    }
+
+    image_to_ground(num, &col[0], &row[0], &hup[0], &lon_up[0], &lat_up[0]);
+    image_to_ground(num, &col[0], &row[0], &hdn[0], &lon_dn[0], &lat_dn[0]);
+
+    for (size_t i = 0; i < num; i++) {
+      Vector3 P_up = m_datum.geodetic_to_cartesian(Vector3(lon_up[i], lat_up[i], height_up));
+      Vector3 P_dn = m_datum.geodetic_to_cartesian(Vector3(lon_dn[i], lat_dn[i], height_dn));
+      dir[i] = normalize(P_dn - P_up);
+      P[i]   = P_up - dir[i]*LONG_SCALE_UP;
+    }
+  }
+
   Vector3 RPCModel::camera_center(Vector2 const& pix ) const{
     // Return an arbitrarily chosen point on the ray back-projected
     // through the camera from the current pixel.
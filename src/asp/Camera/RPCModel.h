@@ -37,6 +37,7 @@
 
 #include <string>
 #include <ostream>
+#include <vector>
 
 namespace vw {
   class DiskImageResourceGDAL;
@@ -124,6 +125,29 @@ namespace asp {
     /// and the direction of the ray going through that point.
     void point_and_dir(vw::Vector2 const& pix, vw::Vector3 & P, vw::Vector3 & dir ) const;
 
+    // Batch versions of the above. The points are passed as separate
+    // arrays of coordinates, so that the polynomials are evaluated in
+    // plain loops over contiguous memory which the compiler can
+    // vectorize. These give the same results as the per-point calls.
+
+    /// Project num geodetic points (lon, lat, height) into the image.
+    void geodetic_to_pixel(size_t num, const double* lon, const double* lat,
+                           const double* height, double* col, double* row) const;
+
+    /// Project a batch of points in ECEF coordinates into the image.
+    void point_to_pixel(std::vector<vw::Vector3> const& points,
+                        std::vector<vw::Vector2> & pixels) const;
+
+    /// Batch version of image_to_ground(). Each point is seeded with the
+    /// solution for the previous one, so neighboring pixels converge in
+    /// fewer iterations. Returns the total number of Newton iterations.
+    int image_to_ground(size_t num, const double* col, const double* row,
+                        const double* height, double* lon, double* lat) const;
+
+    /// Batch version of point_and_dir().
+    void point_and_dir(std::vector<vw::Vector2> const& pixels,
+                       std::vector<vw::Vector3> & P, std::vector<vw::Vector3> & dir) const;
+
   private:
     vw::cartography::Datum m_datum;
 
@@ -16,13 +16,231 @@
 // __END_LICENSE__
 
 
+#include <vw/Core/Settings.h>
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Math/LinearAlgebra.h>
 #include <asp/Camera/RPCModelGen.h>
 #include <asp/Camera/RPCModel.h>
 
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+
 using namespace vw;
 
 namespace asp {
 
+  namespace {
+
+    // Number of unknowns for each of the line and sample: 20 in the
+    // numerator, and 19 in the denominator, whose constant term is 1.
+    const int NUM_COORD_COEFFS = 39;
+
+    // Split the points in blocks, a few per thread
+    void point_blocks(int num_pts, std::vector<std::pair<int, int> > & blocks) {
+      int num_blocks = std::max(1, std::min(num_pts, 4*int(vw_settings().default_num_threads())));
+      blocks.clear();
+      for (int b = 0; b < num_blocks; b++)
+        blocks.push_back(std::make_pair(int((long long)num_pts*b/num_blocks),
+                                        int((long long)num_pts*(b+1)/num_blocks)));
+    }
+
+    // Fill the Jacobian rows for the points in [beg, end). Blocks write
+    // to separate rows, so they need no locking.
+    class RpcJacobianTask: public vw::Task, private boost::noncopyable {
+      Vector<double> const& m_geo;
+      Vector<double> const& m_C;
+      int m_beg, m_end;
+      Matrix<double> & m_J;
+    public:
+      RpcJacobianTask(Vector<double> const& geo, Vector<double> const& C,
+                      int beg, int end, Matrix<double> & J):
+        m_geo(geo), m_C(C), m_beg(beg), m_end(end), m_J(J) {}
+
+      virtual void operator()() {
+        RPCModel::CoeffVec lineNum, lineDen, sampNum, sampDen;
+        unpackCoeffs(m_C, lineNum, lineDen, sampNum, sampDen);
+
+        for (int i = m_beg; i < m_end; i++) {
+          Vector3 G = subvector(m_geo, RPCModel::GEODETIC_COORD_SIZE*i,
+                                RPCModel::GEODETIC_COORD_SIZE);
+          RPCModel::CoeffVec T = RPCModel::calculate_terms(G);
+          double Ps = dot_prod(T, sampNum), Qs = dot_prod(T, sampDen);
+          double Pl = dot_prod(T, lineNum), Ql = dot_prod(T, lineDen);
+
+          // Output pixels are (sample, line). The coefficients are
+          // packed as line num, line den, sample num, sample den.
+          int row_s = RPCModel::IMAGE_COORD_SIZE*i, row_l = row_s + 1;
+          for (int k = 0; k < 20; k++) {
+            m_J(row_l, k)      = T[k]/Ql;
+            m_J(row_s, 39 + k) = T[k]/Qs;
+          }
+          for (int k = 1; k < 20; k++) {
+            m_J(row_l, 20 + k - 1) = -Pl*T[k]/(Ql*Ql);
+            m_J(row_s, 59 + k - 1) = -Ps*T[k]/(Qs*Qs);
+          }
+        }
+      }
+    };
+
+    // Accumulate the weighted normal equations of the linearized
+    // problem for one of line or sample, for the points in [beg, end).
+    // The unknowns are the numerator coefficients followed by the
+    // denominator ones other than the constant term.
+    class RpcNormalEqTask: public vw::Task, private boost::noncopyable {
+      Vector<double> const& m_geo;
+      Vector<double> const& m_pix;
+      RPCModel::CoeffVec const& m_den; // from the previous iteration
+      int m_coord, m_beg, m_end;
+      Matrix<double> & m_N;
+      Vector<double> & m_rhs;
+      Mutex          & m_mutex;
+    public:
+      RpcNormalEqTask(Vector<double> const& geo, Vector<double> const& pix,
+                      RPCModel::CoeffVec const& den, int coord, int beg, int end,
+                      Matrix<double> & N, Vector<double> & rhs, Mutex & mutex):
+        m_geo(geo), m_pix(pix), m_den(den), m_coord(coord), m_beg(beg), m_end(end),
+        m_N(N), m_rhs(rhs), m_mutex(mutex) {}
+
+      virtual void operator()() {
+        double N[NUM_COORD_COEFFS][NUM_COORD_COEFFS], rhs[NUM_COORD_COEFFS], a[NUM_COORD_COEFFS];
+        std::fill(&N[0][0], &N[0][0] + NUM_COORD_COEFFS*NUM_COORD_COEFFS, 0.0);
+        std::fill(rhs, rhs + NUM_COORD_COEFFS, 0.0);
+
+        for (int i = m_beg; i < m_end; i++) {
+          Vector3 G = subvector(m_geo, RPCModel::GEODETIC_COORD_SIZE*i,
+                                RPCModel::GEODETIC_COORD_SIZE);
+          RPCModel::CoeffVec T = RPCModel::calculate_terms(G);
+          double r = m_pix[RPCModel::IMAGE_COORD_SIZE*i + m_coord];
+          double Q = dot_prod(T, m_den);
+          if (Q == 0)
+            continue;
+          double w = 1.0/(Q*Q);
+
+          // r * (1 + sum den_k T_k) = sum num_k T_k
+          for (int k = 0; k < 20; k++)
+            a[k] = T[k];
+          for (int k = 1; k < 20; k++)
+            a[20 + k - 1] = -r*T[k];
+
+          for (int j = 0; j < NUM_COORD_COEFFS; j++) {
+            double wa = w*a[j];
+            rhs[j] += wa*r;
+            for (int k = j; k < NUM_COORD_COEFFS; k++)
+              N[j][k] += wa*a[k];
+          }
+        }
+
+        Mutex::Lock lock(m_mutex);
+        for (int j = 0; j < NUM_COORD_COEFFS; j++) {
+          m_rhs[j] += rhs[j];
+          for (int k = j; k < NUM_COORD_COEFFS; k++)
+            m_N(j, k) += N[j][k];
+        }
+      }
+    };
+
+  } // end anonymous namespace
+
+  RpcSolveLMA::jacobian_type RpcSolveLMA::jacobian( domain_type const& C ) const {
+
+    if (!m_analyticJacobian)
+      return vw::math::LeastSquaresModelBase<RpcSolveLMA>::jacobian(C);
+
+    int numPts = m_normalizedGeodetics.size()/RPCModel::GEODETIC_COORD_SIZE;
+    jacobian_type J(m_normalizedPixels.size(), C.size());
+    std::fill(J.begin(), J.end(), 0.0);
+
+    std::vector<std::pair<int, int> > blocks;
+    point_blocks(numPts, blocks);
+    FifoWorkQueue queue(vw_settings().default_num_threads());
+    for (size_t b = 0; b < blocks.size(); b++) {
+      boost::shared_ptr<RpcJacobianTask> task
+        (new RpcJacobianTask(m_normalizedGeodetics, C, blocks[b].first, blocks[b].second, J));
+      queue.add_task(task);
+    }
+    queue.join_all();
+
+    // The penalty terms are linear in the coefficients, see operator().
+    int count = RPCModel::IMAGE_COORD_SIZE*numPts;
+    vw::Vector<int,20> coeff_order = RPCModel::get_coeff_order();
+    for (int i = 4; i < 20; i++) J(count++, i)          = m_wt*(coeff_order[i]-1);
+    for (int i = 4; i < 20; i++) J(count++, 20 + i - 1) = m_wt*(coeff_order[i]-1);
+    for (int i = 4; i < 20; i++) J(count++, 39 + i)     = m_wt*(coeff_order[i]-1);
+    for (int i = 4; i < 20; i++) J(count++, 59 + i - 1) = m_wt*(coeff_order[i]-1);
+
+    VW_ASSERT((int)J.rows() == count, vw::ArgumentErr() << "Book-keeping error.\n");
+    return J;
+  }
+
+  void fit_rpc_linear(RpcSolveLMA const& lma_model, int max_iterations,
+                      Vector<double> & C) {
+
+    Vector<double> const& geo = lma_model.normalized_geodetics();
+    Vector<double> const& pix = lma_model.normalized_pixels();
+    int numPts = geo.size()/RPCModel::GEODETIC_COORD_SIZE;
+    double wt  = lma_model.penalty_weight();
+
+    std::vector<std::pair<int, int> > blocks;
+    point_blocks(numPts, blocks);
+    vw::Vector<int,20> coeff_order = RPCModel::get_coeff_order();
+
+    RPCModel::CoeffVec lineNum, lineDen, sampNum, sampDen;
+    lineDen[0] = 1;
+    sampDen[0] = 1;
+    for (int iter = 0; iter < std::max(max_iterations, 1); iter++) {
+
+      double max_change = 0;
+      for (int coord = 0; coord < RPCModel::IMAGE_COORD_SIZE; coord++) {
+        // Pixels are (sample, line)
+        RPCModel::CoeffVec & num = (coord == 0) ? sampNum : lineNum;
+        RPCModel::CoeffVec & den = (coord == 0) ? sampDen : lineDen;
+
+        Matrix<double> N(NUM_COORD_COEFFS, NUM_COORD_COEFFS);
+        Vector<double> rhs(NUM_COORD_COEFFS);
+        std::fill(N.begin(), N.end(), 0.0);
+        std::fill(rhs.begin(), rhs.end(), 0.0);
+
+        Mutex mutex;
+        FifoWorkQueue queue(vw_settings().default_num_threads());
+        for (size_t b = 0; b < blocks.size(); b++) {
+          boost::shared_ptr<RpcNormalEqTask> task
+            (new RpcNormalEqTask(geo, pix, den, coord, blocks[b].first, blocks[b].second,
+                                 N, rhs, mutex));
+          queue.add_task(task);
+        }
+        queue.join_all();
+
+        // The same penalty on the higher-degree coefficients as in RpcSolveLMA
+        for (int k = 4; k < 20; k++) {
+          double p = wt*(coeff_order[k]-1);
+          N(k, k)                   += p*p;
+          N(20 + k - 1, 20 + k - 1) += p*p;
+        }
+        for (int j = 0; j < NUM_COORD_COEFFS; j++)
+          for (int k = 0; k < j; k++)
+            N(j, k) = N(k, j);
+
+        Vector<double> x = least_squares(N, rhs);
+        for (int k = 0; k < 20; k++) {
+          max_change = std::max(max_change, std::abs(x[k] - num[k]));
+          num[k] = x[k];
+        }
+        for (int k = 1; k < 20; k++) {
+          max_change = std::max(max_change, std::abs(x[20 + k - 1] - den[k]));
+          den[k] = x[20 + k - 1];
+        }
+      }
+
+      VW_OUT(DebugMessage, "math") << "rpc_gen: linear fit iteration " << iter
+                                   << ", largest coefficient change: " << max_change << std::endl;
+      if (max_change < 1e-12)
+        break;
+    }
+
+    packCoeffs(lineNum, lineDen, sampNum, sampDen, C);
+  }
+
   void unpackCoeffs(Vector<double> const& C,
                     RPCModel::CoeffVec& lineNum, RPCModel::CoeffVec& lineDen,
                     RPCModel::CoeffVec& sampNum, RPCModel::CoeffVec& sampDen
@@ -189,21 +407,19 @@ namespace asp {
     Vector<double> solution;
     double norm_error;
 
-    // Initialize a zero vector of RPC model coefficients
-    Vector<double> startZero;
-    startZero.set_size(RPCModel::NUM_RPC_COEFFS);
-    for (size_t i = 0; i < startZero.size(); i++)
-      startZero[i] = 0.0;
+    // Start with the linear fit, which is close to the solution, then
+    // polish it with the L-M solver.
+    Vector<double> seed;
+    const int num_linear_iterations = 10;
+    fit_rpc_linear(lma_model, num_linear_iterations, seed);
 
-    // Use the L-M solver to optimize the RPC model coefficient values.
-    //VW_OUT(DebugMessage, "math") << "rpc_gen: Solving with zero seed" << std::endl;
-    int status = find_solution_from_seed(lma_model, startZero, normalized_pixels,
+    int status = find_solution_from_seed(lma_model, seed, normalized_pixels,
                                          solution, norm_error);
     VW_OUT(DebugMessage, "math") << "rpc_gen: norm_error = " << norm_error << std::endl;
   
     // Dump all the results to disk if the user passed in an output prefix.
     if (output_prefix != "")
-      write_levmar_solver_results(output_prefix, status, startZero,
+      write_levmar_solver_results(output_prefix, status, seed,
                                   solution, normalized_pixels, lma_model);
   
     // If we ever want to improve our results further we should
@@ -45,6 +45,7 @@ namespace asp {
     vw::Vector<double> m_normalizedGeodetics, 
                        m_normalizedPixels; ///< Also contains the extra penalty terms
     double             m_wt; ///< The penalty weight, k in the reference paper.
+    bool               m_analyticJacobian; ///< If false, differentiate numerically
     
   public:
    
@@ -58,11 +59,16 @@ namespace asp {
     /// Instantiate the solver with a set of GDC <--> Pixel pairs.
     RpcSolveLMA( const vw::Vector<double>& normalizedGeodetics,
                  const vw::Vector<double>& normalizedPixels,
-                 double penaltyWeight
+                 double penaltyWeight,
+                 bool analyticJacobian = true
                  ) :
       m_normalizedGeodetics(normalizedGeodetics),
       m_normalizedPixels(normalizedPixels),
-      m_wt(penaltyWeight){}
+      m_wt(penaltyWeight), m_analyticJacobian(analyticJacobian){}
+
+    vw::Vector<double> const& normalized_geodetics() const { return m_normalizedGeodetics; }
+    vw::Vector<double> const& normalized_pixels   () const { return m_normalizedPixels;    }
+    double                    penalty_weight      () const { return m_wt;                  }
 
     /// Given a set of RPC coefficients, compute the projected pixels.
     inline result_type operator()( domain_type const& C ) const {
@@ -115,8 +121,25 @@ namespace asp {
       return result;
     }
 
+    /// The Jacobian of operator(). Each projected pixel depends linearly
+    /// on the numerator coefficients and through a simple quotient on
+    /// the denominator ones, so this is found directly, in parallel over
+    /// blocks of points, rather than by differentiating numerically.
+    jacobian_type jacobian( domain_type const& C ) const;
+
   };
 
+  /// Fit the RPC coefficients by iteratively reweighted linear least
+  /// squares. Multiplying each residual by its denominator makes it
+  /// linear in the coefficients, and dividing by the denominator from
+  /// the previous iteration makes the result approach the true
+  /// least-squares fit. The line and sample coefficients are fit
+  /// separately, and the normal equations are accumulated in parallel.
+  /// The result, packed as for RpcSolveLMA, is a very good starting
+  /// point for Levenberg-Marquardt.
+  void fit_rpc_linear(RpcSolveLMA const& lma_model, int max_iterations,
+                      vw::Vector<double> & C);
+
   /// Print out a name followed by the vector of values
   void print_vec(std::string const& name, vw::Vector<double> const& vals);
 
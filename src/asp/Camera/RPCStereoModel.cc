@@ -74,10 +74,8 @@ namespace asp {
     try {
       vector<Vector3> camDirs(num_cams), 
                       camCtrs(num_cams);
-      vector<const RPCModel*> rpc_cams(num_cams);
       camDirs.clear(); 
       camCtrs.clear(); 
-      rpc_cams.clear();
 
       // Pick the valid rays
       for (int p = 0; p < num_cams; p++){
@@ -86,7 +84,6 @@ namespace asp {
         const RPCModel *rpc_cam = dynamic_cast<const RPCModel*>(vw::camera::unadjusted_model(m_cameras[p]));
         VW_ASSERT(rpc_cam != NULL,
                   vw::ArgumentErr() << "Camera models are not RPC.\n");
-        rpc_cams.push_back(rpc_cam);
 
         Vector2 pix = pixVec[p];
         if (pix != pix || // i.e., NaN
@@ -99,52 +96,124 @@ namespace asp {
         camCtrs.push_back(ctr);
       }
 
+      return triangulate_rays(pixVec, camCtrs, camDirs, errorVec);
 
-      // Not enough valid rays
-      if (camDirs.size() < 2) 
-          return Vector3();
+    } catch (const camera::PixelToRayErr& /*e*/) {}
+    return Vector3();
+  }
 
-      if (are_nearly_parallel(m_least_squares, camDirs)) 
-          return Vector3();
+  void RPCStereoModel::operator()(vector< vector<Vector2> > const& pixVecs,
+                                  vector<Vector3> & points,
+                                  vector<Vector3> & errorVecs) const {
 
-      // Determine range by triangulation
-      Vector3 result = triangulate_point(camDirs, camCtrs, errorVec);
+    int num_cams = m_cameras.size();
+    VW_ASSERT((int)pixVecs.size() == num_cams,
+              vw::ArgumentErr() << "the number of rays must match "
+                                << "the number of cameras.\n");
+    size_t num_points = pixVecs[0].size();
+
+    // Find the rays for the valid pixels of each camera in one go
+    vector< vector<Vector3> > ctrs(num_cams), dirs(num_cams);
+    vector< vector<bool> > valid(num_cams);
+    for (int p = 0; p < num_cams; p++){
+
+      const RPCModel *rpc_cam = dynamic_cast<const RPCModel*>(vw::camera::unadjusted_model(m_cameras[p]));
+      VW_ASSERT(rpc_cam != NULL,
+                vw::ArgumentErr() << "Camera models are not RPC.\n");
+      VW_ASSERT(pixVecs[p].size() == num_points,
+                vw::ArgumentErr() << "Expecting as many pixels for each camera.\n");
+
+      vector<Vector2> pixels;
+      valid[p].resize(num_points);
+      for (size_t i = 0; i < num_points; i++){
+        Vector2 pix = pixVecs[p][i];
+        valid[p][i] = !(pix != pix || // i.e., NaN
+                        pix == camera::CameraModel::invalid_pixel());
+        if (valid[p][i])
+          pixels.push_back(pix);
+      }
 
+      vector<Vector3> P, D;
+      rpc_cam->point_and_dir(pixels, P, D);
+
+      ctrs[p].resize(num_points);
+      dirs[p].resize(num_points);
+      size_t k = 0;
+      for (size_t i = 0; i < num_points; i++){
+        if (!valid[p][i]) continue;
+        ctrs[p][i] = P[k];
+        dirs[p][i] = D[k];
+        k++;
+      }
+    }
+
+    points.resize(num_points);
+    errorVecs.resize(num_points);
+    vector<Vector2> pixVec(num_cams);
+    vector<Vector3> camDirs, camCtrs;
+    for (size_t i = 0; i < num_points; i++){
+      camDirs.clear();
+      camCtrs.clear();
+      for (int p = 0; p < num_cams; p++){
+        pixVec[p] = pixVecs[p][i];
+        if (!valid[p][i]) continue;
+        camDirs.push_back(dirs[p][i]);
+        camCtrs.push_back(ctrs[p][i]);
+      }
+      errorVecs[i] = Vector3();
+      points[i] = triangulate_rays(pixVec, camCtrs, camDirs, errorVecs[i]);
+    }
+  }
 
-      if ( m_least_squares ){
+  Vector3 RPCStereoModel::triangulate_rays(vector<Vector2> const& pixVec,
+                                           vector<Vector3> const& camCtrs,
+                                           vector<Vector3> const& camDirs,
+                                           Vector3& errorVec) const {
 
-        // Refine triangulation
+    int num_cams = m_cameras.size();
 
-        if (num_cams != 2)
-          vw::vw_throw(vw::NoImplErr() << "Least squares refinement is not "
-                       << "implemented for multi-view stereo.");
+    // Not enough valid rays
+    if (camDirs.size() < 2) 
+        return Vector3();
 
-        detail::RPCTriangulateLMA model(rpc_cams[0], rpc_cams[1]);
-        Vector4 objective(pixVec[0][0], pixVec[0][1], pixVec[1][0], pixVec[1][1]);
-        int status = 0;
+    if (are_nearly_parallel(m_least_squares, camDirs)) 
+        return Vector3();
 
-        Vector3 initialGeodetic = rpc_cams[0]->datum().cartesian_to_geodetic(result);
+    // Determine range by triangulation
+    Vector3 result = triangulate_point(camDirs, camCtrs, errorVec);
 
-        // To do: Find good values for the numbers controlling the convergence
-        Vector3 finalGeodetic = levenberg_marquardt( model, initialGeodetic,
-                                                     objective, status, 1e-3, 1e-6, 10 );
+    if ( m_least_squares ){
 
-        if ( status > 0 )
-          result = rpc_cams[0]->datum().geodetic_to_cartesian(finalGeodetic);
-      } // End least squares case
+      // Refine triangulation
 
+      if (num_cams != 2)
+        vw::vw_throw(vw::NoImplErr() << "Least squares refinement is not "
+                     << "implemented for multi-view stereo.");
 
-      // Reflect points that fall behind one of the two cameras
-      bool reflect = false;
-      for (int p = 0; p < (int)camCtrs.size(); p++)
-        if (dot_prod(result - camCtrs[p], camDirs[p]) < 0 ) reflect = true;
-      if (reflect)
-        result = -result + 2*camCtrs[0];
+      const RPCModel *rpc_cam1 = dynamic_cast<const RPCModel*>(vw::camera::unadjusted_model(m_cameras[0]));
+      const RPCModel *rpc_cam2 = dynamic_cast<const RPCModel*>(vw::camera::unadjusted_model(m_cameras[1]));
+      detail::RPCTriangulateLMA model(rpc_cam1, rpc_cam2);
+      Vector4 objective(pixVec[0][0], pixVec[0][1], pixVec[1][0], pixVec[1][1]);
+      int status = 0;
 
-      return result;
+      Vector3 initialGeodetic = rpc_cam1->datum().cartesian_to_geodetic(result);
 
-    } catch (const camera::PixelToRayErr& /*e*/) {}
-    return Vector3();
+      // To do: Find good values for the numbers controlling the convergence
+      Vector3 finalGeodetic = levenberg_marquardt( model, initialGeodetic,
+                                                   objective, status, 1e-3, 1e-6, 10 );
+
+      if ( status > 0 )
+        result = rpc_cam1->datum().geodetic_to_cartesian(finalGeodetic);
+    } // End least squares case
+
+    // Reflect points that fall behind one of the two cameras
+    bool reflect = false;
+    for (int p = 0; p < (int)camCtrs.size(); p++)
+      if (dot_prod(result - camCtrs[p], camDirs[p]) < 0 ) reflect = true;
+    if (reflect)
+      result = -result + 2*camCtrs[0];
+
+    return result;
   }
 
   Vector3 RPCStereoModel::operator()(vw::Vector2 const& pix1,
@@ -62,6 +62,22 @@ namespace asp {
     virtual vw::Vector3 operator()(vw::Vector2 const& pix1,
                                    vw::Vector2 const& pix2,
                                    double& error) const;
+
+    /// Triangulate many points at once. Element i of pixVecs[p] is the
+    /// pixel in camera p for point i. The rays are found with the batch
+    /// RPC calls, which is faster than one point at a time when
+    /// consecutive pixels are near each other.
+    void operator()(std::vector< std::vector<vw::Vector2> > const& pixVecs,
+                    std::vector<vw::Vector3> & points,
+                    std::vector<vw::Vector3> & errorVecs) const;
+
+  private:
+
+    // Intersect the given valid rays, and refine if desired
+    vw::Vector3 triangulate_rays(std::vector<vw::Vector2> const& pixVec,
+                                 std::vector<vw::Vector3> const& camCtrs,
+                                 std::vector<vw::Vector3> const& camDirs,
+                                 vw::Vector3& errorVec) const;
   };
   
 } // namespace asp
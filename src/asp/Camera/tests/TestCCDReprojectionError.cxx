@@ -0,0 +1,88 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+// TestCCDReprojectionError.cxx
+
+// Compare the analytic derivatives of the ccd_adjust cost function
+// with central differences of its own residuals, and check that the
+// projection it keeps is redone when the point moves.
+
+#include <test/Helpers.h>
+#include <asp/Camera/CCDReprojectionError.h>
+#include <asp/Camera/LinescanDGModel.h>
+#include <xercesc/util/PlatformUtils.hpp>
+
+using namespace vw;
+using namespace asp;
+
+TEST( CCDReprojectionError, EvaluateDG ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  boost::shared_ptr<camera::CameraModel> dg = load_dg_camera_model_from_xml("dg_example1.xml");
+  Vector2i size = get_dg_ptr(dg)->get_image_size();
+  Vector2 pixel_sigma(2.0, 0.5);
+
+  for (int j = 1; j < 5; j++) {
+    Vector2 start(j*size.x()/5.0 + 17.0, size.y()/3.0);
+    Vector3 point = dg->camera_center(start) + 6.5e5*dg->pixel_to_vector(start);
+    Vector2 pixel = dg->point_to_pixel(point);
+
+    std::vector<double> offset(NUM_CCD_OFFSET_PARAMS), point_vec(point.begin(), point.end());
+    offset[0] = 0.7; offset[1] = -0.4;
+    Vector2 observation = pixel + Vector2(offset[0], offset[1]) + Vector2(0.5, -0.3);
+    CCDReprojectionError cost(observation, pixel_sigma, dg);
+
+    std::vector<double> jac_offset(NUM_CCD_OFFSET_PARAMS*NUM_CCD_OFFSET_PARAMS),
+                        jac_point (NUM_CCD_OFFSET_PARAMS*NUM_CCD_POINT_PARAMS);
+    double const* params[] = {&offset[0], &point_vec[0]};
+    double* jacs[] = {&jac_offset[0], &jac_point[0]};
+    double residuals[2];
+    ASSERT_TRUE( cost.Evaluate(params, residuals, jacs) );
+    EXPECT_NEAR( residuals[0], -0.5/pixel_sigma[0], 1e-3 );
+    EXPECT_NEAR( residuals[1],  0.3/pixel_sigma[1], 1e-3 );
+
+    // Against central differences of the residuals. Moving the point
+    // must project it anew.
+    std::vector<double>* blocks[] = {&offset, &point_vec};
+    std::vector<double>* block_jacs[] = {&jac_offset, &jac_point};
+    for (int i = 0; i < 2; i++) {
+      int len = blocks[i]->size();
+      for (int c = 0; c < len; c++) {
+        double h = (i == 0) ? 1e-3 : 1e-1;
+        double p[2], m[2];
+        (*blocks[i])[c] += h;
+        ASSERT_TRUE( cost.Evaluate(params, p, NULL) );
+        (*blocks[i])[c] -= 2*h;
+        ASSERT_TRUE( cost.Evaluate(params, m, NULL) );
+        (*blocks[i])[c] += h;
+        Vector2 N((p[0] - m[0])/(2*h), (p[1] - m[1])/(2*h));
+        Vector2 A((*block_jacs[i])[c], (*block_jacs[i])[len + c]);
+        EXPECT_LT( norm_2(A - N), 1e-2*norm_2(N) + 1e-4 );
+      }
+    }
+
+    // Back at the start the residuals are as before
+    double again[2];
+    ASSERT_TRUE( cost.Evaluate(params, again, NULL) );
+    EXPECT_NEAR( residuals[0], again[0], 1e-8 );
+    EXPECT_NEAR( residuals[1], again[1], 1e-8 );
+  }
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
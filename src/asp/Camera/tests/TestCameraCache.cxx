@@ -0,0 +1,93 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/Camera/CameraCache.h>
+#include <asp/Camera/LinescanDGModel.h>
+#include <asp/Camera/DG_XML.h>
+#include <asp/Camera/SPOT_XML.h>
+#include <asp/Camera/RPCModel.h>
+#include <test/Helpers.h>
+
+#include <boost/filesystem/operations.hpp>
+#include <fstream>
+
+using namespace vw;
+using namespace asp;
+using namespace xercesc;
+
+namespace fs = boost::filesystem;
+
+TEST(CameraCache, DGRoundTrip) {
+  XMLPlatformUtils::Initialize();
+
+  GeometricXML geo;
+  AttitudeXML  att;
+  EphemerisXML eph;
+  ImageXML     img;
+  RPCXML       rpc;
+  read_xml( "dg_example1.xml", geo, att, eph, img, rpc );
+
+  std::string cache_dir  = "camera_cache_test";
+  std::string cache_file = camera_cache_file(cache_dir, "dg_example1.xml", "dg");
+  EXPECT_EQ( "", camera_cache_file("", "dg_example1.xml", "dg") );
+  fs::remove_all(cache_dir);
+  write_dg_camera_cache(cache_file, geo, att, eph, img, 2.5);
+  ASSERT_TRUE( fs::exists(cache_file) );
+
+  GeometricXML geo2;
+  AttitudeXML  att2;
+  EphemerisXML eph2;
+  ImageXML     img2;
+  double parse_seconds = 0;
+  ASSERT_TRUE( read_dg_camera_cache(cache_file, geo2, att2, eph2, img2, parse_seconds) );
+  EXPECT_EQ( 2.5, parse_seconds );
+  EXPECT_EQ( img.image_size, img2.image_size );
+
+  // The cameras built from the XML and from the cache agree
+  boost::shared_ptr<DGCameraModel> cam1 = load_dg_camera_model(geo,  att,  eph,  img);
+  boost::shared_ptr<DGCameraModel> cam2 = load_dg_camera_model(geo2, att2, eph2, img2);
+  for (int row = 0; row <= 4; row++) {
+    for (int col = 0; col <= 4; col++) {
+      Vector2 pix(col*(img.image_size.x() - 1)/4.0, row*(img.image_size.y() - 1)/4.0);
+      EXPECT_VECTOR_NEAR( cam1->camera_center(pix),   cam2->camera_center(pix),   1e-8 );
+      EXPECT_VECTOR_NEAR( cam1->pixel_to_vector(pix), cam2->pixel_to_vector(pix), 1e-12 );
+      Vector3 point = cam1->camera_center(pix) + 7e5*cam1->pixel_to_vector(pix);
+      EXPECT_VECTOR_NEAR( cam1->point_to_pixel(point), cam2->point_to_pixel(point), 1e-6 );
+      EXPECT_VECTOR_NEAR( pix, cam2->point_to_pixel(point), 1e-2 );
+    }
+  }
+
+  // A cache of another kind is not used
+  SpotXML spot;
+  EXPECT_FALSE( read_spot5_camera_cache(cache_file, spot, parse_seconds) );
+
+  // A changed camera file has another cache file, which does not exist
+  std::string changed_xml = cache_dir + "/changed.xml";
+  fs::copy_file("dg_example1.xml", changed_xml);
+  EXPECT_EQ( cache_file, camera_cache_file(cache_dir, changed_xml, "dg") );
+  {
+    std::ofstream os(changed_xml.c_str(), std::ios::app);
+    os << "<!-- changed -->\n";
+  }
+  std::string changed_cache = camera_cache_file(cache_dir, changed_xml, "dg");
+  EXPECT_NE( cache_file, changed_cache );
+  EXPECT_FALSE( read_dg_camera_cache(changed_cache, geo2, att2, eph2, img2, parse_seconds) );
+
+  fs::remove_all(cache_dir);
+  XMLPlatformUtils::Terminate();
+}
@@ -0,0 +1,239 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+// TestCameraJacobians.cxx
+
+// Compare the analytic derivatives of projecting into DG, RPC and
+// adjusted cameras with numerical ones, and time both on a synthetic
+// network of 200 adjusted cameras, the way bundle_adjust uses them.
+// Also check the weights of the piecewise adjustments of jitter
+// correction, from which its derivatives are found.
+
+#include <vw/Camera/CameraModel.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Math/Quaternion.h>
+#include <test/Helpers.h>
+#include <asp/Camera/AdjustedLinescanDGModel.h>
+#include <asp/Camera/CameraJacobians.h>
+#include <asp/Camera/DG_XML.h>
+#include <asp/Camera/LinescanDGModel.h>
+#include <asp/Camera/RPCModel.h>
+#include <xercesc/util/PlatformUtils.hpp>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // The pixel in the adjusted camera, as bundle_adjust finds it
+  Vector2 adjusted_pixel(boost::shared_ptr<camera::CameraModel> cam,
+                         Vector<double, 6> const& adj, Vector3 const& point) {
+    camera::AdjustedCameraModel acam(cam, subvector(adj, 0, 3),
+                                     axis_angle_to_quaternion(subvector(adj, 3, 3)));
+    return acam.point_to_pixel(point);
+  }
+
+  // Central differences in the adjustment and the point, as done by
+  // ceres::NumericDiffCostFunction
+  void numerical_jacobians(boost::shared_ptr<camera::CameraModel> cam,
+                           Vector<double, 6> const& adj, Vector3 const& point,
+                           Matrix<double, 2, 6> & J_adj, Matrix<double, 2, 3> & J_point) {
+    const double step = 1e-6;
+    for (int c = 0; c < 6; c++) {
+      Vector<double, 6> p = adj, m = adj;
+      double h = step*std::max(1.0, std::abs(adj[c]));
+      p[c] += h; m[c] -= h;
+      select_col(J_adj, c) = (adjusted_pixel(cam, p, point) - adjusted_pixel(cam, m, point))/(2*h);
+    }
+    for (int c = 0; c < 3; c++) {
+      Vector3 p = point, m = point;
+      double h = step*std::max(1.0, std::abs(point[c]));
+      p[c] += h; m[c] -= h;
+      select_col(J_point, c) = (adjusted_pixel(cam, adj, p) - adjusted_pixel(cam, adj, m))/(2*h);
+    }
+  }
+
+  // Largest difference relative to the largest entry, per column,
+  // since the columns have very different scales.
+  template <int N>
+  double relative_error(Matrix<double, 2, N> const& A, Matrix<double, 2, N> const& B) {
+    double err = 0;
+    for (int c = 0; c < N; c++) {
+      double scale = std::max(max(abs(select_col(B, c))), 1e-12);
+      err = std::max(err, max(abs(select_col(A, c) - select_col(B, c)))/scale);
+    }
+    return err;
+  }
+
+  Vector<double, 6> make_adjustment(double t, double r) {
+    Vector<double, 6> adj;
+    subvector(adj, 0, 3) = Vector3(t, -0.5*t, 0.25*t);
+    subvector(adj, 3, 3) = Vector3(r, 0.3*r, -0.7*r);
+    return adj;
+  }
+
+}
+
+TEST( CameraJacobians, InverseRotation ) {
+  Vector3 w(0.3, -0.2, 0.5), v(1, 2, -3);
+  Matrix3x3 J = inverse_rotation_jacobian(w, v), N;
+  for (int c = 0; c < 3; c++) {
+    Vector3 p = w, m = w;
+    p[c] += 1e-6; m[c] -= 1e-6;
+    Matrix3x3 Rp = axis_angle_to_quaternion(p).rotation_matrix();
+    Matrix3x3 Rm = axis_angle_to_quaternion(m).rotation_matrix();
+    select_col(N, c) = (transpose(Rp)*v - transpose(Rm)*v)/2e-6;
+  }
+  EXPECT_LT( max(abs(J - N)), 1e-8 );
+
+  // Near zero rotation the derivative of R^T v is the cross product
+  // matrix of v
+  J = inverse_rotation_jacobian(Vector3(1e-9, 0, 0), v);
+  N = Matrix3x3();
+  N(0, 1) = -v[2]; N(0, 2) =  v[1];
+  N(1, 0) =  v[2]; N(1, 2) = -v[0];
+  N(2, 0) = -v[1]; N(2, 1) =  v[0];
+  EXPECT_LT( max(abs(J - N)), 1e-8 );
+}
+
+TEST( CameraJacobians, DGAndRPC ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  boost::shared_ptr<camera::CameraModel> dg = load_dg_camera_model_from_xml("dg_example1.xml");
+  RPCXML xml;
+  xml.read_from_file("dg_example1.xml");
+  boost::shared_ptr<camera::CameraModel> rpc(new RPCModel(*xml.rpc_ptr()));
+
+  boost::shared_ptr<camera::CameraModel> cams[] = {dg, rpc};
+  for (int k = 0; k < 2; k++) {
+    boost::shared_ptr<camera::CameraModel> cam = cams[k];
+    Vector3 center = cam->camera_center(Vector2());
+    for (int i = 2000; i < 35000; i += 10000) {
+      for (int j = 1000; j < 25000; j += 8000) {
+        Vector2 pix(i, j);
+        Vector3 point = dg->camera_center(pix) + 6.5e5*dg->pixel_to_vector(pix);
+
+        // The unadjusted camera
+        Matrix<double, 2, 3> J;
+        Vector2 p = point_to_pixel_jacobian(*cam, point, J);
+        EXPECT_VECTOR_NEAR( cam->point_to_pixel(point), p, 1e-6 );
+
+        // An adjusted camera, against AdjustedCameraModel
+        Vector<double, 6> adj = make_adjustment(3.0, 2e-5);
+        Matrix<double, 2, 6> J_adj, N_adj;
+        Matrix<double, 2, 3> J_point, N_point;
+        p = adjusted_point_to_pixel_jacobian(*cam, center, adj, point, J_adj, J_point);
+        EXPECT_VECTOR_NEAR( adjusted_pixel(cam, adj, point), p, 1e-6 );
+
+        numerical_jacobians(cam, adj, point, N_adj, N_point);
+        EXPECT_LT( relative_error(J_adj,   N_adj),   1e-3 );
+        EXPECT_LT( relative_error(J_point, N_point), 1e-3 );
+      }
+    }
+  }
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
+TEST( CameraJacobians, Network200 ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  // 200 adjusted copies of a DG camera, each seeing the same 50
+  // ground points, which are 10000 observations.
+  boost::shared_ptr<camera::CameraModel> dg = load_dg_camera_model_from_xml("dg_example1.xml");
+  Vector3 center = dg->camera_center(Vector2());
+  const int num_cams = 200;
+  std::vector<Vector<double, 6> > adjustments;
+  for (int c = 0; c < num_cams; c++)
+    adjustments.push_back(make_adjustment(0.1*(c % 20) - 1.0, 1e-6*(c % 10) - 5e-6));
+  std::vector<Vector3> points;
+  for (int i = 2000; i < 35000; i += 3500) {
+    for (int j = 1000; j < 25000; j += 5000) {
+      Vector2 pix(i, j);
+      points.push_back(dg->camera_center(pix) + 6.5e5*dg->pixel_to_vector(pix));
+    }
+  }
+
+  Matrix<double, 2, 6> J_adj;
+  Matrix<double, 2, 3> J_point;
+  Stopwatch sw_analytic, sw_numerical;
+
+  sw_analytic.start();
+  double sum_analytic = 0;
+  for (int c = 0; c < num_cams; c++) {
+    for (size_t k = 0; k < points.size(); k++) {
+      adjusted_point_to_pixel_jacobian(*dg, center, adjustments[c], points[k], J_adj, J_point);
+      sum_analytic += J_adj(0, 0) + J_point(1, 2);
+    }
+  }
+  sw_analytic.stop();
+
+  sw_numerical.start();
+  double sum_numerical = 0;
+  for (int c = 0; c < num_cams; c++) {
+    for (size_t k = 0; k < points.size(); k++) {
+      adjusted_pixel(dg, adjustments[c], points[k]);
+      numerical_jacobians(dg, adjustments[c], points[k], J_adj, J_point);
+      sum_numerical += J_adj(0, 0) + J_point(1, 2);
+    }
+  }
+  sw_numerical.stop();
+
+  int num_obs = num_cams*points.size();
+  vw_out() << "Jacobians of " << num_obs << " observations in " << num_cams
+           << " DG cameras: " << sw_analytic.elapsed_seconds() << " s analytic, "
+           << sw_numerical.elapsed_seconds() << " s numerical.\n";
+
+  EXPECT_NEAR( sum_numerical, sum_analytic, 1e-3*std::abs(sum_numerical) + 1e-6 );
+  EXPECT_LT( sw_analytic.elapsed_seconds(), sw_numerical.elapsed_seconds() );
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
+TEST( CameraJacobians, PiecewiseAdjustmentWeights ) {
+  int num = 20;
+  Vector2 bounds(100.0, 5000.0);
+  std::vector<Vector3> adjustments;
+  for (int k = 0; k < num; k++)
+    adjustments.push_back(Vector3(1.0 + 0.3*k, -0.1*k*k, 2.0*((k*7) % 5)));
+
+  for (int interp_type = LinearInterp; interp_type <= GaussianWeightsInterp; interp_type++) {
+    AdjustablePosition position(interp_type, bounds, adjustments, g_num_wts, g_sigma);
+    for (double t = 0.0; t < 5200.0; t += 37.3) {
+      std::vector<int>    indices = position.get_closest_adj_indices(t);
+      std::vector<double> weights = position.get_adj_weights(t, indices);
+      ASSERT_EQ( indices.size(), weights.size() );
+
+      // Each weight is what is interpolated from all the adjustments
+      // when that one is 1 and the others are 0.
+      Vector3 sum;
+      for (size_t k = 0; k < indices.size(); k++) {
+        std::vector<Vector3> unit(num);
+        unit[indices[k]] = Vector3(1, 0, 0);
+        AdjustablePosition probe(interp_type, bounds, unit, g_num_wts, g_sigma);
+        EXPECT_NEAR( weights[k], probe(t)[0], 1e-12 );
+        sum += weights[k]*adjustments[indices[k]];
+      }
+
+      // The nearest adjustments are all that matter
+      EXPECT_LT( norm_2(sum - position(t)), 1e-6*norm_2(position(t)) + 1e-9 );
+    }
+  }
+}
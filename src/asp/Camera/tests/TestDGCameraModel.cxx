@@ -23,6 +23,7 @@
 #include <boost/scoped_ptr.hpp>
 #include <test/Helpers.h>
 
+#include <vw/Core/Stopwatch.h>
 #include <vw/Stereo/StereoModel.h>
 
 #include <vw/Cartography/GeoTransform.h>
@@ -158,3 +159,50 @@ TEST(DGCameraModel, CreateCamera) {
   XMLPlatformUtils::Terminate();
 }
 
+
+TEST(DGCameraModel, FastPointToPixel) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  boost::shared_ptr<DGCameraModel> cam = load_dg_camera_model_from_xml("dg_example1.xml");
+  ASSERT_TRUE( cam.get() != 0 );
+
+  // Points on rays through a grid of pixels, including some beyond the
+  // image lines, which must be extrapolated.
+  std::vector<Vector2> pixels;
+  std::vector<Vector3> points;
+  for ( int i = 0; i < 35000; i += 2500 ) {
+    for ( int j = -1000; j < 25000; j += 2000 ) {
+      Vector2 pix(i, j);
+      pixels.push_back(pix);
+      points.push_back(cam->camera_center(pix) + 6e5 * cam->pixel_to_vector(pix));
+    }
+  }
+
+  int num = points.size(), num_iter = 0;
+  std::vector<Vector2> fast(num), lma(num);
+  Stopwatch sw_fast, sw_lma;
+  sw_fast.start();
+  for ( int k = 0; k < num; k++ ) {
+    int iter = 0;
+    EXPECT_TRUE( cam->point_to_pixel_fast(points[k], -1, fast[k], iter) );
+    num_iter += iter;
+  }
+  sw_fast.stop();
+
+  sw_lma.start();
+  for ( int k = 0; k < num; k++ )
+    lma[k] = cam->point_to_pixel_lma(points[k], -1);
+  sw_lma.stop();
+
+  vw_out() << "DG point_to_pixel: " << 1e6*sw_fast.elapsed_seconds()/num
+           << " us/point with " << double(num_iter)/num << " line iterations/point, "
+           << 1e6*sw_lma.elapsed_seconds()/num << " us/point with the generic solver.\n";
+
+  for ( int k = 0; k < num; k++ ) {
+    EXPECT_VECTOR_NEAR( pixels[k], fast[k], 1e-4 );
+    EXPECT_VECTOR_NEAR( lma[k],    fast[k], 1e-4 );
+  }
+
+  XMLPlatformUtils::Terminate();
+}
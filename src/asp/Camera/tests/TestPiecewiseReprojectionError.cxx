@@ -0,0 +1,117 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+// TestPiecewiseReprojectionError.cxx
+
+// Compare the analytic derivatives of the jitter_adjust cost function
+// with central differences of its own residuals, for both kinds of
+// interpolation of the piecewise adjustments.
+
+#include <test/Helpers.h>
+#include <asp/Camera/PiecewiseReprojectionError.h>
+#include <asp/Camera/LinescanDGModel.h>
+#include <xercesc/util/PlatformUtils.hpp>
+
+using namespace vw;
+using namespace asp;
+
+TEST( PiecewiseReprojectionError, EvaluateDG ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  boost::shared_ptr<camera::CameraModel> dg = load_dg_camera_model_from_xml("dg_example1.xml");
+  Vector2i size = get_dg_ptr(dg)->get_image_size();
+  Vector2 bounds(0.1*size.y(), 0.9*size.y());
+  Vector2 pixel_sigma(2.0, 0.5);
+
+  // The adjustments of this camera come after those of another one,
+  // as when several cameras are solved for together.
+  int start_index = 2, end_index = 8;
+  std::vector<double> cameras_vec;
+  for (int k = 0; k < end_index; k++) {
+    double t = 1.0 + 0.3*k, r = 1e-6*(k + 1);
+    double adj[] = {t, -0.5*t, 0.25*t, r, 0.3*r, -0.7*r};
+    cameras_vec.insert(cameras_vec.end(), adj, adj + NUM_CAMERA_PARAMS);
+  }
+
+  std::vector<Vector3> position_adjustments;
+  std::vector<Quat>    pose_adjustments;
+  populate_adjustements(cameras_vec, start_index, end_index,
+                        position_adjustments, pose_adjustments);
+
+  for (int interp_type = LinearInterp; interp_type <= GaussianWeightsInterp; interp_type++) {
+    stereo_settings().piecewise_adjustment_interp_type = interp_type;
+    AdjustedModelWrapper cam_wrapper("dg", dg, interp_type, bounds,
+                                     position_adjustments, pose_adjustments, size);
+
+    for (int j = 1; j < 5; j++) {
+      Vector2 start(size.x()/3.0, j*size.y()/5.0 + 123.0);
+      Vector3 point = dg->camera_center(start) + 6.5e5*dg->pixel_to_vector(start);
+      Vector2 observation = cam_wrapper.point_to_pixel(point, start.y()) + Vector2(0.5, -0.3);
+
+      std::vector<int> indices = cam_wrapper.get_closest_adj_indices(observation.y());
+      std::vector<int> camera_indices;
+      for (size_t k = 0; k < indices.size(); k++)
+        camera_indices.push_back(indices[k] + start_index);
+      PiecewiseReprojectionError cost(observation, pixel_sigma, bounds, cameras_vec, dg,
+                                      size, "dg", start_index, camera_indices, end_index, 0);
+
+      // The parameter blocks, and the jacobians in the layout ceres uses
+      int num_adj = camera_indices.size();
+      std::vector< std::vector<double> > params, jacs;
+      for (int i = 0; i < num_adj; i++) {
+        double const* cam = &cameras_vec[NUM_CAMERA_PARAMS*camera_indices[i]];
+        params.push_back(std::vector<double>(cam, cam + NUM_CAMERA_PARAMS));
+        jacs.push_back(std::vector<double>(2*NUM_CAMERA_PARAMS));
+      }
+      params.push_back(std::vector<double>(point.begin(), point.end()));
+      jacs.push_back(std::vector<double>(2*NUM_POINT_PARAMS));
+
+      std::vector<double const*> param_ptrs;
+      std::vector<double*>       jac_ptrs;
+      for (int i = 0; i <= num_adj; i++) {
+        param_ptrs.push_back(&params[i][0]);
+        jac_ptrs.push_back(&jacs[i][0]);
+      }
+      double residuals[2];
+      ASSERT_TRUE( cost.Evaluate(&param_ptrs[0], residuals, &jac_ptrs[0]) );
+      EXPECT_NEAR( residuals[0], -0.5/pixel_sigma[0], 1e-3 );
+      EXPECT_NEAR( residuals[1],  0.3/pixel_sigma[1], 1e-3 );
+
+      // Against central differences of the residuals, which solve for
+      // the pixel each time
+      for (int i = 0; i <= num_adj; i++) {
+        int len = params[i].size();
+        for (int c = 0; c < len; c++) {
+          double h = (i == num_adj || c < 3) ? 1e-2 : 1e-7;
+          double p[2], m[2];
+          params[i][c] += h;
+          ASSERT_TRUE( cost.Evaluate(&param_ptrs[0], p, NULL) );
+          params[i][c] -= 2*h;
+          ASSERT_TRUE( cost.Evaluate(&param_ptrs[0], m, NULL) );
+          params[i][c] += h;
+          Vector2 N((p[0] - m[0])/(2*h), (p[1] - m[1])/(2*h));
+          Vector2 A(jacs[i][c], jacs[i][len + c]);
+          EXPECT_LT( norm_2(A - N), 1e-2*norm_2(N) + 1e-3 );
+        }
+      }
+    }
+  }
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
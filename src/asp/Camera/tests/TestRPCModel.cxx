@@ -0,0 +1,177 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+// TestRPCModel.cxx
+
+// Check that the batch RPC calls agree with the per-point ones, and
+// report how long each takes.
+
+#include <vw/Core/Log.h>
+#include <vw/Core/Stopwatch.h>
+#include <test/Helpers.h>
+#include <asp/Camera/DG_XML.h>
+#include <asp/Camera/RPCModel.h>
+#include <asp/Camera/RPCStereoModel.h>
+#include <xercesc/util/PlatformUtils.hpp>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // A tile of pixels in row-major order, as stereo_tri and mapproject
+  // pass them.
+  void pixel_tile(Vector2 const& corner, int cols, int rows,
+                  std::vector<Vector2> & pixels) {
+    pixels.clear();
+    for (int r = 0; r < rows; r++)
+      for (int c = 0; c < cols; c++)
+        pixels.push_back(corner + Vector2(c, r));
+  }
+
+}
+
+TEST( RPCModel, BatchMatchesSingle ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml;
+  xml.read_from_file( "dg_example1.xml" );
+  RPCModel model( *xml.rpc_ptr() );
+
+  std::vector<Vector2> pixels;
+  pixel_tile(Vector2(5000, 7000), 128, 128, pixels);
+  size_t num = pixels.size();
+  double h = 2300;
+
+  // Image to ground
+  std::vector<double> col(num), row(num), height(num, h), lon(num), lat(num);
+  for (size_t i = 0; i < num; i++) {
+    col[i] = pixels[i][0];
+    row[i] = pixels[i][1];
+  }
+
+  Stopwatch sw_single, sw_batch;
+  sw_single.start();
+  std::vector<Vector2> lonlat(num);
+  for (size_t i = 0; i < num; i++)
+    lonlat[i] = model.image_to_ground(pixels[i], h);
+  sw_single.stop();
+
+  sw_batch.start();
+  int num_iter = model.image_to_ground(num, &col[0], &row[0], &height[0], &lon[0], &lat[0]);
+  sw_batch.stop();
+
+  vw_out() << "image_to_ground: " << 1e6*sw_single.elapsed_seconds()/num
+           << " us/point single, " << 1e6*sw_batch.elapsed_seconds()/num
+           << " us/point batch, " << double(num_iter)/num << " iterations/point.\n";
+
+  for (size_t i = 0; i < num; i++)
+    EXPECT_VECTOR_NEAR( lonlat[i], Vector2(lon[i], lat[i]), 1e-9 );
+
+  // Ground to image
+  std::vector<double> col2(num), row2(num);
+  Stopwatch sw_single2, sw_batch2;
+  sw_single2.start();
+  std::vector<Vector2> pix_single(num);
+  for (size_t i = 0; i < num; i++)
+    pix_single[i] = model.geodetic_to_pixel(Vector3(lon[i], lat[i], h));
+  sw_single2.stop();
+
+  sw_batch2.start();
+  model.geodetic_to_pixel(num, &lon[0], &lat[0], &height[0], &col2[0], &row2[0]);
+  sw_batch2.stop();
+
+  vw_out() << "geodetic_to_pixel: " << 1e6*sw_single2.elapsed_seconds()/num
+           << " us/point single, " << 1e6*sw_batch2.elapsed_seconds()/num
+           << " us/point batch.\n";
+
+  for (size_t i = 0; i < num; i++) {
+    EXPECT_VECTOR_NEAR( pix_single[i], Vector2(col2[i], row2[i]), 1e-8 );
+    EXPECT_VECTOR_NEAR( pixels[i],     Vector2(col2[i], row2[i]), 1e-5 );
+  }
+
+  // Rays
+  std::vector<Vector3> P, dir;
+  model.point_and_dir(pixels, P, dir);
+  ASSERT_EQ( num, P.size() );
+  for (size_t i = 0; i < num; i += 97) {
+    Vector3 P1, dir1;
+    model.point_and_dir(pixels[i], P1, dir1);
+    EXPECT_VECTOR_NEAR( P1,   P[i],   1e-3 );
+    EXPECT_VECTOR_NEAR( dir1, dir[i], 1e-8 );
+  }
+
+  // Points along the rays project back to the pixels
+  std::vector<Vector3> points(num);
+  for (size_t i = 0; i < num; i++)
+    points[i] = P[i] + 1000*dir[i];
+  std::vector<Vector2> pix_back;
+  model.point_to_pixel(points, pix_back);
+  for (size_t i = 0; i < num; i += 97)
+    EXPECT_VECTOR_NEAR( model.point_to_pixel(points[i]), pix_back[i], 1e-6 );
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
+TEST( RPCStereoModel, BatchMatchesSingle ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml1, xml2;
+  xml1.read_from_file( "wv_mvp_1.xml" );
+  xml2.read_from_file( "wv_mvp_2.xml" );
+  RPCModel model1( *xml1.rpc_ptr() );
+  RPCModel model2( *xml2.rpc_ptr() );
+
+  std::vector<const vw::camera::CameraModel*> cameras;
+  cameras.push_back(&model1);
+  cameras.push_back(&model2);
+  RPCStereoModel stereo_model(cameras, false);
+
+  std::vector< std::vector<Vector2> > pixVecs(2);
+  pixel_tile(Vector2(10000, 10000), 64, 64, pixVecs[0]);
+  pixel_tile(Vector2(10000, 10000), 64, 64, pixVecs[1]);
+  size_t num = pixVecs[0].size();
+
+  Stopwatch sw_single, sw_batch;
+  std::vector<Vector3> points_single(num), errors_single(num);
+  sw_single.start();
+  for (size_t i = 0; i < num; i++) {
+    std::vector<Vector2> pixVec(2);
+    pixVec[0] = pixVecs[0][i];
+    pixVec[1] = pixVecs[1][i];
+    points_single[i] = stereo_model(pixVec, errors_single[i]);
+  }
+  sw_single.stop();
+
+  std::vector<Vector3> points, errors;
+  sw_batch.start();
+  stereo_model(pixVecs, points, errors);
+  sw_batch.stop();
+
+  vw_out() << "RPC triangulation: " << 1e6*sw_single.elapsed_seconds()/num
+           << " us/point single, " << 1e6*sw_batch.elapsed_seconds()/num
+           << " us/point batch.\n";
+
+  ASSERT_EQ( num, points.size() );
+  for (size_t i = 0; i < num; i++) {
+    EXPECT_VECTOR_NEAR( points_single[i], points[i], 1e-4 );
+    EXPECT_VECTOR_NEAR( errors_single[i], errors[i], 1e-4 );
+  }
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
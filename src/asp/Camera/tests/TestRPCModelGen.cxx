@@ -0,0 +1,133 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+// TestRPCModelGen.cxx
+
+// Fit an RPC model to points generated by a known one, both the old way
+// (Levenberg-Marquardt from zero with a numerical Jacobian) and with the
+// linear fit followed by Levenberg-Marquardt with the analytic
+// Jacobian, and compare time and residuals.
+
+#include <vw/Core/Log.h>
+#include <vw/Core/Stopwatch.h>
+#include <test/Helpers.h>
+#include <asp/Camera/DG_XML.h>
+#include <asp/Camera/RPCModel.h>
+#include <asp/Camera/RPCModelGen.h>
+#include <xercesc/util/PlatformUtils.hpp>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // Normalized geodetics on a grid, and their normalized pixels in the model
+  void make_points(RPCModel const& model, int num_per_dim,
+                   Vector<double> & geodetics, Vector<double> & pixels) {
+    int num_pts = num_per_dim*num_per_dim*5;
+    geodetics.set_size(RPCModel::GEODETIC_COORD_SIZE*num_pts);
+    pixels.set_size(RPCModel::IMAGE_COORD_SIZE*num_pts + RpcSolveLMA::NUM_PENALTY_TERMS);
+    for (size_t i = 0; i < pixels.size(); i++)
+      pixels[i] = 0.0; // The penalty terms must be zero
+
+    int count = 0;
+    for (int h = 0; h < 5; h++) {
+      for (int r = 0; r < num_per_dim; r++) {
+        for (int c = 0; c < num_per_dim; c++) {
+          Vector3 G(-1 + 2.0*c/(num_per_dim - 1), -1 + 2.0*r/(num_per_dim - 1), -1 + 0.5*h);
+          subvector(geodetics, RPCModel::GEODETIC_COORD_SIZE*count,
+                    RPCModel::GEODETIC_COORD_SIZE) = G;
+          subvector(pixels, RPCModel::IMAGE_COORD_SIZE*count, RPCModel::IMAGE_COORD_SIZE)
+            = model.normalized_geodetic_to_normalized_pixel(G);
+          count++;
+        }
+      }
+    }
+  }
+
+}
+
+TEST( RPCModelGen, AnalyticJacobian ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml;
+  xml.read_from_file( "dg_example1.xml" );
+  RPCModel model( *xml.rpc_ptr() );
+
+  Vector<double> geodetics, pixels, C;
+  make_points(model, 5, geodetics, pixels);
+  packCoeffs(model.line_num_coeff(), model.line_den_coeff(),
+             model.sample_num_coeff(), model.sample_den_coeff(), C);
+
+  RpcSolveLMA analytic (geodetics, pixels, 0.1, true);
+  RpcSolveLMA numerical(geodetics, pixels, 0.1, false);
+  Matrix<double> Ja = analytic.jacobian(C);
+  Matrix<double> Jn = numerical.jacobian(C);
+  ASSERT_EQ( Jn.rows(), Ja.rows() );
+  ASSERT_EQ( Jn.cols(), Ja.cols() );
+  EXPECT_LT( max(abs(Ja - Jn)), 1e-5*max(abs(Ja)) );
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
+TEST( RPCModelGen, LinearFitAndPolish ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml;
+  xml.read_from_file( "dg_example1.xml" );
+  RPCModel model( *xml.rpc_ptr() );
+
+  Vector<double> geodetics, pixels;
+  make_points(model, 12, geodetics, pixels);
+
+  // The penalty weight as computed in gen_rpc() for the default of rpc_gen
+  double penalty = 0.03/(double(RpcSolveLMA::NUM_PENALTY_TERMS)/pixels.size());
+
+  // The old way
+  Stopwatch sw_old;
+  sw_old.start();
+  RpcSolveLMA old_model(geodetics, pixels, penalty, false);
+  Vector<double> zero(RPCModel::NUM_RPC_COEFFS), old_solution;
+  for (size_t i = 0; i < zero.size(); i++)
+    zero[i] = 0.0;
+  double old_error = 0;
+  find_solution_from_seed(old_model, zero, pixels, old_solution, old_error);
+  sw_old.stop();
+
+  // The linear fit, and polishing it
+  Stopwatch sw_new;
+  sw_new.start();
+  RpcSolveLMA new_model(geodetics, pixels, penalty, true);
+  Vector<double> seed, new_solution;
+  fit_rpc_linear(new_model, 10, seed);
+  double seed_error = norm_2(new_model.difference(new_model(seed), pixels));
+  double new_error  = 0;
+  find_solution_from_seed(new_model, seed, pixels, new_solution, new_error);
+  sw_new.stop();
+
+  vw_out() << "RPC fit of " << geodetics.size()/3 << " points: "
+           << sw_old.elapsed_seconds() << " s with residual " << old_error
+           << " from zero with a numerical Jacobian, "
+           << sw_new.elapsed_seconds() << " s with residual " << new_error
+           << " (linear fit: " << seed_error << ") with the analytic one.\n";
+
+  EXPECT_LE( new_error, 1.01*old_error + 1e-12 );
+  EXPECT_LT( seed_error, 10*new_error + 1e-6 );
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
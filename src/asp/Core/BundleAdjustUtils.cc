@@ -26,6 +26,8 @@
 #include <vw/BundleAdjustment/ControlNetwork.h>
 #include <vw/Stereo/StereoModel.h>
 
+#include <algorithm>
+#include <map>
 #include <string>
 
 using namespace vw;
@@ -127,6 +129,18 @@ void asp::write_adjustments(std::string const& filename,
   ostr.close();
 }
 
+void asp::compose_adjustments(Vector3 const& position1, Quat const& pose1,
+                              Vector3 const& position2, Quat const& pose2,
+                              Vector3 & position, Quat & pose) {
+
+  // An adjusted camera sees X where the camera it adjusts sees
+  // R^T (X - c - t) + c, with c the center of that camera at the
+  // origin pixel. The center of the first adjusted camera is c + t1,
+  // so the second adjustment turns X into R1^T R2^T (X - c - t1 - t2) + c.
+  position = position1 + position2;
+  pose     = pose2*pose1;
+}
+
 void asp::compute_stereo_residuals(std::vector<boost::shared_ptr<CameraModel> > const& camera_models,
                               ControlNetwork const& cnet) {
 
@@ -155,3 +169,87 @@ void asp::compute_stereo_residuals(std::vector<boost::shared_ptr<CameraModel> >
   vw_out() << "\nStereo Intersection Residuals -- Min: " << min_error
            << "  Max: " << max_error << "  Average: " << (error_sum/n) << "\n";
 }
+
+namespace {
+
+  // The strongest connection from a camera not excluded to the
+  // cameras with the given gains, or false if there is none.
+  bool strongest(std::map<size_t, int> const& gain, std::vector<bool> const& excluded,
+                 size_t & best) {
+    int best_gain = 0;
+    for (std::map<size_t, int>::const_iterator it = gain.begin(); it != gain.end(); it++) {
+      if (excluded[it->first] || it->second <= best_gain) continue;
+      best      = it->first;
+      best_gain = it->second;
+    }
+    return best_gain > 0;
+  }
+
+  void add_gains(std::map<size_t, int> const& weights, std::map<size_t, int> & gain) {
+    for (std::map<size_t, int>::const_iterator it = weights.begin(); it != weights.end(); it++)
+      gain[it->first] += it->second;
+  }
+}
+
+void asp::partition_cameras(std::vector< std::vector<size_t> > const& camera_points,
+                            int max_size, int num_overlap,
+                            std::vector< std::vector<size_t> > & clusters) {
+
+  VW_ASSERT(max_size > 0, ArgumentErr() << "The cluster size must be positive.\n");
+  clusters.clear();
+  size_t num_cameras = camera_points.size();
+
+  // The cameras seeing each point
+  std::map< size_t, std::vector<size_t> > point_cameras;
+  for (size_t icam = 0; icam < num_cameras; icam++)
+    for (size_t p = 0; p < camera_points[icam].size(); p++)
+      point_cameras[camera_points[icam][p]].push_back(icam);
+
+  // The number of points shared by each pair of cameras
+  std::vector< std::map<size_t, int> > weights(num_cameras);
+  for (std::map< size_t, std::vector<size_t> >::const_iterator it = point_cameras.begin();
+       it != point_cameras.end(); it++) {
+    std::vector<size_t> const& cams = it->second;
+    for (size_t i = 0; i < cams.size(); i++) {
+      for (size_t j = 0; j < cams.size(); j++) {
+        if (cams[i] != cams[j])
+          weights[cams[i]][cams[j]]++;
+      }
+    }
+  }
+
+  // Grow each cluster from the first camera not yet assigned, adding
+  // the camera most strongly connected to the cluster so far.
+  std::vector<bool> assigned(num_cameras, false);
+  for (size_t seed = 0; seed < num_cameras; seed++) {
+    if (assigned[seed]) continue;
+
+    std::vector<size_t> cluster(1, seed);
+    assigned[seed] = true;
+    std::map<size_t, int> gain;
+    add_gains(weights[seed], gain);
+    size_t next = 0;
+    while (int(cluster.size()) < max_size && strongest(gain, assigned, next)) {
+      cluster.push_back(next);
+      assigned[next] = true;
+      add_gains(weights[next], gain);
+    }
+    clusters.push_back(cluster);
+  }
+
+  // Extend each cluster into its neighbours
+  for (size_t c = 0; c < clusters.size(); c++) {
+    std::vector<bool> in_cluster(num_cameras, false);
+    std::map<size_t, int> gain;
+    for (size_t i = 0; i < clusters[c].size(); i++) {
+      in_cluster[clusters[c][i]] = true;
+      add_gains(weights[clusters[c][i]], gain);
+    }
+    size_t next = 0;
+    for (int k = 0; k < num_overlap && strongest(gain, in_cluster, next); k++) {
+      clusters[c].push_back(next);
+      in_cluster[next] = true;
+    }
+    std::sort(clusters[c].begin(), clusters[c].end());
+  }
+}
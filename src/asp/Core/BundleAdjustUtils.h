@@ -60,10 +60,30 @@ namespace asp{
                          vw::Vector3 const& position_correction,
                          vw::Quat    const& pose_correction);
 
+  /// The single adjustment of a camera equal to adjusting it first by
+  /// (position1, pose1), then adjusting the result by (position2,
+  /// pose2), as vw::camera::AdjustedCameraModel does it.
+  void compose_adjustments(vw::Vector3 const& position1, vw::Quat const& pose1,
+                           vw::Vector3 const& position2, vw::Quat const& pose2,
+                           vw::Vector3 & position, vw::Quat & pose);
+
   ///
   void compute_stereo_residuals(std::vector<boost::shared_ptr<vw::camera::CameraModel> >
                                 const& camera_models,
                                 vw::ba::ControlNetwork const& cnet);
+
+  /// Split the cameras into clusters for partitioned bundle
+  /// adjustment. Two cameras are connected if they see the same
+  /// points, and the more points they share the stronger the
+  /// connection. Each camera is assigned to one cluster of at most
+  /// max_size cameras grown along the strongest connections. Then
+  /// each cluster is extended by up to num_overlap of the cameras
+  /// outside it most strongly connected to it, so that neighbouring
+  /// clusters share cameras. camera_points lists the points each
+  /// camera sees.
+  void partition_cameras(std::vector< std::vector<size_t> > const& camera_points,
+                         int max_size, int num_overlap,
+                         std::vector< std::vector<size_t> > & clusters);
 }
 
 #endif // __BUNDLE_ADJUST_UTILS_H__
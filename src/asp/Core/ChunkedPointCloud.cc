@@ -0,0 +1,487 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ChunkedPointCloud.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <asp/Core/ChunkedPointCloud.h>
+
+#include <zlib.h>
+#include <cmath>
+#include <cstring>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+
+    const char   CHUNKED_PC_MAGIC[] = "ASPCHUNKEDPC0001";
+    const size_t CHUNKED_PC_MAGIC_LEN = 16;
+
+    // How many decoded blocks to keep in memory per reader
+    const size_t CHUNKED_PC_CACHE_SIZE = 32;
+
+    template <class T>
+    void write_pod(std::ostream & os, T const& val) {
+      os.write(reinterpret_cast<const char*>(&val), sizeof(T));
+    }
+
+    template <class T>
+    void read_pod(std::istream & is, T & val) {
+      is.read(reinterpret_cast<char*>(&val), sizeof(T));
+    }
+
+    // Store small signed numbers in few bytes: zigzag, then 7 bits per byte.
+    void append_varint(std::vector<unsigned char> & buf, int64 val) {
+      uint64 u = (uint64(val) << 1) ^ uint64(val >> 63);
+      while (u >= 0x80) {
+        buf.push_back((unsigned char)(u | 0x80));
+        u >>= 7;
+      }
+      buf.push_back((unsigned char)u);
+    }
+
+    int64 read_varint(std::vector<unsigned char> const& buf, size_t & pos) {
+      uint64 u = 0;
+      int shift = 0;
+      while (true) {
+        if (pos >= buf.size())
+          vw_throw(IOErr() << "Corrupted block in chunked point cloud.\n");
+        unsigned char b = buf[pos++];
+        u |= uint64(b & 0x7f) << shift;
+        if (!(b & 0x80))
+          break;
+        shift += 7;
+      }
+      return int64(u >> 1) ^ -int64(u & 1);
+    }
+
+    std::vector<unsigned char> compress_buffer(std::vector<unsigned char> const& raw) {
+      uLongf len = compressBound(raw.size());
+      std::vector<unsigned char> out(len);
+      if (compress2(&out[0], &len, raw.empty() ? NULL : &raw[0], raw.size(),
+                    Z_DEFAULT_COMPRESSION) != Z_OK)
+        vw_throw(IOErr() << "Failed to compress a point cloud block.\n");
+      out.resize(len);
+      return out;
+    }
+
+    std::vector<unsigned char> uncompress_buffer(std::vector<unsigned char> const& in,
+                                                 uint64 raw_size) {
+      std::vector<unsigned char> raw(raw_size);
+      uLongf len = raw_size;
+      if (raw_size > 0 &&
+          (uncompress(&raw[0], &len, &in[0], in.size()) != Z_OK || len != raw_size))
+        vw_throw(IOErr() << "Failed to uncompress a point cloud block.\n");
+      return raw;
+    }
+
+    void write_block_info(std::ostream & os, PointCloudBlockInfo const& info) {
+      write_pod(os, int32(info.pixel_box.min().x()));
+      write_pod(os, int32(info.pixel_box.min().y()));
+      write_pod(os, int32(info.pixel_box.width()));
+      write_pod(os, int32(info.pixel_box.height()));
+      write_pod(os, info.num_valid);
+      for (int c = 0; c < 3; c++) write_pod(os, info.origin[c]);
+      for (int c = 0; c < 3; c++) write_pod(os, info.point_bbox.min()[c]);
+      for (int c = 0; c < 3; c++) write_pod(os, info.point_bbox.max()[c]);
+      write_pod(os, info.pos_offset); write_pod(os, info.pos_size); write_pod(os, info.pos_raw_size);
+      write_pod(os, info.err_offset); write_pod(os, info.err_size); write_pod(os, info.err_raw_size);
+    }
+
+    void read_block_info(std::istream & is, PointCloudBlockInfo & info) {
+      int32 x, y, w, h;
+      read_pod(is, x); read_pod(is, y); read_pod(is, w); read_pod(is, h);
+      info.pixel_box = BBox2i(x, y, w, h);
+      read_pod(is, info.num_valid);
+      for (int c = 0; c < 3; c++) read_pod(is, info.origin[c]);
+      Vector3 lo, hi;
+      for (int c = 0; c < 3; c++) read_pod(is, lo[c]);
+      for (int c = 0; c < 3; c++) read_pod(is, hi[c]);
+      info.point_bbox = BBox3();
+      if (info.num_valid > 0) {
+        info.point_bbox.grow(lo);
+        info.point_bbox.grow(hi);
+      }
+      read_pod(is, info.pos_offset); read_pod(is, info.pos_size); read_pod(is, info.pos_raw_size);
+      read_pod(is, info.err_offset); read_pod(is, info.err_size); read_pod(is, info.err_raw_size);
+    }
+
+  } // end anonymous namespace
+
+  bool is_chunked_point_cloud(std::string const& file) {
+    std::ifstream is(file.c_str(), std::ios::binary);
+    if (!is.good())
+      return false;
+    char magic[CHUNKED_PC_MAGIC_LEN];
+    is.read(magic, CHUNKED_PC_MAGIC_LEN);
+    return is.good() && std::memcmp(magic, CHUNKED_PC_MAGIC, CHUNKED_PC_MAGIC_LEN) == 0;
+  }
+
+  PointCloudBlockInfo::PointCloudBlockInfo():
+    num_valid(0), pos_offset(0), pos_size(0), pos_raw_size(0),
+    err_offset(0), err_size(0), err_raw_size(0) {
+    for (int c = 0; c < 3; c++)
+      origin[c] = 0;
+  }
+
+  ChunkedPointCloudWriter::ChunkedPointCloudWriter(std::string const& file,
+                                                   Vector2i const& size,
+                                                   int num_channels, int block_size,
+                                                   Vector3 const& shift, double rounding_error,
+                                                   bool has_georef,
+                                                   cartography::GeoReference const& georef):
+    m_file(file), m_size(size), m_num_channels(num_channels), m_block_size(block_size),
+    m_shift(shift), m_rounding_error(rounding_error), m_table_pos_offset(0), m_closed(false) {
+
+    VW_ASSERT(m_num_channels >= 3,
+              ArgumentErr() << "A point cloud must have at least three channels.\n");
+    VW_ASSERT(m_block_size > 0 && m_rounding_error > 0,
+              ArgumentErr() << "Expecting a positive block size and rounding error.\n");
+
+    m_stream.open(file.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!m_stream.good())
+      vw_throw(IOErr() << "Cannot open for writing: " << file << "\n");
+
+    std::string wkt;
+    if (has_georef)
+      wkt = georef.get_wkt();
+
+    m_stream.write(CHUNKED_PC_MAGIC, CHUNKED_PC_MAGIC_LEN);
+    write_pod(m_stream, int32(m_size.x()));
+    write_pod(m_stream, int32(m_size.y()));
+    write_pod(m_stream, int32(m_num_channels));
+    write_pod(m_stream, int32(m_block_size));
+    for (int c = 0; c < 3; c++)
+      write_pod(m_stream, m_shift[c]);
+    write_pod(m_stream, m_rounding_error);
+    write_pod(m_stream, uint64(wkt.size()));
+    m_stream.write(wkt.c_str(), wkt.size());
+
+    // Will be filled in by close()
+    m_table_pos_offset = m_stream.tellp();
+    write_pod(m_stream, uint64(0));
+  }
+
+  ChunkedPointCloudWriter::~ChunkedPointCloudWriter() {
+    if (!m_closed) {
+      try {
+        close();
+      } catch (...) {}
+    }
+  }
+
+  void ChunkedPointCloudWriter::write_block(BBox2i const& pixel_box,
+                                            std::vector<double> const& pixels) {
+
+    const int nc = m_num_channels;
+    const size_t num_pix = size_t(pixel_box.width())*pixel_box.height();
+    VW_ASSERT(pixels.size() == num_pix*nc,
+              ArgumentErr() << "Wrong number of values in point cloud block.\n");
+
+    PointCloudBlockInfo info;
+    info.pixel_box = pixel_box;
+
+    // Quantize the points relative to the shift, and find the block origin
+    std::vector<unsigned char> mask((num_pix + 7)/8, 0);
+    std::vector<int64> quant;
+    quant.reserve(num_pix*nc);
+    int64 lo[3] = {0, 0, 0};
+    for (size_t k = 0; k < num_pix; k++) {
+      double const* p = &pixels[k*nc];
+      if (p[0] == 0 && p[1] == 0 && p[2] == 0)
+        continue;
+      mask[k/8] |= (unsigned char)(1 << (k % 8));
+      for (int c = 0; c < nc; c++) {
+        double val = (c < 3) ? p[c] - m_shift[c] : p[c];
+        int64 q = (int64)std::floor(val/m_rounding_error + 0.5);
+        quant.push_back(q);
+        if (c < 3 && (info.num_valid == 0 || q < lo[c]))
+          lo[c] = q;
+      }
+      info.num_valid++;
+    }
+
+    // Positions relative to the block origin, delta-encoded along the
+    // valid pixels of each channel, followed by the error channels in
+    // their own stream.
+    std::vector<unsigned char> pos_raw = mask, err_raw;
+    for (int c = 0; c < nc; c++) {
+      std::vector<unsigned char> & buf = (c < 3) ? pos_raw : err_raw;
+      int64 origin = (c < 3 && info.num_valid > 0) ? lo[c] : 0;
+      int64 prev = 0;
+      for (uint64 k = 0; k < info.num_valid; k++) {
+        int64 q = quant[k*nc + c] - origin;
+        append_varint(buf, q - prev);
+        prev = q;
+      }
+    }
+
+    if (info.num_valid > 0) {
+      for (int c = 0; c < 3; c++)
+        info.origin[c] = lo[c];
+      for (uint64 k = 0; k < info.num_valid; k++) {
+        Vector3 pt;
+        for (int c = 0; c < 3; c++)
+          pt[c] = quant[k*nc + c]*m_rounding_error + m_shift[c];
+        info.point_bbox.grow(pt);
+      }
+    }
+
+    std::vector<unsigned char> pos_buf = compress_buffer(pos_raw);
+    std::vector<unsigned char> err_buf = compress_buffer(err_raw);
+    info.pos_raw_size = pos_raw.size();
+    info.err_raw_size = err_raw.size();
+    append_block(info, pos_buf, err_buf);
+  }
+
+  void ChunkedPointCloudWriter::write_encoded_block(PointCloudBlockInfo const& info,
+                                                    std::vector<unsigned char> const& pos_buf,
+                                                    std::vector<unsigned char> const& err_buf) {
+    append_block(info, pos_buf, err_buf);
+  }
+
+  // Write the compressed streams of a block, and record where they are
+  void ChunkedPointCloudWriter::append_block(PointCloudBlockInfo info,
+                                             std::vector<unsigned char> const& pos_buf,
+                                             std::vector<unsigned char> const& err_buf) {
+    info.pos_size = pos_buf.size();
+    info.err_size = err_buf.size();
+
+    Mutex::Lock lock(m_mutex);
+    if (m_closed)
+      vw_throw(LogicErr() << "Cannot add blocks after closing " << m_file << "\n");
+    info.pos_offset = m_stream.tellp();
+    if (!pos_buf.empty())
+      m_stream.write(reinterpret_cast<const char*>(&pos_buf[0]), pos_buf.size());
+    info.err_offset = m_stream.tellp();
+    if (!err_buf.empty())
+      m_stream.write(reinterpret_cast<const char*>(&err_buf[0]), err_buf.size());
+    if (!m_stream.good())
+      vw_throw(IOErr() << "Failed writing to: " << m_file << "\n");
+    m_blocks.push_back(info);
+  }
+
+  void ChunkedPointCloudWriter::close() {
+    Mutex::Lock lock(m_mutex);
+    if (m_closed)
+      return;
+    m_closed = true;
+
+    // Sort the blocks so that the reader can find them by position
+    int bpr = (m_size.x() + m_block_size - 1)/m_block_size;
+    int bpc = (m_size.y() + m_block_size - 1)/m_block_size;
+    std::vector<PointCloudBlockInfo> table(size_t(bpr)*bpc);
+    std::vector<bool> found(table.size(), false);
+    for (size_t i = 0; i < m_blocks.size(); i++) {
+      BBox2i const& box = m_blocks[i].pixel_box;
+      if (box.min().x() % m_block_size != 0 || box.min().y() % m_block_size != 0)
+        vw_throw(ArgumentErr() << "Point cloud blocks must start at multiples of the block size.\n");
+      size_t index = size_t(box.min().y()/m_block_size)*bpr + box.min().x()/m_block_size;
+      if (index >= table.size() || found[index])
+        vw_throw(ArgumentErr() << "Invalid or duplicate point cloud block: " << box << "\n");
+      table[index] = m_blocks[i];
+      found[index] = true;
+    }
+    for (size_t i = 0; i < found.size(); i++) {
+      if (!found[i])
+        vw_throw(ArgumentErr() << "Missing blocks when writing point cloud: " << m_file << "\n");
+    }
+
+    uint64 table_offset = m_stream.tellp();
+    write_pod(m_stream, uint64(table.size()));
+    for (size_t i = 0; i < table.size(); i++)
+      write_block_info(m_stream, table[i]);
+    m_stream.seekp(m_table_pos_offset);
+    write_pod(m_stream, table_offset);
+    m_stream.close();
+    if (m_stream.fail())
+      vw_throw(IOErr() << "Failed writing to: " << m_file << "\n");
+  }
+
+  uint64 ChunkedPointCloudWriter::compressed_size() const {
+    uint64 size = 0;
+    for (size_t i = 0; i < m_blocks.size(); i++)
+      size += m_blocks[i].pos_size + m_blocks[i].err_size;
+    return size;
+  }
+
+  ChunkedPointCloudReader::ChunkedPointCloudReader(std::string const& file):
+    m_file(file) {
+
+    std::ifstream is(file.c_str(), std::ios::binary);
+    char magic[CHUNKED_PC_MAGIC_LEN];
+    is.read(magic, CHUNKED_PC_MAGIC_LEN);
+    if (!is.good() || std::memcmp(magic, CHUNKED_PC_MAGIC, CHUNKED_PC_MAGIC_LEN) != 0)
+      vw_throw(IOErr() << "Not a chunked point cloud: " << file << "\n");
+
+    int32 cols, rows, nc, bs;
+    read_pod(is, cols); read_pod(is, rows); read_pod(is, nc); read_pod(is, bs);
+    m_size = Vector2i(cols, rows);
+    m_num_channels = nc;
+    m_block_size = bs;
+    for (int c = 0; c < 3; c++)
+      read_pod(is, m_shift[c]);
+    read_pod(is, m_rounding_error);
+    uint64 wkt_len = 0;
+    read_pod(is, wkt_len);
+    m_wkt.resize(wkt_len);
+    if (wkt_len > 0)
+      is.read(&m_wkt[0], wkt_len);
+    uint64 table_offset = 0;
+    read_pod(is, table_offset);
+    if (!is.good() || table_offset == 0 || m_block_size <= 0)
+      vw_throw(IOErr() << "Incomplete chunked point cloud: " << file << "\n");
+
+    is.seekg(table_offset);
+    uint64 num_blocks = 0;
+    read_pod(is, num_blocks);
+    m_blocks_per_row = (m_size.x() + m_block_size - 1)/m_block_size;
+    int bpc = (m_size.y() + m_block_size - 1)/m_block_size;
+    if (num_blocks != uint64(m_blocks_per_row)*bpc)
+      vw_throw(IOErr() << "Inconsistent block table in: " << file << "\n");
+    m_blocks.resize(num_blocks);
+    for (size_t i = 0; i < m_blocks.size(); i++)
+      read_block_info(is, m_blocks[i]);
+    if (!is.good())
+      vw_throw(IOErr() << "Failed reading the block table of: " << file << "\n");
+  }
+
+  bool ChunkedPointCloudReader::read_georeference(cartography::GeoReference & georef) const {
+    if (m_wkt.empty())
+      return false;
+    georef.set_wkt(m_wkt);
+    return true;
+  }
+
+  BBox3 ChunkedPointCloudReader::point_bbox() const {
+    BBox3 bbox;
+    for (size_t i = 0; i < m_blocks.size(); i++) {
+      if (m_blocks[i].num_valid > 0)
+        bbox.grow(m_blocks[i].point_bbox);
+    }
+    return bbox;
+  }
+
+  std::vector<int> ChunkedPointCloudReader::blocks_intersecting(BBox2i const& pixel_box) const {
+    std::vector<int> indices;
+    BBox2i box = pixel_box;
+    box.crop(BBox2i(0, 0, m_size.x(), m_size.y()));
+    if (box.empty())
+      return indices;
+    int bx0 = box.min().x()/m_block_size, bx1 = (box.max().x() - 1)/m_block_size;
+    int by0 = box.min().y()/m_block_size, by1 = (box.max().y() - 1)/m_block_size;
+    for (int by = by0; by <= by1; by++)
+      for (int bx = bx0; bx <= bx1; bx++)
+        indices.push_back(by*m_blocks_per_row + bx);
+    return indices;
+  }
+
+  ChunkedPointCloudReader::BlockPtr
+  ChunkedPointCloudReader::read_block(int index) const {
+
+    {
+      Mutex::Lock lock(m_cache_mutex);
+      for (std::list<std::pair<int, BlockPtr> >::iterator it = m_cache.begin();
+           it != m_cache.end(); it++) {
+        if (it->first == index) {
+          std::pair<int, BlockPtr> entry = *it;
+          m_cache.erase(it);
+          m_cache.push_front(entry);
+          return entry.second;
+        }
+      }
+    }
+
+    PointCloudBlockInfo const& info = m_blocks[index];
+    const int nc = m_num_channels;
+    const size_t num_pix = size_t(info.pixel_box.width())*info.pixel_box.height();
+    boost::shared_ptr<std::vector<double> > block(new std::vector<double>(num_pix*nc, 0.0));
+
+    if (info.num_valid > 0) {
+      // Each call has its own stream, so reads can happen in parallel
+      std::ifstream is(m_file.c_str(), std::ios::binary);
+      std::vector<unsigned char> pos_buf(info.pos_size), err_buf(info.err_size);
+      is.seekg(info.pos_offset);
+      is.read(reinterpret_cast<char*>(&pos_buf[0]), pos_buf.size());
+      if (!err_buf.empty()) {
+        is.seekg(info.err_offset);
+        is.read(reinterpret_cast<char*>(&err_buf[0]), err_buf.size());
+      }
+      if (!is.good())
+        vw_throw(IOErr() << "Failed reading a block of: " << m_file << "\n");
+
+      std::vector<unsigned char> pos_raw = uncompress_buffer(pos_buf, info.pos_raw_size);
+      std::vector<unsigned char> err_raw = uncompress_buffer(err_buf, info.err_raw_size);
+
+      // Locations of the valid pixels
+      size_t mask_len = (num_pix + 7)/8;
+      if (pos_raw.size() < mask_len)
+        vw_throw(IOErr() << "Corrupted block in: " << m_file << "\n");
+      std::vector<size_t> valid;
+      valid.reserve(info.num_valid);
+      for (size_t k = 0; k < num_pix; k++) {
+        if (pos_raw[k/8] & (1 << (k % 8)))
+          valid.push_back(k);
+      }
+      if (valid.size() != info.num_valid)
+        vw_throw(IOErr() << "Corrupted block in: " << m_file << "\n");
+
+      size_t pos_pos = mask_len, err_pos = 0;
+      for (int c = 0; c < nc; c++) {
+        bool is_pos = (c < 3);
+        int64 origin = is_pos ? info.origin[c] : 0;
+        double shift = is_pos ? m_shift[c] : 0.0;
+        int64 q = 0;
+        for (size_t k = 0; k < valid.size(); k++) {
+          q += is_pos ? read_varint(pos_raw, pos_pos) : read_varint(err_raw, err_pos);
+          (*block)[valid[k]*nc + c] = (origin + q)*m_rounding_error + shift;
+        }
+      }
+    }
+
+    Mutex::Lock lock(m_cache_mutex);
+    m_cache.push_front(std::make_pair(index, BlockPtr(block)));
+    if (m_cache.size() > CHUNKED_PC_CACHE_SIZE)
+      m_cache.pop_back();
+    return block;
+  }
+
+  void ChunkedPointCloudReader::read_encoded_block(int index,
+                                                   std::vector<unsigned char> & pos_buf,
+                                                   std::vector<unsigned char> & err_buf) const {
+    PointCloudBlockInfo const& info = m_blocks[index];
+    pos_buf.resize(info.pos_size);
+    err_buf.resize(info.err_size);
+    std::ifstream is(m_file.c_str(), std::ios::binary);
+    if (!pos_buf.empty()) {
+      is.seekg(info.pos_offset);
+      is.read(reinterpret_cast<char*>(&pos_buf[0]), pos_buf.size());
+    }
+    if (!err_buf.empty()) {
+      is.seekg(info.err_offset);
+      is.read(reinterpret_cast<char*>(&err_buf[0]), err_buf.size());
+    }
+    if (!is.good())
+      vw_throw(IOErr() << "Failed reading a block of: " << m_file << "\n");
+  }
+
+} // namespace asp
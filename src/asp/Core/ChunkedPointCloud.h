@@ -0,0 +1,483 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ChunkedPointCloud.h
+///
+/// A native container for the point clouds written by stereo_tri, as
+/// an alternative to the PC.tif GeoTIFF. The image is split into
+/// blocks. Each block has a header with its pixel extent, the number of
+/// valid points, and the 3D bounds of those points, so that readers can
+/// skip blocks without decoding them. Positions are quantized to the
+/// rounding error relative to the block origin and delta-encoded, the
+/// error channels are quantized and compressed in a separate stream,
+/// and invalid pixels are stored as a bit mask only.
+///
+/// The file layout is: a fixed header (magic string, image size, number
+/// of channels, block size, point offset, rounding error, georeference
+/// WKT, offset of the block table), then the compressed blocks in the
+/// order in which they were finished, then the block table. Numbers are
+/// stored in the byte order of the machine which wrote the file.
+
+#ifndef __ASP_CORE_CHUNKED_POINT_CLOUD_H__
+#define __ASP_CORE_CHUNKED_POINT_CLOUD_H__
+
+#include <vw/Core/FundamentalTypes.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelAccessors.h>
+#include <vw/Cartography/GeoReference.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <fstream>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// Return true if the file starts with the chunked point cloud magic string.
+  bool is_chunked_point_cloud(std::string const& file);
+
+  /// The header of one block of a chunked point cloud. The bounds are
+  /// in the same absolute coordinates as the points.
+  struct PointCloudBlockInfo {
+    vw::BBox2i  pixel_box;
+    vw::uint64  num_valid;
+    vw::int64   origin[3];   // block origin, in units of the rounding error
+    vw::BBox3   point_bbox;  // bounds of the valid points
+    vw::uint64  pos_offset, pos_size, pos_raw_size;
+    vw::uint64  err_offset, err_size, err_raw_size;
+    PointCloudBlockInfo();
+  };
+
+  /// Writes a chunked point cloud. Blocks can be added from several
+  /// threads and in any order.
+  class ChunkedPointCloudWriter: private boost::noncopyable {
+    std::ofstream m_stream;
+    std::string   m_file;
+    vw::Vector2i  m_size;
+    int           m_num_channels, m_block_size;
+    vw::Vector3   m_shift;
+    double        m_rounding_error;
+    std::streamoff m_table_pos_offset;
+    std::vector<PointCloudBlockInfo> m_blocks;
+    vw::Mutex     m_mutex;
+    bool          m_closed;
+
+    void append_block(PointCloudBlockInfo info, std::vector<unsigned char> const& pos_buf,
+                      std::vector<unsigned char> const& err_buf);
+  public:
+    /// Create the file. Points are written relative to the shift and
+    /// rounded to multiples of the rounding error.
+    ChunkedPointCloudWriter(std::string const& file, vw::Vector2i const& size,
+                            int num_channels, int block_size,
+                            vw::Vector3 const& shift, double rounding_error,
+                            bool has_georef, vw::cartography::GeoReference const& georef);
+    ~ChunkedPointCloudWriter();
+
+    /// Encode and append one block. The pixels have num_channels values
+    /// each and are in row-major order. A point whose first three values
+    /// are zero is invalid.
+    void write_block(vw::BBox2i const& pixel_box, std::vector<double> const& pixels);
+
+    /// Append one block as it was encoded in another chunked point
+    /// cloud, as returned by ChunkedPointCloudReader::read_encoded_block().
+    /// That cloud must have the same number of channels, shift, and
+    /// rounding error as this one.
+    void write_encoded_block(PointCloudBlockInfo const& info,
+                             std::vector<unsigned char> const& pos_buf,
+                             std::vector<unsigned char> const& err_buf);
+
+    /// Write the block table. The blocks must cover the image.
+    void close();
+
+    /// Total size of the compressed blocks written so far.
+    vw::uint64 compressed_size() const;
+  };
+
+  /// Reads a chunked point cloud. Decoded blocks are cached, and reads
+  /// may be done from several threads.
+  class ChunkedPointCloudReader: private boost::noncopyable {
+    std::string   m_file;
+    vw::Vector2i  m_size;
+    int           m_num_channels, m_block_size;
+    vw::Vector3   m_shift;
+    double        m_rounding_error;
+    std::string   m_wkt;
+    std::vector<PointCloudBlockInfo> m_blocks;   // in row-major block order
+    int           m_blocks_per_row;
+
+    typedef boost::shared_ptr<const std::vector<double> > BlockPtr;
+    mutable vw::Mutex m_cache_mutex;
+    mutable std::list<std::pair<int, BlockPtr> > m_cache;
+  public:
+    explicit ChunkedPointCloudReader(std::string const& file);
+
+    int cols        () const { return m_size.x(); }
+    int rows        () const { return m_size.y(); }
+    int num_channels() const { return m_num_channels; }
+    int block_size  () const { return m_block_size; }
+    vw::Vector3 const& shift() const { return m_shift; }
+    double rounding_error() const { return m_rounding_error; }
+
+    /// Return false if no georeference was saved.
+    bool read_georeference(vw::cartography::GeoReference & georef) const;
+
+    std::vector<PointCloudBlockInfo> const& blocks() const { return m_blocks; }
+
+    /// The bounds of all valid points, found from the block headers only.
+    vw::BBox3 point_bbox() const;
+
+    /// Indices of the blocks which intersect the given pixel box.
+    std::vector<int> blocks_intersecting(vw::BBox2i const& pixel_box) const;
+
+    /// The decoded block, with num_channels values per pixel in
+    /// row-major order, in absolute coordinates. Invalid points are zero.
+    BlockPtr read_block(int index) const;
+
+    /// The compressed streams of a block, as stored, without decoding them.
+    void read_encoded_block(int index, std::vector<unsigned char> & pos_buf,
+                            std::vector<unsigned char> & err_buf) const;
+  };
+
+  /// An image view which reads the first m channels of a chunked
+  /// point cloud, decoding only the blocks which are needed.
+  template <int m>
+  class ChunkedPointCloudView: public vw::ImageViewBase<ChunkedPointCloudView<m> > {
+    boost::shared_ptr<ChunkedPointCloudReader> m_reader;
+  public:
+    typedef vw::Vector<double, m> pixel_type;
+    typedef pixel_type            result_type;
+    typedef vw::ProceduralPixelAccessor<ChunkedPointCloudView<m> > pixel_accessor;
+
+    ChunkedPointCloudView(boost::shared_ptr<ChunkedPointCloudReader> reader):
+      m_reader(reader) {
+      VW_ASSERT(m <= m_reader->num_channels(),
+                vw::ArgumentErr() << "Cannot read " << m << " channels from a point cloud with "
+                << m_reader->num_channels() << " channels.\n");
+    }
+
+    inline vw::int32 cols  () const { return m_reader->cols(); }
+    inline vw::int32 rows  () const { return m_reader->rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+    /// Slow, as it may decode a whole block for one pixel.
+    inline result_type operator()(int col, int row, int /*p*/ = 0) const {
+      return prerasterize(vw::BBox2i(col, row, 1, 1))(col, row);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> tile(bbox.width(), bbox.height());
+      int nc = m_reader->num_channels();
+      std::vector<int> indices = m_reader->blocks_intersecting(bbox);
+      for (size_t i = 0; i < indices.size(); i++) {
+        vw::BBox2i block_box = m_reader->blocks()[indices[i]].pixel_box;
+        boost::shared_ptr<const std::vector<double> > block = m_reader->read_block(indices[i]);
+        vw::BBox2i box = block_box;
+        box.crop(bbox);
+        for (int row = box.min().y(); row < box.max().y(); row++) {
+          for (int col = box.min().x(); col < box.max().x(); col++) {
+            size_t k = nc*(size_t(row - block_box.min().y())*block_box.width()
+                           + (col - block_box.min().x()));
+            pixel_type & pix = tile(col - bbox.min().x(), row - bbox.min().y());
+            for (int c = 0; c < m; c++)
+              pix[c] = (*block)[k + c];
+          }
+        }
+      }
+      return vw::crop(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// Read the first m channels of a chunked point cloud.
+  template <int m>
+  ChunkedPointCloudView<m> read_chunked_point_cloud(std::string const& file) {
+    boost::shared_ptr<ChunkedPointCloudReader> reader(new ChunkedPointCloudReader(file));
+    return ChunkedPointCloudView<m>(reader);
+  }
+
+  namespace chunked_pc_private {
+
+    /// Rasterize one block of the point cloud and hand it to the writer.
+    template <class ImageT>
+    class WriteBlockTask: public vw::Task, private boost::noncopyable {
+      ImageT                    m_image;
+      vw::BBox2i                m_box;
+      ChunkedPointCloudWriter & m_writer;
+      vw::Mutex               & m_mutex;
+      int                     & m_num_done;
+      int                       m_num_blocks;
+      vw::ProgressCallback const& m_progress;
+    public:
+      WriteBlockTask(ImageT const& image, vw::BBox2i const& box,
+                     ChunkedPointCloudWriter & writer, vw::Mutex & mutex,
+                     int & num_done, int num_blocks, vw::ProgressCallback const& progress):
+        m_image(image), m_box(box), m_writer(writer), m_mutex(mutex),
+        m_num_done(num_done), m_num_blocks(num_blocks), m_progress(progress) {}
+
+      void operator()() {
+        typedef typename ImageT::pixel_type PixelT;
+        const int nc = vw::math::VectorSize<PixelT>::value;
+        vw::ImageView<PixelT> tile = vw::crop(m_image, m_box);
+        std::vector<double> pixels(size_t(nc)*tile.cols()*tile.rows());
+        size_t k = 0;
+        for (int row = 0; row < tile.rows(); row++) {
+          for (int col = 0; col < tile.cols(); col++) {
+            for (int c = 0; c < nc; c++)
+              pixels[k++] = tile(col, row)[c];
+          }
+        }
+        m_writer.write_block(m_box, pixels);
+
+        vw::Mutex::Lock lock(m_mutex);
+        m_num_done++;
+        m_progress.report_fractional_progress(m_num_done, m_num_blocks);
+      }
+    };
+
+    /// Copy the parts of the tiles which fall in one block to the writer.
+    template <int m>
+    class MergeTilesTask: public vw::Task, private boost::noncopyable {
+      typedef vw::Vector<double, m> PixelT;
+      std::vector<vw::ImageViewRef<PixelT> > const& m_tiles;
+      std::vector<vw::BBox2i>            const& m_tile_boxes;
+      vw::BBox2i                m_box;
+      ChunkedPointCloudWriter & m_writer;
+      vw::Mutex               & m_mutex;
+      int                     & m_num_done;
+      int                       m_num_blocks;
+      vw::ProgressCallback const& m_progress;
+    public:
+      MergeTilesTask(std::vector<vw::ImageViewRef<PixelT> > const& tiles,
+                     std::vector<vw::BBox2i> const& tile_boxes, vw::BBox2i const& box,
+                     ChunkedPointCloudWriter & writer, vw::Mutex & mutex,
+                     int & num_done, int num_blocks, vw::ProgressCallback const& progress):
+        m_tiles(tiles), m_tile_boxes(tile_boxes), m_box(box), m_writer(writer),
+        m_mutex(mutex), m_num_done(num_done), m_num_blocks(num_blocks), m_progress(progress) {}
+
+      void operator()() {
+        // Points not in any tile are invalid, so zero
+        std::vector<double> pixels(size_t(m)*m_box.width()*m_box.height(), 0.0);
+        for (size_t t = 0; t < m_tiles.size(); t++) {
+          vw::BBox2i piece = m_tile_boxes[t];
+          piece.crop(m_box);
+          if (piece.width() <= 0 || piece.height() <= 0)
+            continue;
+          vw::ImageView<PixelT> tile = vw::crop(m_tiles[t], piece);
+          for (int row = 0; row < tile.rows(); row++) {
+            for (int col = 0; col < tile.cols(); col++) {
+              size_t k = m*(size_t(row + piece.min().y() - m_box.min().y())*m_box.width()
+                            + (col + piece.min().x() - m_box.min().x()));
+              for (int c = 0; c < m; c++)
+                pixels[k + c] = tile(col, row)[c];
+            }
+          }
+        }
+        m_writer.write_block(m_box, pixels);
+
+        vw::Mutex::Lock lock(m_mutex);
+        m_num_done++;
+        m_progress.report_fractional_progress(m_num_done, m_num_blocks);
+      }
+    };
+
+    /// Copy a block of a chunked tile to the writer as it is encoded.
+    class CopyBlockTask: public vw::Task, private boost::noncopyable {
+      ChunkedPointCloudReader const& m_reader;
+      int                       m_index;
+      ChunkedPointCloudWriter & m_writer;
+      vw::Mutex               & m_mutex;
+      int                     & m_num_done;
+      int                       m_num_blocks;
+      vw::ProgressCallback const& m_progress;
+    public:
+      CopyBlockTask(ChunkedPointCloudReader const& reader, int index,
+                    ChunkedPointCloudWriter & writer, vw::Mutex & mutex,
+                    int & num_done, int num_blocks, vw::ProgressCallback const& progress):
+        m_reader(reader), m_index(index), m_writer(writer), m_mutex(mutex),
+        m_num_done(num_done), m_num_blocks(num_blocks), m_progress(progress) {}
+
+      void operator()() {
+        std::vector<unsigned char> pos_buf, err_buf;
+        m_reader.read_encoded_block(m_index, pos_buf, err_buf);
+        m_writer.write_encoded_block(m_reader.blocks()[m_index], pos_buf, err_buf);
+
+        vw::Mutex::Lock lock(m_mutex);
+        m_num_done++;
+        m_progress.report_fractional_progress(m_num_done, m_num_blocks);
+      }
+    };
+  }
+
+  /// Write a point cloud image with 3, 4, or 6 channels to a chunked
+  /// point cloud file. The blocks are computed and compressed using
+  /// the given number of threads.
+  template <class ImageT>
+  void write_chunked_point_cloud(std::string const& file,
+                                 vw::Vector3 const& shift, double rounding_error,
+                                 vw::ImageViewBase<ImageT> const& image,
+                                 bool has_georef,
+                                 vw::cartography::GeoReference const& georef,
+                                 int block_size, int num_threads,
+                                 vw::ProgressCallback const& progress) {
+
+    typedef typename ImageT::pixel_type PixelT;
+    const int nc = vw::math::VectorSize<PixelT>::value;
+    ChunkedPointCloudWriter writer(file, vw::Vector2i(image.impl().cols(), image.impl().rows()),
+                                   nc, block_size, shift, rounding_error, has_georef, georef);
+
+    std::vector<vw::BBox2i> boxes = vw::image_blocks(image.impl(), block_size, block_size);
+    vw::Mutex mutex;
+    int num_done = 0;
+    progress.report_progress(0);
+    vw::FifoWorkQueue queue(std::max(num_threads, 1));
+    for (size_t i = 0; i < boxes.size(); i++) {
+      boost::shared_ptr<chunked_pc_private::WriteBlockTask<ImageT> >
+        task(new chunked_pc_private::WriteBlockTask<ImageT>
+             (image.impl(), boxes[i], writer, mutex, num_done, boxes.size(), progress));
+      queue.add_task(task);
+    }
+    queue.join_all();
+    writer.close();
+    progress.report_finished();
+  }
+
+  /// Merge the point cloud tiles made by parallel_stereo into one
+  /// chunked point cloud of the given size. Each tile is an image of
+  /// that size, in absolute coordinates, of which only the pixels in
+  /// its box are used. The tiles are read block by block, as each
+  /// block of the output is written, and pixels which are in no tile
+  /// are invalid.
+  ///
+  /// A tile may also be given as the reader of its chunked point
+  /// cloud, or a null pointer if it is not one. If such a tile has the
+  /// same number of channels, block size, shift, and rounding error as
+  /// the output, its blocks which are inside its box and in no other
+  /// box are copied as they are encoded, without decoding them.
+  /// Returns the number of blocks copied that way.
+  template <int m>
+  int merge_point_cloud_tiles(std::string const& file, vw::Vector2i const& size,
+                              std::vector<vw::ImageViewRef<vw::Vector<double, m> > > const& tiles,
+                              std::vector<boost::shared_ptr<ChunkedPointCloudReader> >
+                              const& chunked_tiles,
+                              std::vector<vw::BBox2i> const& tile_boxes,
+                              vw::Vector3 const& shift, double rounding_error,
+                              bool has_georef, vw::cartography::GeoReference const& georef,
+                              int block_size, int num_threads,
+                              vw::ProgressCallback const& progress) {
+
+    VW_ASSERT(tiles.size() == tile_boxes.size(),
+              vw::ArgumentErr() << "merge_point_cloud_tiles: Each tile must have a box.\n");
+    VW_ASSERT(chunked_tiles.empty() || chunked_tiles.size() == tiles.size(),
+              vw::ArgumentErr() << "merge_point_cloud_tiles: Expecting a reader per tile.\n");
+    for (size_t t = 0; t < tiles.size(); t++) {
+      if (tiles[t].cols() != size.x() || tiles[t].rows() != size.y())
+        vw_throw(vw::ArgumentErr() << "merge_point_cloud_tiles: Expecting tiles of size "
+                                   << size << ".\n");
+    }
+
+    // The tiles whose blocks are encoded as they would be in the output
+    std::vector<bool> can_copy(tiles.size(), false);
+    for (size_t t = 0; t < chunked_tiles.size(); t++) {
+      ChunkedPointCloudReader const* reader = chunked_tiles[t].get();
+      can_copy[t] = (reader != NULL && reader->num_channels() == m &&
+                     reader->block_size() == block_size && reader->shift() == shift &&
+                     reader->rounding_error() == rounding_error &&
+                     reader->cols() == size.x() && reader->rows() == size.y());
+    }
+
+    ChunkedPointCloudWriter writer(file, size, m, block_size, shift, rounding_error,
+                                   has_georef, georef);
+
+    std::vector<vw::BBox2i> boxes = vw::image_blocks(vw::BBox2i(0, 0, size.x(), size.y()),
+                                                     block_size, block_size);
+    vw::Mutex mutex;
+    int num_done = 0, num_copied = 0;
+    progress.report_progress(0);
+    vw::FifoWorkQueue queue(std::max(num_threads, 1));
+    for (size_t i = 0; i < boxes.size(); i++) {
+
+      // The block can be copied if it is all from one tile
+      int src = -1, num_touching = 0;
+      for (size_t t = 0; t < tile_boxes.size(); t++) {
+        vw::BBox2i piece = tile_boxes[t];
+        piece.crop(boxes[i]);
+        if (piece.width() <= 0 || piece.height() <= 0)
+          continue;
+        num_touching++;
+        if (piece == boxes[i])
+          src = int(t);
+      }
+      if (num_touching == 1 && src >= 0 && can_copy[src]) {
+        ChunkedPointCloudReader const& reader = *chunked_tiles[src];
+        std::vector<int> indices = reader.blocks_intersecting(boxes[i]);
+        if (indices.size() == 1 && reader.blocks()[indices[0]].pixel_box == boxes[i]) {
+          boost::shared_ptr<chunked_pc_private::CopyBlockTask>
+            task(new chunked_pc_private::CopyBlockTask
+                 (reader, indices[0], writer, mutex, num_done, boxes.size(), progress));
+          queue.add_task(task);
+          num_copied++;
+          continue;
+        }
+      }
+
+      boost::shared_ptr<chunked_pc_private::MergeTilesTask<m> >
+        task(new chunked_pc_private::MergeTilesTask<m>
+             (tiles, tile_boxes, boxes[i], writer, mutex, num_done, boxes.size(), progress));
+      queue.add_task(task);
+    }
+    queue.join_all();
+    writer.close();
+    progress.report_finished();
+    return num_copied;
+  }
+
+  /// As above, decoding all the tiles.
+  template <int m>
+  void merge_point_cloud_tiles(std::string const& file, vw::Vector2i const& size,
+                               std::vector<vw::ImageViewRef<vw::Vector<double, m> > > const& tiles,
+                               std::vector<vw::BBox2i> const& tile_boxes,
+                               vw::Vector3 const& shift, double rounding_error,
+                               bool has_georef, vw::cartography::GeoReference const& georef,
+                               int block_size, int num_threads,
+                               vw::ProgressCallback const& progress) {
+    merge_point_cloud_tiles<m>(file, size, tiles,
+                               std::vector<boost::shared_ptr<ChunkedPointCloudReader> >(),
+                               tile_boxes, shift, rounding_error, has_georef, georef,
+                               block_size, num_threads, progress);
+  }
+
+} // namespace asp
+
+#endif//__ASP_CORE_CHUNKED_POINT_CLOUD_H__
@@ -19,6 +19,7 @@
 /// \file DEMDisparity.cc
 ///
 
+#include <vw/Core/Thread.h>
 #include <vw/Image/ImageView.h>
 #include <vw/Image/Transform.h>
 #include <vw/Image/MaskViews.h>
@@ -39,6 +40,85 @@ using namespace vw::cartography;
 
 namespace asp {
 
+namespace {
+
+  // How much work the ray-DEM intersections took, over all tiles
+  struct DemIntersectionStats {
+    vw::Mutex mutex;
+    vw::int64 num_pixels, num_iterations, num_fallbacks;
+    DemIntersectionStats(): num_pixels(0), num_iterations(0), num_fallbacks(0) {}
+  };
+
+  // The height of a point above the DEM below it, interpolated
+  // bilinearly. Return false if the DEM is not valid there.
+  bool height_above_dem(Vector3 const& xyz, ImageView<PixelMask<float> > const& dem,
+                        GeoReference const& georef, double & height) {
+    Vector3 llh = georef.datum().cartesian_to_geodetic(xyz);
+    Vector2 pix = georef.lonlat_to_pixel(subvector(llh, 0, 2));
+    int c = floor(pix[0]), r = floor(pix[1]);
+    if (c < 0 || r < 0 || c + 1 >= dem.cols() || r + 1 >= dem.rows())
+      return false;
+    if (!is_valid(dem(c, r))   || !is_valid(dem(c+1, r)) ||
+        !is_valid(dem(c, r+1)) || !is_valid(dem(c+1, r+1)))
+      return false;
+    double x = pix[0] - c, y = pix[1] - r;
+    double h = (1-x)*(1-y)*dem(c, r).child()   + x*(1-y)*dem(c+1, r).child()
+             + (1-x)*y    *dem(c, r+1).child() + x*y    *dem(c+1, r+1).child();
+    height = llh[2] - h;
+    return true;
+  }
+
+  // Distance along a ray from the camera center to the datum
+  // ellipsoid raised by the given height. Return -1 if it is missed.
+  double datum_distance(Datum const& datum, double height,
+                        Vector3 const& ctr, Vector3 const& dir) {
+    double a = datum.semi_major_axis() + height, b = datum.semi_minor_axis() + height;
+    Vector3 c(ctr[0], ctr[1], ctr[2]*a/b), d(dir[0], dir[1], dir[2]*a/b);
+    double A = dot_prod(d, d), B = 2*dot_prod(c, d), C = dot_prod(c, c) - a*a;
+    double disc = B*B - 4*A*C;
+    if (disc < 0)
+      return -1;
+    return (-B - sqrt(disc))/(2*A);
+  }
+
+  // Intersect a ray with a DEM held in memory. Search with the secant
+  // method for the distance t along the ray at which the point on it is
+  // at the height of the DEM. The search starts at t0, which is
+  // usually the distance found for a neighboring pixel, so it
+  // converges in a couple of iterations. Return false if it fails.
+  bool ray_dem_intersection(Vector3 const& ctr, Vector3 const& dir,
+                            ImageView<PixelMask<float> > const& dem, GeoReference const& georef,
+                            double t0, double height_tol, int max_iter,
+                            Vector3 & xyz, int & num_iter) {
+    num_iter = 0;
+    double g0;
+    if (t0 <= 0 || !height_above_dem(ctr + t0*dir, dem, georef, g0))
+      return false;
+
+    // The first step assumes the terrain is flat
+    double slope = dot_prod(dir, normalize(ctr + t0*dir)); // height change per unit of t
+    if (slope >= 0)
+      return false;
+    double t1 = t0 - g0/slope, g1 = g0;
+    while (num_iter < max_iter) {
+      num_iter++;
+      if (!height_above_dem(ctr + t1*dir, dem, georef, g1))
+        return false;
+      if (std::abs(g1) < height_tol) {
+        xyz = ctr + t1*dir;
+        return true;
+      }
+      if (g1 == g0)
+        return false;
+      double t2 = t1 - g1*(t1 - t0)/(g1 - g0);
+      t0 = t1; g0 = g1;
+      t1 = t2;
+    }
+    return false;
+  }
+
+} // end anonymous namespace
+
   template <class ImageT, class DEMImageT>
   class DemDisparity : public ImageViewBase<DemDisparity<ImageT, DEMImageT> > {
     ImageT            m_left_image;
@@ -52,6 +132,7 @@ namespace asp {
     Matrix<double>  m_align_left_matrix, m_align_right_matrix;
     int             m_pixel_sample;
     ImageView<PixelMask<Vector2i> > & m_disparity_spread;
+    boost::shared_ptr<DemIntersectionStats> m_stats;
 
   public:
     DemDisparity( ImageViewBase<ImageT> const& left_image,
@@ -62,7 +143,8 @@ namespace asp {
                   boost::shared_ptr<camera::CameraModel> right_camera_model,
                   bool do_align,
                   Matrix<double> const& align_left_matrix, Matrix<double> const& align_right_matrix,
-                  int pixel_sample, ImageView<PixelMask<Vector2i> > & disparity_spread)
+                  int pixel_sample, ImageView<PixelMask<Vector2i> > & disparity_spread,
+                  boost::shared_ptr<DemIntersectionStats> stats)
       :m_left_image(left_image.impl()),
        m_dem_error(dem_error),
        m_dem_georef(dem_georef),
@@ -74,7 +156,8 @@ namespace asp {
        m_align_left_matrix(align_left_matrix),
        m_align_right_matrix(align_right_matrix),
        m_pixel_sample(pixel_sample),
-       m_disparity_spread(disparity_spread){}
+       m_disparity_spread(disparity_spread),
+       m_stats(stats){}
 
     // Image View interface
     typedef PixelMask<Vector2i> pixel_type;
@@ -173,43 +256,102 @@ namespace asp {
       GeoReference georef_crop = crop(m_dem_georef, dem_box);
       ImageView <PixelMask<float> > dem_crop = crop(m_dem, dem_box);
 
-      // Compute the DEM disparity. Use one in every 'm_pixel_sample' pixels.
+      // A height to intersect the first ray of a tile with, before
+      // there are neighbors to start from
+      double mean_height = 0, num_valid = 0;
+      for (int row = 0; row < dem_crop.rows(); row += 10) {
+        for (int col = 0; col < dem_crop.cols(); col += 10) {
+          if (!is_valid(dem_crop(col, row))) continue;
+          mean_height += dem_crop(col, row).child();
+          num_valid++;
+        }
+      }
+      if (num_valid > 0)
+        mean_height /= num_valid;
+
+      // Compute the DEM disparity. Use one in every 'm_pixel_sample'
+      // pixels. Each row is done in stages: find the rays, intersect
+      // them with the DEM, then project into the right camera. Each
+      // intersection starts from the one of the pixel to the left, or
+      // else of the pixel above, which is close to it.
+      vw::int64 num_pixels = 0, num_iterations = 0, num_fallbacks = 0;
+      int first_col = m_pixel_sample*((bbox.min().x() + m_pixel_sample - 1)/m_pixel_sample);
+      std::vector<int> cols_in_row;
+      for (int col = first_col; col < bbox.max().x(); col += m_pixel_sample)
+        cols_in_row.push_back(col);
+      int num_cols = cols_in_row.size();
+      std::vector<double>  prev_row_t(num_cols, -1), row_t(num_cols);
+      std::vector<Vector3> ctrs(num_cols), dirs(num_cols), xyzs(num_cols);
+      std::vector<bool>    valid(num_cols);
 
       for (int row = bbox.min().y(); row < bbox.max().y(); row++){
         if (row%m_pixel_sample != 0) continue;
 
-        // Must wipe the previous guess since we are now too far from it
-        prev_xyz = Vector3();
-
-        for (int col = bbox.min().x(); col < bbox.max().x(); col++){
-          if (col%m_pixel_sample != 0) continue;
-
-          Vector2 left_lowres_pix = Vector2(col, row);
-
-          Vector2 left_fullres_pix = elem_quot(left_lowres_pix, m_downsample_scale);
+        // The rays
+        for (int i = 0; i < num_cols; i++) {
+          Vector2 left_fullres_pix = elem_quot(Vector2(cols_in_row[i], row), m_downsample_scale);
           if (m_do_align){
             // Need to go to the image pixel in the untransformed image
             left_fullres_pix = HomographyTransform(m_align_left_matrix).reverse(left_fullres_pix);
           }
-
-          bool has_intersection;
-          Vector3 left_camera_ctr, left_camera_vec;
           try {
-            left_camera_ctr = m_left_camera_model->camera_center(left_fullres_pix);
-            left_camera_vec = m_left_camera_model->pixel_to_vector(left_fullres_pix);
+            ctrs[i]  = m_left_camera_model->camera_center(left_fullres_pix);
+            dirs[i]  = m_left_camera_model->pixel_to_vector(left_fullres_pix);
+            valid[i] = true;
           } catch (...) {
-            continue;
+            valid[i] = false;
+          }
+        }
+
+        // The intersections
+        for (int i = 0; i < num_cols; i++) {
+          row_t[i] = -1;
+          if (!valid[i]) continue;
+
+          double t0 = -1;
+          if (i > 0 && row_t[i-1] > 0)
+            t0 = row_t[i-1];
+          else if (prev_row_t[i] > 0)
+            t0 = prev_row_t[i];
+          else if (num_valid > 0)
+            t0 = datum_distance(georef_crop.datum(), mean_height, ctrs[i], dirs[i]);
+
+          int num_iter = 0;
+          bool success = ray_dem_intersection(ctrs[i], dirs[i], dem_crop, georef_crop,
+                                              t0, max_abs_tol, num_max_iter,
+                                              xyzs[i], num_iter);
+          num_iterations += num_iter;
+          if (!success) {
+            // Fall back to the general solver, which is slower but
+            // copes better with rough terrain and holes in the DEM
+            num_fallbacks++;
+            bool has_intersection;
+            xyzs[i] = camera_pixel_to_dem_xyz(ctrs[i], dirs[i],
+                                              dem_crop, georef_crop,
+                                              treat_nodata_as_zero,
+                                              has_intersection,
+                                              height_error_tol, max_abs_tol,
+                                              max_rel_tol, num_max_iter,
+                                              prev_xyz
+                                              );
+            if ( !has_intersection || xyzs[i] == Vector3() ) {
+              valid[i] = false;
+              continue;
+            }
+            prev_xyz = xyzs[i];
           }
-          Vector3 xyz = camera_pixel_to_dem_xyz(left_camera_ctr, left_camera_vec,
-                                                dem_crop, georef_crop,
-                                                treat_nodata_as_zero,
-                                                has_intersection,
-                                                height_error_tol, max_abs_tol,
-                                                max_rel_tol, num_max_iter,
-                                                prev_xyz
-                                                );
-          if ( !has_intersection || xyz == Vector3() ) continue;
-          prev_xyz = xyz;
+          num_pixels++;
+          row_t[i] = dot_prod(xyzs[i] - ctrs[i], dirs[i]);
+        }
+        prev_row_t = row_t;
+
+        // The disparities
+        for (int i = 0; i < num_cols; i++) {
+          if (!valid[i]) continue;
+          int col = cols_in_row[i];
+          Vector2 left_lowres_pix = Vector2(col, row);
+          Vector3 xyz = xyzs[i];
+          Vector3 left_camera_vec = dirs[i];
 
           // Since our DEM is only known approximately, the true
           // intersection point of the ray coming from the left camera
@@ -252,6 +394,13 @@ namespace asp {
         }
       }
 
+      {
+        Mutex::Lock lock(m_stats->mutex);
+        m_stats->num_pixels     += num_pixels;
+        m_stats->num_iterations += num_iterations;
+        m_stats->num_fallbacks  += num_fallbacks;
+      }
+
       return lowres_disparity;
     }
 
@@ -273,7 +422,8 @@ namespace asp {
                  Matrix<double> const& align_left_matrix,
                  Matrix<double> const& align_right_matrix,
                  int pixel_sample,
-                 ImageView<PixelMask<Vector2i> > & disparity_spread
+                 ImageView<PixelMask<Vector2i> > & disparity_spread,
+                 boost::shared_ptr<DemIntersectionStats> stats
                  ) {
     typedef DemDisparity<ImageT, DEMImageT> return_type;
     return return_type( left.impl(),
@@ -281,7 +431,7 @@ namespace asp {
                         dem, downsample_scale,
                         left_camera_model, right_camera_model,
                         do_align, align_left_matrix, align_right_matrix,
-                        pixel_sample, disparity_spread
+                        pixel_sample, disparity_spread, stats
                         );
   }
 
@@ -352,6 +502,7 @@ namespace asp {
 
     // This image is small enough that we can keep it in memory
     ImageView<PixelMask<Vector2i> > disparity_spread(left_image_sub.cols(), left_image_sub.rows());
+    boost::shared_ptr<DemIntersectionStats> stats(new DemIntersectionStats);
 
     ImageViewRef<PixelMask<Vector2i> > lowres_disparity
       = dem_disparity(left_image_sub,
@@ -360,7 +511,7 @@ namespace asp {
                       left_camera_model, right_camera_model,
                       do_align,
                       align_left_matrix, align_right_matrix,
-                      pixel_sample, disparity_spread
+                      pixel_sample, disparity_spread, stats
                       );
     std::string disparity_file = opt.out_prefix + "-D_sub.tif";
     vw_out() << "Writing low-resolution disparity: " << disparity_file << "\n";
@@ -387,6 +538,11 @@ namespace asp {
     // Go back to the original tile size
     opt.raster_tile_size = orig_tile_size;
 
+    if (stats->num_pixels > 0)
+      vw_out() << "\t--> Intersected " << stats->num_pixels << " rays with the DEM, with "
+               << double(stats->num_iterations)/stats->num_pixels << " iterations per ray. "
+               << stats->num_fallbacks << " rays needed the general solver.\n";
+
 #if 0 // Debug code
     ImageView<PixelMask<Vector2i> > lowres_disparity_disk;
     read_image( lowres_disparity_disk, opt.out_prefix + "-D_sub.tif" );
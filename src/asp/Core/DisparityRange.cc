@@ -0,0 +1,168 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityRange.cc
+///
+
+#include <vw/Core/Log.h>
+#include <asp/Core/DisparityRange.h>
+
+#include <algorithm>
+#include <utility>
+
+using namespace vw;
+
+namespace asp {
+
+  DispRangeSample::DispRangeSample(Vector2f const& l, Vector2f const& u) {
+    // A transform of the disparity may have swapped the bounds
+    for (int c = 0; c < 2; c++) {
+      lower[c] = std::min(l[c], u[c]);
+      upper[c] = std::max(l[c], u[c]);
+    }
+    weight = 1.0/(1.0 + 0.5*norm_2(upper - lower));
+  }
+
+  BBox2f minmax_disparity_range(std::vector<DispRangeSample> const& samples) {
+    BBox2f range;
+    for (size_t i = 0; i < samples.size(); i++) {
+      range.grow(samples[i].lower);
+      range.grow(samples[i].upper);
+    }
+    return range;
+  }
+
+  // The weighted quantile of (value, weight) pairs. The input gets sorted.
+  double weighted_quantile(std::vector< std::pair<float, float> > & vals, double q) {
+    std::sort(vals.begin(), vals.end());
+    double total = 0;
+    for (size_t i = 0; i < vals.size(); i++)
+      total += vals[i].second;
+    double target = q*total, sum = 0;
+    for (size_t i = 0; i < vals.size(); i++) {
+      sum += vals[i].second;
+      if (sum >= target)
+        return vals[i].first;
+    }
+    return vals.back().first;
+  }
+
+  BBox2f robust_disparity_range(std::vector<DispRangeSample> const& samples,
+                                double percentile) {
+    if (samples.empty())
+      return BBox2f();
+
+    double q = std::max(0.0, std::min(50.0, percentile))/100.0;
+    BBox2f range;
+    std::vector< std::pair<float, float> > vals(samples.size());
+    for (int c = 0; c < 2; c++) {
+      for (size_t i = 0; i < samples.size(); i++)
+        vals[i] = std::make_pair(samples[i].lower[c], samples[i].weight);
+      range.min()[c] = weighted_quantile(vals, q);
+      for (size_t i = 0; i < samples.size(); i++)
+        vals[i] = std::make_pair(samples[i].upper[c], samples[i].weight);
+      range.max()[c] = weighted_quantile(vals, 1.0 - q);
+      if (range.min()[c] > range.max()[c])
+        std::swap(range.min()[c], range.max()[c]);
+    }
+    return range;
+  }
+
+  bool is_multimodal(std::vector<DispRangeSample> const& samples,
+                     double percentile, double min_gap) {
+
+    if (samples.size() < 10)
+      return false;
+
+    BBox2f range = robust_disparity_range(samples, percentile);
+    std::vector<float> centers(samples.size());
+    for (int c = 0; c < 2; c++) {
+      for (size_t i = 0; i < samples.size(); i++)
+        centers[i] = 0.5*(samples[i].lower[c] + samples[i].upper[c]);
+      std::sort(centers.begin(), centers.end());
+
+      // Look for the largest gap with enough samples on both sides
+      size_t min_count = samples.size()/10;
+      float max_gap = 0;
+      for (size_t i = min_count; i + min_count < centers.size(); i++)
+        max_gap = std::max(max_gap, centers[i] - centers[i-1]);
+
+      double extent = range.max()[c] - range.min()[c];
+      if (max_gap >= min_gap && max_gap >= 0.5*extent)
+        return true;
+    }
+    return false;
+  }
+
+  SearchRangeStats::SearchRangeStats(): m_num_tiles(0), m_num_splits(0),
+                                        m_minmax_volume(0), m_robust_volume(0),
+                                        m_corr_time(0), m_minmax_corr_time(0) {}
+
+  // The number of disparities to try for a given range
+  double search_volume(BBox2i const& range) {
+    return double(range.width() + 1)*double(range.height() + 1);
+  }
+
+  void SearchRangeStats::add_tile(double num_pixels, BBox2i const& minmax_range,
+                                  BBox2i const& robust_range, double corr_time) {
+    double minmax_volume = num_pixels*search_volume(minmax_range);
+    double robust_volume = num_pixels*search_volume(robust_range);
+
+    // Correlation time is assumed to be proportional to the search volume
+    double minmax_corr_time = corr_time;
+    if (robust_volume > 0)
+      minmax_corr_time = corr_time*minmax_volume/robust_volume;
+
+    VW_OUT(DebugMessage, "asp") << "Search range " << robust_range << " vs "
+                                << minmax_range << ", volume reduction: "
+                                << (minmax_volume > 0 ? robust_volume/minmax_volume : 1.0)
+                                << ", correlation time: " << corr_time << " s vs estimated "
+                                << minmax_corr_time << " s.\n";
+
+    Mutex::Lock lock(m_mutex);
+    m_num_tiles++;
+    m_minmax_volume    += minmax_volume;
+    m_robust_volume    += robust_volume;
+    m_corr_time        += corr_time;
+    m_minmax_corr_time += minmax_corr_time;
+  }
+
+  void SearchRangeStats::add_split() {
+    Mutex::Lock lock(m_mutex);
+    m_num_splits++;
+  }
+
+  void SearchRangeStats::report() const {
+    if (m_num_tiles == 0 || m_minmax_volume <= 0)
+      return;
+    vw_out() << "\t--> Robust search range: " << m_num_tiles << " tiles, "
+             << m_num_splits << " tile splits, search volume reduced to "
+             << 100.0*m_robust_volume/m_minmax_volume << "% of min/max range.\n";
+    vw_out() << "\t--> Correlation time (all threads): " << m_corr_time
+             << " s, estimated saved time: " << m_minmax_corr_time - m_corr_time << " s.\n";
+  }
+
+  namespace {
+    SearchRangeStats g_search_range_stats;
+  }
+
+  SearchRangeStats& search_range_stats() {
+    return g_search_range_stats;
+  }
+
+} // namespace asp
@@ -0,0 +1,82 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DisparityRange.h
+///
+/// Estimate the correlation search range of a tile from the low-res
+/// disparity in a way that is robust to outliers.
+
+#ifndef __ASP_CORE_DISPARITY_RANGE_H__
+#define __ASP_CORE_DISPARITY_RANGE_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <vector>
+
+namespace asp {
+
+  /// One low-res disparity value and the range it may vary in.
+  struct DispRangeSample {
+    vw::Vector2f lower, upper; // disparity minus and plus the spread
+    float weight;              // smaller for larger spread
+    DispRangeSample(vw::Vector2f const& l, vw::Vector2f const& u);
+  };
+
+  /// The box containing all the samples.
+  vw::BBox2f minmax_disparity_range(std::vector<DispRangeSample> const& samples);
+
+  /// The box containing the samples after removing the given
+  /// percentage (between 0 and 50) of the lowest and highest values
+  /// in each direction. Samples with a larger spread count less.
+  vw::BBox2f robust_disparity_range(std::vector<DispRangeSample> const& samples,
+                                    double percentile);
+
+  /// Return true if, in either direction, the samples form two groups
+  /// separated by a gap of at least min_gap which is also at least
+  /// half of the robust range, with each group holding at least 10%
+  /// of the samples. Splitting a tile with such samples results in
+  /// smaller search ranges.
+  bool is_multimodal(std::vector<DispRangeSample> const& samples,
+                     double percentile, double min_gap);
+
+  /// Statistics of how much smaller the search ranges are compared to
+  /// the min/max range of the low-res disparity, summed over tiles.
+  class SearchRangeStats {
+    vw::Mutex m_mutex;
+    int       m_num_tiles, m_num_splits;
+    double    m_minmax_volume, m_robust_volume;
+    double    m_corr_time, m_minmax_corr_time;
+  public:
+    SearchRangeStats();
+
+    /// Record a tile of given number of pixels, the search ranges with
+    /// both approaches, and the time it took to correlate with the
+    /// robust range.
+    void add_tile(double num_pixels, vw::BBox2i const& minmax_range,
+                  vw::BBox2i const& robust_range, double corr_time);
+    void add_split();
+    void report() const;
+  };
+
+  /// The statistics shared by all correlation tiles.
+  SearchRangeStats& search_range_stats();
+
+} // namespace asp
+
+#endif//__ASP_CORE_DISPARITY_RANGE_H__
@@ -0,0 +1,192 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ImageStats.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/FileIO/DiskImageResourceGDAL.h>
+#include <asp/Core/ImageStats.h>
+
+#include <gdal.h>
+#include <gdal_priv.h>
+
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+using namespace vw;
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+  void ImageStatsAccumulator::merge(ImageStatsAccumulator const& other) {
+    m_values.insert(m_values.end(), other.m_values.begin(), other.m_values.end());
+    m_sum  += other.m_sum;
+    m_sum2 += other.m_sum2;
+  }
+
+  Vector6f ImageStatsAccumulator::stats() {
+    Vector6f result;
+    for (int i = 0; i < 6; i++)
+      result[i] = 0;
+    size_t n = m_values.size();
+    if (n == 0)
+      return result;
+
+    double mean = m_sum/n;
+    result[0] = *std::min_element(m_values.begin(), m_values.end());
+    result[1] = *std::max_element(m_values.begin(), m_values.end());
+    result[2] = mean;
+    result[3] = sqrt(std::max(0.0, m_sum2/n - mean*mean));
+
+    // The percentiles, by partially sorting the values
+    double pct[2] = {0.02, 0.98};
+    for (int k = 0; k < 2; k++) {
+      std::vector<float>::iterator it
+        = m_values.begin() + std::min(size_t(pct[k]*(n - 1) + 0.5), n - 1);
+      std::nth_element(m_values.begin(), it, m_values.end());
+      result[4 + k] = *it;
+    }
+    return result;
+  }
+
+  std::string stats_sidecar_file(std::string const& out_prefix, std::string const& image_file) {
+    return out_prefix + "-" + fs::path(image_file).stem().string() + ".stats.txt";
+  }
+
+  // What identifies the version of the image the statistics were
+  // computed for. Images with the same name in different directories
+  // share a sidecar, so the path is part of it.
+  std::string stats_sidecar_key(std::string const& image_file, float nodata) {
+    std::ostringstream os;
+    os << "path "   << fs::absolute(image_file).string()
+       << " size "  << fs::file_size(image_file)
+       << " mtime " << fs::last_write_time(image_file)
+       << " nodata " << std::setprecision(17) << nodata;
+    return os.str();
+  }
+
+  bool read_stats_sidecar(std::string const& sidecar, std::string const& image_file,
+                          float nodata, Vector6f & stats) {
+    try {
+      if (!fs::exists(image_file) || !fs::exists(sidecar))
+        return false;
+
+      std::ifstream fh(sidecar.c_str());
+      std::string comment, key;
+      if (!std::getline(fh, comment) || !std::getline(fh, key) ||
+          key != stats_sidecar_key(image_file, nodata))
+        return false;
+      for (int i = 0; i < 6; i++) {
+        if (!(fh >> stats[i]))
+          return false;
+      }
+    } catch (const std::exception & e) {
+      return false;
+    }
+    return true;
+  }
+
+  void write_stats_sidecar(std::string const& sidecar, std::string const& image_file,
+                           float nodata, Vector6f const& stats) {
+
+    // Write to a temporary file first, so that a process reading the
+    // sidecar at the same time never sees a partial one.
+    std::ostringstream tmp;
+    tmp << sidecar << ".tmp" << getpid();
+    try {
+      if (!fs::exists(image_file))
+        return;
+      {
+        std::ofstream fh(tmp.str().c_str());
+        fh << "# min max mean stddev pct2 pct98\n"
+           << stats_sidecar_key(image_file, nodata) << "\n"
+           << std::setprecision(17);
+        for (int i = 0; i < 6; i++)
+          fh << stats[i] << (i < 5 ? " " : "\n");
+        if (!fh.good())
+          vw_throw(IOErr() << "Could not write " << tmp.str());
+      }
+      fs::rename(tmp.str(), sidecar);
+    } catch (const std::exception & e) {
+      boost::system::error_code ec;
+      fs::remove(tmp.str(), ec);
+      vw_out(DebugMessage, "asp") << "Could not save the statistics of " << image_file
+                                  << " in " << sidecar << ": " << e.what() << "\n";
+    }
+  }
+
+  bool accumulate_overview(std::string const& image_file, float nodata,
+                           int min_cols, int min_rows, ImageStatsAccumulator & accum) {
+
+    boost::shared_ptr<DiskImageResourceGDAL> rsrc;
+    try {
+      rsrc.reset(new DiskImageResourceGDAL(image_file));
+    } catch (const std::exception & e) {
+      return false; // Not a GDAL image, so no overviews
+    }
+
+    Mutex::Lock lock(DiskImageResourceGDAL::global_lock());
+    boost::shared_ptr<GDALDataset> dataset = rsrc->get_dataset_ptr();
+    if (!dataset || dataset->GetRasterCount() < 1)
+      return false;
+    GDALRasterBand * band = dataset->GetRasterBand(1);
+
+    // The smallest overview which is still large enough
+    GDALRasterBand * overview = NULL;
+    for (int k = 0; k < band->GetOverviewCount(); k++) {
+      GDALRasterBand * ov = band->GetOverview(k);
+      if (ov == NULL || ov->GetXSize() < min_cols || ov->GetYSize() < min_rows)
+        continue;
+      if (overview == NULL ||
+          double(ov->GetXSize())*ov->GetYSize() <
+          double(overview->GetXSize())*overview->GetYSize())
+        overview = ov;
+    }
+    if (overview == NULL)
+      return false;
+
+    int cols = overview->GetXSize(), rows = overview->GetYSize();
+    int scale = std::max(1, std::min(cols/std::max(min_cols, 1), rows/std::max(min_rows, 1)));
+    vw_out(DebugMessage, "asp") << "Computing the statistics of " << image_file
+                                << " from its " << cols << " x " << rows << " overview.\n";
+
+    ImageStatsAccumulator local_accum;
+    std::vector<float> line(cols);
+    for (int row = 0; row < rows; row += scale) {
+      if (overview->RasterIO(GF_Read, 0, row, cols, 1, &line[0], cols, 1,
+                             GDT_Float32, 0, 0) != CE_None)
+        return false;
+      for (int col = 0; col < cols; col += scale) {
+        // Written so that with a NaN nodata all values are valid
+        if (!(line[col] <= nodata))
+          local_accum(line[col]);
+      }
+    }
+    if (local_accum.size() == 0)
+      return false;
+    accum.merge(local_accum);
+    return true;
+  }
+
+} // namespace asp
@@ -0,0 +1,216 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ImageStats.h
+///
+/// The statistics of an image used to normalize it for correlation and
+/// interest point matching: min, max, mean, standard deviation, and the
+/// 2% and 98% percentiles, computed on about a million samples.
+///
+/// The samples are read in tiles by multiple threads, each with its own
+/// accumulator, and the accumulators are then merged. For an image on
+/// disk, a GDAL overview of about the right size is read instead when
+/// there is one. The result may be saved in a sidecar file under the
+/// output prefix of the tool, never next to the image, as that may be
+/// the user's input. The sidecar records the path, size, and
+/// modification time of the image and the nodata value used, so it is
+/// ignored once any of these changes.
+
+#ifndef __ASP_CORE_IMAGE_STATS_H__
+#define __ASP_CORE_IMAGE_STATS_H__
+
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/EdgeExtension.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PixelTypeInfo.h>
+#include <vw/Image/Transform.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <cmath>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  typedef vw::Vector<vw::float32,6> Vector6f;
+
+  /// Accumulate pixel values and find their statistics. The quantiles
+  /// are exact, as the values are kept. Accumulators filled by
+  /// different threads can be merged.
+  class ImageStatsAccumulator {
+    std::vector<float> m_values;
+    double m_sum, m_sum2;
+  public:
+    ImageStatsAccumulator(): m_sum(0), m_sum2(0) {}
+
+    void operator()(float value) {
+      m_values.push_back(value);
+      m_sum  += value;
+      m_sum2 += double(value)*value;
+    }
+
+    void merge(ImageStatsAccumulator const& other);
+    size_t size() const { return m_values.size(); }
+
+    /// The min, max, mean, standard deviation, and the 2% and 98%
+    /// percentiles. All are zero if no values were accumulated.
+    Vector6f stats();
+  };
+
+  /// The subsampling factor which leaves about a million samples
+  inline int stats_subsample_scale(int cols, int rows) {
+    return std::max(1, int(ceil(sqrt(float(cols)*float(rows) / 1000000))));
+  }
+
+  /// The sidecar file with the statistics of the given image, for a
+  /// tool writing its output at the given prefix
+  std::string stats_sidecar_file(std::string const& out_prefix, std::string const& image_file);
+
+  /// Read the statistics of the image from the sidecar. Return false if
+  /// there is none, or it was made for a different image, version of
+  /// the image, or nodata value.
+  bool read_stats_sidecar(std::string const& sidecar, std::string const& image_file,
+                          float nodata, Vector6f & stats);
+
+  /// Save the statistics of the image in the sidecar. Failing to do so,
+  /// for example in a read-only directory, is not an error.
+  void write_stats_sidecar(std::string const& sidecar, std::string const& image_file,
+                           float nodata, Vector6f const& stats);
+
+  /// Accumulate the first band of the smallest GDAL overview of the
+  /// image with at least min_cols x min_rows pixels, skipping values no
+  /// more than nodata, as create_mask_less_or_equal() does, so none if
+  /// nodata is NaN. Return false if the image has no such overview, or
+  /// no valid values in it.
+  bool accumulate_overview(std::string const& image_file, float nodata,
+                           int min_cols, int min_rows, ImageStatsAccumulator & accum);
+
+  /// Accumulate the valid pixels of a block of an image and merge them
+  /// into the shared accumulator.
+  template <class ViewT>
+  class ImageStatsTask: public vw::Task, private boost::noncopyable {
+    ViewT                   m_view;
+    vw::BBox2i              m_bbox;
+    ImageStatsAccumulator & m_accum;
+    vw::Mutex             & m_mutex;
+  public:
+    ImageStatsTask(ViewT const& view, vw::BBox2i const& bbox,
+                   ImageStatsAccumulator & accum, vw::Mutex & mutex):
+      m_view(view), m_bbox(bbox), m_accum(accum), m_mutex(mutex) {}
+
+    void operator()() {
+      typedef typename ViewT::pixel_type PixelT;
+      typedef typename vw::UnmaskedPixelType<PixelT>::type ValueT;
+      typedef typename vw::CompoundChannelType<ValueT>::type ChannelT;
+      const int num_channels = vw::PixelNumChannels<ValueT>::value;
+
+      vw::ImageView<PixelT> tile = crop(m_view, m_bbox);
+      ImageStatsAccumulator local_accum;
+      for (int row = 0; row < tile.rows(); row++) {
+        for (int col = 0; col < tile.cols(); col++) {
+          if (!is_valid(tile(col, row)))
+            continue;
+          ValueT value = remove_mask(tile(col, row));
+          for (int c = 0; c < num_channels; c++)
+            local_accum(vw::compound_select_channel<ChannelT const&>(value, c));
+        }
+      }
+      vw::Mutex::Lock lock(m_mutex);
+      m_accum.merge(local_accum);
+    }
+  };
+
+  /// Accumulate the valid pixels of an image, subsampled to about a
+  /// million samples, reading it in blocks using multiple threads.
+  template <class ViewT>
+  void accumulate_image(vw::ImageViewBase<ViewT> const& view_base,
+                        ImageStatsAccumulator & accum) {
+    using namespace vw;
+    ViewT const& image = view_base.impl();
+    int scale = stats_subsample_scale(image.cols(), image.rows());
+
+    typedef SubsampleView< EdgeExtensionView<ViewT, ConstantEdgeExtension> > SubViewT;
+    SubViewT sub = subsample(edge_extend(image, ConstantEdgeExtension()), scale);
+
+    // Blocks which cover several tiles of the full-resolution image
+    int block = std::max(1, 4*vw_settings().default_tile_size()/scale);
+    Mutex mutex;
+    FifoWorkQueue queue(vw_settings().default_num_threads());
+    for (int row = 0; row < sub.rows(); row += block) {
+      for (int col = 0; col < sub.cols(); col += block) {
+        BBox2i bbox(col, row, std::min(block, sub.cols() - col),
+                    std::min(block, sub.rows() - row));
+        boost::shared_ptr<Task> task(new ImageStatsTask<SubViewT>(sub, bbox, accum, mutex));
+        queue.add_task(task);
+      }
+    }
+    queue.join_all();
+  }
+
+  inline void log_stats(std::string const& tag, Vector6f const& result) {
+    vw::vw_out(vw::InfoMessage) << "\t  " << tag << ": [ lo: " << result[0] << " hi: " << result[1]
+                                << " mean: " << result[2] << " std_dev: "  << result[3] << " ]\n";
+  }
+
+  /// The statistics of a masked image which is the image in the given
+  /// file with the values no more than nodata masked. They are read from
+  /// the sidecar if it is current, else computed from an overview of the
+  /// file, or from the view itself, and saved in the sidecar. No sidecar
+  /// is used if its name is empty, and none is saved if the image has
+  /// no valid pixels. The tag is only used in log messages.
+  template <class ViewT>
+  Vector6f gather_image_stats(vw::ImageViewBase<ViewT> const& view_base,
+                              std::string const& image_file, float nodata,
+                              std::string const& tag, std::string const& sidecar) {
+    using namespace vw;
+    Vector6f result;
+    if (sidecar != "" && read_stats_sidecar(sidecar, image_file, nodata, result)) {
+      vw_out(InfoMessage) << "\t--> Using statistics for " << tag << " from "
+                          << sidecar << "\n";
+      log_stats(tag, result);
+      return result;
+    }
+
+    vw_out(InfoMessage) << "\t--> Computing statistics for " + tag + "\n";
+    ViewT const& image = view_base.impl();
+    int scale = stats_subsample_scale(image.cols(), image.rows());
+    ImageStatsAccumulator accum;
+    if (!accumulate_overview(image_file, nodata, image.cols()/scale, image.rows()/scale, accum))
+      accumulate_image(image, accum);
+    result = accum.stats();
+    log_stats(tag, result);
+
+    if (accum.size() == 0)
+      vw_out(WarningMessage) << "No valid pixels found in " << image_file << ".\n";
+    else if (sidecar != "")
+      write_stats_sidecar(sidecar, image_file, nodata, result);
+    return result;
+  }
+
+} // namespace asp
+
+#endif//__ASP_CORE_IMAGE_STATS_H__
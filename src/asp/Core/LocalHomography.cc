@@ -21,14 +21,26 @@
 
 #include <vw/Image/ImageView.h>
 #include <vw/Image/Transform.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/Thread.h>
 #include <vw/Core/ThreadPool.h>
 #include <vw/FileIO/DiskImageView.h>
+#include <vw/Math/Geometry.h>
+#include <vw/Math/RANSAC.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <asp/Core/LocalHomography.h>
 #include <asp/Core/StereoSettings.h>
-#include <asp/Core/InterestPointMatching.h>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 
 using namespace vw;
+namespace fs = boost::filesystem;
 
 namespace asp {
 
@@ -58,28 +70,28 @@ namespace asp {
 
   }
 
-  // Given a disparity map restricted to a subregion, find the homography
-  // transform which aligns best the two images based on this disparity.
-  template<class SeedDispT>
-  vw::math::Matrix<double> homography_for_disparity(vw::BBox2i subregion,
-                                                    SeedDispT const& disparity,
-                                                    bool & success){
-    success = true;
-
-    VW_ASSERT(subregion.width() == disparity.cols() &&
-              subregion.height() == disparity.rows(),
-              vw::ArgumentErr() << "homography_for_disparity: "
-              << "The sizes of subregion and disparity don't match.\n");
-
-    // We will split the subregion into N x N boxes, and average the
-    // disparity in each box, to reduce the run-time.
+namespace {
+
+  const char   LOCAL_HOM_MAGIC[] = "ASPLHOM1";
+  const size_t LOCAL_HOM_MAGIC_LEN = 8;
+  const size_t LOCAL_HOM_HEADER_LEN = LOCAL_HOM_MAGIC_LEN + 2*sizeof(vw::int64);
+
+  typedef ImageView<PixelMask<Vector2i> > SubDispImage;
+
+  // Matches between the left and right low-res images in a subregion
+  // of D_sub, as homogeneous points. We split the subregion into N x N
+  // boxes, and average the disparity in each box, to reduce the
+  // run-time.
+  void tile_matches(BBox2i const& subregion, SubDispImage const& sub_disp,
+                    std::vector<Vector3> & left_pts, std::vector<Vector3> & right_pts){
+    left_pts.clear();
+    right_pts.clear();
     int N = 10;
 
     std::vector<int> partitionx, partitiony;
-    split_n_into_k(disparity.cols(), std::min(disparity.cols(), N), partitionx);
-    split_n_into_k(disparity.rows(), std::min(disparity.rows(), N), partitiony);
+    split_n_into_k(subregion.width(),  std::min(subregion.width(),  N), partitionx);
+    split_n_into_k(subregion.height(), std::min(subregion.height(), N), partitiony);
 
-    std::vector<vw::ip::InterestPoint> left_ip, right_ip;
     for (int ix = 0; ix < (int)partitionx.size()-1; ix++){
       for (int iy = 0; iy < (int)partitiony.size()-1; iy++){
 
@@ -87,8 +99,8 @@ namespace asp {
         double lx = 0, ly = 0, rx = 0, ry = 0, count = 0; // int may cause overflow
         for (int x = partitionx[ix]; x < partitionx[ix+1]; x++){
           for (int y = partitiony[iy]; y < partitiony[iy+1]; y++){
-
-            typename SeedDispT::pixel_type disp = disparity(x, y);
+            PixelMask<Vector2i> disp = sub_disp(subregion.min().x() + x,
+                                                subregion.min().y() + y);
             if (!is_valid(disp)) continue;
             lx += x; rx += (x + disp.child().x());
             ly += y; ry += (y + disp.child().y());
@@ -98,133 +110,248 @@ namespace asp {
         if (count == 0) continue; // no valid points
 
         // Do the averaging. We must add the box corner to the left and
-        // right interest points.
-        vw::ip::InterestPoint l, r;
-        l.x = subregion.min().x() + lx/count; r.x = subregion.min().x() + rx/count;
-        l.y = subregion.min().y() + ly/count; r.y = subregion.min().y() + ry/count;
-        left_ip.push_back(l);
-        right_ip.push_back(r);
+        // right points.
+        left_pts.push_back (Vector3(subregion.min().x() + lx/count,
+                                    subregion.min().y() + ly/count, 1));
+        right_pts.push_back(Vector3(subregion.min().x() + rx/count,
+                                    subregion.min().y() + ry/count, 1));
+      }
+    }
+  }
+
+  // The matches which the homography (from right to left) fits
+  void find_inliers(Matrix3x3 const& H, std::vector<Vector3> const& left_pts,
+                    std::vector<Vector3> const& right_pts, double threshold,
+                    std::vector<size_t> & inliers){
+    inliers.clear();
+    math::InterestPointErrorMetric error;
+    for (size_t i = 0; i < left_pts.size(); i++){
+      if (error(H, right_pts[i], left_pts[i]) < threshold)
+        inliers.push_back(i);
+    }
+  }
+
+  // Fit the homography to the given matches only
+  Matrix3x3 refit(std::vector<Vector3> const& left_pts, std::vector<Vector3> const& right_pts,
+                  std::vector<size_t> const& indices, Matrix3x3 const& seed){
+    std::vector<Vector3> left_sub, right_sub;
+    for (size_t i = 0; i < indices.size(); i++){
+      left_sub.push_back (left_pts [indices[i]]);
+      right_sub.push_back(right_pts[indices[i]]);
+    }
+    return math::HomographyFittingFunctor()(right_sub, left_sub, Matrix<double>(seed));
+  }
+
+  // Find the homography mapping the right points to the left ones,
+  // with at least min_inliers matches within threshold, and refit it to
+  // those. Each tile has its own random numbers, so the result does not
+  // depend on the order in which the tiles are done.
+  bool ransac_homography(std::vector<Vector3> const& left_pts,
+                         std::vector<Vector3> const& right_pts,
+                         double threshold, size_t min_inliers, int num_iter,
+                         boost::random::mt19937 & gen, Matrix3x3 & H, int & iterations){
+    const size_t sample_size = 4;
+    iterations = 0;
+    if (left_pts.size() < sample_size || min_inliers < sample_size)
+      return false;
+
+    boost::random::uniform_int_distribution<size_t> dist(0, left_pts.size() - 1);
+    std::vector<size_t> best_inliers, inliers;
+    Matrix3x3 best_H;
+    for (int iter = 0; iter < num_iter; iter++){
+      iterations++;
+
+      std::vector<size_t> sample;
+      while (sample.size() < sample_size){
+        size_t k = dist(gen);
+        if (std::find(sample.begin(), sample.end(), k) == sample.end())
+          sample.push_back(k);
+      }
+      Matrix3x3 candidate;
+      try {
+        candidate = refit(left_pts, right_pts, sample, math::identity_matrix<3>());
+      } catch (...) {
+        continue; // degenerate sample
+      }
+      find_inliers(candidate, left_pts, right_pts, threshold, inliers);
+      if (inliers.size() > best_inliers.size()){
+        best_inliers = inliers;
+        best_H       = candidate;
       }
     }
+    if (best_inliers.size() < min_inliers)
+      return false;
 
     try {
-      Matrix<double> left_matrix, right_matrix;
-      BBox2i image_size = bounding_box(disparity);
-      bool adjust_left_image_size = true;
-      homography_rectification( adjust_left_image_size,
-                                image_size.size(), image_size.size(),
-                                left_ip, right_ip, left_matrix, right_matrix );
-      // Undoing the shift in origin.
-      right_matrix(0,2) -= left_matrix(0,2);
-      right_matrix(1,2) -= left_matrix(1,2);
-      return right_matrix;
+      H = refit(left_pts, right_pts, best_inliers, best_H);
+    } catch (...) {
+      return false;
     }
-    catch ( const vw::ArgumentErr& e ){}
-    catch ( const vw::math::RANSACErr& e ){}
-    success = false;
-    return vw::math::identity_matrix<3>();
+    return true;
   }
 
-  // Task that computes local homography in a given tile
+
+  // Fits the local homography of one tile. If homographies of
+  // neighboring tiles are given, try first each of them on the matches
+  // of this tile. When one fits enough of them, its inliers are the
+  // start of the fit, and there is no need for RANSAC.
   class LocalHomTask: public vw::Task, private boost::noncopyable {
 
     int m_col, m_row;
-    BBox2i m_sub_bbox;
-    // We on purpose store a local deep copy of sub_disparity_crop to
-    // avoid segfault.
-    ImageView < PixelMask<Vector2i> > m_sub_disparity_crop;
+    BBox2i m_bbox, m_sub_bbox;
+    SubDispImage const& m_sub_disp;
+    std::vector<Matrix3x3> m_neighbors;
     ImageView<Matrix3x3> & m_local_hom;
+    LocalHomographyFitStats & m_stats;
+    vw::Mutex & m_mutex;
   public:
-    LocalHomTask(int col, int row,
-                 BBox2i sub_bbox,
-                 ImageViewRef < PixelMask<Vector2i> > const& sub_disparity_crop,
-                 ImageView<Matrix3x3> & local_hom):
-      m_col(col), m_row(row), m_sub_bbox(sub_bbox),
-      m_sub_disparity_crop(sub_disparity_crop),
-      m_local_hom(local_hom){}
-
-    void operator()() {
-      bool success;
-      // To do: If this function is ever used, the variable 'success'
-      // needs to be treated properly.
-      exit(1); // broken, for now
-      m_local_hom(m_col, m_row)
-        = homography_for_disparity(m_sub_bbox, m_sub_disparity_crop, success);
+    LocalHomTask(int col, int row, BBox2i const& bbox, BBox2i const& sub_bbox,
+                 SubDispImage const& sub_disp, std::vector<Matrix3x3> const& neighbors,
+                 ImageView<Matrix3x3> & local_hom, LocalHomographyFitStats & stats,
+                 vw::Mutex & mutex):
+      m_col(col), m_row(row), m_bbox(bbox), m_sub_bbox(sub_bbox),
+      m_sub_disp(sub_disp), m_neighbors(neighbors),
+      m_local_hom(local_hom), m_stats(stats), m_mutex(mutex){}
+
+    virtual void operator()() {
+
+      boost::random::mt19937 gen(m_row*m_local_hom.cols() + m_col);
+      BBox2i sub_bbox = m_sub_bbox, full_box = bounding_box(m_sub_disp);
+      std::vector<Vector3> left_pts, right_pts;
+      std::vector<size_t> inliers;
+      Matrix3x3 H = math::identity_matrix<3>();
+      bool success = false, seeded = false;
+      int iterations = 0;
+
+      // If the fit fails, keep on expanding the box
+      while (1){
+        sub_bbox.crop(full_box);
+        tile_matches(sub_bbox, m_sub_disp, left_pts, right_pts);
+
+        double threshold   = norm_2(Vector2(sub_bbox.width(), sub_bbox.height()))/10.0;
+        size_t min_inliers = left_pts.size()*2/3;
+
+        for (size_t i = 0; i < m_neighbors.size() && !success; i++){
+          find_inliers(m_neighbors[i], left_pts, right_pts, threshold, inliers);
+          if (inliers.size() < std::max(min_inliers, size_t(4)))
+            continue;
+          try {
+            H = refit(left_pts, right_pts, inliers, m_neighbors[i]);
+            success = seeded = true;
+          } catch (...) {}
+        }
+
+        if (!success){
+          int num_iter = 0;
+          success = ransac_homography(left_pts, right_pts, threshold, min_inliers, 100,
+                                      gen, H, num_iter);
+          iterations += num_iter;
+        }
+        if (success) break;
+
+        vw_out() << "\t--> Failed to find local disparity in box: " << m_bbox  << std::endl;
+        vw_out() << "\t--> Trying again by increasing the local region."  << std::endl;
+        if (sub_bbox == full_box) break; // can't expand more
+        int len = std::max(sub_bbox.width(), sub_bbox.height());
+        sub_bbox.expand(len);
+      }
+
+      m_local_hom(m_col, m_row) = success ? H : Matrix3x3(math::identity_matrix<3>());
+
+      Mutex::Lock lock(m_mutex);
+      m_stats.num_tiles++;
+      m_stats.ransac_iterations += iterations;
+      if (seeded)   m_stats.num_seeded++;
+      if (!success) m_stats.num_failed++;
     }
   };
 
+} // end anonymous namespace
+
+  std::string local_homographies_file(std::string const& out_prefix){
+    return out_prefix + "-local_hom.bin";
+  }
+
+  // The tiles are done in parallel, in two passes over a checkerboard
+  // pattern. In the second pass each tile starts from the homographies
+  // of its neighbors, found in the first one, which usually fit it.
+  void fit_local_homographies(SubDispImage const& sub_disparity,
+                              Vector2i const& left_size, Vector2 const& upscale_factor,
+                              int ts, bool seed_from_neighbors,
+                              ImageView<Matrix3x3> & local_hom,
+                              LocalHomographyFitStats & stats){
+
+    VW_ASSERT(ts > 0, ArgumentErr() << "fit_local_homographies: Invalid tile size.\n");
+    BBox2i left_box(0, 0, left_size.x(), left_size.y());
+    int cols = (int)ceil(left_size.x()/double(ts));
+    int rows = (int)ceil(left_size.y()/double(ts));
+    local_hom.set_size(cols, rows);
+    stats = LocalHomographyFitStats();
+
+    vw::Mutex mutex;
+    for (int pass = 0; pass < 2; pass++){
+      FifoWorkQueue queue( vw_settings().default_num_threads() );
+      for (int row = 0; row < rows; row++){
+        for (int col = 0; col < cols; col++){
+          if ((col + row) % 2 != pass) continue;
+
+          BBox2i bbox(col*ts, row*ts, ts, ts);
+          bbox.crop(left_box);
+
+          // The low-res version of bbox. Expand the box until square
+          // to make sure the local homography calculation does not fail.
+          BBox2i sub_bbox( elem_quot(bbox.min(), upscale_factor),
+                           elem_quot(bbox.max(), upscale_factor) );
+          int len = std::max(sub_bbox.width(), sub_bbox.height());
+          sub_bbox = BBox2i(sub_bbox.max() - Vector2(len, len), sub_bbox.max());
+          sub_bbox.expand(1);
+
+          std::vector<Matrix3x3> neighbors;
+          if (pass == 1 && seed_from_neighbors){
+            if (col > 0)        neighbors.push_back(local_hom(col-1, row));
+            if (col + 1 < cols) neighbors.push_back(local_hom(col+1, row));
+            if (row > 0)        neighbors.push_back(local_hom(col, row-1));
+            if (row + 1 < rows) neighbors.push_back(local_hom(col, row+1));
+          }
+
+          boost::shared_ptr<Task>
+            task(new LocalHomTask(col, row, bbox, sub_bbox, sub_disparity, neighbors,
+                                  local_hom, stats, mutex));
+          queue.add_task(task);
+        }
+      }
+      queue.join_all();
+    }
+  }
+
   // Create a local homography for each correlation tile
   void create_local_homographies(ASPGlobalOptions const& opt){
 
     DiskImageView< PixelGray<float> > left_sub (opt.out_prefix + "-L_sub.tif");
     DiskImageView< PixelGray<float> > left_img (opt.out_prefix + "-L.tif");
-    DiskImageView< PixelMask<Vector2i> >
-      sub_disparity(opt.out_prefix + "-D_sub.tif");
+
+    // D_sub is small, and is shared by all tasks
+    SubDispImage sub_disparity = DiskImageView< PixelMask<Vector2i> >(opt.out_prefix + "-D_sub.tif");
 
     Vector2 upscale_factor( double(left_img.cols()) / double(left_sub.cols()),
                             double(left_img.rows()) / double(left_sub.rows()) );
 
-    int ts   = ASPGlobalOptions::corr_tile_size();
-    int cols = (int)ceil(left_img.cols()/double(ts));
-    int rows = (int)ceil(left_img.rows()/double(ts));
-    ImageView<Matrix3x3> local_hom(cols, rows);
-
-    // Calculate the local homographies using multiple threads.
-    // To do: Each thread calls RANSAC, which calls rand(), which
-    // is not thread safe. So for now use just one thread.
-
     Stopwatch sw;
     sw.start();
 
-    //FifoWorkQueue queue( vw_settings().default_num_threads() );
-    for (int col = 0; col < cols; col++){
-      for (int row = 0; row < rows; row++){
-
-        BBox2i bbox(col*ts, row*ts, ts, ts);
-        bbox.crop(bounding_box(left_img));
-
-        // The low-res version of bbox
-        BBox2i sub_bbox( elem_quot(bbox.min(), upscale_factor),
-                          elem_quot(bbox.max(), upscale_factor) );
-
-        // Expand the box until square to make sure the local
-        // homography calculation does not fail. If that does not
-        // help, keep on expanding the box.
-        bool success = false;
-        int len = std::max(sub_bbox.width(), sub_bbox.height());
-        sub_bbox = BBox2i(sub_bbox.max() - Vector2(len, len), sub_bbox.max());
-        sub_bbox.expand(1);
-        while(1){
-
-          // This code enables multi-threading. It gives different answers each time,
-          // as multiple threads pull random numbers from the same stream.
-          // This code must be kept disabled until Boost's random function is used
-          // with one random stream for each thread.
-          //boost::shared_ptr<LocalHomTask>
-          //task(new LocalHomTask(col, row, sub_bbox, crop(sub_disparity, sub_bbox),
-          //                        local_hom));
-          //queue.add_task(task);
-
-          sub_bbox.crop( bounding_box(sub_disparity) );
-          local_hom(col, row)
-            = homography_for_disparity(sub_bbox, crop(sub_disparity, sub_bbox), success);
-          if (success) break;
-          vw_out() << "\t--> Failed to find local disparity in box: " << bbox  << std::endl;
-          vw_out() << "\t--> Trying again by increasing the local region."  << std::endl;
-          if (sub_bbox == bounding_box(sub_disparity)) break; // can't expand more
-          len = std::max(sub_bbox.width(), sub_bbox.height());
-          sub_bbox.expand(len);
-        }
-
-      }
-    }
-    //queue.join_all();
+    ImageView<Matrix3x3> local_hom;
+    LocalHomographyFitStats stats;
+    fit_local_homographies(sub_disparity, Vector2i(left_img.cols(), left_img.rows()),
+                           upscale_factor, ASPGlobalOptions::corr_tile_size(), true,
+                           local_hom, stats);
 
     sw.stop();
-    vw_out(DebugMessage,"asp") << "Local homographies elapsed time: "
-                               << sw.elapsed_seconds() << " s." << std::endl;
+    vw_out() << "\t--> Fit " << stats.num_tiles << " local homographies in "
+             << sw.elapsed_seconds() << " s. " << stats.num_seeded
+             << " started from a neighbor, " << stats.ransac_iterations
+             << " RANSAC iterations in total, " << stats.num_failed << " failed.\n";
 
-    std::string local_hom_file = opt.out_prefix + "-local_hom.txt";
+    std::string local_hom_file = local_homographies_file(opt.out_prefix);
     vw_out() << "Writing: " << local_hom_file << "\n";
     write_local_homographies(local_hom_file, local_hom);
 
@@ -234,52 +361,77 @@ namespace asp {
   void write_local_homographies(std::string const& local_hom_file,
                                 ImageView<Matrix3x3> const& local_hom){
 
-    std::ofstream fh(local_hom_file.c_str());
-    fh.precision(18);
-    fh << local_hom.cols() << " " << local_hom.rows() << std::endl;
-
-    for (int col = 0; col < local_hom.cols(); col++){
-      for (int row = 0; row < local_hom.rows(); row++){
-        Vector<double> V = matrix_to_vector(local_hom(col, row));
-        for (int t = 0; t < int(V.size())-1; t++) fh << V[t] << " ";
-        if (V.size() > 0) fh << V[V.size()-1] << std::endl;
+    // Write to a temporary file and rename it, so that a reader never
+    // maps a partial file
+    std::string tmp_file = local_hom_file + ".tmp";
+    std::ofstream fh(tmp_file.c_str(), std::ios::binary);
+    if (!fh.good())
+      vw_throw( IOErr() << "write_local_homographies: Cannot write: "
+                << tmp_file << ".\n" );
+
+    vw::int64 cols = local_hom.cols(), rows = local_hom.rows();
+    fh.write(LOCAL_HOM_MAGIC, LOCAL_HOM_MAGIC_LEN);
+    fh.write((const char*)&cols, sizeof(cols));
+    fh.write((const char*)&rows, sizeof(rows));
+    for (int row = 0; row < local_hom.rows(); row++){
+      for (int col = 0; col < local_hom.cols(); col++){
+        Matrix3x3 const& H = local_hom(col, row);
+        for (int r = 0; r < 3; r++)
+          for (int c = 0; c < 3; c++)
+            fh.write((const char*)&H(r, c), sizeof(double));
       }
     }
     fh.close();
+    if (!fh.good())
+      vw_throw( IOErr() << "write_local_homographies: Cannot write: "
+                << tmp_file << ".\n" );
+    fs::rename(tmp_file, local_hom_file);
 
     return;
   }
 
-  void read_local_homographies(std::string const& local_hom_file,
-                               ImageView<Matrix3x3> & local_hom){
+  LocalHomographies::LocalHomographies(std::string const& local_hom_file):
+    m_data(NULL), m_cols(0), m_rows(0){
 
-    std::ifstream fh(local_hom_file.c_str());
-    if (!fh.good())
-      vw_throw( IOErr() << "read_local_homographies: File does not exist: "
+    if (!fs::exists(local_hom_file))
+      vw_throw( IOErr() << "LocalHomographies: File does not exist: "
                 << local_hom_file << ".\n" );
+    try {
+      m_file.reset(new boost::iostreams::mapped_file_source(local_hom_file));
+    } catch (std::exception const& e) {
+      vw_throw( IOErr() << "LocalHomographies: Cannot map: " << local_hom_file
+                << ". " << e.what() << "\n" );
+    }
 
-    int cols, rows;
-    if ( !(fh >> cols >> rows) )
-      vw_throw( IOErr() << "read_local_homographies: Invalid file: "
+    const char * data = m_file->data();
+    vw::int64 cols = 0, rows = 0;
+    if (m_file->size() < LOCAL_HOM_HEADER_LEN ||
+        std::memcmp(data, LOCAL_HOM_MAGIC, LOCAL_HOM_MAGIC_LEN) != 0)
+      vw_throw( IOErr() << "LocalHomographies: Invalid file: "
+                << local_hom_file << ".\n" );
+    std::memcpy(&cols, data + LOCAL_HOM_MAGIC_LEN, sizeof(cols));
+    std::memcpy(&rows, data + LOCAL_HOM_MAGIC_LEN + sizeof(cols), sizeof(rows));
+    if (cols < 0 || rows < 0 ||
+        m_file->size() != LOCAL_HOM_HEADER_LEN + size_t(cols*rows*9)*sizeof(double))
+      vw_throw( IOErr() << "LocalHomographies: Invalid file: "
                 << local_hom_file << ".\n" );
 
-    local_hom.set_size(cols, rows);
-    for (int col = 0; col < local_hom.cols(); col++){
-      for (int row = 0; row < local_hom.rows(); row++){
-
-        Vector<double, 9> V;
-        for (int t = 0; t < int(V.size()); t++){
-          if (! (fh >> V[t]) )
-            vw_throw( IOErr() << "read_local_homographies: Invalid file: "
-                      << local_hom_file << ".\n" );
-        }
-
-        local_hom(col, row) = vector_to_matrix(V);
-      }
-    }
-    fh.close();
+    // The header length is a multiple of 8, so the doubles are aligned
+    m_data = (const double*)(data + LOCAL_HOM_HEADER_LEN);
+    m_cols = cols;
+    m_rows = rows;
+  }
 
-    return;
+  Matrix3x3 LocalHomographies::operator()(int col, int row) const {
+    VW_ASSERT(col >= 0 && row >= 0 && col < m_cols && row < m_rows,
+              ArgumentErr() << "LocalHomographies: Tile (" << col << ", " << row
+              << ") is out of range.\n");
+    const double * p = m_data + 9*(size_t(row)*m_cols + col);
+    Matrix3x3 H;
+    for (int r = 0; r < 3; r++)
+      for (int c = 0; c < 3; c++)
+        H(r, c) = p[3*r + c];
+    return H;
   }
 
 } // namespace asp
@@ -18,29 +18,81 @@
 
 /// \file LocalHomography.h
 ///
+/// A homography for each correlation tile, which makes the right image
+/// resemble the left image in that tile. They are found from D_sub by
+/// stereo_corr, and stored in a binary file which stereo_corr and
+/// stereo_rfne memory-map. The file has a magic string, the number of
+/// tile columns and rows as 64-bit integers, and then for each tile in
+/// row-major order the 9 entries of its matrix, row by row, as doubles
+/// in the byte order of the machine which wrote it.
 
 #ifndef __LOCAL_DISPARITY_H__
 #define __LOCAL_DISPARITY_H__
 
 #include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/Matrix.h>
+#include <boost/shared_ptr.hpp>
+#include <string>
 #include <vector>
 
 // Forward declaration
 namespace asp {
   class ASPGlobalOptions;
 }
+namespace boost { namespace iostreams {
+  class mapped_file_source;
+}}
 
 namespace asp {
 
   void split_n_into_k(int n, int k, std::vector<int> & partition);
 
+  /// The local homographies file for the given output prefix
+  std::string local_homographies_file(std::string const& out_prefix);
+
+  /// The tally of the fit of the local homographies
+  struct LocalHomographyFitStats {
+    int num_tiles, num_seeded, num_failed, ransac_iterations;
+    LocalHomographyFitStats(): num_tiles(0), num_seeded(0), num_failed(0),
+                               ransac_iterations(0) {}
+  };
+
+  /// Fit the homography of each tile of size ts of the left image,
+  /// mapping the right image to it, from D_sub. The left image is
+  /// upscale_factor times larger than D_sub. With seed_from_neighbors,
+  /// half of the tiles start from the homographies of their neighbors
+  /// before trying RANSAC. A tile with no fit gets the identity.
+  void fit_local_homographies(vw::ImageView<vw::PixelMask<vw::Vector2i> > const& sub_disp,
+                              vw::Vector2i const& left_size, vw::Vector2 const& upscale_factor,
+                              int ts, bool seed_from_neighbors,
+                              vw::ImageView<vw::Matrix3x3> & local_hom,
+                              LocalHomographyFitStats & stats);
+
+  /// Fit the local homographies from D_sub and write them
   void create_local_homographies(ASPGlobalOptions const& opt);
 
   void write_local_homographies(std::string const& local_hom_file,
                                 vw::ImageView<vw::Matrix3x3> const& local_hom);
-  void read_local_homographies(std::string const& local_hom_file,
-                               vw::ImageView<vw::Matrix3x3> & local_hom);
 
+  /// The local homographies, read from a memory-mapped file. Copies
+  /// share the mapping.
+  class LocalHomographies {
+    boost::shared_ptr<boost::iostreams::mapped_file_source> m_file;
+    const double * m_data;
+    int m_cols, m_rows;
+  public:
+    LocalHomographies(): m_data(NULL), m_cols(0), m_rows(0) {}
+
+    /// Throws vw::IOErr if the file is missing or invalid.
+    explicit LocalHomographies(std::string const& local_hom_file);
+
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+
+    /// The homography of a tile
+    vw::Matrix3x3 operator()(int col, int row) const;
+  };
 
 } // namespace asp
 
@@ -0,0 +1,152 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file LowResCache.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <asp/Core/LowResCache.h>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+
+namespace asp {
+
+  vw::uint64 hash_bytes(const char* data, size_t len, vw::uint64 hash) {
+    for (size_t i = 0; i < len; i++) {
+      hash ^= (unsigned char)data[i];
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  namespace {
+    std::string hash_to_string(vw::uint64 hash) {
+      std::ostringstream os;
+      os << std::hex << std::setw(16) << std::setfill('0') << hash;
+      return os.str();
+    }
+  }
+
+  std::string file_checksum(std::string const& file, vw::uint64 max_full_size) {
+    std::ifstream is(file.c_str(), std::ios::binary);
+    if (!is.good())
+      vw::vw_throw(vw::IOErr() << "Cannot read: " << file << "\n");
+
+    vw::uint64 hash = hash_bytes(NULL, 0);
+    vw::uint64 size = fs::file_size(file);
+    if (size <= max_full_size) {
+      std::vector<char> buf(1 << 20);
+      while (is) {
+        is.read(&buf[0], buf.size());
+        hash = hash_bytes(&buf[0], is.gcount(), hash);
+      }
+      return hash_to_string(hash);
+    }
+
+    std::ostringstream os;
+    os << "size " << size << " mtime " << fs::last_write_time(file);
+    std::string stamp = os.str();
+    hash = hash_bytes(stamp.c_str(), stamp.size(), hash);
+
+    const int num_samples = 64;
+    const vw::uint64 block = std::min(vw::uint64(1 << 16), size);
+    std::vector<char> buf(block);
+    for (int k = 0; k < num_samples; k++) {
+      is.seekg((size - block)*k/(num_samples - 1));
+      is.read(&buf[0], block);
+      if (!is.good())
+        vw::vw_throw(vw::IOErr() << "Cannot read: " << file << "\n");
+      hash = hash_bytes(&buf[0], block, hash);
+    }
+    return hash_to_string(hash);
+  }
+
+  std::string lowres_cache_key(std::vector<std::string> const& files,
+                               std::string const& settings) {
+    std::string all = settings;
+    for (size_t i = 0; i < files.size(); i++)
+      all += " " + file_checksum(files[i]);
+    return hash_to_string(hash_bytes(all.c_str(), all.size()));
+  }
+
+  bool fetch_from_lowres_cache(std::string const& cache_dir, std::string const& key,
+                               std::string const& out_prefix,
+                               std::vector<std::string> const& suffixes) {
+
+    fs::path entry = fs::path(cache_dir) / key;
+    if (!fs::is_directory(entry))
+      return false;
+
+    for (size_t i = 0; i < suffixes.size(); i++) {
+      if (!fs::exists(entry / suffixes[i]))
+        return false;
+    }
+
+    for (size_t i = 0; i < suffixes.size(); i++) {
+      std::string dest = out_prefix + suffixes[i];
+      if (fs::exists(dest))
+        fs::remove(dest);
+      fs::copy_file(entry / suffixes[i], dest);
+    }
+    return true;
+  }
+
+  void store_in_lowres_cache(std::string const& cache_dir, std::string const& key,
+                             std::string const& settings,
+                             std::string const& out_prefix,
+                             std::vector<std::string> const& suffixes) {
+
+    fs::path entry = fs::path(cache_dir) / key;
+    if (fs::exists(entry))
+      return;
+
+    // Fill a uniquely named directory, then move it in place
+    std::ostringstream tmp_name;
+    tmp_name << key << ".tmp" << getpid();
+    fs::path tmp = fs::path(cache_dir) / tmp_name.str();
+    try {
+      fs::create_directories(tmp);
+      for (size_t i = 0; i < suffixes.size(); i++) {
+        std::string src = out_prefix + suffixes[i];
+        if (fs::exists(src))
+          fs::copy_file(src, tmp / suffixes[i]);
+      }
+      std::ofstream fh((tmp / "settings.txt").string().c_str());
+      fh << settings << std::endl;
+      fh.close();
+      fs::rename(tmp, entry);
+    } catch (fs::filesystem_error const& e) {
+      // Another run may have stored the same entry meanwhile. Not
+      // being able to cache is not an error.
+      vw::vw_out(vw::WarningMessage) << "Could not store in the low-resolution cache: "
+                                     << e.what() << "\n";
+      boost::system::error_code ec;
+      fs::remove_all(tmp, ec);
+    }
+  }
+
+} // namespace asp
@@ -0,0 +1,71 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file LowResCache.h
+///
+/// A content-addressed cache of the products of low-resolution
+/// correlation (D_sub, D_sub_spread, local homographies). An entry is
+/// a subdirectory of the cache directory whose name is a checksum of
+/// the input images and of the settings which affect these products,
+/// so runs on the same inputs with the same low-resolution settings
+/// share the entry, whatever their output prefix.
+
+#ifndef __ASP_CORE_LOW_RES_CACHE_H__
+#define __ASP_CORE_LOW_RES_CACHE_H__
+
+#include <vw/Core/FundamentalTypes.h>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// Fold the given bytes into a 64-bit FNV-1a hash.
+  vw::uint64 hash_bytes(const char* data, size_t len,
+                        vw::uint64 hash = 14695981039346656037ULL);
+
+  /// The hash of the contents of a file, as a hex string. A file
+  /// larger than max_full_size, such as a full-resolution DEM or cube,
+  /// is not read in full. Its size, modification time, and 64 blocks
+  /// sampled evenly through it are hashed instead.
+  std::string file_checksum(std::string const& file,
+                            vw::uint64 max_full_size = 16*1024*1024);
+
+  /// Form a cache key from the checksums of the given files and a
+  /// description of the settings.
+  std::string lowres_cache_key(std::vector<std::string> const& files,
+                               std::string const& settings);
+
+  /// Copy the files with the given suffixes (such as "-D_sub.tif") from
+  /// the cache entry to the output prefix. Return false if the entry
+  /// does not exist or lacks any of these files.
+  bool fetch_from_lowres_cache(std::string const& cache_dir, std::string const& key,
+                               std::string const& out_prefix,
+                               std::vector<std::string> const& suffixes);
+
+  /// Store the files with the given suffixes which exist for the output
+  /// prefix in a new cache entry, together with the settings used. The
+  /// entry appears only once it is complete, so concurrent runs never
+  /// see a partial entry.
+  void store_in_lowres_cache(std::string const& cache_dir, std::string const& key,
+                             std::string const& settings,
+                             std::string const& out_prefix,
+                             std::vector<std::string> const& suffixes);
+
+} // namespace asp
+
+#endif//__ASP_CORE_LOW_RES_CACHE_H__
@@ -25,6 +25,7 @@
 #include <asp/Core/PointUtils.h>
 #include <vw/Cartography/Chipper.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/FileIO/DiskImageView.h>
 #include <boost/math/special_functions/fpclassify.hpp>
 
 using namespace vw;
@@ -889,6 +890,30 @@ bool asp::georef_from_las(std::string const& las_file,
   return true;
 }
 
+/// The number of channels of an image or chunked point cloud
+int asp::pc_num_channels(std::string const& file){
+  if (is_chunked_point_cloud(file))
+    return ChunkedPointCloudReader(file).num_channels();
+  return get_num_channels(file);
+}
+
+/// The size of an image or chunked point cloud
+vw::Vector2i asp::pc_file_size(std::string const& file){
+  if (is_chunked_point_cloud(file)){
+    ChunkedPointCloudReader reader(file);
+    return Vector2i(reader.cols(), reader.rows());
+  }
+  DiskImageView<float> img(file);
+  return Vector2i(img.cols(), img.rows());
+}
+
+bool asp::read_pc_georeference(vw::cartography::GeoReference & georef,
+                               std::string const& file){
+  if (is_chunked_point_cloud(file))
+    return ChunkedPointCloudReader(file).read_georeference(georef);
+  return read_georeference(georef, file);
+}
+
 /// Builds a GeoReference from the first cloud having a georeference in the list
 bool asp::georef_from_pc_files(std::vector<std::string> const& files,
 			       vw::cartography::GeoReference & georef){
@@ -901,7 +926,7 @@ bool asp::georef_from_pc_files(std::vector<std::string> const& files,
 
     // Sometimes ASP PC files can have georef, written there by stereo
     try {
-      if (!is_las(files[i]) && read_georeference(local_georef, files[i])){
+      if (!is_las(files[i]) && read_pc_georeference(local_georef, files[i])){
 	georef = local_georef;
 	return true;
       }
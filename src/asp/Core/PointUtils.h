@@ -33,6 +33,7 @@
 #include <vw/FileIO/DiskImageUtils.h>
 
 #include <asp/Core/Common.h>
+#include <asp/Core/ChunkedPointCloud.h>
 
 namespace vw{
   namespace cartography{
@@ -191,6 +192,15 @@ namespace asp {
   bool georef_from_las(std::string const& las_file,
                        vw::cartography::GeoReference & georef);
 
+  /// The number of channels and the size of a point cloud, which can be
+  /// an image or a chunked point cloud.
+  int          pc_num_channels(std::string const& file);
+  vw::Vector2i pc_file_size   (std::string const& file);
+
+  /// Read the georeference of an image or of a chunked point cloud
+  bool read_pc_georeference(vw::cartography::GeoReference & georef,
+                            std::string const& file);
+
   /// Builds a GeoReference from the first cloud having a georeference in the list
   bool georef_from_pc_files(std::vector<std::string> const& files,
 			    vw::cartography::GeoReference & georef);
@@ -337,6 +347,10 @@ namespace asp {
 template<int m>
 vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const& filename){
 
+  // The chunked container stores absolute coordinates
+  if (asp::is_chunked_point_cloud(filename))
+    return asp::read_chunked_point_cloud<m>(filename);
+
   vw::Vector3 shift;
   std::string shift_str;
   boost::shared_ptr<vw::DiskImageResource> rsrc
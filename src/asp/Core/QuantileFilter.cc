@@ -0,0 +1,150 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file QuantileFilter.cc
+///
+
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <asp/Core/QuantileFilter.h>
+
+#include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+
+using namespace vw;
+
+namespace asp {
+
+  void DisparityHistogram::add(Vector2i const& disp) {
+    m_hist[0][disp[0]]++;
+    m_hist[1][disp[1]]++;
+    m_count++;
+  }
+
+  void DisparityHistogram::merge(DisparityHistogram const& other) {
+    for (int c = 0; c < 2; c++) {
+      for (std::map<int, uint64>::const_iterator it = other.m_hist[c].begin();
+           it != other.m_hist[c].end(); it++)
+        m_hist[c][it->first] += it->second;
+    }
+    m_count += other.m_count;
+  }
+
+  double DisparityHistogram::quantile(int channel, double q) const {
+    if (m_count == 0)
+      return 0.0;
+
+    // The index of the desired value if all values were sorted
+    q = std::max(0.0, std::min(1.0, q));
+    uint64 rank = std::min(uint64(q*m_count), m_count - 1);
+
+    uint64 seen = 0;
+    std::map<int, uint64>::const_iterator it = m_hist[channel].begin();
+    for ( ; it != m_hist[channel].end(); it++) {
+      seen += it->second;
+      if (seen > rank)
+        return it->first;
+    }
+    return m_hist[channel].rbegin()->first; // not reached
+  }
+
+  void DisparityHistogram::outlier_brackets(double pct, double multiple,
+                                            Vector2 & lo, Vector2 & hi) const {
+    for (int c = 0; c < 2; c++) {
+      double q1 = quantile(c, 1.0 - pct);
+      double q3 = quantile(c, pct);
+      if (q1 > q3)
+        std::swap(q1, q3);
+      lo[c] = q1 - multiple*(q3 - q1);
+      hi[c] = q3 + multiple*(q3 - q1);
+    }
+  }
+
+  // Task that accumulates the histogram of one tile of the disparity
+  // and then merges it into the global histogram.
+  class DispHistTask: public vw::Task, private boost::noncopyable {
+    DiskImageView<PixelMask<Vector2i> > m_disp;
+    BBox2i               m_bbox;
+    DisparityHistogram & m_hist;
+    Mutex              & m_mutex;
+  public:
+    DispHistTask(DiskImageView<PixelMask<Vector2i> > const& disp, BBox2i const& bbox,
+                 DisparityHistogram & hist, Mutex & mutex):
+      m_disp(disp), m_bbox(bbox), m_hist(hist), m_mutex(mutex) {}
+
+    void operator()() {
+      ImageView<PixelMask<Vector2i> > tile = crop(m_disp, m_bbox);
+      DisparityHistogram local_hist;
+      for (int row = 0; row < tile.rows(); row++) {
+        for (int col = 0; col < tile.cols(); col++) {
+          if (is_valid(tile(col, row)))
+            local_hist.add(tile(col, row).child());
+        }
+      }
+      Mutex::Lock lock(m_mutex);
+      m_hist.merge(local_hist);
+    }
+  };
+
+  void gather_disparity_histogram(std::string const& disp_file,
+                                  DisparityHistogram & hist) {
+
+    DiskImageView<PixelMask<Vector2i> > disp(disp_file);
+
+    Mutex mutex;
+    FifoWorkQueue queue(vw_settings().default_num_threads());
+    int ts = vw_settings().default_tile_size();
+    std::vector<BBox2i> bboxes = image_blocks(disp, ts, ts);
+    BOOST_FOREACH(BBox2i const& bbox, bboxes) {
+      boost::shared_ptr<DispHistTask> task(new DispHistTask(disp, bbox, hist, mutex));
+      queue.add_task(task);
+    }
+    queue.join_all();
+  }
+
+  void filter_disparity_using_quantiles(std::string const& in_file,
+                                        std::string const& out_file,
+                                        double pct, double multiple,
+                                        vw::cartography::GdalWriteOptions const& opt,
+                                        vw::ProgressCallback const& progress) {
+
+    // First pass: the distribution of disparities
+    DisparityHistogram hist;
+    gather_disparity_histogram(in_file, hist);
+
+    Vector2 lo, hi;
+    hist.outlier_brackets(pct, multiple, lo, hi);
+    vw_out(DebugMessage, "asp") << "Quantile filter keeps disparities in "
+                                << lo << " to " << hi << " out of "
+                                << hist.count() << " valid values.\n";
+
+    // Second pass: filter and write the tiles in parallel
+    DiskImageView<PixelMask<Vector2i> > disp(in_file);
+    vw::cartography::block_write_gdal_image(out_file,
+                                            per_pixel_filter(disp, QuantileBracketFunctor(lo, hi)),
+                                            opt, progress);
+  }
+
+} // namespace asp
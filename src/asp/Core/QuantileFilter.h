@@ -0,0 +1,98 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file QuantileFilter.h
+///
+/// Quantile-based outlier removal for disparity images which are too
+/// large to keep in memory. A first pass gathers the distribution of
+/// disparities tile by tile, and a second pass filters the tiles in
+/// parallel and writes them to disk.
+
+#ifndef __ASP_CORE_QUANTILE_FILTER_H__
+#define __ASP_CORE_QUANTILE_FILTER_H__
+
+#include <vw/Core/FundamentalTypes.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Math/Vector.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PerPixelViews.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <map>
+#include <string>
+
+namespace asp {
+
+  /// Histogram of the two channels of an integer disparity image. Since
+  /// disparities are integers, the memory use depends only on the
+  /// search range, not on the image size, and quantiles are exact.
+  /// Histograms of different tiles can be merged.
+  class DisparityHistogram {
+    std::map<int, vw::uint64> m_hist[2];
+    vw::uint64 m_count;
+  public:
+    DisparityHistogram(): m_count(0) {}
+
+    void add(vw::Vector2i const& disp);
+    void merge(DisparityHistogram const& other);
+    vw::uint64 count() const { return m_count; }
+
+    /// The value at the given quantile (between 0 and 1) of the given channel.
+    double quantile(int channel, double q) const;
+
+    /// Find the range outside of which disparities are outliers. For
+    /// each channel, with Q1 and Q3 the (1 - pct) and pct quantiles,
+    /// this is [Q1 - multiple*(Q3 - Q1), Q3 + multiple*(Q3 - Q1)].
+    void outlier_brackets(double pct, double multiple,
+                          vw::Vector2 & lo, vw::Vector2 & hi) const;
+  };
+
+  /// Invalidate the disparities outside the given brackets.
+  class QuantileBracketFunctor: public vw::ReturnFixedType<vw::PixelMask<vw::Vector2i> > {
+    vw::Vector2 m_lo, m_hi;
+  public:
+    QuantileBracketFunctor(vw::Vector2 const& lo, vw::Vector2 const& hi):
+      m_lo(lo), m_hi(hi) {}
+
+    vw::PixelMask<vw::Vector2i> operator()(vw::PixelMask<vw::Vector2i> const& disp) const {
+      vw::PixelMask<vw::Vector2i> out = disp;
+      if (!is_valid(out)) return out;
+      for (int c = 0; c < 2; c++) {
+        if (out.child()[c] < m_lo[c] || out.child()[c] > m_hi[c])
+          invalidate(out);
+      }
+      return out;
+    }
+  };
+
+  /// Gather the histogram of a disparity image on disk, reading it in
+  /// tiles using multiple threads.
+  void gather_disparity_histogram(std::string const& disp_file,
+                                  DisparityHistogram & hist);
+
+  /// Read the disparity in in_file, remove outliers based on the
+  /// quantiles of its distribution, and write the result to out_file.
+  /// At no point is the whole image held in memory.
+  void filter_disparity_using_quantiles(std::string const& in_file,
+                                        std::string const& out_file,
+                                        double pct, double multiple,
+                                        vw::cartography::GdalWriteOptions const& opt,
+                                        vw::ProgressCallback const& progress);
+
+} // namespace asp
+
+#endif//__ASP_CORE_QUANTILE_FILTER_H__
@@ -91,6 +91,7 @@ namespace asp {
     // Must initialize this variable as it is used in mapproject
     // to get a camera pointer, and there we don't parse stereo.default
     disable_correct_velocity_aberration = false;
+    use_tabulated_isis_cameras          = false;
 
     double nan = std::numeric_limits<double>::quiet_NaN();
     nodata_value = nan;
@@ -171,7 +172,11 @@ namespace asp {
       ("use-local-homography",   po::bool_switch(&global.use_local_homography)->default_value(false)->implicit_value(true),
                      "Apply a local homography in each tile.")
       ("corr-timeout",           po::value(&global.corr_timeout)->default_value(900),
-                     "Correlation timeout for a tile, in seconds.");
+                     "Correlation timeout for a tile, in seconds.")
+      ("corr-range-percentile",  po::value(&global.corr_range_percentile)->default_value(0.0),
+                     "If positive, find the search range of each tile from the low-resolution disparity by ignoring this percentage of the lowest and highest values, with values of large spread counting less, rather than using the min and max. Tiles whose disparities form separate clusters are split. A value such as 1 is suggested.")
+      ("lowres-cache-dir",       po::value(&global.lowres_cache_dir)->default_value(""),
+                     "If set, store the low-resolution disparity, its spread, and the local homographies in this directory, keyed by checksums of the low-resolution images and of the settings they depend on. Any later run with the same key will reuse them.");
 
     po::options_description backwards_compat_options("Aliased backwards compatibility options");
     // Do not add default values here. They may override the values set
@@ -198,7 +203,9 @@ namespace asp {
       ("disable-v-subpixel",  po::bool_switch(&global.disable_v_subpixel)->default_value(false)->implicit_value(true),
                               "Disable calculation of subpixel in vertical direction.")
       ("subpixel-max-levels", po::value(&global.subpixel_max_levels)->default_value(2),
-                              "Max pyramid levels to process when using the BayesEM refinement. (0 is just a single level).");
+                              "Max pyramid levels to process when using the BayesEM refinement. (0 is just a single level).")
+      ("subpixel-tile-engine", po::bool_switch(&global.subpixel_tile_engine)->default_value(false)->implicit_value(true),
+                              "Read, warp, and prefilter each left and right tile only once, and do the subpixel fit in memory. Applies to the parabola and affine subpixel modes.");
 
     po::options_description experimental_subpixel_options("Experimental Subpixel Options");
     experimental_subpixel_options.add_options()
@@ -272,6 +279,8 @@ namespace asp {
       ("piecewise-adjustment-camera-weight", po::value(&global.piecewise_adjustment_camera_weight)->default_value(1.0), "The weight to use for the sum of squares of adjustments component of the cost function. Increasing this value will constrain the adjustments to be smaller.")
       ("point-cloud-rounding-error",        po::value(&global.point_cloud_rounding_error)->default_value(0.0),
                                             "How much to round the output point cloud values, in meters (more rounding means less precision but potentially smaller size on disk). The inverse of a power of 2 is suggested. Default: 1/2^10 for Earth and proportionally less for smaller bodies.")
+      ("save-chunked-point-cloud",          po::bool_switch(&global.save_chunked_point_cloud)->default_value(false)->implicit_value(true),
+                                            "Save the point cloud as a compressed chunked file, PC.pcc, with per-block bounds, rather than as PC.tif. Points are quantized to the rounding error.")
       ("save-double-precision-point-cloud", po::bool_switch(&global.save_double_precision_point_cloud)->default_value(false)->implicit_value(true),
                                             "Save the final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at twice the storage).")
       ("compute-point-cloud-center-only",   po::bool_switch(&global.compute_point_cloud_center_only)->default_value(false)->implicit_value(true),
@@ -300,6 +309,10 @@ namespace asp {
                             "Plot the images in the projected coordinate system given by the georeference of the images.")
       ("hillshade",         po::bool_switch(&global.hillshade)->default_value(false)->implicit_value(true),
                             "Interpret the input images as DEMs and hillshade them.")
+      ("hillshade-azimuth", po::value(&global.hillshade_azimuth)->default_value(300),
+                            "The azimuth of the light when hillshading, in degrees clockwise from north.")
+      ("hillshade-elevation", po::value(&global.hillshade_elevation)->default_value(20),
+                            "The elevation of the light above the horizon when hillshading, in degrees.")
       ("view-matches",   po::bool_switch(&global.view_matches)->default_value(false)->implicit_value(true),
                             "Locate and display the interest point matches.")
       ("match-file", po::value(&global.match_file)->default_value(""),
@@ -308,6 +321,12 @@ namespace asp {
        "Delete any subsampled and other files created by the GUI when exiting.")
       ("create-image-pyramids-only",   po::bool_switch(&global.create_image_pyramids_only)->default_value(false)->implicit_value(true),
        "Without starting the GUI, build multi-resolution pyramids for the inputs, to be able to load them fast later.")
+      ("tile-cache-size",  po::value(&global.tile_cache_size)->default_value(512),
+       "The memory, in MB, to use for keeping the image tiles shown on screen. The images are loaded in the background, one tile at a time.")
+      ("pyramid-cache-dir", po::value(&global.pyramid_cache_dir)->default_value(""),
+       "Keep the multi-resolution pyramids of the images in this directory, to be reused by later sessions until the images change. If not set, the ASP_PYRAMID_CACHE_DIR environment variable is used, if present. Otherwise the pyramids are created next to the images.")
+      ("pyramid-cache-size", po::value(&global.pyramid_cache_size)->default_value(10000),
+       "The size, in MB, beyond which the pyramids used least recently are removed from the pyramid cache.")
       ;
   }
 
@@ -315,13 +334,26 @@ namespace asp {
     StereoSettings& global = stereo_settings();
     (*this).add_options()
       ("disable-correct-velocity-aberration", po::bool_switch(&global.disable_correct_velocity_aberration)->default_value(false)->implicit_value(true),
-       "Apply the velocity aberration correction for Digital Globe cameras.");
+       "Apply the velocity aberration correction for Digital Globe cameras.")
+      ("camera-cache-dir", po::value(&global.camera_cache_dir)->default_value(""),
+       "Store what is read from Digital Globe, SPOT5, and ASTER camera files in this directory, in binary form, and read it from there in later runs, which is much faster than parsing the XML files. If not set, the ASP_CAMERA_CACHE_DIR environment variable is used, if present.");
+  }
+
+  IsisDescription::IsisDescription() : po::options_description("ISIS Options") {
+    StereoSettings& global = stereo_settings();
+    (*this).add_options()
+      ("use-tabulated-isis-cameras", po::bool_switch(&global.use_tabulated_isis_cameras)->default_value(false)->implicit_value(true),
+       "Sample ISIS line scan cameras once when loaded and use these samples afterwards. This allows these cameras to be used from multiple threads.");
   }
 
   UndocOptsDescription::UndocOptsDescription() : po::options_description("Undocumented Options") {
     StereoSettings& global = stereo_settings();
     (*this).add_options()
       ("trans-crop-win", po::value(&global.trans_crop_win)->default_value(BBox2i(0, 0, 0, 0), "xoff yoff xsize ysize"), "Left image crop window in respect to L.tif. This is an internal option. [default: use the entire image].")
+      ("worker-queue", po::value(&global.worker_queue)->default_value(""),
+       "Process one after another the tiles queued in this directory by parallel_stereo, rather than a single region. This is an internal option.")
+      ("plan-tiles", po::value(&global.plan_tiles)->default_value(0),
+       "Write to <output prefix>-tile-plan.txt a split of the left image into this many tiles of about equal estimated correlation cost, for parallel_stereo. This is an internal option.")
       ("attach-georeference-to-lowres-disparity", po::bool_switch(&global.attach_georeference_to_lowres_disparity)->default_value(false)->implicit_value(true),
        "If input images are georeferenced, make D_sub and D_sub_spread georeferenced.");
   }
@@ -337,6 +369,7 @@ namespace asp {
     cfg_options.add( TriangulationDescription() );
     cfg_options.add( GUIDescription()           );
     cfg_options.add( DGDescription()            );
+    cfg_options.add( IsisDescription()          );
     cfg_options.add( UndocOptsDescription()     );
 
     return cfg_options;
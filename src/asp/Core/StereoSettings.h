@@ -59,6 +59,7 @@ namespace asp {
   struct TriangulationDescription : public boost::program_options::options_description { TriangulationDescription(); };
   struct GUIDescription           : public boost::program_options::options_description { GUIDescription          (); };
   struct DGDescription            : public boost::program_options::options_description { DGDescription           (); };
+  struct IsisDescription          : public boost::program_options::options_description { IsisDescription         (); };
   struct UndocOptsDescription     : public boost::program_options::options_description { UndocOptsDescription    (); };
 
   boost::program_options::options_description
@@ -130,6 +131,8 @@ namespace asp {
     double disparity_estimation_dem_error; // Error (in meters) of the disparity estimation DEM
     bool   use_local_homography;      // Apply a local homography in each tile
     int    corr_timeout;              // Correlation timeout for a tile, in seconds
+    double corr_range_percentile;     // If positive, ignore this percentile of extreme low-res disparities
+    std::string lowres_cache_dir;     // If set, share D_sub and local homographies among runs via this directory
 
     // Subpixel Options
     vw::uint16 subpixel_mode;         // 0 = none
@@ -141,6 +144,7 @@ namespace asp {
     vw::Vector2i subpixel_kernel;     // Subpixel correlation kernel
     bool disable_h_subpixel, disable_v_subpixel;
     vw::uint16 subpixel_max_levels;   // Max pyramid levels to process. 0 hits only once.
+    bool subpixel_tile_engine;        // Prefilter each tile once and refine it in memory
 
     // Experimental Subpixel Options (mode 3 only)
     int subpixel_em_iter;
@@ -185,6 +189,7 @@ namespace asp {
     bool   use_least_squares;                 // Use a more rigorous triangulation
     bool   save_double_precision_point_cloud; // Save final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at 2x the storage).
     double point_cloud_rounding_error;        // How much to round the output point cloud values
+    bool   save_chunked_point_cloud;          // Save the point cloud as a compressed chunked file rather than a GeoTIFF
     bool   compute_point_cloud_center_only;   // Only compute the center of triangulated point cloud and exit.
     bool   skip_point_cloud_center_comp;
 
@@ -194,16 +199,26 @@ namespace asp {
     bool single_window;
     bool use_georef;
     bool hillshade;
+    double hillshade_azimuth, hillshade_elevation; // The light direction, in degrees
     bool view_matches;
     std::string match_file;
     bool delete_temporary_files_on_exit;
     bool create_image_pyramids_only;
+    int  tile_cache_size; // In MB, for the image tiles shown on screen
+    std::string pyramid_cache_dir; // Where to keep image pyramids across sessions
+    double pyramid_cache_size;     // In MB
 
     // DG Options
     bool disable_correct_velocity_aberration;
+    std::string camera_cache_dir; // If set, cache what is read from DG, SPOT5, and ASTER camera files
+
+    // ISIS Options
+    bool use_tabulated_isis_cameras; // Sample ISIS line scan cameras at load time, for thread-safe use
 
     // Undocumented options. We don't want these exposed to the user.
     vw::BBox2i trans_crop_win;        // Left image crop window in respect to L.tif.
+    std::string worker_queue;         // Process the tiles queued here by parallel_stereo
+    int  plan_tiles;                  // Split L.tif into this many tiles of equal correlation cost
     bool attach_georeference_to_lowres_disparity;
 
     // Internal variable, to ensure we always initialize this class before using it
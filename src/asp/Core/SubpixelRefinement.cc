@@ -0,0 +1,439 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SubpixelRefinement.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Image/EdgeExtension.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Stereo/PreFilter.h>
+#include <vw/Stereo/SubpixelView.h>
+#include <asp/Core/StereoSettings.h>
+#include <asp/Core/SubpixelRefinement.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+using namespace vw;
+
+namespace asp {
+
+  // Rows are padded to a multiple of this many floats (32 bytes).
+  const int ALIGN_FLOATS = 8;
+
+  AlignedTile::AlignedTile(): m_data(NULL), m_stride(0) {}
+
+  AlignedTile::~AlignedTile() {
+    free(m_data);
+  }
+
+  void AlignedTile::reset(BBox2i const& region) {
+    free(m_data);
+    m_data   = NULL;
+    m_region = region;
+    m_stride = ALIGN_FLOATS*((region.width() + ALIGN_FLOATS - 1)/ALIGN_FLOATS);
+
+    size_t num_bytes = sizeof(float)*size_t(m_stride)*size_t(region.height());
+    if (num_bytes == 0)
+      return;
+    void * ptr = NULL;
+    if (posix_memalign(&ptr, sizeof(float)*ALIGN_FLOATS, num_bytes) != 0)
+      vw_throw(LogicErr() << "AlignedTile: Could not allocate "
+                          << num_bytes << " bytes.\n");
+    m_data = static_cast<float*>(ptr);
+  }
+
+  void AlignedTile::fill(ImageView<PixelGray<float> > const& image) {
+    VW_ASSERT(image.cols() == m_region.width() && image.rows() == m_region.height(),
+              ArgumentErr() << "AlignedTile: Image size does not match the tile region.\n");
+    for (int row = 0; row < image.rows(); row++) {
+      float * ptr = m_data + row*m_stride;
+      for (int col = 0; col < image.cols(); col++)
+        ptr[col] = image(col, row)[0];
+    }
+  }
+
+  RfneTimingStats::RfneTimingStats(): m_read_time(0), m_prefilter_time(0), m_warp_time(0),
+                                      m_fit_time(0), m_num_tiles(0) {}
+
+  void RfneTimingStats::add(double read_time, double prefilter_time,
+                            double warp_time, double fit_time) {
+    Mutex::Lock lock(m_mutex);
+    m_read_time      += read_time;
+    m_prefilter_time += prefilter_time;
+    m_warp_time      += warp_time;
+    m_fit_time       += fit_time;
+    m_num_tiles++;
+  }
+
+  void RfneTimingStats::report() const {
+    if (m_num_tiles == 0)
+      return;
+    // The times are summed over all threads.
+    vw_out() << "\t--> Refinement time over " << m_num_tiles << " tiles (all threads): "
+             << "read: "      << m_read_time      << " s, "
+             << "prefilter: " << m_prefilter_time << " s, "
+             << "warp: "      << m_warp_time      << " s, "
+             << "fit: "       << m_fit_time       << " s.\n";
+  }
+
+  namespace {
+    RfneTimingStats g_rfne_timing_stats;
+  }
+
+  RfneTimingStats& rfne_timing_stats() {
+    return g_rfne_timing_stats;
+  }
+
+  bool tile_engine_supports_subpixel_mode(int subpixel_mode) {
+    return subpixel_mode == 1 || subpixel_mode == 3;
+  }
+
+  int prefilter_halo(int prefilter_mode, float prefilter_width) {
+    if (prefilter_mode != 1 && prefilter_mode != 2)
+      return 0;
+    // The Gaussian kernel is negligible beyond 4 sigma, and the
+    // Laplacian needs one more pixel.
+    return int(ceil(4.0*prefilter_width)) + 2;
+  }
+
+  ImageView<PixelGray<float> >
+  rasterize_with_halo(ImageViewRef<PixelGray<float> > const& image,
+                      BBox2i const& region, int halo) {
+    BBox2i expanded = region;
+    expanded.expand(halo);
+    ImageView<PixelGray<float> > out = crop(edge_extend(image, ConstantEdgeExtension()),
+                                            expanded);
+    return out;
+  }
+
+  ImageView<PixelGray<float> >
+  apply_prefilter(ImageView<PixelGray<float> > const& image, int halo,
+                  int prefilter_mode, float prefilter_width) {
+
+    ImageView<PixelGray<float> > filtered;
+    if (prefilter_mode == 2) {
+      vw::stereo::LaplacianOfGaussian prefilter(prefilter_width);
+      filtered = prefilter.filter(image);
+    } else if (prefilter_mode == 1) {
+      vw::stereo::SubtractedMean prefilter(prefilter_width);
+      filtered = prefilter.filter(image);
+    } else {
+      filtered = image;
+    }
+
+    BBox2i inner(halo, halo, image.cols() - 2*halo, image.rows() - 2*halo);
+    ImageView<PixelGray<float> > out = crop(filtered, inner);
+    return out;
+  }
+
+  BBox2i align_region(BBox2i const& region, int factor) {
+    // Round towards minus infinity also for negative coordinates
+    BBox2i out;
+    out.min() = Vector2i(int(floor(double(region.min().x())/factor))*factor,
+                         int(floor(double(region.min().y())/factor))*factor);
+    out.max() = Vector2i(int(ceil(double(region.max().x())/factor))*factor,
+                         int(ceil(double(region.max().y())/factor))*factor);
+    return out;
+  }
+
+  bool parabola_fit_3x3(float const cost[9], float & dx, float & dy) {
+
+    // Fit z = a*x^2 + b*y^2 + c*x*y + d*x + e*y + f in the least
+    // squares sense on the 3x3 grid. Since the grid is symmetric the
+    // normal equations decouple and have a closed-form solution.
+    float cm = cost[0] + cost[3] + cost[6]; // column x = -1
+    float c0 = cost[1] + cost[4] + cost[7]; // column x =  0
+    float cp = cost[2] + cost[5] + cost[8]; // column x =  1
+    float rm = cost[0] + cost[1] + cost[2]; // row    y = -1
+    float r0 = cost[3] + cost[4] + cost[5]; // row    y =  0
+    float rp = cost[6] + cost[7] + cost[8]; // row    y =  1
+
+    float a = (cp + cm - 2.0f*c0)/6.0f;
+    float b = (rp + rm - 2.0f*r0)/6.0f;
+    float c = (cost[8] + cost[0] - cost[2] - cost[6])/4.0f;
+    float d = (cp - cm)/6.0f;
+    float e = (rp - rm)/6.0f;
+
+    // The minimum is where the gradient is zero.
+    float det = 4.0f*a*b - c*c;
+    dx = 0; dy = 0;
+    if (!(a > 0) || !(det > 0))
+      return false;
+
+    float x = (c*e - 2.0f*b*d)/det;
+    float y = (c*d - 2.0f*a*e)/det;
+    if (!(std::abs(x) <= 1.0f) || !(std::abs(y) <= 1.0f))
+      return false;
+
+    dx = x; dy = y;
+    return true;
+  }
+
+  // Sums of absolute differences between l[0..n) and r[0..n) shifted
+  // by -1, 0, and 1. The sums are kept in independent lanes so that
+  // the compiler can vectorize the loop without reordering additions.
+  inline void sad3(float const* l, float const* r, int n,
+                   float & s0, float & s1, float & s2) {
+    const int LANES = ALIGN_FLOATS;
+    float a0[LANES], a1[LANES], a2[LANES];
+    for (int k = 0; k < LANES; k++) {
+      a0[k] = 0; a1[k] = 0; a2[k] = 0;
+    }
+    int i = 0;
+    for (; i + LANES <= n; i += LANES) {
+      for (int k = 0; k < LANES; k++) {
+        float v = l[i+k];
+        a0[k] += std::abs(v - r[i+k-1]);
+        a1[k] += std::abs(v - r[i+k  ]);
+        a2[k] += std::abs(v - r[i+k+1]);
+      }
+    }
+    for (; i < n; i++) {
+      float v = l[i];
+      a0[0] += std::abs(v - r[i-1]);
+      a1[0] += std::abs(v - r[i  ]);
+      a2[0] += std::abs(v - r[i+1]);
+    }
+    for (int k = 0; k < LANES; k++) {
+      s0 += a0[k]; s1 += a1[k]; s2 += a2[k];
+    }
+  }
+
+  void parabola_refine_tile(AlignedTile const& left, AlignedTile const& right,
+                            BBox2i const& bbox,
+                            ImageView<PixelMask<Vector2i> > const& integer_disp,
+                            Vector2i const& kernel,
+                            ImageView<PixelMask<Vector2f> > & refined_disp) {
+
+    int hx = kernel[0]/2, hy = kernel[1]/2;
+    int kw = 2*hx + 1;
+    int width = bbox.width();
+
+    refined_disp.set_size(bbox.width(), bbox.height());
+
+    // The costs for a whole row, for each of the 9 offsets
+    std::vector<float> costs(9*width);
+    std::vector<char>  has_costs(width);
+
+    BBox2i left_needed = bbox;
+    left_needed.expand(std::max(hx, hy));
+    VW_ASSERT(left.region().contains(left_needed),
+              ArgumentErr() << "parabola_refine_tile: The left tile is too small.\n");
+
+    for (int row = 0; row < bbox.height(); row++) {
+      int y = bbox.min().y() + row;
+
+      // Pass 1: The costs along the row
+      for (int col = 0; col < width; col++) {
+        has_costs[col] = 0;
+        PixelMask<Vector2i> const& disp = integer_disp(col, row);
+        if (!is_valid(disp))
+          continue;
+        int x = bbox.min().x() + col;
+
+        // Skip pixels whose window is not fully inside the right tile
+        BBox2i needed(x + disp.child()[0] - hx - 1, y + disp.child()[1] - hy - 1,
+                      kw + 2, 2*hy + 3);
+        if (!right.region().contains(needed))
+          continue;
+
+        float * c = &costs[9*col];
+        for (int k = 0; k < 9; k++) c[k] = 0;
+        for (int oy = -1; oy <= 1; oy++) {
+          float * co = c + 3*(oy + 1);
+          for (int wy = -hy; wy <= hy; wy++) {
+            float const* l = left.row(y + wy)
+              + (x - hx - left.region().min().x());
+            float const* r = right.row(y + wy + disp.child()[1] + oy)
+              + (x + disp.child()[0] - hx - right.region().min().x());
+            sad3(l, r, kw, co[0], co[1], co[2]);
+          }
+        }
+        has_costs[col] = 1;
+      }
+
+      // Pass 2: The parabola fits along the row
+      for (int col = 0; col < width; col++) {
+        PixelMask<Vector2i> const& disp = integer_disp(col, row);
+        PixelMask<Vector2f> result(Vector2f(disp.child()[0], disp.child()[1]));
+        if (!is_valid(disp)) {
+          invalidate(result);
+        } else if (has_costs[col]) {
+          float dx, dy;
+          if (parabola_fit_3x3(&costs[9*col], dx, dy)) {
+            result.child()[0] += dx;
+            result.child()[1] += dy;
+          }
+        }
+        refined_disp(col, row) = result;
+      }
+    }
+  }
+
+  ImageView<PixelMask<Vector2f> >
+  refine_tile(ImageViewRef<PixelGray<float> > const& left_image,
+              ImageViewRef<PixelGray<float> > const& right_image,
+              ImageViewRef<PixelMask<Vector2i> > const& integer_disp,
+              BBox2i const& bbox, bool has_homography) {
+
+    int   subpixel_mode   = stereo_settings().subpixel_mode;
+    int   prefilter_mode  = stereo_settings().pre_filter_mode;
+    float prefilter_width = stereo_settings().slogW;
+    Vector2i kernel       = stereo_settings().subpixel_kernel;
+    if (subpixel_mode == 3) // affine subpixel always uses the LoG filter
+      prefilter_mode = 2;
+
+    ImageView<PixelMask<Vector2i> > tile_disp = crop(integer_disp, bbox);
+    ImageView<PixelMask<Vector2f> > refined_disp(bbox.width(), bbox.height());
+
+    // The range of disparities in this tile
+    BBox2i disp_range;
+    bool any_valid = false;
+    for (int row = 0; row < tile_disp.rows(); row++) {
+      for (int col = 0; col < tile_disp.cols(); col++) {
+        if (!is_valid(tile_disp(col, row)))
+          continue;
+        disp_range.grow(tile_disp(col, row).child());
+        any_valid = true;
+      }
+    }
+    if (!any_valid)
+      return refined_disp; // all pixels are invalid
+
+    // The affine fit works on an image pyramid, so it needs a
+    // correspondingly larger halo.
+    int halo = std::max(kernel[0], kernel[1])/2 + 1;
+    if (subpixel_mode == 3)
+      halo = halo << stereo_settings().subpixel_max_levels;
+
+    BBox2i left_region = bbox;
+    left_region.expand(halo);
+    BBox2i right_region(bbox.min() + disp_range.min(),
+                        bbox.max() + disp_range.max());
+    right_region.expand(halo);
+
+    int filter_halo = prefilter_halo(prefilter_mode, prefilter_width);
+    Stopwatch read_sw, prefilter_sw, warp_sw, fit_sw;
+
+    // When a homography is used, the right image is warped on the fly
+    // as it is rasterized, and that is done only once per tile.
+    Stopwatch & right_sw = has_homography ? warp_sw : read_sw;
+
+    if (subpixel_mode == 3) {
+      // The affine refinement builds a pyramid and applies the LoG
+      // filter at each level, so it gets the raw tiles, grown by the
+      // filter halo, as the whole images would be seen by it, and the
+      // filter time is part of the fit time. The corners of the tiles
+      // are aligned to the coarsest level, so the tile pyramids sample
+      // the same pixels as those of the whole images. The disparity
+      // must be made relative to the corners of the tiles.
+      left_region.expand(filter_halo);
+      right_region.expand(filter_halo);
+      left_region  = align_region(left_region,  1 << stereo_settings().subpixel_max_levels);
+      right_region = align_region(right_region, 1 << stereo_settings().subpixel_max_levels);
+      read_sw.start();
+      ImageView<PixelGray<float> > left_tile = rasterize_with_halo(left_image, left_region, 0);
+      read_sw.stop();
+      right_sw.start();
+      ImageView<PixelGray<float> > right_tile = rasterize_with_halo(right_image, right_region, 0);
+      right_sw.stop();
+
+      // Outside of the image there is no disparity
+      fit_sw.start();
+      Vector2i shift = left_region.min() - right_region.min();
+      ImageView<PixelMask<Vector2i> > local_disp(left_region.width(), left_region.height());
+      BBox2i disp_box = left_region;
+      disp_box.crop(bounding_box(integer_disp));
+      for (int row = 0; row < local_disp.rows(); row++)
+        for (int col = 0; col < local_disp.cols(); col++)
+          invalidate(local_disp(col, row));
+      if (!disp_box.empty())
+        crop(local_disp, disp_box - left_region.min()) = crop(integer_disp, disp_box);
+      for (int row = 0; row < local_disp.rows(); row++) {
+        for (int col = 0; col < local_disp.cols(); col++) {
+          if (is_valid(local_disp(col, row)))
+            local_disp(col, row).child() += shift;
+        }
+      }
+
+      BBox2i local_bbox = bbox - left_region.min();
+      refined_disp = crop(vw::stereo::affine_subpixel(local_disp, left_tile, right_tile,
+                                                      vw::stereo::LaplacianOfGaussian(prefilter_width),
+                                                      kernel, stereo_settings().subpixel_max_levels),
+                          local_bbox);
+      for (int row = 0; row < refined_disp.rows(); row++) {
+        for (int col = 0; col < refined_disp.cols(); col++) {
+          if (is_valid(refined_disp(col, row)))
+            refined_disp(col, row).child() -= Vector2f(shift[0], shift[1]);
+        }
+      }
+      fit_sw.stop();
+
+      rfne_timing_stats().add(read_sw.elapsed_seconds(),
+                              prefilter_sw.elapsed_seconds(),
+                              warp_sw.elapsed_seconds(),
+                              fit_sw.elapsed_seconds());
+      return refined_disp;
+    }
+
+    read_sw.start();
+    ImageView<PixelGray<float> > left_raw
+      = rasterize_with_halo(left_image, left_region, filter_halo);
+    read_sw.stop();
+
+    right_sw.start();
+    ImageView<PixelGray<float> > right_raw
+      = rasterize_with_halo(right_image, right_region, filter_halo);
+    right_sw.stop();
+
+    prefilter_sw.start();
+    ImageView<PixelGray<float> > left_tile
+      = apply_prefilter(left_raw, filter_halo, prefilter_mode, prefilter_width);
+    ImageView<PixelGray<float> > right_tile
+      = apply_prefilter(right_raw, filter_halo, prefilter_mode, prefilter_width);
+    prefilter_sw.stop();
+
+    fit_sw.start();
+    if (subpixel_mode == 1) {
+      AlignedTile left_buf, right_buf;
+      left_buf.reset(left_region);
+      left_buf.fill(left_tile);
+      right_buf.reset(right_region);
+      right_buf.fill(right_tile);
+      parabola_refine_tile(left_buf, right_buf, bbox, tile_disp, kernel, refined_disp);
+    } else {
+      vw_throw(ArgumentErr() << "refine_tile: Unsupported subpixel mode: "
+                             << subpixel_mode << ".\n");
+    }
+    fit_sw.stop();
+
+    rfne_timing_stats().add(read_sw.elapsed_seconds(),
+                            prefilter_sw.elapsed_seconds(),
+                            warp_sw.elapsed_seconds(),
+                            fit_sw.elapsed_seconds());
+
+    return refined_disp;
+  }
+
+} // namespace asp
@@ -0,0 +1,136 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file SubpixelRefinement.h
+///
+/// Tile-based subpixel refinement engine. Each left and right tile is
+/// read (and warped, if a local homography is in use) and prefiltered
+/// exactly once, with a halo large enough for the refinement kernel,
+/// and then the subpixel fit is done on these in-memory buffers. The
+/// affine fit filters each level of its pyramid, so for it the tiles
+/// are not prefiltered.
+
+#ifndef __ASP_CORE_SUBPIXEL_REFINEMENT_H__
+#define __ASP_CORE_SUBPIXEL_REFINEMENT_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PixelTypes.h>
+#include <boost/noncopyable.hpp>
+
+namespace asp {
+
+  /// A float image buffer covering a given region of a larger image.
+  /// The rows are padded and 32-byte aligned so that loops over them
+  /// can be vectorized by the compiler.
+  class AlignedTile: private boost::noncopyable {
+    float *    m_data;
+    int        m_stride;
+    vw::BBox2i m_region;
+  public:
+    AlignedTile();
+    ~AlignedTile();
+
+    /// Allocate storage for the given region (in full image coordinates).
+    void reset(vw::BBox2i const& region);
+
+    /// Copy an image whose upper-left corner is at region().min().
+    void fill(vw::ImageView<vw::PixelGray<float> > const& image);
+
+    vw::BBox2i const& region() const { return m_region; }
+    int stride() const { return m_stride; }
+
+    /// Pointer to the pixel at column region().min().x() in the given
+    /// row. The row is in full image coordinates.
+    float const* row(int y) const { return m_data + (y - m_region.min().y())*m_stride; }
+    float      * row(int y)       { return m_data + (y - m_region.min().y())*m_stride; }
+  };
+
+  /// Total time spent in each part of the refinement engine, summed
+  /// over all tiles and threads.
+  class RfneTimingStats {
+    vw::Mutex m_mutex;
+    double    m_read_time, m_prefilter_time, m_warp_time, m_fit_time;
+    int       m_num_tiles;
+  public:
+    RfneTimingStats();
+    void add(double read_time, double prefilter_time, double warp_time, double fit_time);
+    void report() const;
+  };
+
+  /// The instance of the timing stats shared by all refinement tiles.
+  RfneTimingStats& rfne_timing_stats();
+
+  /// Return true if the tile engine can do the current subpixel mode.
+  bool tile_engine_supports_subpixel_mode(int subpixel_mode);
+
+  /// How many pixels the prefilter reads beyond the region it writes.
+  int prefilter_halo(int prefilter_mode, float prefilter_width);
+
+  /// Rasterize the given region of the image, grown by the given
+  /// halo. Pixels outside the image are obtained by edge extension.
+  vw::ImageView<vw::PixelGray<float> >
+  rasterize_with_halo(vw::ImageViewRef<vw::PixelGray<float> > const& image,
+                      vw::BBox2i const& region, int halo);
+
+  /// Apply the prefilter to an image rasterized with the given halo,
+  /// and return the result with the halo removed.
+  vw::ImageView<vw::PixelGray<float> >
+  apply_prefilter(vw::ImageView<vw::PixelGray<float> > const& image, int halo,
+                  int prefilter_mode, float prefilter_width);
+
+  /// The smallest region containing the given one whose corners are
+  /// multiples of the given factor.
+  vw::BBox2i align_region(vw::BBox2i const& region, int factor);
+
+  /// Fit a 2D quadratic to the costs at the 3x3 integer offsets
+  /// around the current disparity (in row-major order, starting at
+  /// offset (-1, -1)), and find its minimum. Return false if the
+  /// surface has no minimum within one pixel of the center.
+  bool parabola_fit_3x3(float const cost[9], float & dx, float & dy);
+
+  /// Refine the integer disparity of the pixels in bbox using a
+  /// parabola fit to the sum of absolute differences of prefiltered
+  /// intensities. The left and right tiles must contain the bbox and
+  /// its disparity-shifted version, grown by half the kernel plus one.
+  /// The disparity images must have the size of bbox.
+  void parabola_refine_tile(AlignedTile const& left, AlignedTile const& right,
+                            vw::BBox2i const& bbox,
+                            vw::ImageView<vw::PixelMask<vw::Vector2i> > const& integer_disp,
+                            vw::Vector2i const& kernel,
+                            vw::ImageView<vw::PixelMask<vw::Vector2f> > & refined_disp);
+
+  /// Refine the integer disparity in bbox with the given subpixel mode
+  /// (parabola or affine). The images are read, the right one is
+  /// warped if a homography is given, and both are prefiltered once
+  /// per tile, except for the affine fit, which applies the LoG filter
+  /// at each pyramid level as without tiles, and whose tiles are
+  /// aligned to the coarsest level. The returned disparity has the
+  /// size of bbox.
+  vw::ImageView<vw::PixelMask<vw::Vector2f> >
+  refine_tile(vw::ImageViewRef<vw::PixelGray<float> > const& left_image,
+              vw::ImageViewRef<vw::PixelGray<float> > const& right_image,
+              vw::ImageViewRef<vw::PixelMask<vw::Vector2i> > const& integer_disp,
+              vw::BBox2i const& bbox, bool has_homography);
+
+} // namespace asp
+
+#endif//__ASP_CORE_SUBPIXEL_REFINEMENT_H__
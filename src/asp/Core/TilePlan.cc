@@ -0,0 +1,262 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TilePlan.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/TilePlan.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+
+    // Sums of the costs over boxes of blocks, from the sums over all
+    // boxes starting at the origin.
+    class CostTable {
+      std::vector<double> m_sums;
+      int m_cols;
+    public:
+      CostTable(ImageView<double> const& costs):
+        m_sums((costs.cols() + 1)*(costs.rows() + 1), 0.0), m_cols(costs.cols() + 1) {
+        for (int row = 0; row < costs.rows(); row++) {
+          for (int col = 0; col < costs.cols(); col++) {
+            m_sums[(row + 1)*m_cols + col + 1] = costs(col, row)
+              + m_sums[row*m_cols + col + 1] + m_sums[(row + 1)*m_cols + col]
+              - m_sums[row*m_cols + col];
+          }
+        }
+      }
+
+      double sum(BBox2i const& b) const {
+        return m_sums[b.max().y()*m_cols + b.max().x()] - m_sums[b.min().y()*m_cols + b.max().x()]
+          - m_sums[b.max().y()*m_cols + b.min().x()] + m_sums[b.min().y()*m_cols + b.min().x()];
+      }
+    };
+
+    // The part of the box before position k along x or y, and the rest
+    void cut_box(BBox2i const& box, bool along_x, int k, BBox2i & first, BBox2i & second) {
+      first = box; second = box;
+      if (along_x) {
+        first.max().x()  = box.min().x() + k;
+        second.min().x() = box.min().x() + k;
+      } else {
+        first.max().y()  = box.min().y() + k;
+        second.min().y() = box.min().y() + k;
+      }
+    }
+
+    void split_blocks(CostTable const& table, BBox2i const& blocks, int num_tiles,
+                      std::vector<BBox2i> & tiles) {
+
+      int len_x = blocks.width(), len_y = blocks.height();
+      if (num_tiles <= 1 || (len_x <= 1 && len_y <= 1)) {
+        tiles.push_back(blocks);
+        return;
+      }
+
+      bool along_x = (len_x >= len_y);
+      int len = along_x ? len_x : len_y;
+      int num_first = num_tiles/2;
+
+      // Cut where the first part gets its share of the cost, or of the
+      // area if there is no cost.
+      double total  = table.sum(blocks);
+      double target = total*num_first/num_tiles;
+      int best_k = std::max(1, std::min(len - 1, int(round(double(len)*num_first/num_tiles))));
+      if (total > 0) {
+        double best_err = std::numeric_limits<double>::max();
+        for (int k = 1; k < len; k++) {
+          BBox2i first, second;
+          cut_box(blocks, along_x, k, first, second);
+          double err = std::abs(table.sum(first) - target);
+          if (err < best_err) {
+            best_err = err;
+            best_k   = k;
+          }
+        }
+      }
+
+      BBox2i first, second;
+      cut_box(blocks, along_x, best_k, first, second);
+      split_blocks(table, first,  num_first,             tiles);
+      split_blocks(table, second, num_tiles - num_first, tiles);
+    }
+
+  } // end anonymous namespace
+
+  ImageView<double>
+  correlation_block_costs(ImageView<PixelMask<Vector2i> > const& sub_disp,
+                          ImageView<PixelMask<Vector2i> > const& sub_disp_spread,
+                          ImageView<uint8> const& left_mask_sub,
+                          Vector2i const& left_size, BBox2i const& crop_win,
+                          int block_size) {
+
+    VW_ASSERT(block_size > 0 && sub_disp.cols() > 0 && sub_disp.rows() > 0,
+              ArgumentErr() << "correlation_block_costs: Invalid block size or D_sub.\n");
+    bool has_spread = (sub_disp_spread.cols() != 0 && sub_disp_spread.rows() != 0);
+    if (has_spread && (sub_disp_spread.cols() != sub_disp.cols() ||
+                       sub_disp_spread.rows() != sub_disp.rows()))
+      vw_throw(ArgumentErr() << "correlation_block_costs: D_sub and D_sub_spread "
+                             << "must have equal sizes.\n");
+    bool has_mask = (left_mask_sub.cols() != 0 && left_mask_sub.rows() != 0);
+
+    Vector2 disp_scale(double(left_size.x())/sub_disp.cols(),
+                       double(left_size.y())/sub_disp.rows());
+    Vector2 mask_scale(1, 1);
+    if (has_mask)
+      mask_scale = Vector2(double(left_size.x())/left_mask_sub.cols(),
+                           double(left_size.y())/left_mask_sub.rows());
+
+    int cols = (left_size.x() + block_size - 1)/block_size;
+    int rows = (left_size.y() + block_size - 1)/block_size;
+    ImageView<double> costs(cols, rows);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+
+        costs(col, row) = 0;
+        BBox2i box(col*block_size, row*block_size, block_size, block_size);
+        box.crop(BBox2i(0, 0, left_size.x(), left_size.y()));
+        box.crop(crop_win);
+        if (box.width() <= 0 || box.height() <= 0)
+          continue;
+
+        // The search range, from the low-res disparity over the block
+        // and one low-res pixel around it, as in stereo_corr.
+        BBox2i seed_box(elem_quot(box.min(), disp_scale), elem_quot(box.max(), disp_scale));
+        seed_box.expand(1);
+        seed_box.crop(bounding_box(sub_disp));
+        BBox2f range;
+        bool has_range = false;
+        for (int r = seed_box.min().y(); r < seed_box.max().y(); r++) {
+          for (int c = seed_box.min().x(); c < seed_box.max().x(); c++) {
+            if (!is_valid(sub_disp(c, r)))
+              continue;
+            Vector2 d = sub_disp(c, r).child(), s;
+            if (has_spread && is_valid(sub_disp_spread(c, r)))
+              s = abs(Vector2(sub_disp_spread(c, r).child()));
+            range.grow(d - s);
+            range.grow(d + s);
+            has_range = true;
+          }
+        }
+        double search_area = 0;
+        if (has_range)
+          search_area = (range.width()  + 2)*disp_scale.x()
+                      * (range.height() + 2)*disp_scale.y();
+
+        // The fraction of the block which is not masked
+        double valid_fraction = 1.0;
+        if (has_mask) {
+          BBox2i mask_box(elem_quot(box.min(), mask_scale), elem_quot(box.max(), mask_scale));
+          mask_box.crop(bounding_box(left_mask_sub));
+          int num = 0, num_valid = 0;
+          for (int r = mask_box.min().y(); r < mask_box.max().y(); r++) {
+            for (int c = mask_box.min().x(); c < mask_box.max().x(); c++) {
+              num++;
+              if (left_mask_sub(c, r) > 0)
+                num_valid++;
+            }
+          }
+          if (num > 0)
+            valid_fraction = double(num_valid)/num;
+        }
+
+        costs(col, row) = double(box.width())*box.height()*(1.0 + valid_fraction*search_area);
+      }
+    }
+    return costs;
+  }
+
+  void plan_tiles(ImageView<double> const& block_costs, int block_size,
+                  Vector2i const& left_size, BBox2i const& crop_win,
+                  int num_tiles, std::vector<BBox2i> & tiles,
+                  std::vector<double> & tile_costs) {
+
+    VW_ASSERT(block_size > 0 && num_tiles > 0,
+              ArgumentErr() << "plan_tiles: Invalid block size or number of tiles.\n");
+    tiles.clear();
+    tile_costs.clear();
+
+    BBox2i image_box(0, 0, left_size.x(), left_size.y());
+    BBox2i win = crop_win;
+    win.crop(image_box);
+    if (win.width() <= 0 || win.height() <= 0)
+      win = image_box;
+
+    BBox2i blocks(Vector2i(win.min().x()/block_size, win.min().y()/block_size),
+                  Vector2i((win.max().x() + block_size - 1)/block_size,
+                           (win.max().y() + block_size - 1)/block_size));
+    blocks.crop(bounding_box(block_costs));
+
+    CostTable table(block_costs);
+    std::vector<BBox2i> block_tiles;
+    split_blocks(table, blocks, num_tiles, block_tiles);
+
+    for (size_t i = 0; i < block_tiles.size(); i++) {
+      BBox2i tile(block_tiles[i].min()*block_size, block_tiles[i].max()*block_size);
+      tile.crop(image_box);
+      tiles.push_back(tile);
+      tile_costs.push_back(table.sum(block_tiles[i]));
+    }
+
+    // The rest of the image, above, below, left, and right of the
+    // tiles
+    BBox2i region(blocks.min()*block_size, blocks.max()*block_size);
+    region.crop(image_box);
+    int W = left_size.x(), H = left_size.y();
+    BBox2i border[4] = {
+      BBox2i(0, 0, W, region.min().y()),
+      BBox2i(0, region.max().y(), W, H - region.max().y()),
+      BBox2i(0, region.min().y(), region.min().x(), region.height()),
+      BBox2i(region.max().x(), region.min().y(), W - region.max().x(), region.height())
+    };
+    for (int i = 0; i < 4; i++) {
+      if (border[i].width() <= 0 || border[i].height() <= 0)
+        continue;
+      tiles.push_back(border[i]);
+      tile_costs.push_back(0);
+    }
+  }
+
+  void write_tile_plan(std::string const& plan_file, Vector2i const& left_size,
+                       std::vector<BBox2i> const& tiles,
+                       std::vector<double> const& tile_costs) {
+
+    VW_ASSERT(tiles.size() == tile_costs.size(),
+              ArgumentErr() << "write_tile_plan: Each tile must have a cost.\n");
+    std::ofstream fh(plan_file.c_str());
+    fh << "# Tiles for parallel_stereo: x y width height estimated_cost\n";
+    fh << "image " << left_size.x() << " " << left_size.y() << "\n";
+    fh.precision(17);
+    for (size_t i = 0; i < tiles.size(); i++)
+      fh << tiles[i].min().x() << " " << tiles[i].min().y() << " "
+         << tiles[i].width()   << " " << tiles[i].height()  << " "
+         << tile_costs[i] << "\n";
+    if (!fh.good())
+      vw_throw(IOErr() << "Could not write " << plan_file << ".\n");
+  }
+
+} // namespace asp
@@ -0,0 +1,74 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TilePlan.h
+///
+/// Split the left image into the tiles parallel_stereo processes
+/// separately, such that their correlation takes about the same time.
+///
+/// The cost of correlating a block of the image is estimated as one
+/// unit per pixel, plus, for each pixel which is not masked, one unit
+/// per disparity searched. As in stereo_corr, the search range of the
+/// block is the range of D_sub over it, grown by D_sub_spread.
+/// parallel_stereo compares the cost of each tile with the time it took
+/// and reports how well they agree.
+
+#ifndef __ASP_CORE_TILE_PLAN_H__
+#define __ASP_CORE_TILE_PLAN_H__
+
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The estimated cost of correlating each block of block_size x
+  /// block_size pixels of the left image, of size left_size. Only the
+  /// pixels in crop_win are counted. The spread and the low-res left
+  /// mask may be empty images.
+  vw::ImageView<double>
+  correlation_block_costs(vw::ImageView<vw::PixelMask<vw::Vector2i> > const& sub_disp,
+                          vw::ImageView<vw::PixelMask<vw::Vector2i> > const& sub_disp_spread,
+                          vw::ImageView<vw::uint8> const& left_mask_sub,
+                          vw::Vector2i const& left_size, vw::BBox2i const& crop_win,
+                          int block_size);
+
+  /// Split crop_win, grown to whole blocks, into num_tiles tiles made
+  /// of whole blocks, of about equal cost, by cutting it recursively
+  /// along its longer side. The rest of the image is covered by up to
+  /// four more tiles of zero cost around it, so that the tiles cover
+  /// the whole image, as parallel_stereo mosaics them. The tiles are
+  /// cropped to the image.
+  void plan_tiles(vw::ImageView<double> const& block_costs, int block_size,
+                  vw::Vector2i const& left_size, vw::BBox2i const& crop_win,
+                  int num_tiles, std::vector<vw::BBox2i> & tiles,
+                  std::vector<double> & tile_costs);
+
+  /// Save the tiles and their costs as read by parallel_stereo, one
+  /// tile per line as "x y width height cost".
+  void write_tile_plan(std::string const& plan_file, vw::Vector2i const& left_size,
+                       std::vector<vw::BBox2i> const& tiles,
+                       std::vector<double> const& tile_costs);
+
+} // namespace asp
+
+#endif//__ASP_CORE_TILE_PLAN_H__
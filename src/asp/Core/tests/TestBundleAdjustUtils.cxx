@@ -0,0 +1,109 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/BundleAdjustUtils.h>
+#include <vw/Camera/PinholeModel.h>
+#include <vw/Camera/CameraModel.h>
+#include <set>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // Two strips of cameras, each camera sharing points with the next
+  // one in its strip only.
+  void make_strips(int num_per_strip, std::vector< std::vector<size_t> > & camera_points) {
+    camera_points.assign(2*num_per_strip, std::vector<size_t>());
+    size_t point = 0;
+    for (int s = 0; s < 2; s++) {
+      for (int i = 0; i + 1 < num_per_strip; i++) {
+        for (int k = 0; k < 10; k++, point++) {
+          camera_points[s*num_per_strip + i    ].push_back(point);
+          camera_points[s*num_per_strip + i + 1].push_back(point);
+        }
+      }
+    }
+  }
+
+}
+
+TEST( BundleAdjustUtils, PartitionCameras ) {
+  std::vector< std::vector<size_t> > camera_points, clusters;
+  make_strips(20, camera_points);
+
+  partition_cameras(camera_points, 6, 0, clusters);
+  std::vector<int> count(camera_points.size(), 0);
+  for (size_t c = 0; c < clusters.size(); c++) {
+    EXPECT_LE( clusters[c].size(), 6u );
+    // The strips are not connected, so are never in the same cluster
+    for (size_t i = 0; i < clusters[c].size(); i++) {
+      EXPECT_EQ( clusters[c][0] / 20, clusters[c][i] / 20 );
+      count[clusters[c][i]]++;
+    }
+  }
+  for (size_t icam = 0; icam < count.size(); icam++)
+    EXPECT_EQ( 1, count[icam] );
+  EXPECT_EQ( 8u, clusters.size() );
+
+  // With overlap, neighbouring clusters share cameras
+  partition_cameras(camera_points, 6, 2, clusters);
+  EXPECT_EQ( 8u, clusters.size() );
+  std::set<size_t> shared;
+  count.assign(camera_points.size(), 0);
+  for (size_t c = 0; c < clusters.size(); c++) {
+    EXPECT_LE( clusters[c].size(), 8u );
+    for (size_t i = 0; i < clusters[c].size(); i++) {
+      if (++count[clusters[c][i]] > 1)
+        shared.insert(clusters[c][i]);
+    }
+  }
+  EXPECT_FALSE( shared.empty() );
+  for (size_t icam = 0; icam < count.size(); icam++)
+    EXPECT_GE( count[icam], 1 );
+}
+
+TEST( BundleAdjustUtils, ComposeAdjustments ) {
+  boost::shared_ptr<camera::CameraModel>
+    pinhole(new camera::PinholeModel(Vector3(1000, -2000, -500000), math::identity_matrix<3>(),
+                                     5000, 5000, 500, 500));
+
+  Vector3 t1(3, -4, 20), t2(-1, 7, 2);
+  Quat    q1(sqrt(1 - 0.01*0.01 - 0.02*0.02 - 0.005*0.005), 0.01, -0.02, 0.005);
+  Quat    q2(sqrt(1 - 0.003*0.003 - 0.004*0.004 - 0.02*0.02), -0.003, 0.004, 0.02);
+
+  // Adjusting the adjusted camera, and adjusting the original camera
+  // once, give the same pixels.
+  boost::shared_ptr<camera::CameraModel>
+    inner(new camera::AdjustedCameraModel(pinhole, t1, q1));
+  camera::AdjustedCameraModel nested(inner, t2, q2);
+
+  Vector3 t;
+  Quat    q;
+  compose_adjustments(t1, q1, t2, q2, t, q);
+  camera::AdjustedCameraModel composed(pinhole, t, q);
+
+  Vector3 points[] = { Vector3(1000, -2000, 0), Vector3(1200, -1900, 100),
+                       Vector3(700, -2300, -50) };
+  for (int i = 0; i < 3; i++) {
+    Vector2 pix = nested.point_to_pixel(points[i]);
+    EXPECT_VECTOR_NEAR( pix, composed.point_to_pixel(points[i]), 1e-6 );
+    EXPECT_VECTOR_NEAR( nested.camera_center(pix), composed.camera_center(pix), 1e-6 );
+  }
+}
@@ -0,0 +1,191 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/ChunkedPointCloud.h>
+#include <asp/Core/PointUtils.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( ChunkedPointCloud, WriteRead ) {
+
+  // Points near the surface of the Earth, with a few invalid ones
+  Vector3 shift(-2.5e+6, -4.6e+6, 3.5e+6);
+  double rounding_error = 1.0/1024.0;
+  ImageView<Vector4> cloud(70, 45);
+  for (int row = 0; row < cloud.rows(); row++) {
+    for (int col = 0; col < cloud.cols(); col++) {
+      if ((col + row) % 11 == 0)
+        continue; // invalid, stays zero
+      cloud(col, row) = Vector4(shift[0] + 0.37*col, shift[1] - 0.21*row,
+                                shift[2] + 0.05*col*row, 0.01*col);
+    }
+  }
+
+  UnlinkName file("chunked_pc_test.pcc");
+  write_chunked_point_cloud(file, shift, rounding_error, cloud, false,
+                            cartography::GeoReference(), 32, 2,
+                            ProgressCallback::dummy_instance());
+  EXPECT_TRUE(is_chunked_point_cloud(file));
+
+  ChunkedPointCloudReader reader(file);
+  ASSERT_EQ(cloud.cols(), reader.cols());
+  ASSERT_EQ(cloud.rows(), reader.rows());
+  EXPECT_EQ(4, reader.num_channels());
+  EXPECT_EQ(6u, reader.blocks().size());
+
+  uint64 num_valid = 0;
+  for (size_t i = 0; i < reader.blocks().size(); i++)
+    num_valid += reader.blocks()[i].num_valid;
+  EXPECT_EQ(uint64(70*45 - 287), num_valid);
+
+  BBox3 bbox = reader.point_bbox();
+  EXPECT_NEAR(shift[0], bbox.min()[0], 1.0);
+  EXPECT_NEAR(shift[0] + 0.37*69, bbox.max()[0], 1e-2);
+
+  ImageView<Vector4> out = read_asp_point_cloud<4>(file);
+  ASSERT_EQ(cloud.cols(), out.cols());
+  for (int row = 0; row < cloud.rows(); row++) {
+    for (int col = 0; col < cloud.cols(); col++) {
+      for (int c = 0; c < 4; c++)
+        EXPECT_NEAR(cloud(col, row)[c], out(col, row)[c], rounding_error);
+    }
+  }
+
+  // A selective read of three channels
+  ImageView<Vector3> part = crop(read_chunked_point_cloud<3>(file), BBox2i(30, 20, 10, 10));
+  EXPECT_NEAR(cloud(35, 25)[2], part(5, 5)[2], rounding_error);
+}
+
+TEST( ChunkedPointCloud, MergeTiles ) {
+
+  // Two tiles of the full size, each valid only in its own box, and a
+  // strip at the bottom in no tile.
+  Vector3 shift(1.2e+6, -4.8e+6, 4.0e+6);
+  double rounding_error = 1.0/1024.0;
+  BBox2i boxes[2] = {BBox2i(0, 0, 25, 40), BBox2i(25, 0, 35, 40)};
+  std::vector<ImageViewRef<Vector3> > tiles;
+  std::vector<BBox2i> tile_boxes;
+  for (int t = 0; t < 2; t++) {
+    ImageView<Vector3> tile(60, 50);
+    for (int row = 0; row < tile.rows(); row++) {
+      for (int col = 0; col < tile.cols(); col++) {
+        // Junk outside the box, which must not be used
+        tile(col, row) = shift + Vector3(0.5*col, 0.25*row, t);
+        if (!boxes[t].contains(Vector2i(col, row)))
+          tile(col, row) = Vector3(1, 2, 3);
+      }
+    }
+    tiles.push_back(tile);
+    tile_boxes.push_back(boxes[t]);
+  }
+
+  UnlinkName file("chunked_pc_merge_test.pcc");
+  merge_point_cloud_tiles(file, Vector2i(60, 50), tiles, tile_boxes, shift, rounding_error,
+                          false, cartography::GeoReference(), 16, 3,
+                          ProgressCallback::dummy_instance());
+
+  ChunkedPointCloudReader reader(file);
+  ASSERT_EQ(60, reader.cols());
+  ASSERT_EQ(50, reader.rows());
+  EXPECT_EQ(3, reader.num_channels());
+  EXPECT_EQ(16u, reader.blocks().size());
+  EXPECT_EQ(shift, reader.shift());
+
+  ImageView<Vector3> out = read_chunked_point_cloud<3>(file);
+  for (int row = 0; row < out.rows(); row++) {
+    for (int col = 0; col < out.cols(); col++) {
+      if (row >= 40) {
+        EXPECT_EQ(Vector3(), out(col, row));
+        continue;
+      }
+      Vector3 expected = shift + Vector3(0.5*col, 0.25*row, col < 25 ? 0 : 1);
+      for (int c = 0; c < 3; c++)
+        EXPECT_NEAR(expected[c], out(col, row)[c], rounding_error);
+    }
+  }
+}
+
+TEST( ChunkedPointCloud, MergeCopiesBlocks ) {
+
+  // Two chunked tiles. The blocks on either side of the boundary
+  // between their boxes are copied, and the block across it is
+  // merged.
+  Vector3 shift(1.2e+6, -4.8e+6, 4.0e+6);
+  double rounding_error = 1.0/1024.0;
+  int block_size = 16;
+  BBox2i boxes[2] = {BBox2i(0, 0, 40, 48), BBox2i(40, 0, 24, 48)};
+  std::vector<ImageViewRef<Vector4> > tiles;
+  std::vector<boost::shared_ptr<ChunkedPointCloudReader> > readers;
+  std::vector<BBox2i> tile_boxes;
+  UnlinkName tile_file0("chunked_pc_copy_tile0.pcc"), tile_file1("chunked_pc_copy_tile1.pcc");
+  std::string tile_files[2] = {tile_file0, tile_file1};
+  for (int t = 0; t < 2; t++) {
+    ImageView<Vector4> tile(64, 48);
+    for (int row = 0; row < tile.rows(); row++) {
+      for (int col = 0; col < tile.cols(); col++) {
+        if ((col + 2*row) % 13 == 0)
+          continue; // invalid
+        tile(col, row) = Vector4(shift[0] + 0.5*col, shift[1] + 0.25*row, shift[2] + t, 0.1*t);
+      }
+    }
+    write_chunked_point_cloud(tile_files[t], shift, rounding_error, tile, false,
+                              cartography::GeoReference(), block_size, 2,
+                              ProgressCallback::dummy_instance());
+    readers.push_back(boost::shared_ptr<ChunkedPointCloudReader>
+                      (new ChunkedPointCloudReader(tile_files[t])));
+    tiles.push_back(ChunkedPointCloudView<4>(readers.back()));
+    tile_boxes.push_back(boxes[t]);
+  }
+
+  UnlinkName file("chunked_pc_copy_test.pcc");
+  int num_copied = merge_point_cloud_tiles<4>(file, Vector2i(64, 48), tiles, readers,
+                                              tile_boxes, shift, rounding_error, false,
+                                              cartography::GeoReference(), block_size, 3,
+                                              ProgressCallback::dummy_instance());
+  EXPECT_EQ(9, num_copied);
+
+  // The copied blocks are the same bytes as in the tiles
+  ChunkedPointCloudReader reader(file);
+  ASSERT_EQ(12u, reader.blocks().size());
+  for (size_t i = 0; i < reader.blocks().size(); i++) {
+    BBox2i box = reader.blocks()[i].pixel_box;
+    if (box.min().x() == 32)
+      continue;
+    int t = (box.min().x() < 32) ? 0 : 1;
+    std::vector<unsigned char> pos_out, err_out, pos_in, err_in;
+    reader.read_encoded_block(i, pos_out, err_out);
+    readers[t]->read_encoded_block(i, pos_in, err_in);
+    EXPECT_TRUE(pos_out == pos_in);
+    EXPECT_TRUE(err_out == err_in);
+    EXPECT_EQ(readers[t]->blocks()[i].num_valid, reader.blocks()[i].num_valid);
+  }
+
+  ImageView<Vector4> out = read_chunked_point_cloud<4>(file);
+  for (int row = 0; row < out.rows(); row++) {
+    for (int col = 0; col < out.cols(); col++) {
+      int t = (col < 40) ? 0 : 1;
+      Vector4 expected;
+      if ((col + 2*row) % 13 != 0)
+        expected = Vector4(shift[0] + 0.5*col, shift[1] + 0.25*row, shift[2] + t, 0.1*t);
+      for (int c = 0; c < 4; c++)
+        EXPECT_NEAR(expected[c], out(col, row)[c], rounding_error);
+    }
+  }
+}
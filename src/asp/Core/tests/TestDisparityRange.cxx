@@ -0,0 +1,47 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/DisparityRange.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( DisparityRange, RobustRange ) {
+
+  // Disparities between 0 and 9, and a single outlier
+  std::vector<DispRangeSample> samples;
+  for (int i = 0; i < 100; i++)
+    samples.push_back(DispRangeSample(Vector2f(i % 10, 0), Vector2f(i % 10, 0)));
+  samples.push_back(DispRangeSample(Vector2f(500, 0), Vector2f(500, 0)));
+
+  BBox2f minmax = minmax_disparity_range(samples);
+  EXPECT_EQ(500, minmax.max().x());
+
+  BBox2f robust = robust_disparity_range(samples, 2.0);
+  EXPECT_EQ(0, robust.min().x());
+  EXPECT_EQ(9, robust.max().x());
+  EXPECT_FALSE(is_multimodal(samples, 2.0, 4.0));
+
+  // Two clusters far apart
+  samples.clear();
+  for (int i = 0; i < 100; i++)
+    samples.push_back(DispRangeSample(Vector2f(i % 3 + (i < 50 ? 0 : 40), 1),
+                                      Vector2f(i % 3 + (i < 50 ? 0 : 40), 1)));
+  EXPECT_TRUE(is_multimodal(samples, 2.0, 4.0));
+}
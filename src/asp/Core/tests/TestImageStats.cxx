@@ -0,0 +1,167 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/ImageStats.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/MaskViews.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/FileIO/DiskImageIO.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <gdal_priv.h>
+#include <boost/filesystem/operations.hpp>
+#include <fstream>
+#include <limits>
+
+using namespace vw;
+using namespace asp;
+
+TEST( ImageStats, MergeAndStats ) {
+
+  ImageStatsAccumulator all, a, b;
+  for (int i = 0; i <= 100; i++) {
+    all(i);
+    if (i % 2 == 0) a(i);
+    else            b(i);
+  }
+  a.merge(b);
+  EXPECT_EQ(all.size(), a.size());
+
+  Vector6f s = a.stats();
+  EXPECT_EQ(0,   s[0]);
+  EXPECT_EQ(100, s[1]);
+  EXPECT_NEAR(50, s[2], 1e-5);
+  EXPECT_NEAR(sqrt(850.0), s[3], 1e-4);
+  EXPECT_EQ(2,  s[4]);
+  EXPECT_EQ(98, s[5]);
+
+  ImageStatsAccumulator empty;
+  EXPECT_EQ(0, empty.stats()[1]);
+}
+
+TEST( ImageStats, Image ) {
+
+  // Larger than a million pixels, so it gets subsampled, with a
+  // masked border.
+  ImageView<PixelMask<float> > img(1500, 1000);
+  for (int row = 0; row < img.rows(); row++) {
+    for (int col = 0; col < img.cols(); col++) {
+      img(col, row) = PixelMask<float>(col % 50 + row % 7);
+      if (col < 10)
+        img(col, row).invalidate();
+    }
+  }
+
+  ImageStatsAccumulator accum;
+  accumulate_image(img, accum);
+
+  // Same as going through the subsampled pixels in order
+  int scale = stats_subsample_scale(img.cols(), img.rows());
+  EXPECT_EQ(2, scale);
+  ImageStatsAccumulator serial;
+  for (int row = 0; row < img.rows(); row += scale) {
+    for (int col = 0; col < img.cols(); col += scale) {
+      if (is_valid(img(col, row)))
+        serial(img(col, row).child());
+    }
+  }
+  EXPECT_EQ(serial.size(), accum.size());
+  Vector6f s1 = accum.stats(), s2 = serial.stats();
+  for (int i = 0; i < 6; i++)
+    EXPECT_NEAR(s2[i], s1[i], 1e-4);
+}
+
+TEST( ImageStats, Sidecar ) {
+
+  EXPECT_EQ("run/out-image_stats_test.stats.txt",
+            stats_sidecar_file("run/out", "dir/image_stats_test.tif"));
+
+  UnlinkName image("image_stats_test.tif"), sidecar("image_stats_test.stats.txt");
+  {
+    std::ofstream fh(image.c_str());
+    fh << "some pixels";
+  }
+
+  Vector6f stats, read;
+  for (int i = 0; i < 6; i++)
+    stats[i] = 0.5 + i;
+  EXPECT_FALSE(read_stats_sidecar(sidecar, image, -32768, read));
+  write_stats_sidecar(sidecar, image, -32768, stats);
+  EXPECT_TRUE(read_stats_sidecar(sidecar, image, -32768, read));
+  for (int i = 0; i < 6; i++)
+    EXPECT_EQ(stats[i], read[i]);
+
+  // Not for another nodata value, or once the image changes
+  EXPECT_FALSE(read_stats_sidecar(sidecar, image, 0, read));
+  {
+    std::ofstream fh(image.c_str());
+    fh << "some other pixels";
+  }
+  EXPECT_FALSE(read_stats_sidecar(sidecar, image, -32768, read));
+}
+
+TEST( ImageStats, OverviewWithNaNNodata ) {
+
+  // An image with no nodata value, so all pixels are valid, including
+  // the zeros, and with an overview at half the resolution.
+  UnlinkName image("image_stats_overview_test.tif"), sidecar("image_stats_overview_test.stats.txt");
+  ImageView<float> img(1200, 900);
+  for (int row = 0; row < img.rows(); row++) {
+    for (int col = 0; col < img.cols(); col++)
+      img(col, row) = (col < 10) ? 0 : col % 50 + row % 7;
+  }
+  write_image(image, img);
+  {
+    GDALAllRegister();
+    GDALDataset * dataset = (GDALDataset*)GDALOpen(image.c_str(), GA_Update);
+    ASSERT_TRUE(dataset != NULL);
+    int levels[] = {2};
+    EXPECT_EQ(CE_None, dataset->BuildOverviews("NEAREST", 1, levels, 0, NULL, NULL, NULL));
+    GDALClose(dataset);
+  }
+
+  float nodata = std::numeric_limits<float>::quiet_NaN();
+  ImageStatsAccumulator accum;
+  ASSERT_TRUE(accumulate_overview(image, nodata, 600, 450, accum));
+  EXPECT_EQ(size_t(600*450), accum.size());
+
+  DiskImageView<float> disk_image(image);
+  Vector6f stats = gather_image_stats(create_mask_less_or_equal(disk_image, nodata),
+                                      image, nodata, "test", sidecar);
+  // The overview may keep either pixel of each pair
+  EXPECT_EQ(0,  stats[0]);
+  EXPECT_GE(stats[1], 54);
+  EXPECT_LE(stats[1], 55);
+  EXPECT_GT(stats[3], 0);
+
+  // The same as from the sidecar, which is used with a NaN nodata too
+  Vector6f read;
+  ASSERT_TRUE(read_stats_sidecar(sidecar, image, nodata, read));
+  for (int i = 0; i < 6; i++)
+    EXPECT_EQ(stats[i], read[i]);
+  boost::filesystem::remove(std::string(sidecar));
+
+  // With all pixels masked there is nothing to save
+  nodata = 1000;
+  accum = ImageStatsAccumulator();
+  EXPECT_FALSE(accumulate_overview(image, nodata, 600, 450, accum));
+  stats = gather_image_stats(create_mask_less_or_equal(disk_image, nodata),
+                             image, nodata, "test", sidecar);
+  EXPECT_EQ(0, stats[1]);
+  EXPECT_FALSE(boost::filesystem::exists(std::string(sidecar)));
+}
@@ -0,0 +1,144 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/LocalHomography.h>
+#include <fstream>
+
+using namespace vw;
+using namespace asp;
+
+TEST( LocalHomography, SplitNIntoK ) {
+  std::vector<int> partition;
+  split_n_into_k(8, 3, partition);
+  ASSERT_EQ(4u, partition.size());
+  EXPECT_EQ(0, partition[0]);
+  EXPECT_EQ(3, partition[1]);
+  EXPECT_EQ(6, partition[2]);
+  EXPECT_EQ(8, partition[3]);
+}
+
+TEST( LocalHomography, WriteAndMap ) {
+
+  ImageView<Matrix3x3> local_hom(3, 2);
+  for (int row = 0; row < local_hom.rows(); row++){
+    for (int col = 0; col < local_hom.cols(); col++){
+      for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+          local_hom(col, row)(r, c) = 100*col + 10*row + 3*r + c + 0.25;
+    }
+  }
+
+  UnlinkName file("local_hom_test.bin");
+  write_local_homographies(file, local_hom);
+
+  LocalHomographies mapped(file);
+  ASSERT_EQ(3, mapped.cols());
+  ASSERT_EQ(2, mapped.rows());
+  for (int row = 0; row < local_hom.rows(); row++){
+    for (int col = 0; col < local_hom.cols(); col++){
+      EXPECT_EQ(0.0, max(abs(local_hom(col, row) - mapped(col, row))));
+    }
+  }
+
+  // Copies share the mapping
+  LocalHomographies copy = mapped;
+  EXPECT_EQ(0.0, max(abs(local_hom(2, 1) - copy(2, 1))));
+}
+
+TEST( LocalHomography, InvalidFile ) {
+  EXPECT_THROW(LocalHomographies("local_hom_missing.bin"), IOErr);
+
+  UnlinkName file("local_hom_bad.bin");
+  {
+    std::ofstream fh(file.c_str());
+    fh << "1 1\n1 0 0 0 1 0 0 0 1\n"; // the old text format
+  }
+  EXPECT_THROW(LocalHomographies(file.c_str()), IOErr);
+}
+
+namespace {
+
+  // Check that each fitted homography takes the right image to the
+  // left one, for a D_sub made of the given translations.
+  void expect_translations(ImageView<Matrix3x3> const& local_hom,
+                           ImageView<Vector2i> const& truth, int ts) {
+    for (int row = 0; row < local_hom.rows(); row++){
+      for (int col = 0; col < local_hom.cols(); col++){
+        for (int k = 0; k < 3; k++){
+          Vector2 left(col*ts + (k + 1)*ts/4.0, row*ts + (k + 1)*ts/4.0);
+          Vector2 d = truth(col, row);
+          Vector3 q = local_hom(col, row)*Vector3(left.x() + d.x(), left.y() + d.y(), 1);
+          EXPECT_VECTOR_NEAR(left, subvector(q, 0, 2)/q[2], 0.5) << col << " " << row;
+        }
+      }
+    }
+  }
+
+}
+
+TEST( LocalHomography, FitWithOutliers ) {
+
+  // Each tile of D_sub has its own translation, differing by one pixel
+  // between neighbors, with scattered outliers and invalid pixels.
+  int ts = 20;
+  ImageView<Vector2i> truth(3, 3);
+  for (int row = 0; row < truth.rows(); row++)
+    for (int col = 0; col < truth.cols(); col++)
+      truth(col, row) = Vector2i(10 + col, 2 + row);
+
+  ImageView<PixelMask<Vector2i> > sub_disp(3*ts, 3*ts);
+  for (int y = 0; y < sub_disp.rows(); y++){
+    for (int x = 0; x < sub_disp.cols(); x++){
+      sub_disp(x, y) = PixelMask<Vector2i>(truth(x/ts, y/ts));
+      if ((7*x + 13*y) % 61 == 0)
+        sub_disp(x, y) = PixelMask<Vector2i>(Vector2i(60, -40));
+      if ((x + 3*y) % 47 == 0)
+        invalidate(sub_disp(x, y));
+    }
+  }
+
+  ImageView<Matrix3x3> plain_hom, seeded_hom;
+  LocalHomographyFitStats plain_stats, seeded_stats;
+  Vector2i size(sub_disp.cols(), sub_disp.rows());
+  fit_local_homographies(sub_disp, size, Vector2(1, 1), ts, false, plain_hom, plain_stats);
+  fit_local_homographies(sub_disp, size, Vector2(1, 1), ts, true, seeded_hom, seeded_stats);
+
+  ASSERT_EQ(3, plain_hom.cols());
+  ASSERT_EQ(3, plain_hom.rows());
+  EXPECT_EQ(9, plain_stats.num_tiles);
+  EXPECT_EQ(0, plain_stats.num_failed);
+  EXPECT_EQ(0, plain_stats.num_seeded);
+  expect_translations(plain_hom, truth, ts);
+
+  // The tiles of the second pass fit a neighbor, so skip RANSAC, and
+  // still end up with their own translation.
+  ASSERT_EQ(3, seeded_hom.cols());
+  EXPECT_EQ(9, seeded_stats.num_tiles);
+  EXPECT_EQ(0, seeded_stats.num_failed);
+  EXPECT_EQ(4, seeded_stats.num_seeded);
+  EXPECT_LT(seeded_stats.ransac_iterations, plain_stats.ransac_iterations);
+  expect_translations(seeded_hom, truth, ts);
+
+  // The tiles of the first pass do not depend on the seeding or the
+  // order in which the tiles are done
+  for (int row = 0; row < 3; row++)
+    for (int col = 0; col < 3; col++)
+      if ((col + row) % 2 == 0)
+        EXPECT_EQ(0.0, max(abs(plain_hom(col, row) - seeded_hom(col, row))));
+}
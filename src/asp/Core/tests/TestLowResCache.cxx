@@ -0,0 +1,98 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/LowResCache.h>
+#include <boost/filesystem/operations.hpp>
+#include <fstream>
+
+using namespace vw;
+using namespace asp;
+namespace fs = boost::filesystem;
+
+namespace {
+  void write_text(std::string const& file, std::string const& text) {
+    std::ofstream fh(file.c_str());
+    fh << text;
+  }
+  std::string read_text(std::string const& file) {
+    std::ifstream fh(file.c_str());
+    std::string text;
+    std::getline(fh, text);
+    return text;
+  }
+}
+
+TEST( LowResCache, Key ) {
+
+  UnlinkName a("lowres_cache_a.txt"), b("lowres_cache_b.txt");
+  write_text(a, "some image");
+  write_text(b, "some image");
+  EXPECT_EQ(file_checksum(a), file_checksum(b));
+
+  std::vector<std::string> files(1, a);
+  std::string key = lowres_cache_key(files, "seed_mode=1 kernel=(21,21)");
+  EXPECT_EQ(16u, key.size());
+  EXPECT_NE(key, lowres_cache_key(files, "seed_mode=1 kernel=(25,25)"));
+
+  write_text(b, "another image");
+  files[0] = b;
+  EXPECT_NE(key, lowres_cache_key(files, "seed_mode=1 kernel=(21,21)"));
+}
+
+TEST( LowResCache, SampledChecksum ) {
+
+  // A file over the size limit is hashed from samples of it
+  UnlinkName a("lowres_cache_large.bin");
+  std::string data(100000, 'x');
+  write_text(a, data);
+  std::string full = file_checksum(a), sampled = file_checksum(a, 1000);
+  EXPECT_NE(full, sampled);
+  EXPECT_EQ(sampled, file_checksum(a, 1000));
+
+  // The first and last bytes are always sampled
+  data[0] = 'y';
+  write_text(a, data);
+  std::string changed = file_checksum(a, 1000);
+  EXPECT_NE(sampled, changed);
+  data[data.size() - 1] = 'y';
+  write_text(a, data);
+  EXPECT_NE(changed, file_checksum(a, 1000));
+}
+
+TEST( LowResCache, StoreFetch ) {
+
+  std::string cache_dir = "lowres_cache_test_dir";
+  fs::remove_all(cache_dir);
+
+  UnlinkName d_sub("run1-D_sub.tif"), d_sub2("run2-D_sub.tif");
+  write_text(d_sub, "disparity");
+
+  std::vector<std::string> suffixes(1, "-D_sub.tif");
+  EXPECT_FALSE(fetch_from_lowres_cache(cache_dir, "0123", "run2", suffixes));
+
+  store_in_lowres_cache(cache_dir, "0123", "settings", "run1", suffixes);
+  EXPECT_TRUE(fetch_from_lowres_cache(cache_dir, "0123", "run2", suffixes));
+  EXPECT_EQ("disparity", read_text(d_sub2));
+
+  // An entry lacking a file does not count
+  suffixes.push_back("-D_sub_spread.tif");
+  EXPECT_FALSE(fetch_from_lowres_cache(cache_dir, "0123", "run2", suffixes));
+
+  fs::remove_all(cache_dir);
+}
@@ -0,0 +1,51 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/QuantileFilter.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( QuantileFilter, MergedHistogram ) {
+
+  // Split the values 0, ..., 99 among two histograms, with one outlier
+  DisparityHistogram hist1, hist2;
+  for (int i = 0; i < 100; i++) {
+    if (i % 2 == 0) hist1.add(Vector2i(i, -i));
+    else            hist2.add(Vector2i(i, -i));
+  }
+  hist2.add(Vector2i(10000, 0));
+  hist1.merge(hist2);
+  EXPECT_EQ(101u, hist1.count());
+
+  EXPECT_EQ(0,   hist1.quantile(0, 0.0));
+  EXPECT_EQ(50,  hist1.quantile(0, 0.5));
+  EXPECT_EQ(10000, hist1.quantile(0, 1.0));
+  EXPECT_EQ(-99, hist1.quantile(1, 0.0));
+
+  Vector2 lo, hi;
+  hist1.outlier_brackets(0.75, 1.0, lo, hi);
+  EXPECT_LT(hi[0], 10000);
+  EXPECT_GT(hi[0], 99);
+  EXPECT_LT(lo[0], 0);
+
+  QuantileBracketFunctor filter(lo, hi);
+  EXPECT_TRUE (is_valid(filter(PixelMask<Vector2i>(Vector2i(50, -50)))));
+  EXPECT_FALSE(is_valid(filter(PixelMask<Vector2i>(Vector2i(10000, 0)))));
+}
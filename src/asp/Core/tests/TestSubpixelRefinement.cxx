@@ -0,0 +1,176 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/SubpixelRefinement.h>
+#include <asp/Core/StereoSettings.h>
+#include <vw/Stereo/PreFilter.h>
+#include <vw/Stereo/SubpixelView.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( SubpixelRefinement, ParabolaFit ) {
+
+  // Sample a quadratic with a known minimum on the 3x3 grid
+  double x0 = 0.3, y0 = -0.2;
+  float cost[9];
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      double dx = x - x0, dy = y - y0;
+      cost[3*(y+1) + (x+1)] = 2.0*dx*dx + 1.5*dy*dy + 0.5*dx*dy + 7.0;
+    }
+  }
+
+  float dx = 0, dy = 0;
+  EXPECT_TRUE(parabola_fit_3x3(cost, dx, dy));
+  EXPECT_NEAR(x0, dx, 1e-5);
+  EXPECT_NEAR(y0, dy, 1e-5);
+
+  // A surface with a maximum has no valid fit
+  for (int k = 0; k < 9; k++)
+    cost[k] = -cost[k];
+  EXPECT_FALSE(parabola_fit_3x3(cost, dx, dy));
+}
+
+TEST( SubpixelRefinement, ParabolaRefineTile ) {
+
+  // The right image is the left one shifted by a fractional amount
+  double shift = 3.3;
+  BBox2i region(-20, -20, 80, 80);
+  ImageView<PixelGray<float> > left(region.width(), region.height()),
+                               right(region.width(), region.height());
+  for (int row = 0; row < left.rows(); row++) {
+    for (int col = 0; col < left.cols(); col++) {
+      double x = col + region.min().x(), y = row + region.min().y();
+      left (col, row) = sin(0.3*x) + cos(0.2*y);
+      right(col, row) = sin(0.3*(x - shift)) + cos(0.2*y);
+    }
+  }
+  AlignedTile left_tile, right_tile;
+  left_tile.reset(region);
+  left_tile.fill(left);
+  right_tile.reset(region);
+  right_tile.fill(right);
+  EXPECT_EQ(0, left_tile.stride() % 8);
+
+  BBox2i bbox(0, 0, 16, 16);
+  ImageView<PixelMask<Vector2i> > integer_disp(bbox.width(), bbox.height());
+  for (int row = 0; row < bbox.height(); row++)
+    for (int col = 0; col < bbox.width(); col++)
+      integer_disp(col, row) = PixelMask<Vector2i>(Vector2i(3, 0));
+  invalidate(integer_disp(5, 5));
+
+  ImageView<PixelMask<Vector2f> > refined_disp;
+  parabola_refine_tile(left_tile, right_tile, bbox, integer_disp,
+                       Vector2i(7, 7), refined_disp);
+  ASSERT_EQ(bbox.width(),  refined_disp.cols());
+  ASSERT_EQ(bbox.height(), refined_disp.rows());
+  EXPECT_FALSE(is_valid(refined_disp(5, 5)));
+  EXPECT_TRUE(is_valid(refined_disp(8, 8)));
+  EXPECT_NEAR(shift, refined_disp(8, 8).child()[0], 0.2);
+  EXPECT_NEAR(0.0,   refined_disp(8, 8).child()[1], 0.2);
+}
+
+TEST( SubpixelRefinement, ParabolaTileMatchesVW ) {
+
+  // The parabola engine must agree with the parabola mode done
+  // without the tile engine.
+  double shift = 2.4;
+  ImageView<PixelGray<float> > left(120, 120), right(120, 120);
+  ImageView<PixelMask<Vector2i> > integer_disp(120, 120);
+  for (int row = 0; row < left.rows(); row++) {
+    for (int col = 0; col < left.cols(); col++) {
+      left (col, row) = sin(0.3*col)*cos(0.25*row) + sin(0.11*(col + row));
+      right(col, row) = sin(0.3*(col - shift))*cos(0.25*row) + sin(0.11*(col - shift + row));
+      integer_disp(col, row) = PixelMask<Vector2i>(Vector2i(2, 0));
+    }
+  }
+
+  stereo_settings().subpixel_mode   = 1;
+  stereo_settings().pre_filter_mode = 2;
+  stereo_settings().slogW           = 1.5;
+  stereo_settings().subpixel_kernel = Vector2i(7, 7);
+
+  BBox2i bbox(37, 41, 32, 32);
+  ImageView<PixelMask<Vector2f> > tile_disp
+    = refine_tile(left, right, integer_disp, bbox, false);
+  ImageView<PixelMask<Vector2f> > vw_disp
+    = crop(vw::stereo::parabola_subpixel(integer_disp, left, right,
+                                         vw::stereo::LaplacianOfGaussian(1.5),
+                                         Vector2i(7, 7)), bbox);
+  ASSERT_EQ(bbox.width(),  tile_disp.cols());
+  ASSERT_EQ(bbox.height(), tile_disp.rows());
+  for (int row = 0; row < bbox.height(); row += 5) {
+    for (int col = 0; col < bbox.width(); col += 5) {
+      ASSERT_TRUE(is_valid(vw_disp(col, row)));
+      ASSERT_TRUE(is_valid(tile_disp(col, row)));
+      EXPECT_VECTOR_NEAR(vw_disp(col, row).child(), tile_disp(col, row).child(), 0.1);
+      EXPECT_NEAR(shift, tile_disp(col, row).child()[0], 0.2);
+    }
+  }
+}
+
+TEST( SubpixelRefinement, AlignRegion ) {
+  EXPECT_EQ(BBox2i(-8, 4, 16, 8), align_region(BBox2i(-5, 5, 10, 6), 4));
+  EXPECT_EQ(BBox2i(12, 12, 8, 4), align_region(BBox2i(12, 12, 8, 4), 4));
+}
+
+TEST( SubpixelRefinement, AffineTileMatchesFullImage ) {
+
+  // The affine mode on a tile must give what it gives on the whole
+  // image, as done without the tile engine.
+  double shift = 2.6;
+  ImageView<PixelGray<float> > left(200, 200), right(200, 200);
+  ImageView<PixelMask<Vector2i> > integer_disp(200, 200);
+  for (int row = 0; row < left.rows(); row++) {
+    for (int col = 0; col < left.cols(); col++) {
+      left (col, row) = sin(0.3*col)*cos(0.25*row) + sin(0.11*(col + row));
+      right(col, row) = sin(0.3*(col - shift))*cos(0.25*row) + sin(0.11*(col - shift + row));
+      integer_disp(col, row) = PixelMask<Vector2i>(Vector2i(3, 0));
+    }
+  }
+
+  stereo_settings().subpixel_mode       = 3;
+  stereo_settings().slogW               = 1.5;
+  stereo_settings().subpixel_kernel     = Vector2i(21, 21);
+  stereo_settings().subpixel_max_levels = 2;
+
+  // The tiles are grown by the pyramid and filter halos, then aligned
+  // to multiples of 4, the scale of the coarsest level. The origin
+  // here is a multiple of 4 so that the left tile, at 12, is aligned
+  // before and after that, while the right tile, at 15, is not.
+  BBox2i bbox(64, 64, 48, 48);
+  ImageView<PixelMask<Vector2f> > tile_disp
+    = refine_tile(left, right, integer_disp, bbox, false);
+  ImageView<PixelMask<Vector2f> > full_disp
+    = crop(vw::stereo::affine_subpixel(integer_disp, left, right,
+                                       vw::stereo::LaplacianOfGaussian(1.5),
+                                       Vector2i(21, 21), 2), bbox);
+  ASSERT_EQ(bbox.width(),  tile_disp.cols());
+  ASSERT_EQ(bbox.height(), tile_disp.rows());
+  for (int row = 0; row < bbox.height(); row += 7) {
+    for (int col = 0; col < bbox.width(); col += 7) {
+      ASSERT_EQ(is_valid(full_disp(col, row)), is_valid(tile_disp(col, row)));
+      if (!is_valid(full_disp(col, row)))
+        continue;
+      EXPECT_VECTOR_NEAR(full_disp(col, row).child(), tile_disp(col, row).child(), 1e-3);
+      EXPECT_NEAR(shift, tile_disp(col, row).child()[0], 0.1);
+    }
+  }
+}
@@ -0,0 +1,132 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/TilePlan.h>
+
+using namespace vw;
+using namespace asp;
+
+// Check that the tiles cover the image without overlapping
+void expect_partition(std::vector<BBox2i> const& tiles, Vector2i const& size) {
+  double area = 0;
+  for (size_t i = 0; i < tiles.size(); i++) {
+    EXPECT_GT(tiles[i].width(),  0);
+    EXPECT_GT(tiles[i].height(), 0);
+    EXPECT_TRUE(BBox2i(0, 0, size.x(), size.y()).contains(tiles[i]));
+    area += double(tiles[i].width())*tiles[i].height();
+    for (size_t j = 0; j < i; j++) {
+      bool overlap = tiles[i].min().x() < tiles[j].max().x() && tiles[j].min().x() < tiles[i].max().x()
+                  && tiles[i].min().y() < tiles[j].max().y() && tiles[j].min().y() < tiles[i].max().y();
+      EXPECT_FALSE(overlap);
+    }
+  }
+  EXPECT_EQ(double(size.x())*size.y(), area);
+}
+
+TEST( TilePlan, BlockCosts ) {
+
+  // The disparity varies a lot on the right, and the left mask hides
+  // the bottom.
+  Vector2i size(400, 400);
+  ImageView<PixelMask<Vector2i> > d_sub(40, 40), spread;
+  ImageView<uint8> mask_sub(40, 40);
+  for (int row = 0; row < 40; row++) {
+    for (int col = 0; col < 40; col++) {
+      d_sub(col, row)    = PixelMask<Vector2i>(Vector2i(col < 20 ? 0 : (col % 2)*10, 0));
+      mask_sub(col, row) = (row < 20) ? 255 : 0;
+    }
+  }
+
+  ImageView<double> costs = correlation_block_costs(d_sub, spread, mask_sub, size,
+                                                    BBox2i(0, 0, 400, 400), 100);
+  ASSERT_EQ(4, costs.cols());
+  ASSERT_EQ(4, costs.rows());
+  EXPECT_GT(costs(3, 0), costs(0, 0));
+  EXPECT_EQ(100.0*100, costs(3, 3)); // masked, so just the pixels
+  EXPECT_GT(costs(0, 0), costs(0, 3));
+
+  // The spread grows the search range
+  spread.set_size(40, 40);
+  for (int row = 0; row < 40; row++)
+    for (int col = 0; col < 40; col++)
+      spread(col, row) = PixelMask<Vector2i>(Vector2i(2, 2));
+  ImageView<double> spread_costs = correlation_block_costs(d_sub, spread, mask_sub, size,
+                                                           BBox2i(0, 0, 400, 400), 100);
+  EXPECT_GT(spread_costs(0, 0), costs(0, 0));
+
+  // Nothing outside the crop window
+  costs = correlation_block_costs(d_sub, spread, mask_sub, size, BBox2i(0, 0, 150, 400), 100);
+  EXPECT_GT(costs(1, 0), 0);
+  EXPECT_EQ(0, costs(2, 0));
+}
+
+TEST( TilePlan, EqualCosts ) {
+
+  // Uniform cost gives tiles of equal size
+  Vector2i size(1000, 800);
+  ImageView<double> costs(10, 8);
+  for (int row = 0; row < costs.rows(); row++)
+    for (int col = 0; col < costs.cols(); col++)
+      costs(col, row) = 1;
+
+  std::vector<BBox2i> tiles;
+  std::vector<double> tile_costs;
+  plan_tiles(costs, 100, size, BBox2i(0, 0, 1000, 800), 4, tiles, tile_costs);
+  ASSERT_EQ(4u, tiles.size());
+  expect_partition(tiles, size);
+  for (size_t i = 0; i < tiles.size(); i++) {
+    EXPECT_EQ(500*400, tiles[i].width()*tiles[i].height());
+    EXPECT_EQ(20, tile_costs[i]);
+  }
+
+  // With more cost in the left column, the tiles there are narrower
+  for (int row = 0; row < costs.rows(); row++)
+    for (int col = 0; col < costs.cols(); col++)
+      costs(col, row) = (col == 0) ? 5 : 1;
+  plan_tiles(costs, 100, size, BBox2i(0, 0, 1000, 800), 4, tiles, tile_costs);
+  ASSERT_EQ(4u, tiles.size());
+  expect_partition(tiles, size);
+  for (size_t i = 0; i < tiles.size(); i++)
+    EXPECT_EQ(28, tile_costs[i]);
+  EXPECT_EQ(300, tiles[0].width());
+  EXPECT_EQ(700, tiles[3].width());
+}
+
+TEST( TilePlan, CropWindow ) {
+
+  // Tiles inside the window, which is grown to whole blocks, and the
+  // rest of the image around them.
+  Vector2i size(1050, 820);
+  ImageView<double> costs(11, 9);
+  for (int row = 0; row < costs.rows(); row++)
+    for (int col = 0; col < costs.cols(); col++)
+      costs(col, row) = (col >= 2 && col < 6 && row >= 3 && row < 7) ? 1 : 0;
+
+  std::vector<BBox2i> tiles;
+  std::vector<double> tile_costs;
+  plan_tiles(costs, 100, size, BBox2i(250, 310, 320, 350), 2, tiles, tile_costs);
+  ASSERT_EQ(6u, tiles.size());
+  expect_partition(tiles, size);
+  EXPECT_EQ(BBox2i(200, 300, 200, 400), tiles[0]);
+  EXPECT_EQ(BBox2i(400, 300, 200, 400), tiles[1]);
+  EXPECT_EQ(8, tile_costs[0]);
+  EXPECT_EQ(8, tile_costs[1]);
+  for (size_t i = 2; i < tiles.size(); i++)
+    EXPECT_EQ(0, tile_costs[i]);
+}
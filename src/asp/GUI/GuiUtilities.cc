@@ -22,6 +22,15 @@
 
 #include <string>
 #include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <ctime>
+#include <algorithm>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
 #include <QtGui>
 #include <QContextMenuEvent>
 
@@ -30,8 +39,11 @@
 #include <vw/Math/EulerAngles.h>
 #include <vw/Image/Algorithms.h>
 #include <vw/Cartography/GeoTransform.h>
-#include <vw/tools/hillshade.h>
 #include <vw/Core/RunOnce.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+#include <asp/Core/LowResCache.h>
+#include <asp/Core/StereoSettings.h>
 #include <asp/GUI/GuiUtilities.h>
 
 using namespace vw;
@@ -111,58 +123,284 @@ QRect bbox2qrect(BBox2 const& B){
                round(B.width()), round(B.height()));
 }
 
-bool write_hillshade(vw::cartography::GdalWriteOptions const& opt,
-                     std::string const& input_file,
-                     std::string      & output_file) {
+void formQimage(bool highlight_nodata, double nodata_val,
+                double min_val, double max_val,
+                ImageView<double> const& clip,
+                QImage & qimg){
+
+  qimg = QImage(clip.cols(), clip.rows(), QImage::Format_ARGB32_Premultiplied);
+  for (int col = 0; col < clip.cols(); col++){
+    for (int row = 0; row < clip.rows(); row++){
+      double v = clip(col, row);
+      v = round(255*(std::min(std::max(v, min_val), max_val) - min_val)/(max_val-min_val));
+
+      // The comparison below is false when nodata_val is NaN
+      if (clip(col, row) <= nodata_val || std::isnan(clip(col, row)) ){
+        
+        if (!highlight_nodata){
+          // transparent
+          qimg.setPixel(col, row, QColor(0, 0, 0, 0).rgba());
+        }else{
+         // highlight in red
+          qimg.setPixel(col, row, qRgb(255, 0, 0));
+        }
+        
+      }else{
+        // opaque
+        qimg.setPixel(col, row, QColor(v, v, v, 255).rgba());
+      }
+    }
+  }
+}
+
+std::string pyramid_cache_dir() {
+  std::string dir = asp::stereo_settings().pyramid_cache_dir;
+  if (dir == "") {
+    char * env_dir = getenv("ASP_PYRAMID_CACHE_DIR");
+    if (env_dir != NULL)
+      dir = env_dir;
+  }
+  return dir;
+}
 
-  // Sanity check: Must have a georeference
-  cartography::GeoReference georef;
-  bool has_georef = vw::cartography::read_georeference(georef, input_file);
-  if (!has_georef) {
-    popUp("No georeference present in: " + input_file + ".");
-    return false;
+namespace {
+  // Cache entries are named "pyr-" followed by 16 hex digits
+  const std::string PYRAMID_PREFIX = "pyr-";
+  const size_t PYRAMID_KEY_LEN = 20;
+
+  // While a session uses an entry it keeps a file named
+  // "<key>.live-<host>-<pid>" next to it, so that other sessions do
+  // not remove the entry. Entries used less than this long ago are
+  // kept as well. A live file from another host, whose process cannot
+  // be checked, counts for this long after the entry was last used.
+  const std::string PYRAMID_LIVE_TAG = ".live-";
+  const double PYRAMID_RECENT_SECONDS     = 3600;
+  const double PYRAMID_REMOTE_LIVE_SECONDS = 24*3600;
+
+  std::string host_name() {
+    char name[256];
+    if (gethostname(name, sizeof(name)) != 0)
+      return "unknown";
+    name[sizeof(name) - 1] = '\0';
+    return name;
   }
 
-  // TODO: Expose these to the user
-  int elevation = 20;
-  int azimuth   = 300;
+  // The live files of this session, removed on exit
+  vw::Mutex g_live_files_mutex;
+  std::set<std::string> g_live_files;
+
+  // If the session which made this live file is still running
+  bool is_live_file(std::string const& name, std::time_t last_used, std::time_t now) {
+    std::string owner = name.substr(name.find(PYRAMID_LIVE_TAG) + PYRAMID_LIVE_TAG.size());
+    size_t dash = owner.rfind('-');
+    if (dash == std::string::npos)
+      return false;
+    std::string host = owner.substr(0, dash);
+    if (host != host_name())
+      return difftime(now, last_used) < PYRAMID_REMOTE_LIVE_SECONDS;
+    pid_t pid = atoi(owner.substr(dash + 1).c_str());
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+  }
+}
+
+std::string pyramid_cache_link(std::string const& image) {
+
+  std::string cache_dir = pyramid_cache_dir();
+  if (cache_dir == "")
+    return image;
+
+  try {
+    fs::path path = fs::absolute(image);
+    std::ostringstream desc;
+    desc << path.string() << " " << fs::last_write_time(path) << " " << fs::file_size(path);
+    std::ostringstream key;
+    key << PYRAMID_PREFIX << std::hex << std::setw(16) << std::setfill('0')
+        << asp::hash_bytes(desc.str().c_str(), desc.str().size());
+
+    // Keep the extension, as it determines how the image is read
+    fs::create_directories(cache_dir);
+    fs::path link = fs::path(cache_dir) / (key.str() + path.extension().string());
+    if (!fs::is_symlink(link)) {
+      try {
+        fs::create_symlink(path, link);
+      } catch (...) {
+        // Another session may have just made it
+        if (!fs::is_symlink(link))
+          throw;
+      }
+    }
+
+    // Note the use of the entry, for trimming the cache
+    std::ofstream used((fs::path(cache_dir) / (key.str() + ".used")).string().c_str());
+    used << path.string() << "\n";
+    std::ostringstream live;
+    live << key.str() << PYRAMID_LIVE_TAG << host_name() << "-" << getpid();
+    std::string live_file = (fs::path(cache_dir) / live.str()).string();
+    std::ofstream live_fh(live_file.c_str());
+    if (live_fh.good()) {
+      vw::Mutex::Lock lock(g_live_files_mutex);
+      g_live_files.insert(live_file);
+    }
+
+    return link.string();
+  } catch (const std::exception & e) {
+    vw_out(WarningMessage) << "Could not use the pyramid cache in " << cache_dir
+                           << " for " << image << ": " << e.what() << "\n";
+  }
+  return image;
+}
+
+void release_pyramid_cache_links() {
+  vw::Mutex::Lock lock(g_live_files_mutex);
+  for (std::set<std::string>::iterator it = g_live_files.begin(); it != g_live_files.end(); it++) {
+    boost::system::error_code ec;
+    fs::remove(*it, ec);
+  }
+  g_live_files.clear();
+}
+
+bool in_pyramid_cache(std::string const& file) {
+  return fs::path(file).filename().string().compare(0, PYRAMID_PREFIX.size(),
+                                                    PYRAMID_PREFIX) == 0
+    && fs::is_symlink(file);
+}
+
+void trim_pyramid_cache(std::string const& cache_dir, double max_size_mb,
+                        std::set<std::string> const& links_in_use) {
 
-  double scale       = 0.0;
-  double blur_sigma  = std::numeric_limits<double>::quiet_NaN();
-  double nodata_val  = std::numeric_limits<double>::quiet_NaN();
-  vw::read_nodata_val(input_file, nodata_val);
-  std::string suffix = "_hillshade.tif";
+  std::set<std::string> keep;
+  for (std::set<std::string>::const_iterator it = links_in_use.begin();
+       it != links_in_use.end(); it++)
+    keep.insert(fs::path(*it).filename().string().substr(0, PYRAMID_KEY_LEN));
 
-  output_file = vw::mosaic::filename_from_suffix1(input_file, suffix);
+  // The size and time of last use of each entry, and the live files
+  // of the sessions using it
+  std::map<std::string, std::pair<std::time_t, double> > entries;
+  std::map<std::string, std::vector<std::string> > live_files;
+  double total_size = 0;
   try {
-    DiskImageView<float> input(input_file);
-    try{
-      bool will_write = vw::mosaic::overwrite_if_no_good(input_file, output_file,
-                                             input.cols(), input.rows());
-      if (will_write){
-        vw_out() << "Writing: " << output_file << std::endl;
-        vw::do_multitype_hillshade(input_file, output_file, azimuth, elevation, scale,
-                                   nodata_val, blur_sigma);
+    for (fs::directory_iterator it(cache_dir); it != fs::directory_iterator(); it++) {
+      std::string name = it->path().filename().string();
+      if (name.size() < PYRAMID_KEY_LEN || name.compare(0, PYRAMID_PREFIX.size(), PYRAMID_PREFIX) != 0)
+        continue;
+      std::string key = name.substr(0, PYRAMID_KEY_LEN);
+      std::pair<std::time_t, double> & entry = entries[key];
+      if (fs::is_symlink(it->path()))
+        continue; // the link is not counted, and its target may be gone
+      if (name.compare(PYRAMID_KEY_LEN, PYRAMID_LIVE_TAG.size(), PYRAMID_LIVE_TAG) == 0) {
+        live_files[key].push_back(name);
+        continue;
       }
-    }catch(...){
-      // Failed to write, presumably because we have no write access.
-      // Write the file in the current dir.
-      vw_out() << "Failed to write: " << output_file << "\n";
-      output_file = vw::mosaic::filename_from_suffix2(input_file, suffix);
-      bool will_write = vw::mosaic::overwrite_if_no_good(input_file, output_file,
-                                             input.cols(), input.rows());
-      if (will_write){
-        vw_out() << "Writing: " << output_file << std::endl;
-        vw::do_multitype_hillshade(input_file,  output_file, azimuth, elevation, scale,
-                                   nodata_val, blur_sigma);
+      if (name.substr(PYRAMID_KEY_LEN) == ".used")
+        entry.first = fs::last_write_time(it->path());
+      double size = fs::file_size(it->path())/(1024.0*1024.0);
+      entry.second += size;
+      total_size   += size;
+    }
+  } catch (const std::exception & e) {
+    vw_out(WarningMessage) << "Could not read the pyramid cache " << cache_dir << ": "
+                           << e.what() << "\n";
+    return;
+  }
+
+  // Remove the entries used least recently first. Those in use by
+  // this or another session, or used recently, are kept.
+  std::time_t now = std::time(NULL);
+  std::vector<std::pair<std::time_t, std::string> > by_time;
+  for (std::map<std::string, std::pair<std::time_t, double> >::iterator it = entries.begin();
+       it != entries.end(); it++) {
+    if (keep.find(it->first) != keep.end())
+      continue;
+    if (difftime(now, it->second.first) < PYRAMID_RECENT_SECONDS)
+      continue;
+    std::vector<std::string> const& live = live_files[it->first];
+    bool in_use = false;
+    for (size_t j = 0; j < live.size() && !in_use; j++)
+      in_use = is_live_file(live[j], it->second.first, now);
+    if (!in_use)
+      by_time.push_back(std::make_pair(it->second.first, it->first));
+  }
+  std::sort(by_time.begin(), by_time.end());
+
+  for (size_t i = 0; i < by_time.size() && total_size > max_size_mb; i++) {
+    std::string key = by_time[i].second;
+    vw_out() << "Removing from the pyramid cache: " << key << "\n";
+    try {
+      std::vector<fs::path> files;
+      for (fs::directory_iterator it(cache_dir); it != fs::directory_iterator(); it++) {
+        if (it->path().filename().string().compare(0, PYRAMID_KEY_LEN, key) == 0)
+          files.push_back(it->path());
       }
+      for (size_t j = 0; j < files.size(); j++)
+        fs::remove(files[j]);
+      total_size -= entries[key].second;
+    } catch (const std::exception & e) {
+      vw_out(WarningMessage) << "Could not remove " << key << " from the pyramid cache: "
+                             << e.what() << "\n";
     }
-  } catch ( const Exception& e ) {
-    popUp(e.what());
-    return false;
   }
+}
+
+namespace {
+
+  // Build the pyramid of an image, so that opening it later is fast
+  class BuildPyramidTask: public vw::Task, private boost::noncopyable {
+    std::string m_file;
+    vw::cartography::GdalWriteOptions const& m_opt;
+    vw::Mutex & m_mutex;
+
+    template<class PixelT>
+    void build() {
+      vw::mosaic::DiskImagePyramid<PixelT> pyramid(m_file, m_opt);
+      if (in_pyramid_cache(m_file))
+        return;
+      Mutex::Lock lock(m_mutex);
+      temporary_files().files.insert(pyramid.get_temporary_files().begin(),
+                                     pyramid.get_temporary_files().end());
+    }
+
+  public:
+    BuildPyramidTask(std::string const& file, vw::cartography::GdalWriteOptions const& opt,
+                     vw::Mutex & mutex):
+      m_file(file), m_opt(opt), m_mutex(mutex) {}
+
+    virtual void operator()() {
+      try {
+        int num_channels = get_num_channels(m_file);
+        if      (num_channels == 1) build<double>();
+        else if (num_channels == 2) build< Vector<vw::uint8, 2> >();
+        else if (num_channels == 3) build< Vector<vw::uint8, 3> >();
+        else if (num_channels == 4) build< Vector<vw::uint8, 4> >();
+      } catch (const std::exception & e) {
+        vw_out(WarningMessage) << "Could not build the pyramid of " << m_file << ": "
+                               << e.what() << "\n";
+      }
+    }
+  };
 
-  return true;
+}
+
+void build_image_pyramids(std::vector<std::string> const& images,
+                          vw::cartography::GdalWriteOptions const& opt) {
+
+  // Each image is built once, even if given several times
+  std::set<std::string> files, links;
+  for (size_t i = 0; i < images.size(); i++) {
+    std::string file = pyramid_cache_link(images[i]);
+    files.insert(file);
+    if (in_pyramid_cache(file))
+      links.insert(file);
+  }
+
+  vw::Mutex mutex;
+  FifoWorkQueue queue(vw_settings().default_num_threads());
+  for (std::set<std::string>::iterator it = files.begin(); it != files.end(); it++)
+    queue.add_task(boost::shared_ptr<Task>(new BuildPyramidTask(*it, opt, mutex)));
+  queue.join_all();
+
+  std::string cache_dir = pyramid_cache_dir();
+  if (cache_dir != "")
+    trim_pyramid_cache(cache_dir, asp::stereo_settings().pyramid_cache_size, links);
 }
 
 void imageData::read(std::string const& name_in, vw::cartography::GdalWriteOptions const& opt,
@@ -172,7 +410,8 @@ void imageData::read(std::string const& name_in, vw::cartography::GdalWriteOptio
 
   int top_image_max_pix = 1000*1000;
   int subsample = 4;
-  img = DiskImagePyramidMultiChannel(name, m_opt, top_image_max_pix, subsample);
+  img = DiskImagePyramidMultiChannel(pyramid_cache_link(name), m_opt, top_image_max_pix,
+                                     subsample);
 
   has_georef = vw::cartography::read_georeference(georef, name);
 
@@ -286,7 +525,8 @@ DiskImagePyramidMultiChannel::DiskImagePyramidMultiChannel(std::string const& ba
                              int subsample):m_opt(opt),
                                                 m_num_channels(0),
                                                 m_rows(0), m_cols(0),
-                                                m_type(UNINIT){
+                                                m_type(UNINIT),
+                                                m_min_val(0), m_max_val(1){
   if (base_file == "") return;
 
   // Instantiate the correct DiskImagePyramid then record information including
@@ -299,8 +539,28 @@ DiskImagePyramidMultiChannel::DiskImagePyramidMultiChannel(std::string const& ba
       m_rows = m_img_ch1_double.rows();
       m_cols = m_img_ch1_double.cols();
       m_type = CH1_DOUBLE;
-      temporary_files().files.insert(m_img_ch1_double.get_temporary_files().begin(), 
-                                     m_img_ch1_double.get_temporary_files().end());
+      if (!in_pyramid_cache(base_file)) // cached levels are kept
+        temporary_files().files.insert(m_img_ch1_double.get_temporary_files().begin(),
+                                       m_img_ch1_double.get_temporary_files().end());
+
+      // Find the range of values at the coarsest level
+      ImageView<double> clip;
+      double scale_out;
+      BBox2i region_out;
+      m_img_ch1_double.get_image_clip(std::max(m_cols, m_rows), BBox2i(0, 0, m_cols, m_rows),
+                                      clip, scale_out, region_out);
+      double nodata_val = m_img_ch1_double.get_nodata_val();
+      m_min_val = std::numeric_limits<double>::max();
+      m_max_val = -std::numeric_limits<double>::max();
+      for (int col = 0; col < clip.cols(); col++){
+        for (int row = 0; row < clip.rows(); row++){
+          if (clip(col, row) <= nodata_val || std::isnan(clip(col, row))) continue;
+          m_min_val = std::min(m_min_val, clip(col, row));
+          m_max_val = std::max(m_max_val, clip(col, row));
+        }
+      }
+      if (m_min_val >= m_max_val)
+        m_max_val = m_min_val + 1.0;
     }else if (m_num_channels == 2){
       // uint8 image with an alpha channel.
       m_img_ch2_uint8 = vw::mosaic::DiskImagePyramid< Vector<vw::uint8, 2> >(base_file, m_opt);
@@ -308,8 +568,9 @@ DiskImagePyramidMultiChannel::DiskImagePyramidMultiChannel(std::string const& ba
       m_rows = m_img_ch2_uint8.rows();
       m_cols = m_img_ch2_uint8.cols();
       m_type = CH2_UINT8;
-      temporary_files().files.insert(m_img_ch2_uint8.get_temporary_files().begin(), 
-                                     m_img_ch2_uint8.get_temporary_files().end());
+      if (!in_pyramid_cache(base_file)) // cached levels are kept
+        temporary_files().files.insert(m_img_ch2_uint8.get_temporary_files().begin(),
+                                       m_img_ch2_uint8.get_temporary_files().end());
     } else if (m_num_channels == 3){
       // RGB image with three uint8 channels.
       m_img_ch3_uint8 = vw::mosaic::DiskImagePyramid< Vector<vw::uint8, 3> >(base_file, m_opt);
@@ -317,8 +578,9 @@ DiskImagePyramidMultiChannel::DiskImagePyramidMultiChannel(std::string const& ba
       m_rows = m_img_ch3_uint8.rows();
       m_cols = m_img_ch3_uint8.cols();
       m_type = CH3_UINT8;
-      temporary_files().files.insert(m_img_ch3_uint8.get_temporary_files().begin(), 
-                                     m_img_ch3_uint8.get_temporary_files().end());
+      if (!in_pyramid_cache(base_file)) // cached levels are kept
+        temporary_files().files.insert(m_img_ch3_uint8.get_temporary_files().begin(),
+                                       m_img_ch3_uint8.get_temporary_files().end());
     } else if (m_num_channels == 4){
       // RGB image with three uint8 channels and an alpha channel
       m_img_ch4_uint8 = vw::mosaic::DiskImagePyramid< Vector<vw::uint8, 4> >(base_file, m_opt);
@@ -326,8 +588,9 @@ DiskImagePyramidMultiChannel::DiskImagePyramidMultiChannel(std::string const& ba
       m_rows = m_img_ch4_uint8.rows();
       m_cols = m_img_ch4_uint8.cols();
       m_type = CH4_UINT8;
-      temporary_files().files.insert(m_img_ch4_uint8.get_temporary_files().begin(), 
-                                     m_img_ch4_uint8.get_temporary_files().end());
+      if (!in_pyramid_cache(base_file)) // cached levels are kept
+        temporary_files().files.insert(m_img_ch4_uint8.get_temporary_files().begin(),
+                                       m_img_ch4_uint8.get_temporary_files().end());
     }else{
       vw_throw(ArgumentErr() << "Unsupported image with " << m_num_channels << " bands.\n");
     }
@@ -341,14 +604,17 @@ void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i re
                   bool highlight_nodata,
                   QImage & qimg, double & scale_out, vw::BBox2i & region_out) {
 
-  bool scale_pixels = (m_type == CH1_DOUBLE);
+  bool scale_pixels = false;
   
   // Extract the clip, then convert it from VW format to QImage format.
+  // Single-channel images are scaled to the range of the whole image,
+  // rather than of the clip, so that neighboring clips match.
   if (m_type == CH1_DOUBLE) {
     ImageView<double> clip;
     m_img_ch1_double.get_image_clip(scale_in, region_in, clip,
                                   scale_out, region_out);
-    formQimage(highlight_nodata, scale_pixels, m_img_ch1_double.get_nodata_val(), clip, qimg);
+    formQimage(highlight_nodata, m_img_ch1_double.get_nodata_val(),
+               m_min_val, m_max_val, clip, qimg);
   } else if (m_type == CH2_UINT8) {
     ImageView<Vector<vw::uint8, 2> > clip;
     m_img_ch2_uint8.get_image_clip(scale_in, region_in, clip,
@@ -369,6 +635,76 @@ void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i re
   }
 }
 
+void DiskImagePyramidMultiChannel::get_hillshaded_clip(double scale_in, vw::BBox2i region_in,
+                                                       vw::cartography::GeoReference const& georef,
+                                                       double azimuth, double elevation,
+                                                       QImage & qimg, double & scale_out,
+                                                       vw::BBox2i & region_out) {
+
+  if (m_type != CH1_DOUBLE)
+    vw_throw(ArgumentErr() << "Hill-shading makes sense only for single-channel images.\n");
+
+  // The pyramid level read has pixels no larger than scale_in, so
+  // growing the region by that much gives a halo of at least a pixel.
+  BBox2i halo_in = region_in;
+  halo_in.expand(int(ceil(scale_in)));
+  halo_in.crop(BBox2i(0, 0, m_cols, m_rows));
+  ImageView<double> dem;
+  BBox2i halo_out;
+  m_img_ch1_double.get_image_clip(scale_in, halo_in, dem, scale_out, halo_out);
+  double nodata_val = m_img_ch1_double.get_nodata_val();
+
+  region_out = BBox2i(Vector2i(floor(region_in.min().x()/scale_out),
+                               floor(region_in.min().y()/scale_out)),
+                      Vector2i(ceil(region_in.max().x()/scale_out),
+                               ceil(region_in.max().y()/scale_out)));
+  region_out.crop(halo_out);
+
+  // The size of a pixel at this level, in meters, in the middle of the clip
+  Vector2 mid = scale_out*(Vector2(region_out.min()) + Vector2(region_out.max()))/2.0;
+  Vector2 ll  = georef.pixel_to_lonlat(mid);
+  Vector3 P   = georef.datum().geodetic_to_cartesian(Vector3(ll[0], ll[1], 0));
+  Vector2 llx = georef.pixel_to_lonlat(mid + Vector2(scale_out, 0));
+  Vector2 lly = georef.pixel_to_lonlat(mid + Vector2(0, scale_out));
+  double dx = norm_2(georef.datum().geodetic_to_cartesian(Vector3(llx[0], llx[1], 0)) - P);
+  double dy = norm_2(georef.datum().geodetic_to_cartesian(Vector3(lly[0], lly[1], 0)) - P);
+
+  // The direction to the light, in east, north, and up coordinates
+  double az = azimuth*M_PI/180.0, el = elevation*M_PI/180.0;
+  Vector3 light(sin(az)*cos(el), cos(az)*cos(el), sin(el));
+
+  qimg = QImage(region_out.width(), region_out.height(), QImage::Format_ARGB32_Premultiplied);
+  for (int col = 0; col < region_out.width(); col++){
+    for (int row = 0; row < region_out.height(); row++){
+
+      int c = col + region_out.min().x() - halo_out.min().x();
+      int r = row + region_out.min().y() - halo_out.min().y();
+      double h = dem(c, r);
+      if (h <= nodata_val || std::isnan(h)) {
+        qimg.setPixel(col, row, QColor(0, 0, 0, 0).rgba()); // transparent
+        continue;
+      }
+
+      // Central differences, one-sided at the edges of the image and of
+      // the valid data. Rows go south, assuming north is up.
+      int c0 = std::max(c - 1, 0), c1 = std::min(c + 1, dem.cols() - 1);
+      int r0 = std::max(r - 1, 0), r1 = std::min(r + 1, dem.rows() - 1);
+      double h_w = dem(c0, r), h_e = dem(c1, r), h_n = dem(c, r0), h_s = dem(c, r1);
+      if (h_w <= nodata_val || std::isnan(h_w)) { h_w = h; c0 = c; }
+      if (h_e <= nodata_val || std::isnan(h_e)) { h_e = h; c1 = c; }
+      if (h_n <= nodata_val || std::isnan(h_n)) { h_n = h; r0 = r; }
+      if (h_s <= nodata_val || std::isnan(h_s)) { h_s = h; r1 = r; }
+      double dzdx = (c1 > c0) ? (h_e - h_w)/((c1 - c0)*dx) : 0.0;
+      double dzdy = (r1 > r0) ? (h_n - h_s)/((r1 - r0)*dy) : 0.0;
+
+      Vector3 normal(-dzdx, -dzdy, 1.0);
+      double shade = std::max(0.0, dot_prod(normal, light)/norm_2(normal));
+      int v = round(255*shade);
+      qimg.setPixel(col, row, QColor(v, v, v, 255).rgba());
+    }
+  }
+}
+
 std::string DiskImagePyramidMultiChannel::get_value_as_str( int32 x, int32 y) const {
 
   std::ostringstream os;
@@ -122,6 +122,13 @@ namespace vw { namespace gui {
              ImageView<PixelT> const& clip,
              QImage & qimg);
 
+  /// Form a QImage from a single-channel image, mapping the values
+  /// from min_val to max_val to the range from 0 to 255.
+  void formQimage(bool highlight_nodata, double nodata_val,
+                  double min_val, double max_val,
+                  ImageView<double> const& clip,
+                  QImage & qimg);
+
   template<class PixelT>
   typename boost::enable_if<boost::is_same<PixelT, vw::Vector<vw::uint8, 2> >, void>::type
   formQimage(bool highlight_nodata, bool scale_pixels, double nodata_val,
@@ -144,11 +151,6 @@ namespace vw { namespace gui {
   /// Convert a BBox2 object to a QRect object.
   QRect bbox2qrect(BBox2 const& B);
 
-  /// ?
-  bool write_hillshade(vw::cartography::GdalWriteOptions const& opt,
-                       std::string const& input_file,
-                       std::string      & output_file);
-
   // Given an image, and an input file name, modify the filename using
   // a prefix. Write the image to that filename. If that fails, create
   // instead the filename in the current directory. Return the name
@@ -178,6 +180,11 @@ namespace vw { namespace gui {
     int m_rows, m_cols;
     ImgType m_type; // keeps track of which of the above images we use
 
+    // The range of values of a single-channel image, used to show it
+    // on screen. It is found at the coarsest level, so that all clips
+    // of the image are scaled the same way and tiles of it match.
+    double m_min_val, m_max_val;
+
     // Constructor
     DiskImagePyramidMultiChannel(std::string const& base_file = "",
                                  vw::cartography::GdalWriteOptions const& opt = vw::cartography::GdalWriteOptions(),
@@ -190,6 +197,16 @@ namespace vw { namespace gui {
                       bool highlight_nodata,
                       QImage & qimg, double & scale_out, vw::BBox2i & region_out);
 
+    // Like get_image_clip(), but hillshade the clip, which must be of a
+    // single-channel DEM with the given georeference. The clip is read
+    // with a halo of one pixel, so that clips next to each other are
+    // shaded seamlessly. The azimuth and elevation of the light are in
+    // degrees, with the azimuth measured clockwise from north.
+    void get_hillshaded_clip(double scale_in, vw::BBox2i region_in,
+                             vw::cartography::GeoReference const& georef,
+                             double azimuth, double elevation,
+                             QImage & qimg, double & scale_out, vw::BBox2i & region_out);
+
     int32 cols  () const { return m_cols;  }
     int32 rows  () const { return m_rows;  }
     int32 planes() const { return m_num_channels; }
@@ -203,6 +220,46 @@ namespace vw { namespace gui {
     std::string get_value_as_str( int32 x, int32 y) const;
   };
 
+  // The pyramid cache. The subsampled levels of an image are built
+  // next to a link to it in the cache directory, whose name is a hash
+  // of the path, modification time, and size of the image, so they are
+  // reused by later sessions until the image changes. An image opened
+  // several times, such as in several windows, shares the levels.
+
+  /// The cache directory from --pyramid-cache-dir, or else from the
+  /// ASP_PYRAMID_CACHE_DIR environment variable. Empty if not set.
+  std::string pyramid_cache_dir();
+
+  /// The file to build the pyramid of an image from. This is the
+  /// link to it in the cache, made if needed, or the image itself if
+  /// there is no cache or the link could not be made.
+  std::string pyramid_cache_link(std::string const& image);
+
+  /// If this file is a link in the cache, whose levels must be kept
+  bool in_pyramid_cache(std::string const& file);
+
+  /// Note that this session no longer uses its cache entries. To be
+  /// called on exit.
+  void release_pyramid_cache_links();
+
+  /// Release the cache links of this session when going out of scope,
+  /// also if an exception is thrown.
+  struct PyramidCacheLinksGuard {
+    ~PyramidCacheLinksGuard() { release_pyramid_cache_links(); }
+  };
+
+  /// Remove the cache entries used least recently, other than those
+  /// of the given links, until the cache is no larger than max_size_mb.
+  /// Entries used recently, or still in use by a running session, are
+  /// kept.
+  void trim_pyramid_cache(std::string const& cache_dir, double max_size_mb,
+                          std::set<std::string> const& links_in_use);
+
+  /// Build the pyramids of these images in parallel, if not built
+  /// already, then trim the cache to --pyramid-cache-size.
+  void build_image_pyramids(std::vector<std::string> const& images,
+                            vw::cartography::GdalWriteOptions const& opt);
+
   /// A class to keep all data associated with an image file
   struct imageData{
     std::string      name;
@@ -269,9 +326,10 @@ formQimage(bool highlight_nodata, bool scale_pixels, double nodata_val,
            ImageView<PixelT> const& clip,
            QImage & qimg){
 
-  double min_val = std::numeric_limits<double>::max();
-  double max_val = -std::numeric_limits<double>::max();
+  double min_val = 0.0, max_val = 255.0;
   if (scale_pixels) {
+    min_val = std::numeric_limits<double>::max();
+    max_val = -std::numeric_limits<double>::max();
     for (int col = 0; col < clip.cols(); col++){
       for (int row = 0; row < clip.rows(); row++){
         if (clip(col, row) <= nodata_val) continue;
@@ -283,30 +341,7 @@ formQimage(bool highlight_nodata, bool scale_pixels, double nodata_val,
       max_val = min_val + 1.0;
   }
 
-  qimg = QImage(clip.cols(), clip.rows(), QImage::Format_ARGB32_Premultiplied);
-  for (int col = 0; col < clip.cols(); col++){
-    for (int row = 0; row < clip.rows(); row++){
-      double v = clip(col, row);
-      if (scale_pixels)
-        v = round(255*(std::max(v, min_val) - min_val)/(max_val-min_val));
-
-      // The comparison below is false when nodata_val is NaN
-      if (clip(col, row) <= nodata_val || std::isnan(clip(col, row)) ){
-        
-        if (!highlight_nodata){
-          // transparent
-          qimg.setPixel(col, row, QColor(0, 0, 0, 0).rgba());
-        }else{
-         // highlight in red
-          qimg.setPixel(col, row, qRgb(255, 0, 0));
-        }
-        
-      }else{
-        // opaque
-        qimg.setPixel(col, row, QColor(v, v, v, 255).rgba());
-      }
-    }
-  }
+  formQimage(highlight_nodata, nodata_val, min_val, max_val, clip, qimg);
 }
   
 template<class PixelT>
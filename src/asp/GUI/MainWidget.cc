@@ -34,6 +34,7 @@
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Cartography/GeoTransform.h>
 #include <asp/GUI/MainWidget.h>
+#include <asp/Core/StereoSettings.h>
 
 using namespace vw;
 using namespace vw::gui;
@@ -153,6 +154,10 @@ namespace vw { namespace gui {
     
     installEventFilter(this);
 
+    // The images are drawn from tiles loaded in the background
+    m_tile_loader.reset(new TileLoader(this, size_t(asp::stereo_settings().tile_cache_size)
+                                       *1024*1024));
+
     m_firstPaintEvent = true;
     m_emptyRubberBand = QRect(0, 0, 0, 0);
     m_rubberBand      = m_emptyRubberBand;
@@ -211,6 +216,9 @@ namespace vw { namespace gui {
 
     m_shadow_thresh = -std::numeric_limits<double>::max();
     m_shadow_thresh_calc_mode = false;
+
+    m_hillshade_azimuth   = asp::stereo_settings().hillshade_azimuth;
+    m_hillshade_elevation = asp::stereo_settings().hillshade_elevation;
     m_shadow_thresh_view_mode = false;
 
     // To do: Warn the user if some images have georef
@@ -241,17 +249,21 @@ namespace vw { namespace gui {
     m_addMatchPoint    = m_ContextMenu->addAction("Add match point");
     m_deleteMatchPoint = m_ContextMenu->addAction("Delete match point");
     m_toggleHillshade  = m_ContextMenu->addAction("Toggle hillshaded display");
+    m_setHillshadeParams = m_ContextMenu->addAction("View/set hillshade azimuth and elevation");
     m_setThreshold     = m_ContextMenu->addAction("View/set shadow threshold");
     connect(m_addMatchPoint,    SIGNAL(triggered()), this, SLOT(addMatchPoint()));
     connect(m_deleteMatchPoint, SIGNAL(triggered()), this, SLOT(deleteMatchPoint()));
     connect(m_toggleHillshade,  SIGNAL(triggered()), this, SLOT(toggleHillshade()));
+    connect(m_setHillshadeParams, SIGNAL(triggered()), this, SLOT(setHillshadeParams()));
     connect(m_setThreshold,    SIGNAL(triggered()), this, SLOT(setTheshold()));
 
-    MainWidget::maybeGenHillshade();
+    MainWidget::checkHillshade();
   } // End constructor
 
 
   MainWidget::~MainWidget() {
+    // Wait for the tiles being loaded, before the images go away
+    m_tile_loader->clear();
   }
 
   bool MainWidget::eventFilter(QObject *obj, QEvent *E){
@@ -408,6 +420,7 @@ namespace vw { namespace gui {
     }
 
     int num_images = m_images.size();
+    m_tile_loader->clear();
     m_shadow_thresh_images.clear(); // wipe the old copy
     m_shadow_thresh_images.resize(num_images);
 
@@ -449,14 +462,11 @@ namespace vw { namespace gui {
     refreshPixmap();
   }
 
-  void MainWidget::maybeGenHillshade(){
+  // Hillshading is done on the fly, one tile at a time, as the images
+  // are drawn. Here just turn it off for images which cannot be shaded.
+  void MainWidget::checkHillshade(){
 
     int num_images = m_images.size();
-    m_hillshaded_images.clear(); // wipe the old copy
-    m_hillshaded_images.resize(num_images);
-
-    // Create the hillshaded images and save them to disk. We have to do
-    // it each time as perhaps the hillshade parameters changed.
     for (int image_iter = 0; image_iter < num_images; image_iter++) {
 
       if (!m_hillshade_mode[image_iter]) continue;
@@ -467,24 +477,11 @@ namespace vw { namespace gui {
         return;
       }
 
-      std::string input_file = m_image_files[image_iter];
-      int num_channels = get_num_channels(input_file);
-      if (num_channels != 1) {
+      if (m_images[image_iter].img.planes() != 1) {
         popUp("Hill-shading makes sense only for single-channel images.");
         m_hillshade_mode[image_iter] = false;
         return;
       }
-
-      // Save the hillshaded images to disk
-      std::string hillshaded_file;
-      bool success = write_hillshade(m_opt, input_file, hillshaded_file);
-      if (!success) {
-        m_hillshade_mode[image_iter] = false;
-        return;
-      }
-
-      m_hillshaded_images[image_iter].read(hillshaded_file, m_opt, m_use_georef);
-      temporary_files().files.insert(hillshaded_file);
     }
   }
 
@@ -492,6 +489,12 @@ namespace vw { namespace gui {
   void MainWidget::deleteImage(){
     emit removeImageAndRefreshSignal();
   }
+
+  // More tiles were loaded in the background. Draw again with them.
+  void MainWidget::tilesArrived(){
+    m_tile_loader->clear_notification();
+    refreshPixmap();
+  }
   
   void MainWidget::refreshHillshade(){
 
@@ -506,7 +509,7 @@ namespace vw { namespace gui {
 
     m_shadow_thresh_calc_mode = false;
     m_shadow_thresh_view_mode = false;
-    MainWidget::maybeGenHillshade();
+    MainWidget::checkHillshade();
 
     m_indicesWithAction.clear();
     
@@ -592,6 +595,9 @@ namespace vw { namespace gui {
 
     std::list<BBox2i> screen_box_list; // List of regions the images are drawn in
 
+    // Tiles queued for an earlier view and not loaded yet are not needed
+    m_tile_loader->begin_view();
+
     // Loop through input images
     // - These images get drawn in the same
     for (int j = 0; j < (int)m_images.size(); j++){
@@ -639,19 +645,22 @@ namespace vw { namespace gui {
       double scale_out;
       BBox2i region_out;
       bool   highlight_nodata = m_shadow_thresh_view_mode;
+      TileStyle style;
+      style.highlight_nodata = highlight_nodata;
       if (m_shadow_thresh_view_mode){
-        m_shadow_thresh_images[i].img.get_image_clip(scale, image_box,
-                                                     highlight_nodata,
-                                                     qimg, scale_out, region_out);
+        getTiledClip(m_shadow_thresh_images[i], scale, image_box,
+                     style, qimg, scale_out, region_out);
       }else if (m_hillshade_mode[i]){
-        m_hillshaded_images[i].img.get_image_clip(scale, image_box,
-                                                  highlight_nodata,
-                                                  qimg, scale_out, region_out);
+        // Shaded from the original images, as needed
+        style.hillshade = true;
+        style.azimuth   = m_hillshade_azimuth;
+        style.elevation = m_hillshade_elevation;
+        getTiledClip(m_images[i], scale, image_box,
+                     style, qimg, scale_out, region_out);
       }else{
         // Original images
-        m_images[i].img.get_image_clip(scale, image_box,
-                                       highlight_nodata,
-                                       qimg, scale_out, region_out);
+        getTiledClip(m_images[i], scale, image_box,
+                     style, qimg, scale_out, region_out);
       }
 
       // Draw on image screen
@@ -725,6 +734,78 @@ namespace vw { namespace gui {
     return;
   } // End function drawImage()
 
+  void MainWidget::getTiledClip(imageData & image, double scale_in, BBox2i const& region_in,
+                                TileStyle const& style,
+                                QImage & qimg, double & scale_out, BBox2i & region_out) {
+
+    DiskImagePyramidMultiChannel & img = image.img;
+    int top   = TileLoader::top_level(img.cols(), img.rows());
+    int level = std::min(TileLoader::level_for_scale(scale_in), top);
+
+    // The clip is formed at the resolution of the chosen level
+    BBox2i image_box = region_in;
+    image_box.crop(BBox2i(0, 0, img.cols(), img.rows()));
+    scale_out = 1 << level;
+    region_out = BBox2i(Vector2i(floor(image_box.min().x()/scale_out),
+                                 floor(image_box.min().y()/scale_out)),
+                        Vector2i(ceil(image_box.max().x()/scale_out),
+                                 ceil(image_box.max().y()/scale_out)));
+    region_out.max().x() = std::max(region_out.max().x(), region_out.min().x() + 1);
+    region_out.max().y() = std::max(region_out.max().y(), region_out.min().y() + 1);
+
+    qimg = QImage(region_out.width(), region_out.height(), QImage::Format_ARGB32_Premultiplied);
+    qimg.fill(QColor(0, 0, 0, 0).rgba());
+    if (image_box.empty())
+      return;
+    QPainter paint(&qimg);
+
+    // The whole image at the coarsest level is loaded first, then a
+    // coarser version of the view, then the view itself, starting from
+    // the tiles closest to its center.
+    m_tile_loader->fetch(image, TileKey(image.name, style, top, 0, 0), 0.0);
+    Vector2 center = (Vector2(image_box.min()) + Vector2(image_box.max()))/2.0;
+    for (int pass = 0; pass < 2; pass++) {
+      int tile_level = (pass == 0) ? level + 2 : level;
+      if (pass == 0 && tile_level >= top)
+        continue;
+
+      int len = TileLoader::tile_size() << tile_level;
+      for (int row = image_box.min().y()/len; row <= (image_box.max().y() - 1)/len; row++) {
+        for (int col = image_box.min().x()/len; col <= (image_box.max().x() - 1)/len; col++) {
+
+          BBox2i box = TileLoader::tile_box(tile_level, col, row);
+          box.crop(BBox2i(0, 0, img.cols(), img.rows()));
+          double dist = norm_2((Vector2(box.min()) + Vector2(box.max()))/2.0 - center)/len;
+          TilePtr tile = m_tile_loader->fetch(image, TileKey(image.name, style,
+                                                             tile_level, col, row),
+                                              (pass == 0 ? 1.0 : 1.0e+6) + dist);
+          if (pass == 0)
+            continue;
+
+          // Until the tile arrives, show the finest coarser one we have
+          for (int coarser = level + 1; !tile && coarser <= top; coarser++)
+            tile = m_tile_loader->cached(TileKey(image.name, style, coarser,
+                                                 col >> (coarser - level),
+                                                 row >> (coarser - level)));
+          if (!tile || tile->qimg.isNull())
+            continue;
+
+          // Draw the part of the tile over the box
+          BBox2 covered = tile->full_res_box();
+          BBox2 part = box;
+          part.crop(covered);
+          if (part.width() <= 0 || part.height() <= 0)
+            continue;
+          BBox2 src = (part - covered.min()) / tile->scale;
+          BBox2 dst = part / scale_out - Vector2(region_out.min());
+          paint.drawImage(QRectF(dst.min().x(), dst.min().y(), dst.width(), dst.height()),
+                          tile->qimg,
+                          QRectF(src.min().x(), src.min().y(), src.width(), src.height()));
+        }
+      }
+    }
+  }
+
 
 
   void MainWidget::drawInterestPoints(QPainter* paint, std::list<BBox2i> const& valid_regions) {
@@ -1440,6 +1521,37 @@ namespace vw { namespace gui {
     emit refreshAllMatches();
   }
 
+  // Show the direction of the light for hillshading, and allow the
+  // user to change it. Only the tiles in view are shaded again.
+  void MainWidget::setHillshadeParams(){
+
+    std::ostringstream oss;
+    oss.precision(18);
+    oss << m_hillshade_azimuth << " " << m_hillshade_elevation;
+    std::string params = oss.str();
+    bool ans = getStringFromGui(this,
+				"Hillshade azimuth and elevation",
+				"Hillshade azimuth and elevation (degrees)",
+				params,
+				params);
+    if (!ans)
+      return;
+
+    double azimuth, elevation;
+    std::istringstream iss(params);
+    if (!(iss >> azimuth >> elevation)) {
+      popUp("Expecting the azimuth and elevation, separated by a space.");
+      return;
+    }
+    m_hillshade_azimuth   = azimuth;
+    m_hillshade_elevation = elevation;
+
+    vw_out() << "Hillshade azimuth and elevation: " << m_hillshade_azimuth
+	     << " " << m_hillshade_elevation << std::endl;
+
+    refreshPixmap();
+  }
+
   // Show the current shadow threshold, and allow the user to change it.
   void MainWidget::setTheshold(){
 
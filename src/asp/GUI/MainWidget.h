@@ -57,6 +57,7 @@
 // ASP
 #include <asp/Core/Common.h>
 #include <asp/GUI/GuiUtilities.h>
+#include <asp/GUI/TileLoader.h>
 
 class QMouseEvent;
 class QWheelEvent;
@@ -117,9 +118,11 @@ public slots:
     void addMatchPoint();       ///< Add a new interest point (from right click menu)
     void deleteMatchPoint();    ///< Delete an interest point (from right click menu)
     void setTheshold();         ///< Set change shadow threshold (from right click menu)
+    void setHillshadeParams();  ///< Set the hillshade light direction (from right click menu)
     void toggleHillshade();     ///< Turn on/off hillshading per image (from right click menu)
     void refreshHillshade();    ///< We modified m_hillshade_mode. Update the display.
     void deleteImage();         ///< Delete an image from the gui and refresh
+    void tilesArrived();        ///< Redraw with the tiles loaded in the background
 
   protected:
 
@@ -218,6 +221,7 @@ public slots:
     QAction* m_addMatchPoint;
     QAction* m_deleteMatchPoint;
     QAction* m_toggleHillshade;
+    QAction* m_setHillshadeParams;
     QAction* m_setThreshold;
     QAction* m_toggleHillshadeFromTable;
     QAction* m_deleteImage;
@@ -227,7 +231,10 @@ public slots:
     bool   m_shadow_thresh_view_mode;
     std::vector<imageData> m_shadow_thresh_images;
 
-    std::vector<imageData> m_hillshaded_images;
+    double m_hillshade_azimuth, m_hillshade_elevation;
+
+    /// Loads the tiles shown on screen in the background, and caches them
+    boost::shared_ptr<TileLoader> m_tile_loader;
     std::set<int> m_indicesWithAction;
     
     bool m_viewMatches; ///< Control if IP's are drawn
@@ -237,6 +244,12 @@ public slots:
     /// Add all the interest points to the provided canvas
     /// - Called internally by drawImage
     void drawInterestPoints(QPainter* paint, std::list<BBox2i> const& valid_regions);
+    /// Form the clip of an image to show at the given scale from its
+    /// tiles, falling back to coarser tiles for those not loaded yet.
+    /// The outputs are as for DiskImagePyramidMultiChannel::get_image_clip().
+    void getTiledClip(imageData & image, double scale_in, BBox2i const& region_in,
+                      TileStyle const& style,
+                      QImage & qimg, double & scale_out, BBox2i & region_out);
 
     vw::Vector2 world2screen(vw::Vector2 const& p);
     vw::Vector2 screen2world(vw::Vector2 const& pix);
@@ -250,7 +263,7 @@ public slots:
     void updateCurrentMousePosition();
     void updateRubberBand(QRect & R);
     void refreshPixmap();
-    void maybeGenHillshade();
+    void checkHillshade();
     void putImageOnTop(int image_index);
   };
 
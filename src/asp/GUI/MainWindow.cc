@@ -104,6 +104,9 @@ MainWindow::MainWindow(vw::cartography::GdalWriteOptions const& opt,
     return;
   }
 
+  // Build the pyramids of all images at once, before the widgets open them
+  build_image_pyramids(m_image_paths, m_opt);
+
   // If a match file was explicitly specified, use it.
   if (stereo_settings().match_file != ""){
     if (m_image_paths.size() != 2){
@@ -372,6 +375,8 @@ void MainWindow::forceQuit(){
     }
   }
 
+  release_pyramid_cache_links();
+
   exit(0); // A fix for an older buggy version of Qt
 }
 
@@ -0,0 +1,233 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2006-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileLoader.cc
+///
+
+#include <algorithm>
+#include <QtGui>
+
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <asp/GUI/GuiUtilities.h>
+#include <asp/GUI/TileLoader.h>
+
+using namespace vw;
+using namespace vw::gui;
+
+namespace vw { namespace gui {
+
+  // Each request queues one of these. It serves whichever request
+  // has the highest priority when it runs, so it does nothing if the
+  // requests were dropped in the meantime.
+  class TileTask: public vw::Task, private boost::noncopyable {
+    TileLoader & m_loader;
+  public:
+    TileTask(TileLoader & loader): m_loader(loader) {}
+    virtual void operator()() { m_loader.load_next(); }
+  };
+
+  bool TileStyle::operator<(TileStyle const& s) const {
+    if (highlight_nodata != s.highlight_nodata) return highlight_nodata < s.highlight_nodata;
+    if (hillshade        != s.hillshade       ) return hillshade        < s.hillshade;
+    if (!hillshade) return false; // the light does not matter then
+    if (azimuth          != s.azimuth         ) return azimuth          < s.azimuth;
+    return elevation < s.elevation;
+  }
+
+  bool TileKey::operator<(TileKey const& k) const {
+    if (level != k.level) return level < k.level;
+    if (col   != k.col  ) return col   < k.col;
+    if (row   != k.row  ) return row   < k.row;
+    if (style < k.style ) return true;
+    if (k.style < style ) return false;
+    return image < k.image;
+  }
+
+  TileLoader::TileLoader(QObject * receiver, size_t memory_budget):
+    m_receiver(receiver), m_memory_budget(memory_budget), m_used_bytes(0),
+    m_generation(0), m_notification_pending(false),
+    m_queue(vw_settings().default_num_threads()) {}
+
+  TileLoader::~TileLoader() {
+    clear();
+  }
+
+  int TileLoader::level_for_scale(double scale) {
+    int level = 0;
+    while (scale >= 2.0) {
+      scale /= 2.0;
+      level++;
+    }
+    return level;
+  }
+
+  int TileLoader::top_level(int cols, int rows) {
+    int level = 0;
+    while ((tile_size() << level) < std::max(cols, rows))
+      level++;
+    return level;
+  }
+
+  BBox2i TileLoader::tile_box(int level, int col, int row) {
+    int len = tile_size() << level;
+    return BBox2i(col*len, row*len, len, len);
+  }
+
+  void TileLoader::begin_view() {
+    Mutex::Lock lock(m_mutex);
+    m_generation++;
+    m_pending.clear();
+  }
+
+  void TileLoader::touch(std::map<TileKey, Entry>::iterator it) {
+    m_lru.erase(it->second.lru_pos);
+    m_lru.push_front(it->first);
+    it->second.lru_pos    = m_lru.begin();
+    it->second.generation = m_generation;
+  }
+
+  TilePtr TileLoader::cached(TileKey const& key) {
+    Mutex::Lock lock(m_mutex);
+    std::map<TileKey, Entry>::iterator it = m_tiles.find(key);
+    if (it == m_tiles.end())
+      return TilePtr();
+    touch(it);
+    return it->second.tile;
+  }
+
+  TilePtr TileLoader::fetch(imageData & image, TileKey const& key,
+                            double priority) {
+    {
+      Mutex::Lock lock(m_mutex);
+      std::map<TileKey, Entry>::iterator it = m_tiles.find(key);
+      if (it != m_tiles.end()) {
+        touch(it);
+        return it->second.tile;
+      }
+      if (m_in_flight.find(key) != m_in_flight.end())
+        return TilePtr();
+
+      std::map<TileKey, Request>::iterator req = m_pending.find(key);
+      if (req != m_pending.end()) {
+        req->second.priority = std::min(req->second.priority, priority);
+        return TilePtr();
+      }
+      Request & R = m_pending[key];
+      R.image    = &image;
+      R.priority = priority;
+    }
+
+    m_queue.add_task(boost::shared_ptr<Task>(new TileTask(*this)));
+    return TilePtr();
+  }
+
+  void TileLoader::load_next() {
+
+    TileKey key("", TileStyle(), 0, 0, 0);
+    imageData * image = NULL;
+    {
+      Mutex::Lock lock(m_mutex);
+      if (m_pending.empty())
+        return;
+      std::map<TileKey, Request>::iterator best = m_pending.begin();
+      for (std::map<TileKey, Request>::iterator it = m_pending.begin();
+           it != m_pending.end(); it++) {
+        if (it->second.priority < best->second.priority)
+          best = it;
+      }
+      key   = best->first;
+      image = best->second.image;
+      m_pending.erase(best);
+      m_in_flight.insert(key);
+    }
+
+    TilePtr tile(new Tile);
+    BBox2i box = tile_box(key.level, key.col, key.row);
+    box.crop(BBox2i(0, 0, image->img.cols(), image->img.rows()));
+    try {
+      if (key.style.hillshade)
+        image->img.get_hillshaded_clip(double(1 << key.level), box, image->georef,
+                                       key.style.azimuth, key.style.elevation,
+                                       tile->qimg, tile->scale, tile->region);
+      else
+        image->img.get_image_clip(double(1 << key.level), box, key.style.highlight_nodata,
+                                  tile->qimg, tile->scale, tile->region);
+    } catch (const std::exception & e) {
+      // Keep the empty tile, so that it is not read over and over
+      vw_out(WarningMessage) << "Failed to read a tile of " << key.image << ": "
+                             << e.what() << "\n";
+      tile->qimg   = QImage();
+      tile->scale  = 1 << key.level;
+      tile->region = BBox2i();
+    }
+
+    bool notify = false;
+    {
+      Mutex::Lock lock(m_mutex);
+      m_in_flight.erase(key);
+
+      Entry & E = m_tiles[key];
+      E.tile       = tile;
+      E.bytes      = tile->qimg.byteCount();
+      E.generation = m_generation;
+      m_lru.push_front(key);
+      E.lru_pos    = m_lru.begin();
+      m_used_bytes += E.bytes;
+      evict();
+
+      notify = !m_notification_pending;
+      m_notification_pending = true;
+    }
+
+    // Have the receiver draw again, in the UI thread
+    if (notify)
+      QMetaObject::invokeMethod(m_receiver, "tilesArrived", Qt::QueuedConnection);
+  }
+
+  void TileLoader::evict() {
+    while (m_used_bytes > m_memory_budget && !m_lru.empty()) {
+      std::map<TileKey, Entry>::iterator it = m_tiles.find(m_lru.back());
+      if (it->second.generation == m_generation)
+        break;
+      m_used_bytes -= it->second.bytes;
+      m_lru.pop_back();
+      m_tiles.erase(it);
+    }
+  }
+
+  void TileLoader::clear_notification() {
+    Mutex::Lock lock(m_mutex);
+    m_notification_pending = false;
+  }
+
+  void TileLoader::clear() {
+    {
+      Mutex::Lock lock(m_mutex);
+      m_pending.clear();
+    }
+    m_queue.join_all();
+
+    Mutex::Lock lock(m_mutex);
+    m_tiles.clear();
+    m_lru.clear();
+    m_used_bytes = 0;
+    m_notification_pending = false;
+  }
+
+}} // namespace vw::gui
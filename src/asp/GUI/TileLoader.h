@@ -0,0 +1,179 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2006-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TileLoader.h
+///
+/// Load the tiles of the images shown in stereo_gui in background
+/// threads, and keep the most recently used ones in memory.
+///
+/// The image at pyramid level L is the full-resolution image
+/// subsampled by 2^L, and it is cut into square tiles of tile_size()
+/// pixels. Drawing asks for the tiles it needs. Those not in memory
+/// are queued, and drawing makes do with coarser tiles for now. Each
+/// time a tile arrives the receiver's tilesArrived() slot is invoked
+/// in the UI thread, so that it can draw again. Drawing a new view
+/// drops the queued requests for the previous one.
+
+#ifndef __STEREO_GUI_TILE_LOADER_H__
+#define __STEREO_GUI_TILE_LOADER_H__
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+// Qt
+#include <QImage>
+
+// Vision Workbench
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Math/BBox.h>
+
+class QObject;
+
+namespace vw { namespace gui {
+
+  struct imageData;
+
+  /// How the tiles of an image are rendered
+  struct TileStyle {
+    bool   highlight_nodata;
+    bool   hillshade;
+    double azimuth, elevation; ///< Of the light, in degrees, when hillshading
+
+    TileStyle(): highlight_nodata(false), hillshade(false), azimuth(0), elevation(0) {}
+
+    bool operator<(TileStyle const& s) const;
+  };
+
+  /// A tile of an image at a pyramid level.
+  struct TileKey {
+    std::string image;     ///< The image file
+    TileStyle   style;
+    int level, col, row;
+
+    TileKey(std::string const& image_in, TileStyle const& style_in,
+            int level_in, int col_in, int row_in):
+      image(image_in), style(style_in),
+      level(level_in), col(col_in), row(row_in) {}
+
+    bool operator<(TileKey const& k) const;
+  };
+
+  /// A loaded tile, as returned by DiskImagePyramidMultiChannel::get_image_clip()
+  /// or get_hillshaded_clip().
+  struct Tile {
+    QImage qimg;       ///< Null if the tile could not be loaded
+    double scale;      ///< The subsampling of the pyramid level it was read from
+    BBox2i region;     ///< The pixels it covers in that level
+
+    /// The full-resolution pixels the tile covers
+    BBox2 full_res_box() const {
+      return BBox2(scale*region.min().x(), scale*region.min().y(),
+                   scale*region.width(), scale*region.height());
+    }
+  };
+  typedef boost::shared_ptr<Tile> TilePtr;
+
+  class TileLoader: private boost::noncopyable {
+  public:
+
+    /// The tiles arriving are announced to receiver, which must have
+    /// a tilesArrived() slot. The memory budget is in bytes.
+    TileLoader(QObject * receiver, size_t memory_budget);
+    ~TileLoader();
+
+    static int tile_size() { return 256; }
+
+    /// The pyramid level to show an image with this many image pixels
+    /// per screen pixel.
+    static int level_for_scale(double scale);
+
+    /// The coarsest level, at which the image fits in one tile
+    static int top_level(int cols, int rows);
+
+    /// The full-resolution pixels of a tile, before cropping to the image
+    static BBox2i tile_box(int level, int col, int row);
+
+    /// Start drawing a new view. Requests queued for the previous one
+    /// which were not started yet are dropped.
+    void begin_view();
+
+    /// Return the tile if in memory. Otherwise queue it for loading
+    /// from the given image and return a null pointer. Requests with
+    /// lower priority values are served first.
+    TilePtr fetch(imageData & image, TileKey const& key, double priority);
+
+    /// Return the tile if in memory, without queuing it otherwise
+    TilePtr cached(TileKey const& key);
+
+    /// Called by the receiver before drawing on a tilesArrived() signal,
+    /// so that tiles arriving while drawing are announced again.
+    void clear_notification();
+
+    /// Drop all requests, wait for those being served, and forget all
+    /// tiles. Must be called before any image which was passed to
+    /// fetch() is modified or destroyed.
+    void clear();
+
+  private:
+
+    friend class TileTask;
+
+    struct Request {
+      imageData * image;
+      double priority;
+    };
+
+    struct Entry {
+      TilePtr tile;
+      size_t  bytes;
+      int     generation; // the last view which used this tile
+      std::list<TileKey>::iterator lru_pos;
+    };
+
+    /// Load the queued tile with the lowest priority value, if any
+    void load_next();
+
+    /// Forget the least recently used tiles until within budget. The
+    /// tiles of the current view are kept even if over budget.
+    void evict();
+
+    void touch(std::map<TileKey, Entry>::iterator it);
+
+    QObject * m_receiver;
+    size_t    m_memory_budget, m_used_bytes;
+    int       m_generation;
+    bool      m_notification_pending;
+
+    std::map<TileKey, Request> m_pending;
+    std::set<TileKey>          m_in_flight;
+    std::map<TileKey, Entry>   m_tiles;
+    std::list<TileKey>         m_lru; // most recently used first
+
+    vw::Mutex         m_mutex;
+    vw::FifoWorkQueue m_queue;
+  };
+
+}} // namespace vw::gui
+
+#endif  // __STEREO_GUI_TILE_LOADER_H__
@@ -0,0 +1,263 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <vw/Camera/CameraModel.h>
+#include <asp/IsisIO/IsisTabulatedCameraModel.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+using namespace vw::camera;
+
+namespace {
+
+  // Number of nodes, and the spacing between them, so that the nodes
+  // start at 0 and end exactly at len - 1.
+  void node_spacing(int len, double step, int & num, double & spacing) {
+    step = std::max(step, 1e-3);
+    num = std::max(2, int(ceil((len - 1)/step)) + 1);
+    spacing = (len - 1)/double(num - 1);
+  }
+
+  // The interval [i, i+1] holding val, and the position in it. The
+  // position falls outside [0, 1] beyond the first and last nodes, which
+  // makes the interpolation below extrapolate linearly.
+  void locate(double val, double spacing, int num, int & i, double & t) {
+    double x = val/spacing;
+    i = std::max(0, std::min(num - 2, int(floor(x))));
+    t = x - i;
+  }
+
+  Quat quat_lerp(Quat const& a, Quat const& b, double t) {
+    Quat q(a.w() + t*(b.w() - a.w()), a.x() + t*(b.x() - a.x()),
+           a.y() + t*(b.y() - a.y()), a.z() + t*(b.z() - a.z()));
+    double len = sqrt(q.w()*q.w() + q.x()*q.x() + q.y()*q.y() + q.z()*q.z());
+    return Quat(q.w()/len, q.x()/len, q.y()/len, q.z()/len);
+  }
+
+  double quat_dot(Quat const& a, Quat const& b) {
+    return a.w()*b.w() + a.x()*b.x() + a.y()*b.y() + a.z()*b.z();
+  }
+}
+
+IsisTabulatedCameraModel::IsisTabulatedCameraModel(std::string const& cube_filename,
+                                                   double line_step, double sample_step):
+  IsisCameraModel(cube_filename) {
+
+  if (m_interface->type() != "LineScan")
+    vw_throw(NoImplErr() << "Tabulated ISIS cameras are implemented only for "
+             << "line scan cameras. The camera in " << cube_filename
+             << " is of type: " << m_interface->type() << ".\n");
+
+  m_lines   = m_interface->lines();
+  m_samples = m_interface->samples();
+  if (m_lines < 2 || m_samples < 2)
+    vw_throw(ArgumentErr() << "The cube " << cube_filename << " is too small.\n");
+
+  int num_lines, num_samples;
+  node_spacing(m_lines,   line_step,   num_lines,   m_line_step);
+  node_spacing(m_samples, sample_step, num_samples, m_sample_step);
+
+  // Position and orientation along the orbit. Keep consecutive
+  // quaternions in the same hemisphere so that they interpolate well.
+  m_centers.resize(num_lines);
+  m_poses.resize(num_lines);
+  for (int i = 0; i < num_lines; i++) {
+    Vector2 pix(0, i*m_line_step);
+    m_centers[i] = m_interface->camera_center(pix);
+    m_poses[i]   = m_interface->camera_pose(pix);
+    if (i > 0 && quat_dot(m_poses[i], m_poses[i-1]) < 0) {
+      Quat q = m_poses[i];
+      m_poses[i] = Quat(-q.w(), -q.x(), -q.y(), -q.z());
+    }
+  }
+
+  // For a pushbroom camera the look directions in the camera frame
+  // depend only on the sample, so sample them on the middle line.
+  double mid_line = (m_lines - 1)/2.0;
+  Quat mid_pose_inv = inverse(m_interface->camera_pose(Vector2(0, mid_line)));
+  m_looks.resize(num_samples);
+  for (int i = 0; i < num_samples; i++)
+    m_looks[i] = normalize(mid_pose_inv.rotate
+                           (m_interface->pixel_to_vector(Vector2(i*m_sample_step, mid_line))));
+
+  // A frame attached to the detector line, used to invert the looks
+  m_boresight      = normalize(m_looks[num_samples/2]);
+  m_along_detector = m_looks.back() - m_looks.front();
+  m_along_detector = normalize(m_along_detector - dot_prod(m_along_detector, m_boresight)*m_boresight);
+  m_plane_normal   = normalize(cross_prod(m_looks.front(), m_looks.back()));
+
+  m_look_u.resize(num_samples);
+  for (int i = 0; i < num_samples; i++) {
+    m_look_u[i] = detector_coord(m_looks[i]);
+    if (i > 0 && m_look_u[i] <= m_look_u[i-1])
+      vw_throw(NoImplErr() << "The detector of the camera in " << cube_filename
+               << " is not a monotonic line. Cannot tabulate it.\n");
+  }
+}
+
+Vector3 IsisTabulatedCameraModel::center_at(double line) const {
+  int num = m_centers.size(), i;
+  double t;
+  locate(line, m_line_step, num, i, t);
+
+  // Cubic Lagrange interpolation inside, linear extrapolation outside
+  if (num < 4 || t < 0 || t > 1)
+    return m_centers[i] + t*(m_centers[i+1] - m_centers[i]);
+
+  int j = std::max(0, std::min(num - 4, i - 1));
+  double x = line/m_line_step - j;
+  double w0 = -(x - 1)*(x - 2)*(x - 3)/6.0;
+  double w1 =  x*(x - 2)*(x - 3)/2.0;
+  double w2 = -x*(x - 1)*(x - 3)/2.0;
+  double w3 =  x*(x - 1)*(x - 2)/6.0;
+  return w0*m_centers[j] + w1*m_centers[j+1] + w2*m_centers[j+2] + w3*m_centers[j+3];
+}
+
+Quat IsisTabulatedCameraModel::pose_at(double line) const {
+  int i;
+  double t;
+  locate(line, m_line_step, m_poses.size(), i, t);
+  return quat_lerp(m_poses[i], m_poses[i+1], t);
+}
+
+Vector3 IsisTabulatedCameraModel::look_at(double sample) const {
+  int i;
+  double t;
+  locate(sample, m_sample_step, m_looks.size(), i, t);
+  return normalize(m_looks[i] + t*(m_looks[i+1] - m_looks[i]));
+}
+
+double IsisTabulatedCameraModel::detector_coord(Vector3 const& v) const {
+  return dot_prod(v, m_along_detector)/dot_prod(v, m_boresight);
+}
+
+double IsisTabulatedCameraModel::find_sample(Vector3 const& v) const {
+
+  double u = detector_coord(v);
+  int num = m_look_u.size();
+  int i = std::upper_bound(m_look_u.begin(), m_look_u.end(), u) - m_look_u.begin() - 1;
+  i = std::max(0, std::min(num - 2, i));
+  double sample = m_sample_step*(i + (u - m_look_u[i])/(m_look_u[i+1] - m_look_u[i]));
+
+  // The looks are interpolated as vectors, not in u, so correct for
+  // the small difference.
+  for (int iter = 0; iter < 2; iter++) {
+    double h  = 0.01*m_sample_step;
+    double u0 = detector_coord(look_at(sample));
+    double du = (detector_coord(look_at(sample + h)) - u0)/h;
+    if (du == 0)
+      break;
+    sample -= (u0 - u)/du;
+  }
+  return sample;
+}
+
+double IsisTabulatedCameraModel::find_line(Vector3 const& point, Vector3 const& normal,
+                                           double guess) const {
+
+  // The signed distance, in the camera frame, from the plane of the
+  // detector to the direction to the point. It changes monotonically
+  // as the camera moves along the orbit, so a secant solve converges
+  // quickly.
+  double l0 = guess, l1 = guess + 1.0;
+  double f0 = dot_prod(normal, normalize(inverse(pose_at(l0)).rotate(point - center_at(l0))));
+  double f1 = dot_prod(normal, normalize(inverse(pose_at(l1)).rotate(point - center_at(l1))));
+
+  const int    max_iter = 50;
+  const double tol      = 1e-8;
+  for (int iter = 0; iter < max_iter; iter++) {
+    if (f1 == f0)
+      break;
+    double l2 = l1 - f1*(l1 - l0)/(f1 - f0);
+    if (std::abs(l2 - l1) < tol)
+      return l2;
+    l0 = l1; f0 = f1;
+    l1 = l2;
+    f1 = dot_prod(normal, normalize(inverse(pose_at(l1)).rotate(point - center_at(l1))));
+  }
+  if (std::abs(f1) < 1e-12)
+    return l1;
+
+  vw_throw(PointToPixelErr() << "Unable to project point into tabulated ISIS camera.");
+  return l1;
+}
+
+Vector2 IsisTabulatedCameraModel::point_to_pixel(Vector3 const& point) const {
+
+  // Find the line where the point is in the plane of the detector,
+  // then the sample from the direction to the point. With distortion
+  // the detector is not quite a plane, so repeat with the plane
+  // tangent to it at the sample found.
+  Vector3 normal = m_plane_normal;
+  double line = (m_lines - 1)/2.0, sample = 0;
+  for (int pass = 0; pass < 3; pass++) {
+    line = find_line(point, normal, line);
+    Vector3 v = inverse(pose_at(line)).rotate(point - center_at(line));
+    if (dot_prod(v, m_boresight) <= 0)
+      vw_throw(PointToPixelErr() << "Point is behind the tabulated ISIS camera.");
+
+    sample = find_sample(normalize(v));
+    Vector3 tangent = look_at(sample + 0.5*m_sample_step) - look_at(sample - 0.5*m_sample_step);
+    normal = normalize(cross_prod(look_at(sample), tangent));
+  }
+
+  return Vector2(sample, line);
+}
+
+Vector3 IsisTabulatedCameraModel::pixel_to_vector(Vector2 const& pix) const {
+  return normalize(pose_at(pix[1]).rotate(look_at(pix[0])));
+}
+
+Vector3 IsisTabulatedCameraModel::camera_center(Vector2 const& pix) const {
+  return center_at(pix[1]);
+}
+
+Quat IsisTabulatedCameraModel::camera_pose(Vector2 const& pix) const {
+  return pose_at(pix[1]);
+}
+
+double IsisTabulatedCameraModel::check_accuracy(int num_per_dim,
+                                                double & max_center_diff) const {
+
+  num_per_dim = std::max(num_per_dim, 2);
+  Vector3 radii = m_interface->target_radii();
+  double radius = (radii[0] + radii[1] + radii[2])/3.0;
+
+  double max_err = 0;
+  max_center_diff = 0;
+  for (int r = 0; r < num_per_dim; r++) {
+    for (int c = 0; c < num_per_dim; c++) {
+      Vector2 pix(c*(m_samples - 1.0)/(num_per_dim - 1), r*(m_lines - 1.0)/(num_per_dim - 1));
+      Vector3 ctr = m_interface->camera_center(pix);
+      Vector3 dir = m_interface->pixel_to_vector(pix);
+      double range = std::max(norm_2(ctr) - radius, 1000.0);
+
+      max_center_diff = std::max(max_center_diff, norm_2(ctr - camera_center(pix)));
+      try {
+        max_err = std::max(max_err, norm_2(point_to_pixel(ctr + range*dir) - pix));
+      } catch (PointToPixelErr const&) {
+        return std::numeric_limits<double>::max();
+      }
+    }
+  }
+  return max_err;
+}
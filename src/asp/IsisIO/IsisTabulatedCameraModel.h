@@ -0,0 +1,98 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file IsisTabulatedCameraModel.h
+///
+/// An ISIS line scan camera whose geometry is sampled once, at load
+/// time, from the live ISIS camera. The camera center and pose are
+/// tabulated per image line and the look direction in the camera frame
+/// (which includes the detector and distortion maps) per image sample.
+/// Projections only read these tables, so, unlike IsisCameraModel, the
+/// projection methods can be called from many threads at once.
+///
+/// Use check_accuracy() to compare against the live ISIS camera. With
+/// the default sampling of one line and one sample, the tabulated
+/// model agrees with ISIS to a small fraction of a pixel.
+///
+#ifndef __ASP_ISIS_TABULATED_CAMERA_MODEL_H__
+#define __ASP_ISIS_TABULATED_CAMERA_MODEL_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Math/Quaternion.h>
+#include <asp/IsisIO/IsisCameraModel.h>
+
+#include <string>
+#include <vector>
+
+namespace vw {
+namespace camera {
+
+  class IsisTabulatedCameraModel : public IsisCameraModel {
+
+  public:
+    /// Load the cube and sample its camera every line_step lines and
+    /// every sample_step samples. Throws NoImplErr if the camera is
+    /// not a line scan camera.
+    IsisTabulatedCameraModel(std::string const& cube_filename,
+                             double line_step = 1.0, double sample_step = 1.0);
+
+    virtual std::string type() const { return "IsisTabulated"; }
+
+    // These are thread-safe. The remaining methods inherited from
+    // IsisCameraModel still go to ISIS and are not.
+    virtual Vector2 point_to_pixel (Vector3 const& point) const;
+    virtual Vector3 pixel_to_vector(Vector2 const& pix) const;
+    virtual Vector3 camera_center  (Vector2 const& pix = Vector2()) const;
+    virtual Quat    camera_pose    (Vector2 const& pix = Vector2()) const;
+
+    /// Compare with the live ISIS camera on a grid of pixels. Points are
+    /// placed along the ISIS rays at the height of the camera above the
+    /// body and projected back with the tabulated model. Return the
+    /// largest distance in pixels, and the largest difference in camera
+    /// centers in meters. Not thread-safe, as it calls ISIS.
+    double check_accuracy(int num_per_dim, double & max_center_diff) const;
+
+  private:
+    int m_lines, m_samples;
+    double m_line_step, m_sample_step;
+
+    std::vector<Vector3> m_centers; // per tabulated line
+    std::vector<Quat>    m_poses;   // per tabulated line
+    std::vector<Vector3> m_looks;   // per tabulated sample, in the camera frame
+    std::vector<double>  m_look_u;  // coordinate along the detector of each look
+
+    Vector3 m_boresight, m_along_detector, m_plane_normal;
+
+    Vector3 center_at(double line)   const;
+    Quat    pose_at  (double line)   const;
+    Vector3 look_at  (double sample) const;
+
+    // The coordinate along the detector of a direction in the camera frame
+    double detector_coord(Vector3 const& v) const;
+
+    // The sample whose look direction is closest to the given one
+    double find_sample(Vector3 const& v) const;
+
+    // The line at which the point is in the plane with the given normal
+    // in the camera frame.
+    double find_line(Vector3 const& point, Vector3 const& normal, double guess) const;
+  };
+
+}}
+
+#endif//__ASP_ISIS_TABULATED_CAMERA_MODEL_H__
@@ -21,6 +21,7 @@
 #include <vw/Math/Vector.h>
 #include <vw/Core/Debugging.h>
 #include <asp/IsisIO/IsisCameraModel.h>
+#include <asp/IsisIO/IsisTabulatedCameraModel.h>
 #include <vw/Cartography/PointImageManipulation.h>
 
 #include <FileName.h>
@@ -271,3 +272,32 @@ TEST(IsisCameraModel, camera_model) {
     EXPECT_LT( angle_from_z, 0.5 );
   }
 }
+
+TEST(IsisCameraModel, tabulated) {
+  if (!asp::isis::IsisEnv()) {
+    vw_out() << "ISISROOT or ISIS3DATA was not set. ISIS unit tests won't be run."
+	     << std::endl;
+    return;
+  }
+
+  // Only line scan cameras can be tabulated
+  EXPECT_THROW( IsisTabulatedCameraModel("5165r.cub"), NoImplErr );
+
+  std::string cube("E1701676.reduce.cub");
+  IsisCameraModel          cam(cube);
+  IsisTabulatedCameraModel tab(cube);
+
+  double center_diff = 0;
+  EXPECT_LT( tab.check_accuracy(5, center_diff), 0.02 );
+  EXPECT_LT( center_diff, 0.1 );
+
+  srand( 42 );
+  for ( size_t i = 0; i < 10; i++ ) {
+    Vector2 pixel = generate_random( cam.samples(),
+				     cam.lines() );
+    EXPECT_VECTOR_NEAR( cam.pixel_to_vector(pixel), tab.pixel_to_vector(pixel), 1e-6 );
+
+    Vector3 point = cam.camera_center(pixel) + 70000*cam.pixel_to_vector(pixel);
+    EXPECT_VECTOR_NEAR( pixel, tab.point_to_pixel(point), 0.02 );
+  }
+}
@@ -23,6 +23,7 @@
 #include <vw/Camera/Extrinsics.h>
 #include <vw/Core/Exception.h>
 #include <vw/Core/Log.h>
+#include <vw/Core/Stopwatch.h>
 #include <vw/Math/EulerAngles.h>
 #include <vw/Math/Matrix.h>
 #include <xercesc/util/PlatformUtils.hpp>
@@ -31,9 +32,13 @@
 #include <asp/Core/StereoSettings.h>
 #include <asp/IsisIO/Equation.h>
 #include <asp/IsisIO/IsisCameraModel.h>
+#include <asp/IsisIO/IsisTabulatedCameraModel.h>
 #include <asp/Camera/LinescanDGModel.h>
 #include <asp/Camera/LinescanSpotModel.h>
 #include <asp/Camera/LinescanASTERModel.h>
+#include <asp/Camera/SPOT_XML.h>
+#include <asp/Camera/ASTER_XML.h>
+#include <asp/Camera/CameraCache.h>
 #include <asp/Sessions/CameraModelLoader.h>
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/DG_XML.h>
@@ -44,6 +49,7 @@
 #include <string>
 #include <ostream>
 #include <limits>
+#include <cstdlib>
 
 // TODO: Break this up. Each of these functions must go back to their
 // individual Session directories rather than being collected here.
@@ -83,34 +89,135 @@ boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_rpc_camera_mo
 }
 
 
+namespace {
+
+  // Where to cache what is read from camera XML files. Empty if not caching.
+  std::string camera_cache_dir() {
+    std::string dir = stereo_settings().camera_cache_dir;
+    if (dir == "") {
+      char * env_dir = getenv("ASP_CAMERA_CACHE_DIR");
+      if (env_dir != NULL)
+        dir = env_dir;
+    }
+    return dir;
+  }
+
+  void log_camera_cache_use(std::string const& path, double load_seconds,
+                            double parse_seconds) {
+    vw::vw_out() << "Read the camera for " << path << " from the cache in "
+                 << load_seconds << " s, rather than parsing it in "
+                 << parse_seconds << " s. Saved "
+                 << std::max(parse_seconds - load_seconds, 0.0) << " s.\n";
+  }
+}
+
 // Load a DG camera file
 boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_dg_camera_model(std::string const& path) const
 {
-  // Redirect to the call from LinescanDGModel.h file
-  return CameraModelPtr(load_dg_camera_model_from_xml(path));
+  std::string cache_file = camera_cache_file(camera_cache_dir(), path, "dg");
+  if (cache_file == "") {
+    // Redirect to the call from LinescanDGModel.h file
+    return CameraModelPtr(load_dg_camera_model_from_xml(path));
+  }
+
+  GeometricXML geo;
+  AttitudeXML  att;
+  EphemerisXML eph;
+  ImageXML     img;
+  double parse_seconds = 0;
+  vw::Stopwatch sw;
+  sw.start();
+  if (read_dg_camera_cache(cache_file, geo, att, eph, img, parse_seconds)) {
+    sw.stop();
+    log_camera_cache_use(path, sw.elapsed_seconds(), parse_seconds);
+  } else {
+    RPCXML rpc;
+    read_xml(path, geo, att, eph, img, rpc);
+    sw.stop();
+    write_dg_camera_cache(cache_file, geo, att, eph, img, sw.elapsed_seconds());
+  }
+  return CameraModelPtr(load_dg_camera_model(geo, att, eph, img));
 }
 
 // Load a spot5 camera file
 boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_spot5_camera_model(std::string const& path) const
 {
-  // Redirect to the call from LinescanSpotModel.h file
-  return CameraModelPtr(load_spot5_camera_model_from_xml(path));
+  std::string cache_file = camera_cache_file(camera_cache_dir(), path, "spot5");
+  if (cache_file == "") {
+    // Redirect to the call from LinescanSpotModel.h file
+    return CameraModelPtr(load_spot5_camera_model_from_xml(path));
+  }
+
+  SpotXML xml_reader;
+  double parse_seconds = 0;
+  vw::Stopwatch sw;
+  sw.start();
+  if (read_spot5_camera_cache(cache_file, xml_reader, parse_seconds)) {
+    sw.stop();
+    log_camera_cache_use(path, sw.elapsed_seconds(), parse_seconds);
+  } else {
+    xml_reader.read_xml(path);
+    sw.stop();
+    write_spot5_camera_cache(cache_file, xml_reader, sw.elapsed_seconds());
+  }
+  return CameraModelPtr(load_spot5_camera_model(xml_reader));
 }
 
 // Load a ASTER camera file
 boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_ASTER_camera_model(std::string const& path) const
 {
-  // This model file also needs the RPC model as an initial guess
-  boost::shared_ptr<vw::camera::CameraModel> rpc_model = load_rpc_camera_model(path);
-  
-  // Redirect to the call from LinescanASTERModel.h file
-  return CameraModelPtr(load_ASTER_camera_model_from_xml(path, rpc_model));
+  std::string cache_file = camera_cache_file(camera_cache_dir(), path, "aster");
+  if (cache_file == "") {
+    // This model file also needs the RPC model as an initial guess
+    boost::shared_ptr<vw::camera::CameraModel> rpc_model = load_rpc_camera_model(path);
+
+    // Redirect to the call from LinescanASTERModel.h file
+    return CameraModelPtr(load_ASTER_camera_model_from_xml(path, rpc_model));
+  }
+
+  ASTERXML xml_reader;
+  boost::shared_ptr<RPCModel> rpc_model;
+  double parse_seconds = 0;
+  vw::Stopwatch sw;
+  sw.start();
+  if (read_ASTER_camera_cache(cache_file, xml_reader, rpc_model, parse_seconds)) {
+    sw.stop();
+    log_camera_cache_use(path, sw.elapsed_seconds(), parse_seconds);
+  } else {
+    rpc_model = boost::dynamic_pointer_cast<RPCModel>(load_rpc_camera_model(path));
+    xml_reader.read_xml(path);
+    sw.stop();
+    write_ASTER_camera_cache(cache_file, xml_reader, *rpc_model, sw.elapsed_seconds());
+  }
+  return CameraModelPtr(load_ASTER_camera_model(xml_reader, rpc_model));
 }
 
 // Load an ISIS camera model
 boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_isis_camera_model(std::string const& path) const
 {
 #if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
+  if (stereo_settings().use_tabulated_isis_cameras) {
+    // A tabulated model is used only if it agrees with ISIS. This
+    // check is done here, once, as it is not thread-safe.
+    const double max_pixel_err = 0.05;
+    try {
+      boost::shared_ptr<vw::camera::IsisTabulatedCameraModel>
+        cam(new vw::camera::IsisTabulatedCameraModel(path));
+      double center_diff = 0;
+      double pixel_err   = cam->check_accuracy(5, center_diff);
+      vw::vw_out(vw::DebugMessage, "asp") << "Tabulated ISIS camera for " << path
+                                          << ": max pixel error " << pixel_err
+                                          << ", max camera center difference "
+                                          << center_diff << " m.\n";
+      if (pixel_err <= max_pixel_err)
+        return cam;
+      vw::vw_out(vw::WarningMessage) << "The tabulated camera for " << path
+                                     << " differs from ISIS by " << pixel_err
+                                     << " pixels. Using the ISIS camera.\n";
+    } catch (vw::NoImplErr const& e) {
+      vw::vw_out(vw::WarningMessage) << e.what() << "Using the ISIS camera.\n";
+    }
+  }
   return CameraModelPtr(new vw::camera::IsisCameraModel(path));
 #endif
   // If ISIS was not enabled in the build, just throw an exception.
@@ -40,6 +40,7 @@
 #include <utility>
 #include <string>
 #include <ostream>
+#include <sstream>
 #include <limits>
 
 using namespace vw;
@@ -126,7 +127,8 @@ namespace asp {
     bool inlier = false;
     if (nadir_facing) {
       // Run an IP matching function that takes the camera and datum info into account
-      bool single_threaded_camera = true; // TODO: This is probably needed only for ISIS.
+      bool single_threaded_camera = (is_single_threaded_camera(cam1) ||
+                                     is_single_threaded_camera(cam2));
 
       bool use_sphere_for_isis = false; // Assume Mars is not a sphere
       cartography::Datum datum = this->get_datum(cam1, use_sphere_for_isis);
@@ -190,11 +192,47 @@ namespace asp {
     return georef;
   }
 
+  std::string StereoSession::camera_models_key() const {
+    std::ostringstream key;
+    std::string ba_pref = stereo_settings().bundle_adjust_prefix;
+    key << ba_pref;
+    if (ba_pref == "")
+      return key.str();
+    std::string adjust_files[] = {
+      asp::bundle_adjust_file_name(ba_pref, m_left_image_file,  m_left_camera_file),
+      asp::bundle_adjust_file_name(ba_pref, m_right_image_file, m_right_camera_file)};
+    for (int i = 0; i < 2; i++) {
+      key << "\n" << adjust_files[i];
+      boost::system::error_code ec;
+      std::time_t mtime = boost::filesystem::last_write_time(adjust_files[i], ec);
+      if (!ec)
+        key << " " << mtime;
+    }
+    return key.str();
+  }
+
   // Default implementation of this function.  Derived classes will probably override this.
   void StereoSession::camera_models(boost::shared_ptr<vw::camera::CameraModel> &cam1,
 				    boost::shared_ptr<vw::camera::CameraModel> &cam2) {
+    // The kept cameras are stale if they were loaded with other
+    // adjustments, as when stereo_tri reloads them with the piecewise
+    // adjustments it just computed.
+    std::string key;
+    if (m_keep_camera_models)
+      key = camera_models_key();
+    if (m_keep_camera_models && m_left_camera_model && m_right_camera_model &&
+        key == m_camera_models_key) {
+      cam1 = m_left_camera_model;
+      cam2 = m_right_camera_model;
+      return;
+    }
     cam1 = camera_model(m_left_image_file,  m_left_camera_file);
     cam2 = camera_model(m_right_image_file, m_right_camera_file);
+    if (m_keep_camera_models) {
+      m_left_camera_model  = cam1;
+      m_right_camera_model = cam2;
+      m_camera_models_key  = key;
+    }
   }
 
   // Processing Hooks. The default is to do nothing.
@@ -522,4 +560,9 @@ load_adjusted_model(boost::shared_ptr<vw::camera::CameraModel> cam,
 						 pose_correction[0], pixel_offset));
 }
 
+bool is_single_threaded_camera(vw::camera::CameraModel const* cam) {
+  std::string type = vw::camera::unadjusted_model(cam)->type();
+  return (type == "Isis");
+}
+
 } // End namespace asp
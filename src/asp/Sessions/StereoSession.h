@@ -32,37 +32,22 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <asp/Core/Common.h>
+#include <asp/Core/ImageStats.h>
 
 namespace asp {
 
-  typedef vw::Vector<vw::float32,6> Vector6f;
-
-  //TODO: Move this function!
-  /// Compute the min, max, mean, and standard deviation of an image object and write them to a log.
+  /// Compute the min, max, mean, standard deviation, and 2% and 98%
+  /// percentiles of an image object, in parallel, and write them to a log.
   /// - "tag" is only used to make the log messages more descriptive.
+  /// Use gather_image_stats() for images on disk, so that overviews
+  /// and saved statistics are used.
   template <class ViewT>
   Vector6f gather_stats( vw::ImageViewBase<ViewT> const& view_base, std::string const& tag) {
-    using namespace vw;
-    vw_out(InfoMessage) << "\t--> Computing statistics for " + tag + "\n";
-    ViewT image = view_base.impl();
-
-    // Compute statistics at a reduced resolution
-    int stat_scale = int(ceil(sqrt(float(image.cols())*float(image.rows()) / 1000000)));
-
-    ChannelAccumulator<vw::math::CDFAccumulator<float> > accumulator;
-    for_each_pixel( subsample( edge_extend(image, ConstantEdgeExtension()),
-			       stat_scale ),
-		    accumulator );
-    Vector6f result;
-    result[0] = accumulator.quantile(0); // Min
-    result[1] = accumulator.quantile(1); // Max
-    result[2] = accumulator.approximate_mean();
-    result[3] = accumulator.approximate_stddev();
-    result[4] = accumulator.quantile(0.02); // Percentile values
-    result[5] = accumulator.quantile(0.98);
-
-    vw_out(InfoMessage) << "\t  " << tag << ": [ lo: " << result[0] << " hi: " << result[1]
-					     << " mean: " << result[2] << " std_dev: "  << result[3] << " ]\n";
+    vw::vw_out(vw::InfoMessage) << "\t--> Computing statistics for " + tag + "\n";
+    ImageStatsAccumulator accumulator;
+    accumulate_image(view_base.impl(), accumulator);
+    Vector6f result = accumulator.stats();
+    log_stats(tag, result);
     return result;
   }
 
@@ -147,6 +132,16 @@ namespace asp {
     std::string m_left_camera_file, m_right_camera_file;
     std::string m_out_prefix, m_input_dem;
 
+    // The cameras returned by camera_models(), if kept, and the
+    // adjustments they were loaded with
+    bool m_keep_camera_models;
+    boost::shared_ptr<vw::camera::CameraModel> m_left_camera_model, m_right_camera_model;
+    std::string m_camera_models_key;
+
+    /// The bundle adjust prefix and the adjustment files the cameras
+    /// would be loaded with now, with their modification times.
+    std::string camera_models_key() const;
+
     virtual void initialize (vw::cartography::GdalWriteOptions const& options,
 			     std::string const& left_image_file,
 			     std::string const& right_image_file,
@@ -156,6 +151,7 @@ namespace asp {
 			     std::string const& input_dem);
 
   public:
+    StereoSession(): m_keep_camera_models(false) {}
     virtual ~StereoSession() {}
 
     /// Simple typedef of a factory function that creates a StereoSession instance
@@ -174,6 +170,12 @@ namespace asp {
     virtual void camera_models(boost::shared_ptr<vw::camera::CameraModel> &cam1,
 			       boost::shared_ptr<vw::camera::CameraModel> &cam2);
 
+    /// Load the cameras only on the first call of camera_models(), and
+    /// return the same ones afterwards, unless the bundle adjust prefix
+    /// or its adjustment files changed since. For a process which does
+    /// many tiles, as the workers of parallel_stereo.
+    void keep_camera_models(bool keep) { m_keep_camera_models = keep; }
+
     /// Method that produces a Camera Model from input files.
     virtual boost::shared_ptr<vw::camera::CameraModel>
     camera_model(std::string const& image_file,
@@ -298,6 +300,10 @@ load_adjusted_model(boost::shared_ptr<vw::camera::CameraModel> cam,
 		    std::string const& camera_file,
 		    vw::Vector2 const& pixel_offset);
 
+/// If a camera can be used from only one thread at a time. That is
+/// the case for ISIS cameras, unless tabulated.
+bool is_single_threaded_camera(vw::camera::CameraModel const* cam);
+
 } // end namespace asp
 
 #endif // __STEREO_SESSION_H__
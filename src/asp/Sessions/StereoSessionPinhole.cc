@@ -129,8 +129,10 @@ void asp::StereoSessionPinhole::pre_preprocessing_hook(bool adjust_left_image_si
   ImageViewRef< PixelMask<float> > left_masked_image  = create_mask_less_or_equal(left_disk_image,  left_nodata_value);
   ImageViewRef< PixelMask<float> > right_masked_image = create_mask_less_or_equal(right_disk_image, right_nodata_value);
 
-  Vector6f left_stats  = gather_stats(left_masked_image,  "left" );
-  Vector6f right_stats = gather_stats(right_masked_image, "right");
+  Vector6f left_stats  = gather_image_stats(left_masked_image,  left_cropped_file,  left_nodata_value,  "left",
+                                            stats_sidecar_file(this->m_out_prefix, left_cropped_file));
+  Vector6f right_stats = gather_image_stats(right_masked_image, right_cropped_file, right_nodata_value, "right",
+                                            stats_sidecar_file(this->m_out_prefix, right_cropped_file));
 
   ImageViewRef< PixelMask<float> > Limg, Rimg;
   std::string lcase_file = boost::to_lower_copy(m_left_camera_file);
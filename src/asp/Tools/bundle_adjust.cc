@@ -27,7 +27,11 @@
 #include <asp/Core/PointUtils.h>
 #include <asp/Tools/bundle_adjust.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <xercesc/util/PlatformUtils.hpp>
+#include <map>
+#include <set>
 
 
 // Turn off warnings from eigen
@@ -83,7 +87,20 @@ struct Options : public vw::cartography::GdalWriteOptions {
   std::vector<boost::shared_ptr<CameraModel> > camera_models;
   cartography::Datum datum;
   int  ip_detect_method;
-  bool individually_normalize;
+  bool individually_normalize, use_tabulated_isis_cameras, numerical_jacobians;
+  int    partition_size, partition_iterations;
+  double partition_overlap;
+  bool   partition_compare;
+
+  // Incremental bundle adjustment. The cameras which have adjustments
+  // under the input prefix are loaded with them applied, and the
+  // others are new.
+  std::string input_adjustments_prefix;
+  int  global_refinement_period, num_incremental_runs;
+  bool global_refinement;
+  std::vector<bool>    new_cameras;
+  std::vector<Vector3> input_positions;
+  std::vector<Quat>    input_poses;
 
   // Make sure all values are initialized, even though they will be
   // over-written later.
@@ -94,7 +111,10 @@ struct Options : public vw::cartography::GdalWriteOptions {
              semi_major(0), semi_minor(0),
              datum(cartography::Datum(UNSPECIFIED_DATUM, "User Specified Spheroid",
                                       "Reference Meridian", 1, 1, 0)),
-             ip_detect_method(0){}
+             ip_detect_method(0), numerical_jacobians(false),
+             partition_size(0), partition_iterations(0), partition_overlap(0),
+             partition_compare(false), global_refinement_period(0),
+             num_incremental_runs(0), global_refinement(false){}
 };
 
 // TODO: This update stuff should really be done somewhere else!
@@ -239,6 +259,81 @@ struct BaReprojectionError {
   size_t m_icam, m_ipt;
 };
 
+/// The same residual as BaReprojectionError<BundleAdjustmentModel>,
+/// but with the derivatives found analytically rather than by numerical
+/// differentiation of cam_pixel(), which would call point_to_pixel()
+/// 18 times per observation.
+class BaAnalyticReprojectionError:
+  public ceres::SizedCostFunction<2, BundleAdjustmentModel::camera_params_n,
+                                  BundleAdjustmentModel::point_params_n> {
+public:
+  BaAnalyticReprojectionError(Vector2 const& observation, Vector2 const& pixel_sigma,
+                              BundleAdjustmentModel * const ba_model, size_t icam, size_t ipt):
+    m_observation(observation),
+    m_pixel_sigma(pixel_sigma),
+    m_ba_model(ba_model),
+    m_icam(icam), m_ipt(ipt){}
+
+  virtual bool Evaluate(double const* const* parameters, double* residuals,
+                        double** jacobians) const {
+
+    const int ncp = BundleAdjustmentModel::camera_params_n;
+    const int npp = BundleAdjustmentModel::point_params_n;
+    try{
+      VW_ASSERT(m_icam < m_ba_model->num_cameras(), ArgumentErr() << "Out of bounds in the number of cameras");
+      VW_ASSERT(m_ipt  < m_ba_model->num_points(),  ArgumentErr() << "Out of bounds in the number of points" );
+
+      BundleAdjustmentModel::camera_vector_t cam_vec;
+      BundleAdjustmentModel::point_vector_t  point_vec;
+      for (int c = 0; c < ncp; c++)
+        cam_vec[c] = parameters[0][c];
+      for (int p = 0; p < npp; p++)
+        point_vec[p] = parameters[1][p];
+
+      Matrix<double, 2, ncp> J_cam;
+      Matrix<double, 2, npp> J_point;
+      Vector2 prediction = m_ba_model->cam_pixel_jacobian(m_icam, cam_vec, point_vec,
+                                                          J_cam, J_point);
+
+      for (int r = 0; r < 2; r++) {
+        residuals[r] = (prediction[r] - m_observation[r])/m_pixel_sigma[r];
+        if (jacobians == NULL) continue;
+        if (jacobians[0] != NULL) {
+          for (int c = 0; c < ncp; c++)
+            jacobians[0][r*ncp + c] = J_cam(r, c)/m_pixel_sigma[r];
+        }
+        if (jacobians[1] != NULL) {
+          for (int p = 0; p < npp; p++)
+            jacobians[1][r*npp + p] = J_point(r, p)/m_pixel_sigma[r];
+        }
+      }
+
+    } catch (std::exception const& e) {
+      // Failed to compute residuals
+
+      Mutex::Lock lock( g_ba_mutex );
+      g_ba_num_errors++;
+      if (g_ba_num_errors < 100) {
+        vw_out(ErrorMessage) << e.what() << std::endl;
+      }else if (g_ba_num_errors == 100) {
+        vw_out() << "Will print no more error messages about "
+                 << "failing to compute residuals.\n";
+      }
+
+      residuals[0] = 1e+20;
+      residuals[1] = 1e+20;
+      return false;
+    }
+
+    return true;
+  }
+
+  Vector2 m_observation;
+  Vector2 m_pixel_sigma;
+  BundleAdjustmentModel * const m_ba_model;
+  size_t m_icam, m_ipt;
+};
+
 /// A ceres cost function. Here we float a pinhole camera's intrinsic
 /// and extrinsic parameters. The result is the residual, the
 /// difference in the observation and the projection of the point into
@@ -431,6 +526,7 @@ void add_residual_block(ModelT & ba_model,
                         Vector2 const& observation, Vector2 const& pixel_sigma,
                         size_t icam, size_t ipt,
                         double * camera, double * point, double * intrinsics,
+                        bool numerical_jacobians,
                         ceres::LossFunction* loss_function,
                         ceres::Problem & problem){
 
@@ -440,6 +536,27 @@ void add_residual_block(ModelT & ba_model,
   problem.AddResidualBlock(cost_function, loss_function, camera, point);
 }
 
+// Add residual block for adjusted cameras, with analytic derivatives
+// unless asked otherwise
+template<>
+void add_residual_block<BundleAdjustmentModel>
+                  (BundleAdjustmentModel & ba_model,
+                   Vector2 const& observation, Vector2 const& pixel_sigma,
+                   size_t icam, size_t ipt,
+                   double * camera, double * point, double * intrinsics,
+                   bool numerical_jacobians,
+                   ceres::LossFunction* loss_function,
+                   ceres::Problem & problem){
+  ceres::CostFunction* cost_function;
+  if (numerical_jacobians)
+    cost_function = BaReprojectionError<BundleAdjustmentModel>::Create(observation, pixel_sigma,
+                                                                       &ba_model, icam, ipt);
+  else
+    cost_function = new BaAnalyticReprojectionError(observation, pixel_sigma,
+                                                    &ba_model, icam, ipt);
+  problem.AddResidualBlock(cost_function, loss_function, camera, point);
+}
+
 // Add residual block, optionally floating the intrinsics
 template<>
 void add_residual_block<BAPinholeModel>
@@ -447,6 +564,7 @@ void add_residual_block<BAPinholeModel>
                    Vector2 const& observation, Vector2 const& pixel_sigma,
                    size_t icam, size_t ipt,
                    double * camera, double * point, double * intrinsics,
+                   bool numerical_jacobians,
                    ceres::LossFunction* loss_function,
                    ceres::Problem & problem){
   // If the intrinsics are constant use the default method above
@@ -464,57 +582,47 @@ void add_residual_block<BAPinholeModel>
 }
 
 
-// Use Ceres to do bundle adjustment. The camera and point variables
-// are stored in arrays.  The projection of point into camera is
-// accomplished by interfacing with the bundle adjustment model. In
-// the future this class can be bypassed.
-template <class ModelT>
-void do_ba_ceres(ModelT & ba_model, Options& opt ){
-
-  ControlNetwork & cnet = *(ba_model.control_network().get());
-
-  size_t num_camera_params    = ModelT::camera_params_n;
-  size_t num_point_params     = ModelT::point_params_n;
-  size_t num_intrinsic_params = ba_model.num_intrinsic_params();
-  size_t num_cameras          = ba_model.num_cameras();
-  size_t num_points           = ba_model.num_points();
+// ISIS cameras can be used from only one thread, unless tabulated
+int ba_num_threads(Options const& opt) {
+  for (size_t icam = 0; icam < opt.camera_models.size(); icam++) {
+    if (asp::is_single_threaded_camera(opt.camera_models[icam].get()))
+      return 1;
+  }
+  return std::max(opt.num_threads, 1);
+}
 
-  // The camera adjustment and point variables concatenated into
-  // vectors. The camera adjustments start as 0. The points come from the network.
-  std::vector<double> cameras_vec(num_cameras*num_camera_params, 0.0);
-  std::vector<double> intrinsics_vec(num_intrinsic_params, 0.0);
+void set_solver_options(Options const& opt, int num_threads, bool verbose,
+                        ceres::Solver::Options & options){
+  options.gradient_tolerance = 1e-16;
+  options.function_tolerance = 1e-16;
+  options.max_num_iterations = opt.max_iterations;
+  options.max_num_consecutive_invalid_steps = std::max(5, opt.max_iterations/5); // try hard
+  options.minimizer_progress_to_stdout = verbose && (opt.report_level >= vw::ba::ReportFile);
+  options.num_threads = num_threads;
 
-  // Do any init required for this camera model.
-  // - Currently we don't do anything except for pinhole models with no input cameras.
-  update_cnet_and_init_cams(ba_model, opt, (*opt.cnet), cameras_vec, intrinsics_vec);
-/*
-  // DEBUG
-  std::cout << "Initial camera parameters: ";
-  for (size_t i=0; i<cameras_vec.size(); ++i)
-    std::cout << cameras_vec[i] << "  ";
-  std::cout << "\nInitial intrinsic parameters: ";
-  for (size_t i=0; i<intrinsics_vec.size(); ++i)
-    std::cout << intrinsics_vec[i] << "  ";
-  std::cout << std::endl;
-*/
+  options.linear_solver_type = ceres::SPARSE_SCHUR;
+  //options.ordering_type = ceres::SCHUR;
+  //options.eta = 1e-3; // FLAGS_eta;
+  //options->max_solver_time_in_seconds = FLAGS_max_solver_time;
+  //options->use_nonmonotonic_steps = FLAGS_nonmonotonic_steps;
+  //if (FLAGS_line_search) {
+  //  options->minimizer_type = ceres::LINE_SEARCH;
+  //}
+}
 
-  // Camera extrinsics and intrinsics
-  double* cameras    = &cameras_vec[0];
-  double* intrinsics = NULL;
-  if (num_intrinsic_params > 0)
-    intrinsics = &intrinsics_vec[0];
+// Solve for all cameras and points at once
+template <class ModelT>
+void solve_ba_ceres(ModelT & ba_model, Options const& opt, ControlNetwork & cnet,
+                    std::vector<double> & cameras_vec, std::vector<double> const& orig_cameras_vec,
+                    std::vector<double> & points_vec, double * intrinsics){
 
-  // Points
-  std::vector<double> points_vec(num_points*num_point_params, 0.0);
-  for (size_t ipt = 0; ipt < num_points; ipt++){
-    for (size_t q = 0; q < num_point_params; q++){
-      points_vec[ipt*num_point_params + q] = cnet[ipt].position()[q];
-    }
-  }
-  double* points = &points_vec[0];
+  size_t num_camera_params = ModelT::camera_params_n;
+  size_t num_point_params  = ModelT::point_params_n;
+  size_t num_cameras       = ba_model.num_cameras();
+  size_t num_points        = ba_model.num_points();
 
-  // The camera positions and orientations before we float them
-  std::vector<double> orig_cameras_vec = cameras_vec;
+  double* cameras = &cameras_vec[0];
+  double* points  = &points_vec[0];
 
   ceres::Problem problem;
 
@@ -553,7 +661,8 @@ void do_ba_ceres(ModelT & ba_model, Options& opt ){
 
       // Call function to select the appropriate Ceres residual block to add.
       add_residual_block(ba_model, observation, pixel_sigma, icam, ipt,
-                         camera, point, intrinsics, loss_function, problem);
+                         camera, point, intrinsics, opt.numerical_jacobians,
+                         loss_function, problem);
     }
   }
 
@@ -593,25 +702,7 @@ void do_ba_ceres(ModelT & ba_model, Options& opt ){
 
   // Solve the problem
   ceres::Solver::Options options;
-  options.gradient_tolerance = 1e-16;
-  options.function_tolerance = 1e-16;
-  options.max_num_iterations = opt.max_iterations;
-  options.max_num_consecutive_invalid_steps = std::max(5, opt.max_iterations/5); // try hard
-  options.minimizer_progress_to_stdout = (opt.report_level >= vw::ba::ReportFile);
-
-  if (opt.stereo_session_string == "isis")
-    options.num_threads = 1;
-  else
-    options.num_threads = opt.num_threads;
-
-  options.linear_solver_type = ceres::SPARSE_SCHUR;
-  //options.ordering_type = ceres::SCHUR;
-  //options.eta = 1e-3; // FLAGS_eta;
-  //options->max_solver_time_in_seconds = FLAGS_max_solver_time;
-  //options->use_nonmonotonic_steps = FLAGS_nonmonotonic_steps;
-  //if (FLAGS_line_search) {
-  //  options->minimizer_type = ceres::LINE_SEARCH;
-  //}
+  set_solver_options(opt, ba_num_threads(opt), true, options);
 
   vw_out() << "Starting the Ceres optimizer..." << std::endl;
   ceres::Solver::Summary summary;
@@ -621,6 +712,568 @@ void do_ba_ceres(ModelT & ba_model, Options& opt ){
     // Print a clarifying message, so the user does not think that the algorithm failed.
     vw_out() << "Found a valid solution, but did not reach the actual minimum." << std::endl;
   }
+}
+
+//=========================================================================
+// Partitioned bundle adjustment
+
+/// An observation of a point, for partitioned bundle adjustment
+struct BaObservation {
+  size_t  icam;
+  Vector2 location, sigma;
+};
+
+/// List the observations of each point and the points each camera
+/// sees, skipping those the solver would not use.
+void collect_observations(ControlNetwork & cnet, size_t num_cameras, size_t num_points,
+                          std::vector< std::vector<BaObservation> > & point_obs,
+                          std::vector< std::vector<size_t> >        & camera_points){
+
+  CameraRelationNetwork<JFeature> crn;
+  crn.read_controlnetwork(cnet);
+
+  point_obs.assign(num_points, std::vector<BaObservation>());
+  camera_points.assign(num_cameras, std::vector<size_t>());
+  typedef CameraNode<JFeature>::iterator crn_iter;
+  for ( size_t icam = 0; icam < crn.size(); icam++ ) {
+    for ( crn_iter fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++ ){
+      size_t ipt = (**fiter).m_point_id;
+      VW_ASSERT(icam < num_cameras, ArgumentErr() << "Out of bounds in the number of cameras");
+      VW_ASSERT(ipt < num_points,   ArgumentErr() << "Out of bounds in the number of points");
+
+      BaObservation obs;
+      obs.icam     = icam;
+      obs.location = (**fiter).m_location;
+      obs.sigma    = (**fiter).m_scale;
+      if (obs.sigma != obs.sigma) // nan check, as in solve_ba_ceres()
+        obs.sigma = Vector2(1, 1);
+      point_obs[ipt].push_back(obs);
+      camera_points[icam].push_back(ipt);
+    }
+  }
+}
+
+/// A bundle adjustment problem over some of the cameras and points,
+/// with its own copy of the values it needs, so that the whole
+/// problem never has to be held by the solver at once. All
+/// observations of its points are included, but the cameras not
+/// being solved for are held fixed, which ties the solution to the
+/// rest of the network.
+template <class ModelT>
+class BaSubproblem: private boost::noncopyable {
+public:
+  BaSubproblem(ModelT & ba_model, Options const& opt, ControlNetwork const& cnet,
+               std::vector< std::vector<BaObservation> > const& point_obs,
+               std::vector<size_t> const& free_cameras, std::vector<size_t> const& points,
+               bool float_points,
+               std::vector<double> const& cameras_vec, std::vector<double> const& orig_cameras_vec,
+               std::vector<double> const& points_vec, double * intrinsics):
+    m_num_free_cameras(free_cameras.size()), m_points(points) {
+
+    const size_t ncp = ModelT::camera_params_n;
+    const size_t npp = ModelT::point_params_n;
+
+    // The cameras involved, the free ones first
+    std::map<size_t, size_t> local_cam;
+    for (size_t i = 0; i < free_cameras.size(); i++) {
+      local_cam[free_cameras[i]] = m_cameras.size();
+      m_cameras.push_back(free_cameras[i]);
+    }
+    for (size_t i = 0; i < points.size(); i++) {
+      std::vector<BaObservation> const& obs = point_obs[points[i]];
+      for (size_t k = 0; k < obs.size(); k++) {
+        if (local_cam.find(obs[k].icam) != local_cam.end()) continue;
+        local_cam[obs[k].icam] = m_cameras.size();
+        m_cameras.push_back(obs[k].icam);
+      }
+    }
+
+    m_camera_vals.resize(ncp*m_cameras.size());
+    for (size_t i = 0; i < m_cameras.size(); i++)
+      for (size_t q = 0; q < ncp; q++)
+        m_camera_vals[i*ncp + q] = cameras_vec[m_cameras[i]*ncp + q];
+    m_point_vals.resize(npp*m_points.size());
+    for (size_t i = 0; i < m_points.size(); i++)
+      for (size_t q = 0; q < npp; q++)
+        m_point_vals[i*npp + q] = points_vec[m_points[i]*npp + q];
+
+    // The same residuals as in solve_ba_ceres()
+    for (size_t i = 0; i < m_points.size(); i++) {
+      size_t ipt    = m_points[i];
+      double* point = &m_point_vals[i*npp];
+      std::vector<BaObservation> const& obs = point_obs[ipt];
+      for (size_t k = 0; k < obs.size(); k++) {
+        double* camera = &m_camera_vals[local_cam[obs[k].icam]*ncp];
+        add_residual_block(ba_model, obs[k].location, obs[k].sigma, obs[k].icam, ipt,
+                           camera, point, intrinsics, opt.numerical_jacobians,
+                           get_loss_function(opt), m_problem);
+      }
+      if (cnet[ipt].type() == ControlPoint::GroundControlPoint)
+        m_problem.AddResidualBlock(XYZError::Create(cnet[ipt].position(), cnet[ipt].sigma()),
+                                   get_loss_function(opt), point);
+      if (!float_points)
+        m_problem.SetParameterBlockConstant(point);
+    }
+
+    if (opt.camera_weight > 0) {
+      for (size_t i = 0; i < m_num_free_cameras; i++) {
+        typename ModelT::camera_vector_t orig_cam;
+        for (size_t q = 0; q < ncp; q++)
+          orig_cam[q] = orig_cameras_vec[m_cameras[i]*ncp + q];
+        m_problem.AddResidualBlock(CamError<ModelT>::Create(orig_cam, opt.camera_weight),
+                                   get_loss_function(opt), &m_camera_vals[i*ncp]);
+      }
+    }
+
+    for (size_t i = m_num_free_cameras; i < m_cameras.size(); i++)
+      m_problem.SetParameterBlockConstant(&m_camera_vals[i*ncp]);
+  }
+
+  int num_residual_blocks() { return m_problem.NumResidualBlocks(); }
+
+  double cost() {
+    double cost = 0.0;
+    m_problem.Evaluate(ceres::Problem::EvaluateOptions(), &cost, NULL, NULL, NULL);
+    return cost;
+  }
+
+  void solve(Options const& opt, int num_threads, ceres::Solver::Summary & summary) {
+    ceres::Solver::Options options;
+    set_solver_options(opt, num_threads, false, options);
+    ceres::Solve(options, &m_problem, &summary);
+  }
+
+  size_t num_free_cameras() const { return m_num_free_cameras; }
+  size_t free_camera(size_t i) const { return m_cameras[i]; }
+  double const* free_camera_vals(size_t i) const {
+    return &m_camera_vals[i*ModelT::camera_params_n];
+  }
+  std::vector<size_t> const& points() const { return m_points; }
+  double const* point_vals(size_t i) const { return &m_point_vals[i*ModelT::point_params_n]; }
+
+private:
+  size_t              m_num_free_cameras;
+  std::vector<size_t> m_cameras, m_points;
+  std::vector<double> m_camera_vals, m_point_vals;
+  ceres::Problem      m_problem;
+};
+
+/// The points seen by the given cameras
+void points_seen_by(std::vector< std::vector<size_t> > const& camera_points,
+                    std::vector<size_t> const& cameras, std::vector<size_t> & points){
+  std::set<size_t> seen;
+  for (size_t i = 0; i < cameras.size(); i++)
+    seen.insert(camera_points[cameras[i]].begin(), camera_points[cameras[i]].end());
+  points.assign(seen.begin(), seen.end());
+}
+
+/// The cost of the whole problem, as in solve_ba_ceres(). It is
+/// evaluated a batch of points at a time, to not build the whole
+/// problem at once.
+template <class ModelT>
+double ba_total_cost(ModelT & ba_model, Options const& opt, ControlNetwork const& cnet,
+                     std::vector< std::vector<BaObservation> > const& point_obs,
+                     std::vector<double> const& cameras_vec,
+                     std::vector<double> const& orig_cameras_vec,
+                     std::vector<double> const& points_vec, double * intrinsics){
+
+  const size_t batch_size = 100000;
+  double cost = 0.0;
+  std::vector<size_t> no_cameras, no_points;
+  for (size_t start = 0; start < point_obs.size(); start += batch_size) {
+    std::vector<size_t> points;
+    for (size_t ipt = start; ipt < std::min(start + batch_size, point_obs.size()); ipt++) {
+      if (!point_obs[ipt].empty() || cnet[ipt].type() == ControlPoint::GroundControlPoint)
+        points.push_back(ipt);
+    }
+    if (points.empty()) continue;
+    BaSubproblem<ModelT> sub(ba_model, opt, cnet, point_obs, no_cameras, points, false,
+                             cameras_vec, orig_cameras_vec, points_vec, intrinsics);
+    cost += sub.cost();
+  }
+
+  // The camera constraints
+  if (opt.camera_weight > 0) {
+    std::vector<size_t> cameras(ba_model.num_cameras());
+    for (size_t icam = 0; icam < cameras.size(); icam++)
+      cameras[icam] = icam;
+    BaSubproblem<ModelT> sub(ba_model, opt, cnet, point_obs, cameras, no_points, false,
+                             cameras_vec, orig_cameras_vec, points_vec, intrinsics);
+    cost += sub.cost();
+  }
+  return cost;
+}
+
+/// What to report about solving a cluster
+struct BaClusterReport {
+  size_t num_cameras, num_points;
+  int    num_residuals;
+  double initial_cost, final_cost, seconds;
+};
+
+/// The solutions of the clusters, summed so that the cameras and
+/// points in several clusters can be averaged.
+struct BaClusterSums {
+  Mutex mutex;
+  std::vector<double> cameras, points;
+  std::vector<int>    camera_counts, point_counts;
+};
+
+/// Solve for the cameras of a cluster and the points they see
+template <class ModelT>
+class BaClusterTask: public vw::Task, private boost::noncopyable {
+  ModelT            & m_ba_model;
+  Options      const& m_opt;
+  ControlNetwork const& m_cnet;
+  std::vector< std::vector<BaObservation> > const& m_point_obs;
+  std::vector< std::vector<size_t> >        const& m_camera_points;
+  std::vector<size_t> const& m_cluster;
+  std::vector<double> const& m_cameras_vec, & m_orig_cameras_vec, & m_points_vec;
+  double            * m_intrinsics;
+  BaClusterSums     & m_sums;
+  BaClusterReport   & m_report;
+public:
+  BaClusterTask(ModelT & ba_model, Options const& opt, ControlNetwork const& cnet,
+                std::vector< std::vector<BaObservation> > const& point_obs,
+                std::vector< std::vector<size_t> >        const& camera_points,
+                std::vector<size_t> const& cluster,
+                std::vector<double> const& cameras_vec,
+                std::vector<double> const& orig_cameras_vec,
+                std::vector<double> const& points_vec, double * intrinsics,
+                BaClusterSums & sums, BaClusterReport & report):
+    m_ba_model(ba_model), m_opt(opt), m_cnet(cnet), m_point_obs(point_obs),
+    m_camera_points(camera_points), m_cluster(cluster), m_cameras_vec(cameras_vec),
+    m_orig_cameras_vec(orig_cameras_vec), m_points_vec(points_vec),
+    m_intrinsics(intrinsics), m_sums(sums), m_report(report) {}
+
+  virtual void operator()() {
+    Stopwatch sw;
+    sw.start();
+
+    std::vector<size_t> points;
+    points_seen_by(m_camera_points, m_cluster, points);
+    BaSubproblem<ModelT> sub(m_ba_model, m_opt, m_cnet, m_point_obs, m_cluster, points, true,
+                             m_cameras_vec, m_orig_cameras_vec, m_points_vec, m_intrinsics);
+    ceres::Solver::Summary summary;
+    sub.solve(m_opt, 1, summary);
+
+    sw.stop();
+    m_report.num_cameras   = m_cluster.size();
+    m_report.num_points    = points.size();
+    m_report.num_residuals = sub.num_residual_blocks();
+    m_report.initial_cost  = summary.initial_cost;
+    m_report.final_cost    = summary.final_cost;
+    m_report.seconds       = sw.elapsed_seconds();
+
+    const size_t ncp = ModelT::camera_params_n;
+    const size_t npp = ModelT::point_params_n;
+    Mutex::Lock lock(m_sums.mutex);
+    for (size_t i = 0; i < sub.num_free_cameras(); i++) {
+      size_t icam = sub.free_camera(i);
+      for (size_t q = 0; q < ncp; q++)
+        m_sums.cameras[icam*ncp + q] += sub.free_camera_vals(i)[q];
+      m_sums.camera_counts[icam]++;
+    }
+    for (size_t i = 0; i < points.size(); i++) {
+      for (size_t q = 0; q < npp; q++)
+        m_sums.points[points[i]*npp + q] += sub.point_vals(i)[q];
+      m_sums.point_counts[points[i]]++;
+    }
+  }
+};
+
+/// Split the cameras into overlapping clusters along the match graph
+/// and solve the clusters in parallel. The cameras in more than one
+/// cluster, and the points in more than one, get the average of their
+/// solutions. Then the cameras shared by clusters are solved for
+/// again, together with the points they see, with all other cameras
+/// fixed. This is repeated until the cost stops decreasing.
+template <class ModelT>
+void solve_ba_ceres_partitioned(ModelT & ba_model, Options const& opt, ControlNetwork & cnet,
+                                std::vector<double> & cameras_vec,
+                                std::vector<double> const& orig_cameras_vec,
+                                std::vector<double> & points_vec, double * intrinsics){
+
+  const size_t ncp = ModelT::camera_params_n;
+  const size_t npp = ModelT::point_params_n;
+  size_t num_cameras = ba_model.num_cameras();
+  size_t num_points  = ba_model.num_points();
+
+  std::vector< std::vector<BaObservation> > point_obs;
+  std::vector< std::vector<size_t> >        camera_points;
+  collect_observations(cnet, num_cameras, num_points, point_obs, camera_points);
+
+  std::vector< std::vector<size_t> > clusters;
+  int num_overlap = (int)round(opt.partition_overlap*opt.partition_size);
+  asp::partition_cameras(camera_points, opt.partition_size, num_overlap, clusters);
+
+  // The cameras shared by clusters
+  std::vector<int> camera_clusters(num_cameras, 0);
+  for (size_t c = 0; c < clusters.size(); c++)
+    for (size_t i = 0; i < clusters[c].size(); i++)
+      camera_clusters[clusters[c][i]]++;
+  std::vector<size_t> separators;
+  for (size_t icam = 0; icam < num_cameras; icam++) {
+    if (camera_clusters[icam] > 1)
+      separators.push_back(icam);
+  }
+  std::vector<size_t> separator_points;
+  points_seen_by(camera_points, separators, separator_points);
+
+  int num_threads = ba_num_threads(opt);
+  vw_out() << "Partitioned the " << num_cameras << " cameras into " << clusters.size()
+           << " clusters sharing " << separators.size() << " cameras. Solving with "
+           << num_threads << " thread(s).\n";
+
+  double cost = ba_total_cost(ba_model, opt, cnet, point_obs, cameras_vec,
+                              orig_cameras_vec, points_vec, intrinsics);
+  vw_out() << "Initial cost: " << cost << "\n";
+
+  // Averaging the clusters need not decrease the cost, so keep the
+  // best solution found
+  double best_cost = cost;
+  std::vector<double> best_cameras = cameras_vec, best_points = points_vec;
+
+  for (int iter = 0; iter < opt.partition_iterations; iter++) {
+
+    Stopwatch sw;
+    sw.start();
+
+    BaClusterSums sums;
+    sums.cameras.assign(cameras_vec.size(), 0.0);
+    sums.points.assign(points_vec.size(), 0.0);
+    sums.camera_counts.assign(num_cameras, 0);
+    sums.point_counts.assign(num_points, 0);
+    std::vector<BaClusterReport> reports(clusters.size());
+    {
+      FifoWorkQueue queue(num_threads);
+      for (size_t c = 0; c < clusters.size(); c++) {
+        boost::shared_ptr<Task>
+          task(new BaClusterTask<ModelT>(ba_model, opt, cnet, point_obs, camera_points,
+                                         clusters[c], cameras_vec, orig_cameras_vec,
+                                         points_vec, intrinsics, sums, reports[c]));
+        queue.add_task(task);
+      }
+      queue.join_all();
+    }
+
+    for (size_t c = 0; c < clusters.size(); c++) {
+      vw_out() << "Cluster " << c << ": " << reports[c].num_cameras << " cameras, "
+               << reports[c].num_points << " points, " << reports[c].num_residuals
+               << " residual blocks, cost " << reports[c].initial_cost << " -> "
+               << reports[c].final_cost << " in " << reports[c].seconds << " seconds.\n";
+    }
+
+    // Reconcile the clusters
+    for (size_t icam = 0; icam < num_cameras; icam++) {
+      if (sums.camera_counts[icam] == 0) continue;
+      for (size_t q = 0; q < ncp; q++)
+        cameras_vec[icam*ncp + q] = sums.cameras[icam*ncp + q]/sums.camera_counts[icam];
+    }
+    for (size_t ipt = 0; ipt < num_points; ipt++) {
+      if (sums.point_counts[ipt] == 0) continue;
+      for (size_t q = 0; q < npp; q++)
+        points_vec[ipt*npp + q] = sums.points[ipt*npp + q]/sums.point_counts[ipt];
+    }
+
+    // The global pass over the shared cameras
+    if (!separators.empty()) {
+      BaSubproblem<ModelT> sub(ba_model, opt, cnet, point_obs, separators, separator_points,
+                               true, cameras_vec, orig_cameras_vec, points_vec, intrinsics);
+      ceres::Solver::Summary summary;
+      sub.solve(opt, num_threads, summary);
+      for (size_t i = 0; i < sub.num_free_cameras(); i++)
+        std::copy(sub.free_camera_vals(i), sub.free_camera_vals(i) + ncp,
+                  &cameras_vec[sub.free_camera(i)*ncp]);
+      for (size_t i = 0; i < separator_points.size(); i++)
+        std::copy(sub.point_vals(i), sub.point_vals(i) + npp,
+                  &points_vec[separator_points[i]*npp]);
+    }
+
+    cost = ba_total_cost(ba_model, opt, cnet, point_obs, cameras_vec,
+                         orig_cameras_vec, points_vec, intrinsics);
+    sw.stop();
+    vw_out() << "Partitioned iteration " << iter + 1 << ": cost " << cost << " in "
+             << sw.elapsed_seconds() << " seconds.\n";
+
+    // Stop when the cost decreases by less than this fraction
+    const double tolerance = 1e-4;
+    bool improved = (best_cost - cost > tolerance*best_cost);
+    if (cost < best_cost) {
+      best_cost    = cost;
+      best_cameras = cameras_vec;
+      best_points  = points_vec;
+    }
+    if (!improved)
+      break;
+  }
+
+  if (cost > best_cost)
+    vw_out() << "Using the solution with the lowest cost: " << best_cost << "\n";
+  cameras_vec = best_cameras;
+  points_vec  = best_points;
+}
+
+//=========================================================================
+// Incremental bundle adjustment
+
+/// Solve for the new cameras, the cameras sharing points with them,
+/// and the points all of those see, with all other cameras fixed at
+/// their earlier solution. The neighbors of the new cameras are kept
+/// close to that solution by the camera weight. Then, if it is time
+/// for it, or if there are no new cameras, refine all cameras.
+template <class ModelT>
+void solve_ba_ceres_incremental(ModelT & ba_model, Options const& opt, ControlNetwork & cnet,
+                                std::vector<double> & cameras_vec,
+                                std::vector<double> const& orig_cameras_vec,
+                                std::vector<double> & points_vec, double * intrinsics){
+
+  const size_t ncp = ModelT::camera_params_n;
+  const size_t npp = ModelT::point_params_n;
+  size_t num_cameras = ba_model.num_cameras();
+  size_t num_points  = ba_model.num_points();
+
+  std::vector< std::vector<BaObservation> > point_obs;
+  std::vector< std::vector<size_t> >        camera_points;
+  collect_observations(cnet, num_cameras, num_points, point_obs, camera_points);
+
+  std::vector<size_t> new_cameras, new_points;
+  for (size_t icam = 0; icam < num_cameras; icam++) {
+    if (opt.new_cameras[icam])
+      new_cameras.push_back(icam);
+  }
+  points_seen_by(camera_points, new_cameras, new_points);
+
+  std::set<size_t> affected(new_cameras.begin(), new_cameras.end());
+  for (size_t i = 0; i < new_points.size(); i++) {
+    std::vector<BaObservation> const& obs = point_obs[new_points[i]];
+    for (size_t k = 0; k < obs.size(); k++)
+      affected.insert(obs[k].icam);
+  }
+  std::vector<size_t> free_cameras(affected.begin(), affected.end()), points;
+  points_seen_by(camera_points, free_cameras, points);
+
+  for (size_t i = 0; i < new_cameras.size(); i++) {
+    if (camera_points[new_cameras[i]].empty())
+      vw_out(WarningMessage) << "No matches were found for " << opt.image_files[new_cameras[i]]
+                             << ". Its camera will not be adjusted.\n";
+  }
+
+  int num_threads = ba_num_threads(opt);
+  if (!new_cameras.empty()) {
+    Stopwatch sw;
+    sw.start();
+    BaSubproblem<ModelT> sub(ba_model, opt, cnet, point_obs, free_cameras, points, true,
+                             cameras_vec, orig_cameras_vec, points_vec, intrinsics);
+    ceres::Solver::Summary summary;
+    sub.solve(opt, num_threads, summary);
+    for (size_t i = 0; i < sub.num_free_cameras(); i++)
+      std::copy(sub.free_camera_vals(i), sub.free_camera_vals(i) + ncp,
+                &cameras_vec[sub.free_camera(i)*ncp]);
+    for (size_t i = 0; i < points.size(); i++)
+      std::copy(sub.point_vals(i), sub.point_vals(i) + npp, &points_vec[points[i]*npp]);
+    sw.stop();
+    vw_out() << "Solved for " << new_cameras.size() << " new camera(s), "
+             << free_cameras.size() - new_cameras.size() << " neighboring camera(s), and "
+             << points.size() << " points, with " << num_cameras - free_cameras.size()
+             << " camera(s) fixed: cost " << summary.initial_cost << " -> "
+             << summary.final_cost << " in " << sw.elapsed_seconds() << " seconds.\n";
+  }
+
+  if (!opt.global_refinement && !new_cameras.empty())
+    return;
+
+  vw_out() << "Refining all cameras.\n";
+  if (opt.partition_size > 0)
+    solve_ba_ceres_partitioned(ba_model, opt, cnet, cameras_vec, orig_cameras_vec,
+                               points_vec, intrinsics);
+  else
+    solve_ba_ceres(ba_model, opt, cnet, cameras_vec, orig_cameras_vec, points_vec, intrinsics);
+}
+
+// Use Ceres to do bundle adjustment. The camera and point variables
+// are stored in arrays.  The projection of point into camera is
+// accomplished by interfacing with the bundle adjustment model. In
+// the future this class can be bypassed.
+template <class ModelT>
+void do_ba_ceres(ModelT & ba_model, Options& opt ){
+
+  ControlNetwork & cnet = *(ba_model.control_network().get());
+
+  size_t num_camera_params    = ModelT::camera_params_n;
+  size_t num_point_params     = ModelT::point_params_n;
+  size_t num_intrinsic_params = ba_model.num_intrinsic_params();
+  size_t num_cameras          = ba_model.num_cameras();
+  size_t num_points           = ba_model.num_points();
+
+  // The camera adjustment and point variables concatenated into
+  // vectors. The camera adjustments start as 0. The points come from the network.
+  std::vector<double> cameras_vec(num_cameras*num_camera_params, 0.0);
+  std::vector<double> intrinsics_vec(num_intrinsic_params, 0.0);
+
+  // Do any init required for this camera model.
+  // - Currently we don't do anything except for pinhole models with no input cameras.
+  update_cnet_and_init_cams(ba_model, opt, (*opt.cnet), cameras_vec, intrinsics_vec);
+/*
+  // DEBUG
+  std::cout << "Initial camera parameters: ";
+  for (size_t i=0; i<cameras_vec.size(); ++i)
+    std::cout << cameras_vec[i] << "  ";
+  std::cout << "\nInitial intrinsic parameters: ";
+  for (size_t i=0; i<intrinsics_vec.size(); ++i)
+    std::cout << intrinsics_vec[i] << "  ";
+  std::cout << std::endl;
+*/
+
+  // Camera intrinsics
+  double* intrinsics = NULL;
+  if (num_intrinsic_params > 0)
+    intrinsics = &intrinsics_vec[0];
+
+  // Points
+  std::vector<double> points_vec(num_points*num_point_params, 0.0);
+  for (size_t ipt = 0; ipt < num_points; ipt++){
+    for (size_t q = 0; q < num_point_params; q++){
+      points_vec[ipt*num_point_params + q] = cnet[ipt].position()[q];
+    }
+  }
+
+  // The camera positions and orientations before we float them
+  std::vector<double> orig_cameras_vec = cameras_vec;
+
+  if (!opt.input_adjustments_prefix.empty()) {
+    solve_ba_ceres_incremental(ba_model, opt, cnet, cameras_vec, orig_cameras_vec,
+                               points_vec, intrinsics);
+  } else if (opt.partition_size <= 0) {
+    solve_ba_ceres(ba_model, opt, cnet, cameras_vec, orig_cameras_vec, points_vec, intrinsics);
+  } else {
+    std::vector<double> mono_cameras_vec = cameras_vec, mono_points_vec = points_vec;
+
+    Stopwatch sw;
+    sw.start();
+    solve_ba_ceres_partitioned(ba_model, opt, cnet, cameras_vec, orig_cameras_vec,
+                               points_vec, intrinsics);
+    sw.stop();
+
+    if (opt.partition_compare) {
+      Stopwatch mono_sw;
+      mono_sw.start();
+      solve_ba_ceres(ba_model, opt, cnet, mono_cameras_vec, orig_cameras_vec,
+                     mono_points_vec, intrinsics);
+      mono_sw.stop();
+
+      std::vector< std::vector<BaObservation> > point_obs;
+      std::vector< std::vector<size_t> >        camera_points;
+      collect_observations(cnet, num_cameras, num_points, point_obs, camera_points);
+      double cost      = ba_total_cost(ba_model, opt, cnet, point_obs, cameras_vec,
+                                       orig_cameras_vec, points_vec, intrinsics);
+      double mono_cost = ba_total_cost(ba_model, opt, cnet, point_obs, mono_cameras_vec,
+                                       orig_cameras_vec, mono_points_vec, intrinsics);
+      vw_out() << "Partitioned solve: cost " << cost << " in " << sw.elapsed_seconds()
+               << " seconds. Monolithic solve: cost " << mono_cost << " in "
+               << mono_sw.elapsed_seconds() << " seconds.\n";
+    }
+  }
 
   // Copy the latest version of the optimized intrinsic variables back
   // into the the separate parameter vectors in ba_model, right after the already updated
@@ -778,7 +1431,20 @@ void do_ba_costfun(CostFunType const& cost_fun, Options& opt){
                                                            opt.image_files[icam],
                                                            opt.camera_files[icam]);
     vw_out() << "Writing: " << adjust_file << std::endl;
-    ba_model.write_adjustment(icam, adjust_file);
+    if (opt.input_adjustments_prefix.empty()) {
+      ba_model.write_adjustment(icam, adjust_file);
+      continue;
+    }
+
+    // The camera being adjusted had the input adjustment applied
+    // already, so save the two adjustments as one.
+    Vector3 position_correction, position;
+    Quat    pose_correction, pose;
+    ba_model.parse_camera_parameters(ba_model.cam_params(icam), position_correction,
+                                     pose_correction);
+    asp::compose_adjustments(opt.input_positions[icam], opt.input_poses[icam],
+                             position_correction, pose_correction, position, pose);
+    asp::write_adjustments(adjust_file, position, pose);
   }
 
 }
@@ -1202,6 +1868,73 @@ bool init_pinhole_model_with_gcp(Options &opt, bool check_only=false) {
 
 
 
+/// For incremental bundle adjustment, apply the adjustments of the
+/// cameras solved for earlier, and note which cameras are new.
+void load_input_adjustments(Options & opt) {
+
+  size_t num_cameras = opt.camera_models.size();
+  opt.new_cameras.assign(num_cameras, true);
+  opt.input_positions.assign(num_cameras, Vector3());
+  opt.input_poses.assign(num_cameras, Quat(1, 0, 0, 0));
+
+  int num_new = num_cameras;
+  for (size_t icam = 0; icam < num_cameras; icam++) {
+    std::string adjust_file = asp::bundle_adjust_file_name(opt.input_adjustments_prefix,
+                                                           opt.image_files[icam],
+                                                           opt.camera_files[icam]);
+    if (!fs::exists(adjust_file))
+      continue;
+
+    bool piecewise_adjustments;
+    Vector2 adjustment_bounds;
+    std::vector<Vector3> position_correction;
+    std::vector<Quat>    pose_correction;
+    std::string session;
+    asp::read_adjustments(adjust_file, piecewise_adjustments, adjustment_bounds,
+                          position_correction, pose_correction, session);
+    if (piecewise_adjustments || position_correction.size() != 1 || pose_correction.size() != 1)
+      vw_throw( ArgumentErr() << "Expecting a single adjustment in: " << adjust_file << "\n" );
+
+    vw_out() << "Reading: " << adjust_file << std::endl;
+    opt.new_cameras[icam]     = false;
+    opt.input_positions[icam] = position_correction[0];
+    opt.input_poses[icam]     = pose_correction[0];
+    opt.camera_models[icam]
+      = boost::shared_ptr<CameraModel>(new AdjustedCameraModel(opt.camera_models[icam],
+                                                               position_correction[0],
+                                                               pose_correction[0]));
+    num_new--;
+  }
+  vw_out() << "Found adjustments for " << int(num_cameras) - num_new << " camera(s). "
+           << num_new << " camera(s) are new.\n";
+}
+
+/// The number of incremental runs so far, saved with the adjustments
+std::string incremental_runs_file(std::string const& prefix) {
+  return prefix + "-incremental-runs.txt";
+}
+
+/// Count this run, and decide if all cameras must be refined. The
+/// count is saved once the adjustments are.
+void count_incremental_run(Options & opt) {
+
+  int num_runs = 0;
+  std::ifstream ifs(incremental_runs_file(opt.input_adjustments_prefix).c_str());
+  if (!(ifs >> num_runs))
+    num_runs = 0;
+  opt.num_incremental_runs = num_runs + 1;
+  opt.global_refinement = (opt.global_refinement_period > 0 &&
+                           opt.num_incremental_runs % opt.global_refinement_period == 0);
+}
+
+void save_incremental_run_count(Options const& opt) {
+  std::string runs_file = incremental_runs_file(opt.out_prefix);
+  std::ofstream ofs(runs_file.c_str());
+  ofs << opt.num_incremental_runs << "\n";
+  if (!ofs.good())
+    vw_throw( IOErr() << "Could not write: " << runs_file << "\n" );
+}
+
 void handle_arguments( int argc, char *argv[], Options& opt ) {
   po::options_description general_options("");
   general_options.add_options()
@@ -1237,8 +1970,24 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
                          "Interest point detection algorithm (0: Integral OBALoG (default), 1: OpenCV SIFT, 2: OpenCV ORB.")
     ("individually-normalize",   po::bool_switch(&opt.individually_normalize)->default_value(false)->implicit_value(true),
                         "Individually normalize the input images instead of using common values.")
+    ("use-tabulated-isis-cameras", po::bool_switch(&opt.use_tabulated_isis_cameras)->default_value(false)->implicit_value(true),
+                         "Sample ISIS line scan cameras once when loaded and use these samples afterwards. This allows the solver to use multiple threads with such cameras.")
+    ("numerical-jacobians", po::bool_switch(&opt.numerical_jacobians)->default_value(false)->implicit_value(true),
+                         "Find the derivatives of the reprojection errors numerically, as before, rather than analytically. Slower, especially with line scan cameras.")
     ("max-iterations",   po::value(&opt.max_iterations)->default_value(1000),
                          "Set the maximum number of iterations.")
+    ("partition-size",   po::value(&opt.partition_size)->default_value(0),
+                         "Split the cameras into clusters of at most this many, which share matches, and solve the clusters in parallel, then solve again for the cameras the clusters share. Repeat until converged. This needs much less memory for large sets of images. Only for the Ceres solver. Set to 0 to solve for all cameras at once.")
+    ("partition-overlap", po::value(&opt.partition_overlap)->default_value(0.25),
+                         "Extend each cluster by this fraction of the partition size with the cameras from other clusters it shares the most matches with.")
+    ("partition-iterations", po::value(&opt.partition_iterations)->default_value(5),
+                         "The maximum number of times to solve the clusters and the cameras they share.")
+    ("partition-compare", po::bool_switch(&opt.partition_compare)->default_value(false)->implicit_value(true),
+                         "Also solve for all cameras at once, and report the cost and time of both solutions. The partitioned solution is kept.")
+    ("input-adjustments-prefix", po::value(&opt.input_adjustments_prefix)->default_value(""),
+                         "Add images to an earlier solution. Start the cameras from the adjustments with this prefix. Match only pairs with a new image, reuse the matches with this prefix for the others, and solve only for the new cameras, the cameras sharing matches with them, and the points those see. Only for the Ceres solver.")
+    ("global-refinement-period", po::value(&opt.global_refinement_period)->default_value(0),
+                         "When adding images to an earlier solution, also refine all cameras every this many runs. The runs are counted with the adjustments. Set to 0 to refine only when there are no new images.")
     ("overlap-limit",    po::value(&opt.overlap_limit)->default_value(0),
                          "Limit the number of subsequent images to search for matches to the current image to this value.  By default match all images.")
     ("position-filter-dist", po::value(&opt.position_filter_dist)->default_value(-1),
@@ -1310,6 +2059,7 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   // Copy the IP settings to the global stereosettings() object
   asp::stereo_settings().ip_matching_method     = opt.ip_detect_method;
   asp::stereo_settings().individually_normalize = opt.individually_normalize;
+  asp::stereo_settings().use_tabulated_isis_cameras = opt.use_tabulated_isis_cameras;
 
   if (!opt.camera_position_file.empty() && opt.csv_format_str == "")
     vw_throw( ArgumentErr() << "When using a camera position file, the csv-format option must be set.\n"
@@ -1355,6 +2105,26 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
           ) )
     vw_throw( ArgumentErr() << "Unknown bundle adjustment version: " << opt.ba_type
               << ". Options are: [Ceres, RobustSparse, RobustRef, Sparse, Ref]\n" );
+
+  if (opt.partition_size > 0) {
+    if (opt.ba_type != "ceres")
+      vw_throw( ArgumentErr() << "Partitioned bundle adjustment needs the Ceres solver.\n" );
+    if (opt.solve_intrinsics)
+      vw_throw( ArgumentErr() << "Partitioned bundle adjustment cannot solve for intrinsics, "
+                << "which are shared by all cameras.\n" );
+    if (opt.partition_overlap < 0)
+      vw_throw( ArgumentErr() << "The partition overlap must be non-negative.\n" );
+  }
+
+  if (!opt.input_adjustments_prefix.empty()) {
+    if (opt.ba_type != "ceres")
+      vw_throw( ArgumentErr() << "Incremental bundle adjustment needs the Ceres solver.\n" );
+    if (opt.local_pinhole_input)
+      vw_throw( ArgumentErr() << "Incremental bundle adjustment cannot be used with "
+                << "--local-pinhole, which writes new cameras rather than adjustments.\n" );
+  }
+  if (opt.global_refinement_period < 0)
+    vw_throw( ArgumentErr() << "The global refinement period must be non-negative.\n" );
 }
 
 // ================================================================================
@@ -1417,6 +2187,13 @@ int main(int argc, char* argv[]) {
                                                         opt.camera_files[i]));
     } // End loop through images loading all the camera models
 
+    // Add images to an earlier solution
+    const bool incremental = !opt.input_adjustments_prefix.empty();
+    if (incremental) {
+      load_input_adjustments(opt);
+      count_incremental_run(opt);
+    }
+
     // Create match files from mapprojection.
     // TODO: This must be documented.
     if (opt.mapprojected_data != "") {
@@ -1554,6 +2331,17 @@ int main(int argc, char* argv[]) {
         std::string camera1_path = opt.camera_files[i];
         std::string camera2_path = opt.camera_files[j];        
         
+        // Both cameras were solved for earlier. Use the matches found then.
+        if (incremental && !opt.new_cameras[i] && !opt.new_cameras[j]) {
+          std::string input_match_file = ip::match_filename(opt.input_adjustments_prefix,
+                                                            image1_path, image2_path);
+          if (fs::exists(input_match_file)) {
+            match_files[ std::pair<int, int>(i, j) ] = input_match_file;
+            ++num_pairs_matched;
+          }
+          continue;
+        }
+
         std::string match_filename = ip::match_filename(opt.out_prefix, image1_path, image2_path);
 
         match_files[ std::pair<int, int>(i, j) ] = match_filename;
@@ -1585,8 +2373,12 @@ int main(int argc, char* argv[]) {
             = create_mask_less_or_equal(image1_view,  nodata1);
           ImageViewRef< PixelMask<float> > masked_image2
             = create_mask_less_or_equal(image2_view, nodata2);
-          vw::Vector<vw::float32,6> image1_stats = asp::gather_stats(masked_image1, image1_path);
-          vw::Vector<vw::float32,6> image2_stats = asp::gather_stats(masked_image2, image2_path);
+          vw::Vector<vw::float32,6> image1_stats
+            = asp::gather_image_stats(masked_image1, image1_path, nodata1, image1_path,
+                                      asp::stats_sidecar_file(opt.out_prefix, image1_path));
+          vw::Vector<vw::float32,6> image2_stats
+            = asp::gather_image_stats(masked_image2, image2_path, nodata2, image2_path,
+                                      asp::stats_sidecar_file(opt.out_prefix, image2_path));
 
           session->ip_matching(image1_path, image2_path,
                                Vector2(masked_image1.cols(), masked_image1.rows()),
@@ -1677,6 +2469,8 @@ int main(int argc, char* argv[]) {
 
     if (opt.local_pinhole_input == false) {
       do_ba_with_model<BundleAdjustmentModel>(opt);
+      if (incremental)
+        save_incremental_run_count(opt);
     }
     else{ // Use for local pinhole models, could also be used for other pinhole models.
 
@@ -34,6 +34,7 @@
 #include <iostream>
 
 #include <asp/Core/BundleAdjustUtils.h>
+#include <asp/Camera/CameraJacobians.h>
 
 // TODO: Move these classes to another file so they can be cleaned up properly!
 
@@ -57,6 +58,7 @@ private:
   std::vector<point_vector_t      > m_point_vec;
   std::vector<camera_vector_t     > m_cam_target_vec;
   std::vector<point_vector_t      > m_point_target_vec;
+  std::vector<vw::Vector3         > m_rotation_centers;
   int m_num_pixel_observations;
 
 public:
@@ -64,7 +66,7 @@ public:
                         boost::shared_ptr<vw::ba::ControlNetwork> network) :
     m_cameras(cameras), m_network(network), m_cam_vec(cameras.size()),
     m_point_vec(network->size()), m_cam_target_vec(cameras.size()),
-    m_point_target_vec(network->size()) {
+    m_point_target_vec(network->size()), m_rotation_centers(cameras.size()) {
 
     // Compute the number of observations from the bundle.
     m_num_pixel_observations = 0;
@@ -77,6 +79,10 @@ public:
       m_point_vec[i] = (*m_network)[i].position();
       m_point_target_vec[i] = m_point_vec[i];
     }
+
+    // AdjustedCameraModel rotates about the camera center at the origin pixel
+    for (unsigned j = 0; j < cameras.size(); ++j)
+      m_rotation_centers[j] = m_cameras[j]->camera_center(vw::Vector2());
   }
 
   size_t num_intrinsic_params() const {return 0;}
@@ -167,6 +173,24 @@ public:
     }
   }
 
+  /// Same as cam_pixel(), and also find the derivatives of the pixel
+  /// with respect to the camera adjustment and the point.
+  vw::Vector2 cam_pixel_jacobian(unsigned j,
+                                 camera_vector_t const& cam_j,
+                                 point_vector_t  const& point_i,
+                                 vw::Matrix<double, 2, camera_params_n> & J_cam,
+                                 vw::Matrix<double, 2, point_params_n > & J_point) const {
+    try {
+      return asp::adjusted_point_to_pixel_jacobian(*m_cameras[j], m_rotation_centers[j],
+                                                   cam_j, point_i, J_cam, J_point);
+    }
+    catch(...) { // Same as in cam_pixel()
+      J_cam   = vw::Matrix<double, 2, camera_params_n>();
+      J_point = vw::Matrix<double, 2, point_params_n >();
+      return vw::Vector2(-999999,-999999);
+    }
+  }
+
   /// Write the adjusted camera at the given index to disk
   void write_adjustment(int j, std::string const& filename) const {
     vw::Vector3 position_correction;
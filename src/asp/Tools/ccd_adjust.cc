@@ -25,7 +25,10 @@
 #include <vw/BundleAdjustment/ControlNetworkLoader.h>
 #include <asp/Core/InterestPointMatching.h>
 #include <asp/Core/BundleAdjustUtils.h>
+#include <asp/Camera/CCDReprojectionError.h>
 #include <asp/Tools/ccd_adjust.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 
 // Turn off warnings from eigen
 #if defined(__GNUC__) || defined(__GNUG__)
@@ -60,9 +63,6 @@ using namespace vw::ba;
 
 namespace asp{
 
-  int g_ccd_num_errors = 0;
-  Mutex g_ccd_mutex;
-
 const int NUM_PIXEL_PARAMS = 2;
 const int NUM_POINT_PARAMS = 3;
 
@@ -70,7 +70,7 @@ const int NUM_POINT_PARAMS = 3;
 // before 1000, between 1000 and 2000, and after 2000.
 int get_cdd_offset_index(double col, std::vector<double> const& ccd_pos){
 
-  if (col <= ccd_pos[0]) return 0;
+  if (ccd_pos.empty() || col <= ccd_pos[0]) return 0;
 
   for (size_t t = 0; t < ccd_pos.size(); t++){
     if (ccd_pos[t] < col && (t+1 >= ccd_pos.size() || col <= ccd_pos[t+1])) {
@@ -85,81 +85,28 @@ int get_cdd_offset_index(double col, std::vector<double> const& ccd_pos){
   return -1;
 }
 
-// A ceres cost function. We pass in the observation, the model, and
-// the current camera and point indices. The result is the residual,
-// the difference in the observation and the projection of the point
-// into the camera, normalized by pixel_sigma.
-struct CCDReprojectionError {
-  CCDReprojectionError(Vector2 const& observation,
-                       Vector2 const& pixel_sigma,
-                       boost::shared_ptr<vw::camera::CameraModel> cam,
-                       std::vector<double> const& ccd_pos):
-    m_observation(observation),
-    m_pixel_sigma(pixel_sigma),
-    m_cam(cam),
-    m_ccd_pos(ccd_pos){}
-
-  ///  
-  template <typename T>
-  bool operator()(const T* const offset, const T* const point, T* residuals) const {
-
-    try{
-
-      Vector<double, NUM_POINT_PARAMS> point_vec;
-      for (int c = 0; c < NUM_POINT_PARAMS; c++)
-        point_vec[c] = (double)point[c];
-
-      Vector<double, NUM_PIXEL_PARAMS> offset_vec;
-      for (int c = 0; c < NUM_PIXEL_PARAMS; c++)
-        offset_vec[c] = (double)offset[c];
-
-      // TODO: Pass here the initial guess!
-      // TODO: Think of the line below!!! + or -!!!
-      Vector2 prediction = m_cam->point_to_pixel(point_vec) + offset_vec;
-
-      // The error is the difference between the predicted and observed position,
-      // normalized by sigma.
-      residuals[0] = (prediction[0] - m_observation[0])/m_pixel_sigma[0];
-      residuals[1] = (prediction[1] - m_observation[1])/m_pixel_sigma[1];
-
-    } catch (std::exception const& e) {
-
-      // Failed to compute residuals
-
-      Mutex::Lock lock( g_ccd_mutex );
-      g_ccd_num_errors++;
-      if (g_ccd_num_errors < 100) {
-	vw_out(ErrorMessage) << e.what() << std::endl;
-      }else if (g_ccd_num_errors == 100) {
-	vw_out() << "Will print no more error messages about "
-                 << "failing to compute residuals.\n";
-      }
-
-      residuals[0] = T(1e+20);
-      residuals[1] = T(1e+20);
-      return false;
+// Project the points of some of the observations, to fill in the
+// projections kept by their cost functions. Failures are left for
+// the solver to report.
+class CCDProjectTask: public vw::Task, private boost::noncopyable {
+  std::vector<CCDReprojectionError*> const& m_costs;
+  std::vector<double*>               const& m_points;
+  size_t m_begin, m_end;
+public:
+  CCDProjectTask(std::vector<CCDReprojectionError*> const& costs,
+                 std::vector<double*> const& points, size_t begin, size_t end):
+    m_costs(costs), m_points(points), m_begin(begin), m_end(end) {}
+
+  void operator()() {
+    Vector2 pixel;
+    Matrix<double, 2, 3> J;
+    for (size_t i = m_begin; i < m_end; i++) {
+      Vector3 point(m_points[i][0], m_points[i][1], m_points[i][2]);
+      try {
+        m_costs[i]->project(point, pixel, J);
+      } catch (std::exception const&) {}
     }
-
-    return true;
   }
-
-  /// Factory to hide the construction of the CostFunction object from the client code.
-  /// - Pass in pixel location, sigma, camera model, and vector of default CCD positions?
-  static ceres::CostFunction* Create(Vector2 const& observation,
-                                     Vector2 const& pixel_sigma,
-                                     boost::shared_ptr<vw::camera::CameraModel> cam,
-                                     std::vector<double> const& ccd_pos){
-
-    return (new ceres::NumericDiffCostFunction<CCDReprojectionError,
-            ceres::CENTRAL, NUM_PIXEL_PARAMS, NUM_PIXEL_PARAMS, NUM_POINT_PARAMS>
-            (new CCDReprojectionError(observation, pixel_sigma, cam, ccd_pos)));
-  }
-
-  Vector2 m_observation;
-  Vector2 m_pixel_sigma;
-  boost::shared_ptr<vw::camera::CameraModel> m_cam;
-
-  std::vector<double> const& m_ccd_pos; // alias
 };
 
 ceres::LossFunction* get_ccd_loss_function(){
@@ -230,8 +177,11 @@ void ccd_adjust(std::vector<std::string> const& image_files,
   }
   double* points = &points_vec[0];
 
-  // The ceres problem
+  // The ceres problem. The cost functions are also kept here, to
+  // fill in their projections.
   ceres::Problem problem;
+  std::vector<CCDReprojectionError*> costs;
+  std::vector<double*> cost_points;
 
   // Add the cost function component for difference of pixel observations
   CameraRelationNetwork<JFeature> crn;
@@ -267,14 +217,35 @@ void ccd_adjust(std::vector<std::string> const& image_files,
 
       ceres::LossFunction* loss_function = get_ccd_loss_function();
 
-      ceres::CostFunction* cost_function
-                = CCDReprojectionError::Create(observation, pixel_sigma,
-                                               camera_models[icam], ccd_pos);
+      CCDReprojectionError* cost_function
+        = new CCDReprojectionError(observation, pixel_sigma, camera_models[icam]);
       problem.AddResidualBlock(cost_function, loss_function,
                                offset, point);
+      costs.push_back(cost_function);
+      cost_points.push_back(point);
     } // End loop through points seen by this camera
   } // End loop through cameras
 
+  // Project all points at once, using all threads. That is where the
+  // time goes, as the cameras are linescan.
+  Stopwatch sw;
+  sw.start();
+  {
+    int num_tasks = std::max(1, 4*num_threads);
+    size_t chunk = (costs.size() + num_tasks - 1)/num_tasks;
+    FifoWorkQueue queue(std::max(1, num_threads));
+    for (size_t begin = 0; begin < costs.size(); begin += chunk) {
+      boost::shared_ptr<CCDProjectTask>
+        task(new CCDProjectTask(costs, cost_points, begin,
+                                std::min(begin + chunk, costs.size())));
+      queue.add_task(task);
+    }
+    queue.join_all();
+  }
+  sw.stop();
+  vw_out() << "Projected " << costs.size() << " observations in "
+           << sw.elapsed_seconds() << " seconds.\n";
+
   // Set up Ceres options
   ceres::Solver::Options options;
   options.gradient_tolerance = 1e-16;
@@ -299,9 +270,19 @@ void ccd_adjust(std::vector<std::string> const& image_files,
   options.callbacks.push_back(&callback);
   options.update_state_every_iteration = true; // ensure we have the latest adjustments
 
-  // Solve the problem using Ceres
+  // First find the offsets with the points fixed, which needs just
+  // the projections found above, then float the points as well.
+  for (int ipt = 0; ipt < num_points; ipt++)
+    problem.SetParameterBlockConstant(points + ipt*NUM_POINT_PARAMS);
+  options.linear_solver_type = ceres::DENSE_QR;
   ceres::Solver::Summary summary;
   ceres::Solve(options, &problem, &summary);
+  vw_out() << summary.BriefReport() << "\n";
+
+  for (int ipt = 0; ipt < num_points; ipt++)
+    problem.SetParameterBlockVariable(points + ipt*NUM_POINT_PARAMS);
+  options.linear_solver_type = ceres::SPARSE_SCHUR;
+  ceres::Solve(options, &problem, &summary);
   vw_out() << summary.FullReport() << "\n";
   if (summary.termination_type == ceres::NO_CONVERGENCE){
     // Print a clarifying message, so the user does not think that the algorithm failed.
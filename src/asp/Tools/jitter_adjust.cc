@@ -23,6 +23,8 @@
 
 #include <asp/Core/Macros.h>
 #include <asp/Camera/AdjustedLinescanDGModel.h>
+#include <asp/Camera/CameraJacobians.h>
+#include <asp/Camera/PiecewiseReprojectionError.h>
 #include <asp/Core/StereoSettings.h>
 #include <vw/BundleAdjustment/ControlNetwork.h>
 #include <vw/BundleAdjustment/ControlNetworkLoader.h>
@@ -31,30 +33,6 @@
 #include <asp/Tools/jitter_adjust.h>
 #include <vw/Core/Stopwatch.h>
 
-// Turn off warnings from eigen
-#if defined(__GNUC__) || defined(__GNUG__)
-#define LOCAL_GCC_VERSION (__GNUC__ * 10000                    \
-			   + __GNUC_MINOR__ * 100              \
-			   + __GNUC_PATCHLEVEL__)
-#if LOCAL_GCC_VERSION >= 40600
-#pragma GCC diagnostic push
-#endif
-#if LOCAL_GCC_VERSION >= 40202
-#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
-#endif
-#endif
-
-#include <ceres/ceres.h>
-#include <ceres/loss_function.h>
-
-#if defined(__GNUC__) || defined(__GNUG__)
-#if LOCAL_GCC_VERSION >= 40600
-#pragma GCC diagnostic pop
-#endif
-#undef LOCAL_GCC_VERSION
-#endif
-
-
 namespace po = boost::program_options;
 namespace fs = boost::filesystem;
 
@@ -65,342 +43,6 @@ using namespace vw::ba;
 
 namespace asp{
 
-int g_jitter_num_errors = 0;
-Mutex g_jitter_mutex;
-
-const int NUM_CAMERA_PARAMS = 6;
-const int NUM_POINT_PARAMS = 3;
-
-typedef Vector<double, NUM_CAMERA_PARAMS> camera_vector_t;
-
-// In spite of trying a lot, I could not find a way to make a base class
-// from which both AdjustedLinescanDGModel and PiecewiseAdjustedLinescanModel
-// could inherit. Hence this wrapper.
-class AdjustedModelWrapper {
-public:
-  AdjustedModelWrapper(std::string               const& session,
-                       boost::shared_ptr<vw::camera::CameraModel> cam,
-                       int interp_type,
-                       vw::Vector2               const& adjustment_bounds,
-                       std::vector<vw::Vector3>  const& position_adjustments,
-                       std::vector<vw::Quat>     const& pose_adjustments,
-                       vw::Vector2i              const& image_size):
-    m_session(session)
-  {
-    if (m_session == "dg" || m_session == "dgmaprpc") {
-      m_cam = boost::shared_ptr<vw::camera::CameraModel>
-        (new asp::AdjustedLinescanDGModel(cam, interp_type, adjustment_bounds,
-                                          position_adjustments, pose_adjustments,
-                                          image_size));
-    } else {
-      m_cam = boost::shared_ptr<vw::camera::CameraModel>
-        (new asp::PiecewiseAdjustedLinescanModel(cam, interp_type, adjustment_bounds,
-                                                 position_adjustments, pose_adjustments,
-                                                 image_size));
-    }
-    
-  }
-
-  vw::Vector2 point_to_pixel(vw::Vector3 const& point, double starty) const {
-    if (m_session == "dg" || m_session == "dgmaprpc") 
-      return
-        dynamic_cast<asp::AdjustedLinescanDGModel*>
-	(m_cam.get())->point_to_pixel(point, starty);
-    
-    return
-      dynamic_cast<asp::PiecewiseAdjustedLinescanModel*>
-      (m_cam.get())->point_to_pixel(point, starty);
-  }
-  
-  std::vector<int> get_closest_adj_indices(double t){
-    if (m_session == "dg" || m_session == "dgmaprpc") 
-      return
-        dynamic_cast<asp::AdjustedLinescanDGModel*>(m_cam.get())->get_closest_adj_indices(t);
-    
-    return
-      dynamic_cast<asp::PiecewiseAdjustedLinescanModel*>(m_cam.get())->get_closest_adj_indices(t);
-  }
-  
-private:
-  std::string m_session;
-  boost::shared_ptr<vw::camera::CameraModel> m_cam;
-
-  
-};
-  
-  
-void populate_adjustements(std::vector<double> const& cameras_vec,
-			   int start_index, int end_index,
-			   std::vector<vw::Vector3> & position_adjustments,
-			   std::vector<vw::Quat>    & pose_adjustments){
-
-  // Extract the adjustments for just the current camera, and copy
-  // them in arrays of vectors and quaternions.
-
-  int num_adjustments = cameras_vec.size()/NUM_CAMERA_PARAMS;
-  VW_ASSERT(0 <= start_index && start_index < end_index && end_index <= num_adjustments,
-	    ArgumentErr() << "Book-keeping failure in camera indicies.");
-
-  position_adjustments.clear();
-  pose_adjustments.clear();
-
-  for (int cam_index = start_index; cam_index < end_index; cam_index++) {
-    Vector3 position, pose;
-    for (int b = 0; b < NUM_CAMERA_PARAMS/2; b++) {
-      position[b] = cameras_vec[NUM_CAMERA_PARAMS * cam_index + b + 0];
-      pose[b]     = cameras_vec[NUM_CAMERA_PARAMS * cam_index + b + NUM_CAMERA_PARAMS/2];
-    }
-
-    position_adjustments.push_back(position);
-    pose_adjustments.push_back(axis_angle_to_quaternion(pose));
-  }
-}
-
-// A ceres cost function. We pass in the observation, the model, and
-// the current camera and point indices. The result is the residual,
-// the difference in the observation and the projection of the point
-// into the camera, normalized by pixel_sigma.
-struct PiecewiseReprojectionError {
-  PiecewiseReprojectionError(Vector2 const& observation, Vector2 const& pixel_sigma,
-			     Vector2 const& adjustment_bounds,
-			     std::vector<double> const& cameras_vec,
-			     boost::shared_ptr<vw::camera::CameraModel> cam,
-			     Vector2i const& image_size,
-			     std::string const& session,
-			     int start_index,
-			     int camera_index1, int camera_index2,
-			     int camera_index3, int camera_index4,
-			     int end_index,
-			     size_t ipt):
-    m_observation(observation),
-    m_pixel_sigma(pixel_sigma),
-    m_adjustment_bounds(adjustment_bounds),
-    m_cameras_vec(cameras_vec),
-    m_cam(cam),
-    m_image_size(image_size),
-    m_session(session),
-    m_start_index(start_index),
-    m_camera_index1(camera_index1),
-    m_camera_index2(camera_index2),
-    m_camera_index3(camera_index3),
-    m_camera_index4(camera_index4),
-    m_end_index(end_index),
-    m_ipt(ipt){}
-
-  template <typename T>
-  bool do_calc(const T* const camera1, const T* const camera2,
-	       const T* const camera3, const T* const camera4,
-	       const T* const point, T* residuals) const {
-
-    try{
-
-      int num_cameras = m_cameras_vec.size();
-      std::vector<double> local_cameras_vec = m_cameras_vec;
-
-	// Copy the camera adjustments to local storage.  Update them
-	// with the latest value for the current camera being floated.
-
-      for (int i = 1; i <= 4; i++) {
-
-	int camera_index = -1;
-	const T * camera = NULL;
-	if (i == 1 && m_camera_index1 >= 0 && camera1 != NULL) {
-	  camera_index = m_camera_index1;
-	  camera       = camera1;
-	} else if (i == 2 && m_camera_index2 >= 0 && camera2 != NULL) {
-	  camera_index = m_camera_index2;
-	  camera       = camera2;
-	} else if (i == 3 && m_camera_index3 >= 0 && camera3 != NULL) {
-	  camera_index = m_camera_index3;
-	  camera       = camera3;
-	} else if (i == 4 && m_camera_index4 >= 0 && camera4 != NULL) {
-	  camera_index = m_camera_index4;
-	  camera       = camera4;
-	}
-
-	if (camera == NULL) continue;
-
-	VW_ASSERT(0 <= camera_index && camera_index < num_cameras,
-		  ArgumentErr() << "Out of bounds in the number of cameras");
-
-	VW_ASSERT(0 <= m_start_index && m_start_index <= camera_index
-		  && camera_index < m_end_index && m_end_index <= num_cameras,
-		  ArgumentErr() << "Book-keeping failure in camera indicies");
-
-	for (int p = 0; p < NUM_CAMERA_PARAMS; p++) {
-	  local_cameras_vec[NUM_CAMERA_PARAMS*camera_index + p] = camera[p];
-	}
-      }
-
-      // Extract the adjustments specific to the current camera
-      std::vector<vw::Vector3> position_adjustments;
-      std::vector<vw::Quat>   pose_adjustments;
-      populate_adjustements(local_cameras_vec,
-			    m_start_index, m_end_index,
-			    position_adjustments, pose_adjustments);
-
-      // The adjusted camera has just the adjustments, it does not create a full
-      // copy of the camera.
-      int interp_type = stereo_settings().piecewise_adjustment_interp_type;
-
-      asp::AdjustedModelWrapper cam_wrapper(m_session, m_cam,
-                                            interp_type,
-                                            m_adjustment_bounds,
-                                            position_adjustments, pose_adjustments,
-                                            m_image_size);
-      
-      // Copy the input data to structures expected by the BA model
-      Vector3 point_vec;
-      for (size_t p = 0; p < point_vec.size(); p++)
-	point_vec[p]  = (double)point[p];
-
-      // Project the current point into the current camera.  Note that
-      // we pass the observation as an initial guess, as the
-      // prediction is hopefully not too far from it.
-      Vector2 prediction = cam_wrapper.point_to_pixel(point_vec, m_observation.y());
-
-      // The error is the difference between the predicted and observed position,
-      // normalized by sigma.
-      residuals[0] = (prediction[0] - m_observation[0])/m_pixel_sigma[0];
-      residuals[1] = (prediction[1] - m_observation[1])/m_pixel_sigma[1];
-
-    } catch (std::exception const& e) {
-
-      // Failed to compute residuals
-
-      Mutex::Lock lock( g_jitter_mutex );
-      g_jitter_num_errors++;
-      if (g_jitter_num_errors < 100) {
-	vw_out(ErrorMessage) << e.what() << std::endl;
-      }else if (g_jitter_num_errors == 100) {
-	vw_out() << "Will print no more error messages about "
-                 << "failing to compute residuals.\n";
-      }
-
-      residuals[0] = T(1e+20);
-      residuals[1] = T(1e+20);
-      return false;
-    }
-
-    return true;
-  }
-
-  template <typename T>
-  bool operator()(const T* const camera1, const T* const point, T* residuals) const {
-    return do_calc<T>(camera1, NULL, NULL, NULL, point, residuals);
-  }
-
-  template <typename T>
-  bool operator()(const T* const camera1,
-		  const T* const camera2,
-		  const T* const point, T* residuals) const {
-    return do_calc<T>(camera1, camera2, NULL, NULL,  point, residuals);
-  }
-
-  template <typename T>
-  bool operator()(const T* const camera1,
-		  const T* const camera2,
-		  const T* const camera3,
-		  const T* const point, T* residuals) const {
-    return do_calc<T>(camera1, camera2, camera3, NULL, point, residuals);
-  }
-
-  template <typename T>
-  bool operator()(const T* const camera1,
-		  const T* const camera2,
-		  const T* const camera3,
-		  const T* const camera4,
-		  const T* const point, T* residuals) const {
-    return do_calc<T>(camera1, camera2, camera3, camera4, point, residuals);
-  }
-
-  // Factory to hide the construction of the CostFunction object from
-  // the client code.
-  static ceres::CostFunction* Create(Vector2 const& observation,
-				     Vector2 const& pixel_sigma,
-				     Vector2 const& adjustment_bounds,
-				     std::vector<double> const& cameras_vec,
-				     boost::shared_ptr<vw::camera::CameraModel> cam,
-				     Vector2i const& image_size,
-				     std::string const& session,
-				     int start_index,
-				     int camera_index1,
-				     int camera_index2,
-				     int camera_index3,
-				     int camera_index4,
-				     int end_index,
-				     size_t ipt // point index
-				     ){
-
-    if (camera_index2 < 0 && camera_index3 < 0 && camera_index4 < 0)
-      return (new ceres::NumericDiffCostFunction<PiecewiseReprojectionError,
-	      ceres::CENTRAL, 2, NUM_CAMERA_PARAMS, NUM_POINT_PARAMS>
-	      (new PiecewiseReprojectionError(observation, pixel_sigma, adjustment_bounds,
-					      cameras_vec, cam, image_size, session,
-					      start_index,
-					      camera_index1, camera_index2,
-					      camera_index3, camera_index4,
-					      end_index,
-					      ipt)));
-
-    if (camera_index3 < 0 && camera_index4 < 0)
-      return (new ceres::NumericDiffCostFunction<PiecewiseReprojectionError,
-	      ceres::CENTRAL, 2, NUM_CAMERA_PARAMS, NUM_CAMERA_PARAMS, NUM_POINT_PARAMS>
-	      (new PiecewiseReprojectionError(observation, pixel_sigma, adjustment_bounds,
-					      cameras_vec, cam, image_size, session,
-					      start_index,
-					      camera_index1, camera_index2,
-					      camera_index3, camera_index4,
-					      end_index,
-					      ipt)));
-
-    if (camera_index4 < 0)
-      return (new ceres::NumericDiffCostFunction<PiecewiseReprojectionError,
-	      ceres::CENTRAL, 2, NUM_CAMERA_PARAMS, NUM_CAMERA_PARAMS,
-              NUM_CAMERA_PARAMS, NUM_POINT_PARAMS>
-	      (new PiecewiseReprojectionError(observation, pixel_sigma, adjustment_bounds,
-					      cameras_vec, cam, image_size, session,
-					      start_index,
-					      camera_index1, camera_index2,
-					      camera_index3, camera_index4,
-					      end_index,
-					      ipt)));
-
-    if (camera_index1 < 0 || camera_index2 < 0 || camera_index3 < 0)
-      vw_throw( ArgumentErr() << "Book-keeping failure in camera indices: "
-		<< camera_index1 << ' ' << camera_index2 << ' ' << camera_index3 << ".\n" );
-
-
-    return (new ceres::NumericDiffCostFunction<PiecewiseReprojectionError,
-	    ceres::CENTRAL, 2, NUM_CAMERA_PARAMS, NUM_CAMERA_PARAMS,
-            NUM_CAMERA_PARAMS, NUM_CAMERA_PARAMS, NUM_POINT_PARAMS>
-	    (new PiecewiseReprojectionError(observation, pixel_sigma, adjustment_bounds,
-					    cameras_vec, cam, image_size, session,
-					    start_index,
-					    camera_index1, camera_index2,
-					    camera_index3, camera_index4,
-					    end_index,
-					    ipt)));
-  }
-
-  Vector2 m_observation;
-  Vector2 m_pixel_sigma;
-  Vector2 m_adjustment_bounds;
-  std::vector<double> const& m_cameras_vec;  // alias
-  boost::shared_ptr<vw::camera::CameraModel> m_cam;
-  Vector2i m_image_size; // TODO: Group this with the above
-  std::string m_session;
-								   
-  // all adjustments for the current camera will be >= this
-  int m_start_index;
-
-  // indices of the current adjustments
-  int m_camera_index1, m_camera_index2, m_camera_index3, m_camera_index4;
-
-  int m_end_index;    // all adjustment indices for current camera will be < this
-  int m_ipt;          // index of the current 3D point in the vector of points
-};
-
 // A ceres cost function. The residual is the difference between the
 // original camera center and the current (floating) camera center.
 // This cost function prevents the cameras from straying too far from
@@ -484,7 +126,7 @@ void jitter_adjust(std::vector<std::string> const& image_files,
                    const& input_camera_models,
                    std::string const& out_prefix,
                    std::string const& session,
-                   std::string const& match_file,
+                   std::map< std::pair<int, int>, std::string> const& match_files,
                    int num_threads){
 
   vw_out() << "Performing piecewise adjustments to correct for jitter.\n";
@@ -493,11 +135,8 @@ void jitter_adjust(std::vector<std::string> const& image_files,
     vw_throw( ArgumentErr() << "Expecting as many images as cameras.\n" );
 
   int num_cameras = input_camera_models.size();
-  if (num_cameras != 2)
-    vw_throw( ArgumentErr() << "Can solve for jitter only for two cameras.\n" );
-
-  std::map< std::pair<int, int>, std::string> match_files;
-  match_files[std::pair<int, int>(0, 1)] = match_file;
+  if (num_cameras < 2)
+    vw_throw( ArgumentErr() << "Can solve for jitter only for two or more cameras.\n" );
 
   int min_matches = 30;   // TODO: Think more here
   double min_angle = 0.1; // in degrees
@@ -514,15 +153,24 @@ void jitter_adjust(std::vector<std::string> const& image_files,
 
   int num_points = cnet.size();
 
-  // Create the adjustment bounds based on percentiles of interest points.
-  std::vector<Vector2> adjustment_bounds;
-  adjustment_bounds.resize(num_cameras);
-  std::vector<ip::InterestPoint> ip0, ip1;
-  ip::read_binary_match_file(match_file, ip0, ip1);
-  adjustment_bounds[0]
-    = find_bounds_from_percentiles(ip0, stereo_settings().piecewise_adjustment_percentiles);
-  adjustment_bounds[1]
-    = find_bounds_from_percentiles(ip1, stereo_settings().piecewise_adjustment_percentiles);
+  // Create the adjustment bounds based on percentiles of the interest
+  // points of each image in all its matches.
+  std::vector< std::vector<ip::InterestPoint> > image_ip(num_cameras);
+  typedef std::map< std::pair<int, int>, std::string>::const_iterator match_iter;
+  for (match_iter it = match_files.begin(); it != match_files.end(); it++) {
+    int i = it->first.first, j = it->first.second;
+    VW_ASSERT(0 <= i && i < num_cameras && 0 <= j && j < num_cameras,
+              ArgumentErr() << "Out of bounds in the number of cameras");
+    std::vector<ip::InterestPoint> ip1, ip2;
+    ip::read_binary_match_file(it->second, ip1, ip2);
+    image_ip[i].insert(image_ip[i].end(), ip1.begin(), ip1.end());
+    image_ip[j].insert(image_ip[j].end(), ip2.begin(), ip2.end());
+  }
+  std::vector<Vector2> adjustment_bounds(num_cameras);
+  for (int icam = 0; icam < num_cameras; icam++)
+    adjustment_bounds[icam]
+      = find_bounds_from_percentiles(image_ip[icam],
+                                     stereo_settings().piecewise_adjustment_percentiles);
 
   for (int icam = 0; icam < num_cameras; icam++)
     vw_out() << "Placing first and last adjustment for image "
@@ -673,71 +321,29 @@ void jitter_adjust(std::vector<std::string> const& image_files,
       VW_ASSERT(indices.size() >= 1 && indices.size() <= 4,
 		ArgumentErr() << "Expecting between 1 and 4 camera indices.");
 
-      // We assume below there are only 4 closest indices!
-      int camera_index1 = -1, camera_index2 = -1, camera_index3 = -1, camera_index4 = -1;
-
-      if (indices.size() >= 1) camera_index1 = indices[1-1] + start_index;
-      if (indices.size() >= 2) camera_index2 = indices[2-1] + start_index;
-      if (indices.size() >= 3) camera_index3 = indices[3-1] + start_index;
-      if (indices.size() >= 4) camera_index4 = indices[4-1] + start_index;
-
-      VW_ASSERT(            0 <= camera_index1 &&
-		camera_index1 <  num_total_adj &&
-		camera_index2 <  num_total_adj &&
-		camera_index3 <  num_total_adj &&
-		camera_index4 <  num_total_adj,
-		ArgumentErr() << "Out of bounds in the camera index");
+      std::vector<int> camera_indices;
+      std::vector<double*> parameter_blocks;
+      for (size_t i = 0; i < indices.size(); i++) {
+        camera_indices.push_back(indices[i] + start_index);
+        VW_ASSERT(start_index <= camera_indices.back() && camera_indices.back() < end_index,
+                  ArgumentErr() << "Out of bounds in the camera index");
+        parameter_blocks.push_back(cameras + camera_indices.back() * NUM_CAMERA_PARAMS);
+      }
 
       // Each observation corresponds to a pair of a camera and a point
-      double * point = points  + ipt * NUM_POINT_PARAMS;
+      parameter_blocks.push_back(points + ipt * NUM_POINT_PARAMS);
 
       ceres::LossFunction* loss_function = get_jitter_loss_function();
 
       ceres::CostFunction* cost_function
-	= PiecewiseReprojectionError::Create(observation, pixel_sigma,
-					     adjustment_bounds[icam],
-					     cameras_vec, camera_models[icam],
-					     sizes[icam],
-					     session,
-					     start_index,
-					     camera_index1, camera_index2,
-					     camera_index3, camera_index4,
-					     end_index,
-					     ipt);
-      if      (camera_index2 < 0) {
-	problem.AddResidualBlock(cost_function, loss_function,
-				 cameras + camera_index1 * NUM_CAMERA_PARAMS,
-				 point);
-
-      }else if (camera_index3 < 0) {
-	problem.AddResidualBlock(cost_function, loss_function,
-				 cameras + camera_index1 * NUM_CAMERA_PARAMS,
-				 cameras + camera_index2 * NUM_CAMERA_PARAMS,
-				 point);
-
-      }else if (camera_index4 < 0) {
-	problem.AddResidualBlock(cost_function, loss_function,
-				 cameras + camera_index1 * NUM_CAMERA_PARAMS,
-				 cameras + camera_index2 * NUM_CAMERA_PARAMS,
-				 cameras + camera_index3 * NUM_CAMERA_PARAMS,
-				 point);
-
-      }else if (camera_index1 >= 0 && camera_index2 >= 0 &&
-		camera_index3 >= 0 && camera_index4 >= 0){
-	problem.AddResidualBlock(cost_function, loss_function,
-				 cameras + camera_index1 * NUM_CAMERA_PARAMS,
-				 cameras + camera_index2 * NUM_CAMERA_PARAMS,
-				 cameras + camera_index3 * NUM_CAMERA_PARAMS,
-				 cameras + camera_index4 * NUM_CAMERA_PARAMS,
-				 point);
-
-      }else{
-	vw_throw( ArgumentErr() << "Book-keeping failure in camera indices! "
-		  << "Values of start_index, camera indices, and end_index are "
-		  << start_index << ' ' << camera_index1 << ' ' << camera_index2
-		  << ' ' << camera_index3 << ' ' << camera_index4 << ' ' << end_index << "\n" );
-      }
-
+	= new PiecewiseReprojectionError(observation, pixel_sigma,
+                                         adjustment_bounds[icam],
+                                         cameras_vec, camera_models[icam],
+                                         sizes[icam],
+                                         session,
+                                         start_index, camera_indices, end_index,
+                                         ipt);
+      problem.AddResidualBlock(cost_function, loss_function, parameter_blocks);
     }
 
   }
@@ -798,7 +404,7 @@ void jitter_adjust(std::vector<std::string> const& image_files,
   
   // Save the adjustments. We will recover them later based on the output prefix.
   start_index = 0;
-  for (int icam = 0; icam < (int)crn.size(); icam++) {
+  for (int icam = 0; icam < num_cameras; icam++) {
 
     if (icam > 0)
       start_index += num_adj_per_cam[icam - 1];
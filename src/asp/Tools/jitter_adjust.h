@@ -20,15 +20,22 @@
 #define __ASP_TOOLS_JITTERADJUST_H__
 
 #include <vw/Camera/CameraModel.h>
+#include <map>
+#include <string>
+#include <vector>
 
 namespace asp{
 
+  /// Solve for piecewise adjustments of the cameras which correct for
+  /// jitter. The matches are read from the given files, indexed by
+  /// the pair of images they are for, so any number of images can be
+  /// tied together.
   void jitter_adjust(std::vector<std::string> const& image_files,
                      std::vector<std::string> const& camera_files,
                      std::vector< boost::shared_ptr<vw::camera::CameraModel> > const& camera_models,
                      std::string const& out_prefix,
 		     std::string const& session,
-                     std::string const& match_file,
+                     std::map< std::pair<int, int>, std::string> const& match_files,
                      int num_threads);
 }
 
@@ -30,6 +30,7 @@
 #include <asp/Sessions/ResourceLoader.h>
 #include <asp/Sessions/StereoSessionFactory.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Camera/RPCModel.h>
 
 using namespace vw;
 using namespace vw::cartography;
@@ -111,10 +112,153 @@ public:
 
 
 
-
 /// The pixel type used for the DEM data
 typedef PixelMask<float> DemPixelT;
 
+/// Map-project an image with an RPC camera. Unlike transform() with
+/// Map2CamTrans, which projects one pixel at a time, each tile is
+/// projected into the camera with the batch RPC call, and the camera
+/// image is then interpolated at the resulting pixels.
+template <class ImageT>
+class RpcMapProjectView : public ImageViewBase< RpcMapProjectView<ImageT> > {
+  typedef typename ImageT::pixel_type ImagePixelT;
+
+  ImageT                  m_image;
+  asp::RPCModel const*    m_rpc;
+  GeoReference            m_target_georef;
+  Datum                   m_dem_datum;
+  ImageViewRef<DemPixelT> m_trans_dem; // DEM heights on the output grid
+  int                     m_cols, m_rows;
+  ImagePixelT             m_nodata;
+
+public:
+  typedef ImagePixelT pixel_type;
+  typedef ImagePixelT result_type;
+  typedef ProceduralPixelAccessor<RpcMapProjectView> pixel_accessor;
+
+  RpcMapProjectView(ImageT const& image, asp::RPCModel const* rpc,
+                    GeoReference const& target_georef, Datum const& dem_datum,
+                    ImageViewRef<DemPixelT> const& trans_dem,
+                    int cols, int rows, ImagePixelT const& nodata):
+    m_image(image), m_rpc(rpc), m_target_georef(target_georef), m_dem_datum(dem_datum),
+    m_trans_dem(trans_dem), m_cols(cols), m_rows(rows), m_nodata(nodata) {}
+
+  inline int32 cols  () const { return m_cols; }
+  inline int32 rows  () const { return m_rows; }
+  inline int32 planes() const { return 1; }
+
+  inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+  inline result_type operator()( double/*i*/, double/*j*/, int32/*p*/ = 0 ) const {
+    vw_throw(NoImplErr() << "RpcMapProjectView::operator()(...) is not implemented.\n");
+    return result_type();
+  }
+
+  typedef CropView< ImageView<pixel_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+    // The heights of the DEM at the output pixels
+    ImageView<DemPixelT> heights = crop(m_trans_dem, bbox);
+
+    // The same datum is the common case, then the DEM heights can be
+    // used with the RPC model directly.
+    bool same_datum = (m_dem_datum.semi_major_axis() == m_rpc->datum().semi_major_axis() &&
+                       m_dem_datum.semi_minor_axis() == m_rpc->datum().semi_minor_axis());
+    double lon_offset = m_rpc->lonlatheight_offset()[0];
+
+    size_t num = size_t(bbox.width())*bbox.height();
+    std::vector<double> lon(num, 0), lat(num, 0), height(num, 0), col(num), row(num);
+    std::vector<bool> valid(num, false);
+    size_t k = 0;
+    for (int r = 0; r < bbox.height(); r++) {
+      for (int c = 0; c < bbox.width(); c++, k++) {
+        if (!is_valid(heights(c, r)))
+          continue;
+        Vector2 lonlat = m_target_georef.pixel_to_lonlat(Vector2(c + bbox.min().x(),
+                                                                 r + bbox.min().y()));
+        Vector3 llh(lonlat[0], lonlat[1], heights(c, r).child());
+        if (!same_datum)
+          llh = m_rpc->datum().cartesian_to_geodetic(m_dem_datum.geodetic_to_cartesian(llh));
+
+        // Bring the longitude in the range where the RPC model is defined
+        llh[0] += 360.0*round((lon_offset - llh[0])/360.0);
+        lon[k] = llh[0]; lat[k] = llh[1]; height[k] = llh[2];
+        valid[k] = true;
+      }
+    }
+
+    if (num > 0)
+      m_rpc->geodetic_to_pixel(num, &lon[0], &lat[0], &height[0], &col[0], &row[0]);
+
+    // Keep the pixels at which we can interpolate, and the region of
+    // the camera image they span.
+    int b = BicubicInterpolation::pixel_buffer;
+    BBox2 cam_box;
+    for (k = 0; k < num; k++) {
+      if (!valid[k])
+        continue;
+      if (col[k] < b - 1 || col[k] >= m_image.cols() - b ||
+          row[k] < b - 1 || row[k] >= m_image.rows() - b) {
+        valid[k] = false;
+        continue;
+      }
+      cam_box.grow(Vector2(col[k], row[k]));
+    }
+
+    ImageView<pixel_type> tile(bbox.width(), bbox.height());
+    fill(tile, m_nodata);
+    if (!cam_box.empty()) {
+      BBox2i in_box = grow_bbox_to_int(cam_box);
+      in_box.expand(b);
+      in_box.crop(bounding_box(m_image));
+
+      // When the output is much coarser than the input, read pixels as
+      // needed rather than bringing the whole region in memory.
+      double max_area = std::max(16.0*num, 4.0*1024*1024);
+      if (double(in_box.width())*in_box.height() <= max_area) {
+        ImageView<pixel_type> in_tile = crop(m_image, in_box);
+        fill_tile(interpolate(in_tile, BicubicInterpolation(), ConstantEdgeExtension()),
+                  in_box.min(), col, row, valid, tile);
+      } else {
+        fill_tile(interpolate(m_image, BicubicInterpolation(), ConstantEdgeExtension()),
+                  Vector2i(), col, row, valid, tile);
+      }
+    }
+
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i const& bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+
+private:
+
+  template <class InterpT>
+  static void fill_tile(InterpT const& interp, Vector2i const& offset,
+                        std::vector<double> const& col, std::vector<double> const& row,
+                        std::vector<bool> const& valid, ImageView<pixel_type> & tile) {
+    size_t k = 0;
+    for (int r = 0; r < tile.rows(); r++) {
+      for (int c = 0; c < tile.cols(); c++, k++) {
+        if (valid[k])
+          tile(c, r) = interp(col[k] - offset.x(), row[k] - offset.y());
+      }
+    }
+  }
+}; // End class RpcMapProjectView
+
+/// What is needed to map-project with RpcMapProjectView. If rpc is
+/// NULL, the image is map-projected one pixel at a time instead.
+struct RpcProjection {
+  asp::RPCModel const*    rpc;
+  GeoReference            target_georef;
+  Datum                   dem_datum;
+  ImageViewRef<DemPixelT> trans_dem;
+  RpcProjection(): rpc(NULL) {}
+};
+
 
 struct Options : vw::cartography::GdalWriteOptions {
   // Input
@@ -435,7 +579,8 @@ void project_image_nodata(Options & opt,
                           Vector2i     const& virtual_image_size,
                           BBox2i       const& croppedImageBB,
                           boost::shared_ptr<camera::CameraModel> const& camera_model,
-                   Map2CamTransT const& transform) {
+                          Map2CamTransT const& transform,
+                          RpcProjection const& rpc_proj) {
 
     typedef PixelMask<ImagePixelT> ImageMaskPixelT;
 
@@ -450,23 +595,28 @@ void project_image_nodata(Options & opt,
     bool            has_img_nodata = true;
     ImageMaskPixelT nodata_mask    = ImageMaskPixelT(); // invalid value for a PixelMask
 
+    ImageViewRef<ImageMaskPixelT> masked_image
+      = create_mask(DiskImageView<ImagePixelT>(img_rsrc), opt.nodata_value); // Handle nodata
+    ImageViewRef<ImageMaskPixelT> projected;
+    if (rpc_proj.rpc)
+      projected = RpcMapProjectView< ImageViewRef<ImageMaskPixelT> >
+        (masked_image, rpc_proj.rpc, rpc_proj.target_georef, rpc_proj.dem_datum,
+         rpc_proj.trans_dem, virtual_image_size[0], virtual_image_size[1], nodata_mask);
+    else
+      projected = transform_nodata( // Apply the output from Map2CamTrans
+                                   masked_image,
+                                   transform,
+                                   virtual_image_size[0],
+                                   virtual_image_size[1],
+                                   ValueEdgeExtension<ImageMaskPixelT>(nodata_mask),
+                                   BicubicInterpolation(), nodata_mask
+                                   );
+
     write_parallel_cond
       ( // Write to the output file
        opt.output_file,
        crop( // Apply crop (only happens if --t_pixelwin was specified)
-            apply_mask
-            ( // Handle nodata
-             transform_nodata( // Apply the output from Map2CamTrans
-                              create_mask(DiskImageView<ImagePixelT>(img_rsrc),
-                                          opt.nodata_value), // Handle nodata
-                              transform,
-                              virtual_image_size[0],
-                              virtual_image_size[1],
-                              ValueEdgeExtension<ImageMaskPixelT>(nodata_mask),
-                              BicubicInterpolation(), nodata_mask
-                              ),
-             opt.nodata_value
-             ),
+            apply_mask(projected, opt.nodata_value), // Handle nodata
             croppedImageBB
             ),
        croppedGeoRef, has_img_nodata, opt.nodata_value, opt,
@@ -482,7 +632,8 @@ void project_image_alpha(Options & opt,
                    Vector2i     const& virtual_image_size,
                    BBox2i       const& croppedImageBB,
                    boost::shared_ptr<camera::CameraModel> const& camera_model,
-                   Map2CamTransT const& transform) {
+                   Map2CamTransT const& transform,
+                   RpcProjection const& rpc_proj) {
 
     // Create handle to input image to be projected on to the map
     boost::shared_ptr<DiskImageResource> img_rsrc = 
@@ -491,33 +642,61 @@ void project_image_alpha(Options & opt,
     const bool        has_img_nodata    = false;
     const ImagePixelT transparent_pixel = ImagePixelT();
 
+    // Transparent pixels are inserted for nodata
+    ImageViewRef<ImagePixelT> image = DiskImageView<ImagePixelT>(img_rsrc);
+    ImageViewRef<ImagePixelT> projected;
+    if (rpc_proj.rpc)
+      projected = RpcMapProjectView< ImageViewRef<ImagePixelT> >
+        (image, rpc_proj.rpc, rpc_proj.target_georef, rpc_proj.dem_datum,
+         rpc_proj.trans_dem, virtual_image_size[0], virtual_image_size[1], transparent_pixel);
+    else
+      projected = transform_nodata( // Apply the output from Map2CamTrans
+                                   image,
+                                   transform,
+                                   virtual_image_size[0],
+                                   virtual_image_size[1],
+                                   ConstantEdgeExtension(),
+                                   BicubicInterpolation(), transparent_pixel
+                                   );
+
     write_parallel_cond
       ( // Write to the output file
        opt.output_file,
-       crop( // Apply crop (only happens if --t_pixelwin was specified)
-             // Transparent pixels are inserted for nodata
-             transform_nodata( // Apply the output from Map2CamTrans
-                              DiskImageView<ImagePixelT>(img_rsrc),
-                              transform,
-                              virtual_image_size[0],
-                              virtual_image_size[1],
-                              ConstantEdgeExtension(),
-                              BicubicInterpolation(), transparent_pixel
-                              ),
-             croppedImageBB
-           ),
+       crop(projected, croppedImageBB), // Apply crop (only happens if --t_pixelwin was specified)
        croppedGeoRef, has_img_nodata, opt.nodata_value, opt,
        TerminalProgressCallback("","")
        );
 
 }
 
+/// If the camera is RPC, set up map-projecting it in batches. With
+/// adjustments the camera is not an RPCModel, and is projected one
+/// pixel at a time.
+RpcProjection rpc_projection(boost::shared_ptr<camera::CameraModel> const& camera_model,
+                             ImageViewRef<DemPixelT> const& dem,
+                             GeoReference const& dem_georef,
+                             GeoReference const& target_georef) {
+  RpcProjection rpc_proj;
+  rpc_proj.rpc = dynamic_cast<asp::RPCModel const*>(camera_model.get());
+  if (!rpc_proj.rpc)
+    return rpc_proj;
+
+  vw_out() << "\t--> Using batched RPC projection.\n";
+  rpc_proj.target_georef = target_georef;
+  rpc_proj.dem_datum     = dem_georef.datum();
+  rpc_proj.trans_dem     = geo_transform(dem, dem_georef, target_georef,
+                                         ValueEdgeExtension<DemPixelT>(DemPixelT()),
+                                         BilinearInterpolation());
+  return rpc_proj;
+}
+
 // The two "pick" functions below select between the Map2CamTrans and Datum2CamTrans
 // transform classes which will be passed to the image projection function.
 // - TODO: Is there a good reason for the transform classes to be CRTP instead of virtual?
 
 template <class ImagePixelT>
 void project_image_nodata_pick_transform(Options & opt,
+                          ImageViewRef<DemPixelT> const& dem,
                           GeoReference const& dem_georef,
                           GeoReference const& target_georef,
                           GeoReference const& croppedGeoRef,
@@ -526,6 +705,7 @@ void project_image_nodata_pick_transform(Options & opt,
                           BBox2i       const& croppedImageBB,
                           boost::shared_ptr<camera::CameraModel> const& camera_model) {
   const bool        call_from_mapproject = true;
+  RpcProjection rpc_proj = rpc_projection(camera_model, dem, dem_georef, target_georef);
   if (fs::path(opt.dem_file).extension() != "") {
     // A DEM file was provided
     return project_image_nodata<ImagePixelT>(opt, croppedGeoRef,
@@ -535,7 +715,8 @@ void project_image_nodata_pick_transform(Options & opt,
                                                           camera_model.get(), target_georef,
                                                           dem_georef, opt.dem_file, image_size,
                                                           call_from_mapproject
-                                                          )
+                                                          ),
+                                             rpc_proj
                                             );
   } else {
     // A constant datum elevation was provided
@@ -546,13 +727,15 @@ void project_image_nodata_pick_transform(Options & opt,
                                                             camera_model.get(), target_georef,
                                                             dem_georef, opt.datum_offset, image_size,
                                                             call_from_mapproject
-                                                            )
+                                                            ),
+                                             rpc_proj
                                             );
   }
 }
 
 template <class ImagePixelT>
 void project_image_alpha_pick_transform(Options & opt,
+                          ImageViewRef<DemPixelT> const& dem,
                           GeoReference const& dem_georef,
                           GeoReference const& target_georef,
                           GeoReference const& croppedGeoRef,
@@ -561,6 +744,7 @@ void project_image_alpha_pick_transform(Options & opt,
                           BBox2i       const& croppedImageBB,
                           boost::shared_ptr<camera::CameraModel> const& camera_model) {
   const bool        call_from_mapproject = true;
+  RpcProjection rpc_proj = rpc_projection(camera_model, dem, dem_georef, target_georef);
   if (fs::path(opt.dem_file).extension() != "") {
     // A DEM file was provided
     return project_image_alpha<ImagePixelT>(opt, croppedGeoRef,
@@ -570,7 +754,8 @@ void project_image_alpha_pick_transform(Options & opt,
                                                          camera_model.get(), target_georef,
                                                          dem_georef, opt.dem_file, image_size,
                                                          call_from_mapproject
-                                                         )
+                                                         ),
+                                             rpc_proj
                                            );
   } else {
     // A constant datum elevation was provided
@@ -581,7 +766,8 @@ void project_image_alpha_pick_transform(Options & opt,
                                                            camera_model.get(), target_georef,
                                                            dem_georef, opt.datum_offset, image_size,
                                                            call_from_mapproject
-                                                           )
+                                                           ),
+                                             rpc_proj
                                            );
   }
 }
@@ -811,22 +997,22 @@ int main( int argc, char* argv[] ) {
         // - Always use an alpha channel with RGB images.
         switch(image_fmt.channel_type) {
         case VW_CHANNEL_UINT8:
-          project_image_alpha_pick_transform<PixelRGBA<uint8> >(opt, dem_georef, target_georef, croppedGeoRef, image_size, 
+          project_image_alpha_pick_transform<PixelRGBA<uint8> >(opt, dem, dem_georef, target_georef, croppedGeoRef, image_size, 
                         Vector2i(virtual_image_width, virtual_image_height),
                         croppedImageBB, camera_model);
           break;
         case VW_CHANNEL_INT16:
-          project_image_alpha_pick_transform<PixelRGBA<int16> >(opt, dem_georef, target_georef, croppedGeoRef, image_size, 
+          project_image_alpha_pick_transform<PixelRGBA<int16> >(opt, dem, dem_georef, target_georef, croppedGeoRef, image_size, 
                         Vector2i(virtual_image_width, virtual_image_height),
                         croppedImageBB, camera_model);
           break;
         case VW_CHANNEL_UINT16:
-          project_image_alpha_pick_transform<PixelRGBA<uint16> >(opt, dem_georef, target_georef, croppedGeoRef, image_size, 
+          project_image_alpha_pick_transform<PixelRGBA<uint16> >(opt, dem, dem_georef, target_georef, croppedGeoRef, image_size, 
                         Vector2i(virtual_image_width, virtual_image_height),
                         croppedImageBB, camera_model);
           break;
         default:
-          project_image_alpha_pick_transform<PixelRGBA<float32> >(opt, dem_georef, target_georef, croppedGeoRef, image_size, 
+          project_image_alpha_pick_transform<PixelRGBA<float32> >(opt, dem, dem_georef, target_georef, croppedGeoRef, image_size, 
                         Vector2i(virtual_image_width, virtual_image_height),
                         croppedImageBB, camera_model);
           break;
@@ -837,7 +1023,7 @@ int main( int argc, char* argv[] ) {
       if (num_input_channels != 1 || image_fmt.planes != 1)
         vw_throw( ArgumentErr() << "Input images must be single channel or RGB!\n" );
       // This will cast to float but will not rescale the pixel values.
-      project_image_nodata_pick_transform<float>(opt, dem_georef, target_georef, croppedGeoRef, image_size, 
+      project_image_nodata_pick_transform<float>(opt, dem, dem_georef, target_georef, croppedGeoRef, image_size, 
                            Vector2i(virtual_image_width, virtual_image_height),
                            croppedImageBB, camera_model);
     } 
@@ -307,7 +307,7 @@ void read_georef(Options& opt, asp::CsvConv& csv_conv, GeoReference& geo){
   string pc_file = "";
   if ( get_file_type(opt.reference) == "PC" ){
     GeoReference local_geo;
-    if (cartography::read_georeference(local_geo, opt.reference)){
+    if (asp::read_pc_georeference(local_geo, opt.reference)){
       pc_file = opt.reference;
       geo = local_geo;
       vw_out() << "Detected datum from " << pc_file << ":\n" << geo.datum() << std::endl;
@@ -316,7 +316,7 @@ void read_georef(Options& opt, asp::CsvConv& csv_conv, GeoReference& geo){
   }
   if ( get_file_type(opt.source) == "PC" ){
     GeoReference local_geo;
-    if (cartography::read_georeference(local_geo, opt.source)){
+    if (asp::read_pc_georeference(local_geo, opt.source)){
       pc_file = opt.source;
       geo = local_geo;
       vw_out() << "Detected datum from " << pc_file << ":\n" << geo.datum() << std::endl;
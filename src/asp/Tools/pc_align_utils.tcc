@@ -58,10 +58,10 @@ std::string get_file_type(std::string const& file_name){
 
   // Note that any tif, ntf, and cub file with one channel with georeference be
   // interpreted as a DEM.
-  int nc = vw::get_num_channels(file_name);
+  int nc = asp::pc_num_channels(file_name);
 
   vw::cartography::GeoReference geo;
-  bool has_georef = vw::cartography::read_georeference(geo, file_name);
+  bool has_georef = asp::read_pc_georeference(geo, file_name);
 
   if (nc == 1 && has_georef)
     return "DEM";
@@ -1063,7 +1063,7 @@ void save_trans_point_cloud(vw::cartography::GdalWriteOptions const& opt,
 
     // Need this logic because we cannot open an image
     // with n channels without knowing n beforehand.
-    int nc = vw::get_num_channels(input_file);
+    int nc = asp::pc_num_channels(input_file);
     switch(nc){
     case 3:  save_trans_point_cloud_n<3>(opt, geo, input_file, output_file, T);  break;
     case 4:  save_trans_point_cloud_n<4>(opt, geo, input_file, output_file, T);  break;
@@ -0,0 +1,263 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file pc_tile_merge.cc
+///
+/// Merge the point cloud tiles made by parallel_stereo into a single
+/// chunked point cloud. Unlike pc_merge, which places unrelated clouds
+/// side by side, here each tile is a piece of the same cloud. A block
+/// of the output which is all in one chunked tile, with the same shift
+/// and rounding error, is copied from it as it is encoded. The other
+/// blocks are read from the tiles which overlap them and encoded once.
+///
+/// The tiles are given in a list file, with one line per tile of the
+/// form "file x y width height". Relative paths are relative to the
+/// directory of the list file.
+
+#include <asp/Core/Macros.h>
+#include <asp/Core/Common.h>
+#include <asp/Core/PointUtils.h>
+#include <asp/Core/ChunkedPointCloud.h>
+
+#include <vw/FileIO/DiskImageResourceGDAL.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+
+#include <fstream>
+#include <sstream>
+
+using namespace vw;
+using namespace vw::cartography;
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// Allows FileIO to correctly read/write these pixel types
+namespace vw {
+  typedef Vector<float64,4> Vector4;
+  typedef Vector<float64,6> Vector6;
+  template<> struct PixelFormatID<Vector3>   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_3_CHANNEL; };
+  template<> struct PixelFormatID<Vector3f>  { static const PixelFormatEnum value = VW_PIXEL_GENERIC_3_CHANNEL; };
+  template<> struct PixelFormatID<Vector4>   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_4_CHANNEL; };
+  template<> struct PixelFormatID<Vector4f>  { static const PixelFormatEnum value = VW_PIXEL_GENERIC_4_CHANNEL; };
+  template<> struct PixelFormatID<Vector6>   { static const PixelFormatEnum value = VW_PIXEL_GENERIC_6_CHANNEL; };
+}
+
+struct Options : vw::cartography::GdalWriteOptions {
+  std::string tile_list, out_file;
+  int         block_size;
+  double      rounding_error;
+
+  // Read from the list
+  std::vector<std::string> tile_files;
+  std::vector<BBox2i>      tile_boxes;
+  Options() : block_size(0), rounding_error(0.0) {}
+};
+
+void handle_arguments( int argc, char *argv[], Options& opt ) {
+
+  po::options_description general_options("General Options");
+  general_options.add_options()
+    ("output-file,o",  po::value(&opt.out_file)->default_value(""),
+     "Specify the output file. It is a chunked point cloud, so it should end in .pcc.")
+    ("block-size",     po::value(&opt.block_size)->default_value(0),
+     "The size of the blocks of the output, in pixels. If not specified, use the one of the chunked tiles, or else 256.")
+    ("rounding-error", po::value(&opt.rounding_error)->default_value(0.0),
+     "How much to round the output points, in meters. If not specified, use the one of the chunked tiles, or else 1/2^10, so about 1 mm for Earth.");
+
+  general_options.add( vw::cartography::GdalWriteOptionsDescription(opt) );
+
+  po::options_description positional("");
+  positional.add_options()
+    ("tile-list", po::value(&opt.tile_list), "The list of tiles");
+
+  po::positional_options_description positional_desc;
+  positional_desc.add("tile-list", 1);
+
+  std::string usage("[options] <tile-list> -o <output.pcc>");
+  bool allow_unregistered = false;
+  std::vector<std::string> unregistered;
+  po::variables_map vm =
+    asp::check_command_line( argc, argv, opt, general_options, general_options,
+                             positional, positional_desc, usage,
+                             allow_unregistered, unregistered );
+
+  if (opt.tile_list == "")
+    vw_throw( ArgumentErr() << "Missing the list of tiles.\n"
+                            << usage << general_options );
+  if (opt.out_file == "")
+    vw_throw( ArgumentErr() << "The output file must be specified!\n"
+              << usage << general_options );
+  if (opt.block_size < 0)
+    vw_throw( ArgumentErr() << "The block size must be positive.\n" );
+
+  vw::create_out_dir(opt.out_file);
+}
+
+/// Read the tile files and their boxes
+void read_tile_list(Options & opt) {
+
+  std::ifstream fh(opt.tile_list.c_str());
+  if (!fh.good())
+    vw_throw( IOErr() << "Could not open: " << opt.tile_list << "\n" );
+
+  fs::path list_dir = fs::path(opt.tile_list).parent_path();
+  std::string line;
+  while (std::getline(fh, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream is(line);
+    std::string file;
+    int x, y, w, h;
+    if (!(is >> file >> x >> y >> w >> h))
+      vw_throw( IOErr() << "Could not parse the line '" << line << "' in "
+                        << opt.tile_list << "\n" );
+    fs::path path(file);
+    if (!path.is_absolute())
+      path = list_dir / path;
+    opt.tile_files.push_back(path.string());
+    opt.tile_boxes.push_back(BBox2i(x, y, w, h));
+  }
+
+  if (opt.tile_files.empty())
+    vw_throw( ArgumentErr() << "No tiles were listed in " << opt.tile_list << ".\n" );
+}
+
+/// The shift stored with a tile, or zero if it has none
+Vector3 read_tile_shift(std::string const& file) {
+
+  if (asp::is_chunked_point_cloud(file))
+    return asp::ChunkedPointCloudReader(file).shift();
+
+  std::string shift_str;
+  boost::shared_ptr<vw::DiskImageResource> rsrc( new vw::DiskImageResourceGDAL(file) );
+  if (vw::cartography::read_header_string(*rsrc.get(), asp::ASP_POINT_OFFSET_TAG_STR, shift_str))
+    return asp::str_to_vec<vw::Vector3>(shift_str);
+  return Vector3();
+}
+
+/// The tiles of parallel_stereo share the point cloud center, so they
+/// have the same shift. If not, as for tiles made before that was the
+/// case, use their mean.
+Vector3 determine_output_shift(Options const& opt) {
+
+  Vector3 shift = read_tile_shift(opt.tile_files[0]), mean = shift;
+  bool same = true;
+  for (size_t i = 1; i < opt.tile_files.size(); i++) {
+    Vector3 tile_shift = read_tile_shift(opt.tile_files[i]);
+    same = same && (tile_shift == shift);
+    mean += tile_shift;
+  }
+  if (same)
+    return shift;
+
+  vw_out(WarningMessage) << "The tiles do not have the same point offset. "
+                         << "Using their mean.\n";
+  return mean/double(opt.tile_files.size());
+}
+
+template <int m>
+void do_work(Vector2i const& size, Vector3 const& shift, Options const& opt) {
+
+  // These read the blocks of a chunked tile directly, and the pixels
+  // of other tiles from disk, with their shift added back. The blocks
+  // of chunked tiles can also be copied without decoding them.
+  std::vector<ImageViewRef<Vector<double, m> > > tiles;
+  std::vector<boost::shared_ptr<asp::ChunkedPointCloudReader> > chunked(opt.tile_files.size());
+  for (size_t i = 0; i < opt.tile_files.size(); i++) {
+    if (asp::is_chunked_point_cloud(opt.tile_files[i])) {
+      chunked[i].reset(new asp::ChunkedPointCloudReader(opt.tile_files[i]));
+      tiles.push_back(asp::ChunkedPointCloudView<m>(chunked[i]));
+    } else {
+      tiles.push_back(asp::read_asp_point_cloud<m>(opt.tile_files[i]));
+    }
+  }
+
+  // Use the georeference of the first tile having one. They all have
+  // the same.
+  bool has_georef = false;
+  GeoReference georef;
+  for (size_t i = 0; i < opt.tile_files.size() && !has_georef; i++)
+    has_georef = asp::read_pc_georeference(georef, opt.tile_files[i]);
+
+  // By default use the block size and rounding error of the chunked
+  // tiles, if they agree, so that their blocks can be copied.
+  int    block_size     = opt.block_size;
+  double rounding_error = opt.rounding_error;
+  int    tile_block_size = 0;
+  double tile_rounding_error = 0.0;
+  bool   same_blocks = true, same_rounding = true;
+  for (size_t i = 0; i < chunked.size(); i++) {
+    if (!chunked[i])
+      continue;
+    if (tile_block_size == 0) {
+      tile_block_size     = chunked[i]->block_size();
+      tile_rounding_error = chunked[i]->rounding_error();
+    }
+    same_blocks   = same_blocks   && (chunked[i]->block_size()     == tile_block_size);
+    same_rounding = same_rounding && (chunked[i]->rounding_error() == tile_rounding_error);
+  }
+  if (block_size <= 0)
+    block_size = (tile_block_size > 0 && same_blocks) ? tile_block_size : 256;
+
+  // The points are always quantized, as in stereo_tri
+  if (rounding_error <= 0 && tile_block_size > 0 && same_rounding)
+    rounding_error = tile_rounding_error;
+  else if (norm_2(shift) > 0)
+    rounding_error = asp::get_rounding_error(shift, rounding_error);
+  else if (rounding_error <= 0)
+    rounding_error = asp::APPROX_ONE_MM;
+
+  vw_out() << "Writing point cloud: " << opt.out_file << "\n";
+  int num_copied
+    = asp::merge_point_cloud_tiles<m>(opt.out_file, size, tiles, chunked, opt.tile_boxes,
+                                      shift, rounding_error, has_georef, georef,
+                                      block_size, opt.num_threads,
+                                      TerminalProgressCallback("asp", "\t--> Merging: "));
+  vw_out() << "Copied " << num_copied << " blocks from the tiles without decoding them.\n";
+}
+
+int main( int argc, char *argv[] ) {
+
+  Options opt;
+  try {
+    handle_arguments( argc, argv, opt );
+    read_tile_list(opt);
+
+    // All tiles have the size of the full cloud, and the same channels
+    int num_channels = asp::pc_num_channels(opt.tile_files[0]);
+    Vector2i size    = asp::pc_file_size(opt.tile_files[0]);
+    for (size_t i = 1; i < opt.tile_files.size(); i++) {
+      if (asp::pc_num_channels(opt.tile_files[i]) != num_channels)
+        vw_throw( ArgumentErr() << "The tiles must all have the same number of channels.\n" );
+      if (asp::pc_file_size(opt.tile_files[i]) != size)
+        vw_throw( ArgumentErr() << "The tiles must all have the same size.\n" );
+    }
+
+    Vector3 shift = determine_output_shift(opt);
+
+    switch (num_channels)
+    {
+      case 3:  do_work<3>(size, shift, opt); break;
+      case 4:  do_work<4>(size, shift, opt); break;
+      case 6:  do_work<6>(size, shift, opt); break;
+      default: vw_throw( ArgumentErr() << "Unsupported number of channels!.\n" );
+    }
+
+  } ASP_STANDARD_CATCHES;
+
+  return 0;
+}
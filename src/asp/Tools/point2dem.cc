@@ -152,7 +152,7 @@ void parse_input_clouds_textures(std::vector<std::string> const& files,
   // Separate the input point clouds from the textures
   opt.pointcloud_files.clear(); opt.texture_files.clear();
   for (int i = 0; i < num; i++){
-    if (asp::is_las_or_csv(files[i]) || get_num_channels(files[i]) >= 3)
+    if (asp::is_las_or_csv(files[i]) || asp::pc_num_channels(files[i]) >= 3)
       opt.pointcloud_files.push_back(files[i]);
     else
       opt.texture_files.push_back(files[i]);
@@ -183,9 +183,9 @@ void parse_input_clouds_textures(std::vector<std::string> const& files,
       // Here we ignore that a point cloud file may have many channels.
       // We just want to verify that the cloud file and texture file
       // have the same number of rows and columns.
-      DiskImageView<float> cloud(opt.pointcloud_files[i]);
+      Vector2i cloud_size = asp::pc_file_size(opt.pointcloud_files[i]);
       DiskImageView<float> texture(opt.texture_files[i]);
-      if ( cloud.cols() != texture.cols() || cloud.rows() != texture.rows() ){
+      if ( cloud_size.x() != texture.cols() || cloud_size.y() != texture.rows() ){
 	vw_throw( ArgumentErr() << "Point cloud " << opt.pointcloud_files[i]
 		  << " and texture file " << opt.texture_files[i]
 		  << " do not have the same dimensions.\n");
@@ -245,8 +245,8 @@ void las_or_csv_to_tifs(Options& opt,
   for (int i = 0; i < num_files; i++){
     if (asp::is_las_or_csv(opt.pointcloud_files[i]))
       continue;
-    DiskImageView<float> img(opt.pointcloud_files[i]);
-    num_rows = std::max(num_rows, img.rows()); // Record the max number of rows across all input tifs
+    Vector2i cloud_size = asp::pc_file_size(opt.pointcloud_files[i]);
+    num_rows = std::max(num_rows, cloud_size.y()); // Record the max number of rows across all input tifs
   }
 
   // No tif files exist. Find a reasonable value for the number of rows.
@@ -917,10 +917,10 @@ namespace asp{
     VW_ASSERT(pc_files.size() >= 1,
 	      ArgumentErr() << "Expecting at least one file.\n");
 
-    int num_channels0 = get_num_channels(pc_files[0]);
+    int num_channels0 = asp::pc_num_channels(pc_files[0]);
     int min_num_channels = num_channels0;
     for (int i = 1; i < (int)pc_files.size(); i++){
-      int num_channels = get_num_channels(pc_files[i]);
+      int num_channels = asp::pc_num_channels(pc_files[i]);
       min_num_channels = std::min(min_num_channels, num_channels);
       if (num_channels != num_channels0)
 	min_num_channels = std::min(min_num_channels, 3);
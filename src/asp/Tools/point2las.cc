@@ -128,7 +128,7 @@ int main( int argc, char *argv[] ) {
     bool has_user_datum = asp::read_user_datum(0, 0, opt.datum, datum);
 
     cartography::GeoReference georef;
-    bool has_georef = vw::cartography::read_georeference(georef, opt.pointcloud_file);
+    bool has_georef = asp::read_pc_georeference(georef, opt.pointcloud_file);
     if (has_georef && opt.target_srs_string.empty()) {
       opt.target_srs_string = georef.overall_proj4_str();
     }
@@ -36,6 +36,7 @@
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
 #include <asp/IsisIO/IsisCameraModel.h>
 #include <asp/Core/BundleAdjustUtils.h>
@@ -760,7 +761,7 @@ struct Options : public vw::cartography::GdalWriteOptions {
   int max_iterations, max_coarse_iterations, reflectance_type, coarse_levels;
   bool float_albedo, float_exposure, float_cameras, model_shadows,
     use_approx_camera_models, use_rpc_approximation, crop_input_images,
-    float_dem_at_boundary, fix_dem, float_reflectance_model;
+    float_dem_at_boundary, fix_dem, float_reflectance_model, use_tabulated_isis_cameras;
   double smoothness_weight, init_dem_height, nodata_val, max_height_change,
     height_change_weight, camera_position_step_size, rpc_penalty_weight;
   Options():max_iterations(0), max_coarse_iterations(0), reflectance_type(0),
@@ -768,7 +769,7 @@ struct Options : public vw::cartography::GdalWriteOptions {
 	    model_shadows(false), use_approx_camera_models(false),
 	    use_rpc_approximation(false),
 	    crop_input_images(false), float_dem_at_boundary(false), fix_dem(false),
-            float_reflectance_model(false),
+            float_reflectance_model(false), use_tabulated_isis_cameras(false),
 	    smoothness_weight(0), max_height_change(0), height_change_weight(0),
 	    camera_position_step_size(1.0), rpc_penalty_weight(0.0) {};
 };
@@ -1943,6 +1944,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Optional shadow thresholds for the input images (a list of real values in quotes).")
     ("use-approx-camera-models",   po::bool_switch(&opt.use_approx_camera_models)->default_value(false)->implicit_value(true),
      "Use approximate camera models for speed.")
+    ("use-tabulated-isis-cameras",   po::bool_switch(&opt.use_tabulated_isis_cameras)->default_value(false)->implicit_value(true),
+     "Sample the ISIS line scan cameras once when loaded and use these samples afterwards. Unlike the exact ISIS cameras, these can be used with multiple threads.")
     ("use-rpc-approximation",   po::bool_switch(&opt.use_rpc_approximation)->default_value(false)->implicit_value(true),
      "Use RPC approximations for the camera models instead of approximate tabulated camera models (invoke with --use-approx-camera-models).")
     ("rpc-penalty-weight", po::value(&opt.rpc_penalty_weight)->default_value(0.1),
@@ -2114,6 +2117,7 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   // Need this to be able to load adjusted camera models. That will happen
   // in the stereo session.
   asp::stereo_settings().bundle_adjust_prefix = opt.bundle_adjust_prefix;
+  asp::stereo_settings().use_tabulated_isis_cameras = opt.use_tabulated_isis_cameras;
 
   if (opt.input_images.size() <=1 && opt.float_albedo)
     vw_throw(ArgumentErr()
@@ -2277,8 +2281,13 @@ void run_sfs_level(// Fixed inputs
   }
   
   if (opt.num_threads > 1 && !opt.use_approx_camera_models) {
-    vw_out() << "Using exact ISIS camera models. Can run with only a single thread.\n";
-    opt.num_threads = 1;
+    bool single_threaded = false;
+    for (size_t i = 0; i < cameras.size(); i++)
+      single_threaded = single_threaded || asp::is_single_threaded_camera(cameras[i].get());
+    if (single_threaded) {
+      vw_out() << "Using exact ISIS camera models. Can run with only a single thread.\n";
+      opt.num_threads = 1;
+    }
   }
   vw_out() << "Using: " << opt.num_threads << " threads.\n";
 
@@ -33,6 +33,12 @@
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics.hpp>
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unistd.h>
 
 using namespace vw;
 using namespace vw::cartography;
@@ -235,14 +241,8 @@ namespace asp {
         }
       }
 
-      string local_prefix = output_prefix;
-      if (num_pairs > 1){
-        // Need to have a separate output prefix for each pair
-        ostringstream os;
-        os << local_prefix << "-pair" << p << "/" << p;
-        local_prefix = os.str();
-      }
-      cmd.push_back(local_prefix);
+      // Need to have a separate output prefix for each pair
+      cmd.push_back(pair_out_prefix(output_prefix, p, num_pairs));
 
       if (!input_dem.empty())
         cmd.push_back(input_dem);
@@ -806,4 +806,200 @@ namespace asp {
            has_tif_or_ntf_extension(opt.in_file2));
   }
 
+  std::string pair_out_prefix(std::string const& output_prefix, int pair, int num_pairs) {
+    if (num_pairs <= 1)
+      return output_prefix;
+    ostringstream os;
+    os << output_prefix << "-pair" << pair << "/" << pair;
+    return os.str();
+  }
+
+  // A tile claimed from the queue of parallel_stereo
+  struct TileJob {
+    string name, claim_file, out_prefix;
+    BBox2i trans_crop_win;
+  };
+
+  // Claim the next job in the queue which no other worker has claimed
+  // yet, trying the files listed in 'pending' in order. List the queue
+  // again once these are exhausted, to be sure nothing is left.
+  bool claim_tile_job(string const& queue_dir, vector<string> & pending, TileJob & job) {
+
+    for (int pass = 0; pass < 2; pass++) {
+
+      while (!pending.empty()) {
+        fs::path job_file = pending.back();
+        pending.pop_back();
+
+        ostringstream claim;
+        claim << job_file.string() << "-claimed-" << getpid();
+        boost::system::error_code ec;
+        fs::rename(job_file, claim.str(), ec);
+        if (ec)
+          continue; // Another worker was first
+
+        job.name       = job_file.stem().string();
+        job.claim_file = claim.str();
+        std::ifstream fh(job.claim_file.c_str());
+        int x = 0, y = 0, w = 0, h = 0;
+        if (!std::getline(fh, job.out_prefix) || !(fh >> x >> y >> w >> h))
+          vw_throw(IOErr() << "Invalid tile job: " << job_file.string() << ".\n");
+        job.trans_crop_win = BBox2i(x, y, w, h);
+        return true;
+      }
+
+      if (pass == 0) {
+        for (fs::directory_iterator it(queue_dir); it != fs::directory_iterator(); it++) {
+          if (it->path().extension() == ".job")
+            pending.push_back(it->path().string());
+        }
+        // Take the tiles in order, from the back
+        std::sort(pending.rbegin(), pending.rend());
+      }
+    }
+    return false;
+  }
+
+  namespace {
+    vw::Mutex g_lowres_inputs_mutex;
+    bool g_keep_lowres_inputs = false;
+    // For each file the tile links resolve to, its stamp and contents
+    std::map<std::string, std::pair<std::string, ImageView<PixelMask<Vector2i> > > >
+      g_lowres_disparities;
+    std::map<std::string, std::pair<std::string, LocalHomographies> > g_local_homographies;
+
+    // The file a name resolves to, and a stamp of its size and
+    // modification time. Return false if the file cannot be found.
+    bool resolve_lowres_file(std::string const& file, std::string & path,
+                             std::string & stamp) {
+      boost::system::error_code ec;
+      fs::path canonical = fs::canonical(file, ec);
+      if (ec)
+        return false;
+      boost::uintmax_t size = fs::file_size(canonical, ec);
+      if (ec)
+        return false;
+      std::time_t mtime = fs::last_write_time(canonical, ec);
+      if (ec)
+        return false;
+      std::ostringstream os;
+      os << size << " " << mtime;
+      path  = canonical.string();
+      stamp = os.str();
+      return true;
+    }
+  }
+
+  void keep_lowres_inputs(bool keep) {
+    vw::Mutex::Lock lock(g_lowres_inputs_mutex);
+    g_keep_lowres_inputs = keep;
+    if (!keep) {
+      g_lowres_disparities.clear();
+      g_local_homographies.clear();
+    }
+  }
+
+  ImageViewRef<PixelMask<Vector2i> > read_lowres_disparity(std::string const& file) {
+    vw::Mutex::Lock lock(g_lowres_inputs_mutex);
+    if (!g_keep_lowres_inputs)
+      return DiskImageView<PixelMask<Vector2i> >(file);
+
+    std::string path, stamp;
+    if (!resolve_lowres_file(file, path, stamp))
+      return DiskImageView<PixelMask<Vector2i> >(file); // throws
+    if (g_lowres_disparities.count(path) == 0 || g_lowres_disparities[path].first != stamp) {
+      ImageView<PixelMask<Vector2i> > disp = DiskImageView<PixelMask<Vector2i> >(path);
+      g_lowres_disparities[path] = std::make_pair(stamp, disp);
+    }
+    return g_lowres_disparities[path].second;
+  }
+
+  LocalHomographies read_local_homographies(std::string const& out_prefix) {
+    std::string file = local_homographies_file(out_prefix);
+    vw::Mutex::Lock lock(g_lowres_inputs_mutex);
+    if (!g_keep_lowres_inputs)
+      return LocalHomographies(file);
+
+    std::string path, stamp;
+    if (!resolve_lowres_file(file, path, stamp))
+      return LocalHomographies(file); // throws
+    if (g_local_homographies.count(path) == 0 || g_local_homographies[path].first != stamp)
+      g_local_homographies[path] = std::make_pair(stamp, LocalHomographies(path));
+    return g_local_homographies[path].second;
+  }
+
+  void run_tile_worker(std::vector<ASPGlobalOptions> const& opt_vec,
+                       double setup_seconds, StereoStageFunc stage) {
+
+    std::string queue_dir = stereo_settings().worker_queue;
+    if (!fs::is_directory(queue_dir))
+      vw_throw(ArgumentErr() << "Cannot find the tile queue: " << queue_dir << ".\n");
+
+    // Each tile starts from the settings as they are now
+    StereoSettings settings = stereo_settings();
+
+    // The cameras need be loaded only once as well, unless a stage
+    // reloads them with other adjustments. So do the low-resolution
+    // disparities and local homographies, unless they are remade. The
+    // images and full-resolution disparities are opened per tile, by
+    // the stage.
+    for (size_t p = 0; p < opt_vec.size(); p++)
+      opt_vec[p].session->keep_camera_models(true);
+    keep_lowres_inputs(true);
+
+    BBox2i L_box;
+    string L_file = opt_vec[0].out_prefix + "-L.tif";
+    if (fs::exists(L_file))
+      L_box = bounding_box(DiskImageView<PixelGray<float> >(L_file));
+
+    vw_out() << "\t--> Processing the tiles in " << queue_dir << ", after a setup of "
+             << setup_seconds << " seconds.\n";
+
+    vector<string> pending;
+    TileJob job;
+    int    num_tiles   = 0;
+    double tile_seconds = 0.0;
+    while (claim_tile_job(queue_dir, pending, job)) {
+
+      vector<ASPGlobalOptions> job_opt = opt_vec;
+      for (size_t p = 0; p < job_opt.size(); p++)
+        job_opt[p].out_prefix = pair_out_prefix(job.out_prefix, p + 1, job_opt.size());
+
+      stereo_settings() = settings;
+      stereo_settings().trans_crop_win = job.trans_crop_win;
+      if (!L_box.empty())
+        stereo_settings().trans_crop_win.crop(L_box);
+
+      vw_out() << "\t--> Tile " << job.name << ": " << job.out_prefix << "\n";
+      Stopwatch sw;
+      sw.start();
+      string status_file;
+      ostringstream status;
+      try {
+        stage(job.out_prefix, job_opt);
+        sw.stop();
+        status_file = (fs::path(queue_dir) / (job.name + ".done")).string();
+        status << "seconds " << sw.elapsed_seconds() << " setup_seconds " << setup_seconds << "\n";
+        num_tiles++;
+        tile_seconds += sw.elapsed_seconds();
+      } catch (const std::exception & e) {
+        status_file = (fs::path(queue_dir) / (job.name + ".failed")).string();
+        status << e.what() << "\n";
+        vw_out(ErrorMessage) << "Tile " << job.name << " failed: " << e.what() << "\n";
+      }
+      {
+        std::ofstream fh(status_file.c_str());
+        fh << status.str();
+      }
+      boost::system::error_code ec;
+      fs::remove(job.claim_file, ec);
+    }
+
+    vw_out() << "\t--> Processed " << num_tiles << " tiles";
+    if (num_tiles > 0)
+      vw_out() << ", in " << tile_seconds/num_tiles << " seconds per tile on average";
+    vw_out() << ". The setup of " << setup_seconds << " seconds was done once rather than for "
+             << "each tile.\n";
+  }
+
 } // end namespace asp
@@ -33,6 +33,7 @@
 #include <asp/Core/MedianFilter.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/LocalHomography.h>
 
 // Support for ISIS image files
 #if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
@@ -97,6 +98,47 @@ namespace asp {
 
   bool skip_image_normalization(ASPGlobalOptions const& opt);
 
+  /// The output prefix of the given stereo pair, counting from 1, out of
+  /// num_pairs pairs made from the images of a run with this prefix.
+  std::string pair_out_prefix(std::string const& output_prefix, int pair, int num_pairs);
+
+  /// Keep the low-resolution disparities and local homographies read
+  /// by the functions below in memory, for the stages run on each tile
+  /// by a worker. All tiles share these files, by way of links.
+  void keep_lowres_inputs(bool keep);
+
+  /// Read D_sub or D_sub_spread. If keep_lowres_inputs(true) was
+  /// called, the image is read in full once, and reused while the file
+  /// the name resolves to keeps its size and modification time, as
+  /// kept cameras are reused while their adjustments are unchanged.
+  /// Throws vw::IOErr if the file cannot be read.
+  vw::ImageViewRef<vw::PixelMask<vw::Vector2i> >
+  read_lowres_disparity(std::string const& file);
+
+  /// Read the local homographies for this output prefix, reusing them
+  /// as read_lowres_disparity() does.
+  LocalHomographies read_local_homographies(std::string const& out_prefix);
+
+  /// A stage of stereo, run for the given stereo pairs
+  typedef void (*StereoStageFunc)(std::string const& output_prefix,
+                                  std::vector<ASPGlobalOptions> & opt_vec);
+
+  /// Run a stage of stereo on each tile queued by parallel_stereo in the
+  /// directory stereo_settings().worker_queue, until none is left. The
+  /// options, sessions and cameras set up by parse_multiview() for the
+  /// whole run are reused for all tiles, so they are set up once rather
+  /// than per tile. That took setup_seconds, which is reported. D_sub
+  /// and the local homographies are also read once, see
+  /// keep_lowres_inputs().
+  ///
+  /// The queue has a file <name>.job per tile, with the output prefix of
+  /// the tile on the first line and its region in L.tif (xoff yoff xsize
+  /// ysize) on the second. A worker claims a tile by renaming its file,
+  /// which only one worker can do. Then it writes <name>.done with the
+  /// time taken, or <name>.failed with the error.
+  void run_tile_worker(std::vector<ASPGlobalOptions> const& opt_vec,
+                       double setup_seconds, StereoStageFunc stage);
+
 } // end namespace vw
 
 #endif//__ASP_STEREO_H__
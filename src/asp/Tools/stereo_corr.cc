@@ -27,17 +27,34 @@
 #include <vw/Stereo/DisparityMap.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Core/DemDisparity.h>
+#include <asp/Core/DisparityRange.h>
 #include <asp/Core/LocalHomography.h>
+#include <asp/Core/LowResCache.h>
+#include <asp/Core/QuantileFilter.h>
 #include <asp/Sessions/StereoSession.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
 #include <asp/Tools/NewCorrelation.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
 using namespace vw;
 using namespace vw::stereo;
 using namespace asp;
 using namespace std;
 
+// Remove a temporary file when going out of scope, also on error
+class ScopedFileRemover {
+  std::string m_file;
+public:
+  ScopedFileRemover(std::string const& file): m_file(file) {}
+  ~ScopedFileRemover() {
+    boost::system::error_code ec;
+    fs::remove(m_file, ec); // destructors must not throw
+  }
+};
 
 // Read the search range from D_sub, and scale it to the full image
 void read_search_range(ASPGlobalOptions & opt){
@@ -142,27 +159,32 @@ void produce_lowres_disparity( ASPGlobalOptions & opt ) {
       );
       // End of giant function call block
     }
-    else { // Use quantile based filtering - This filter needs to be profiled to improve its speed.
-    
-      // Compute image correlation using the PyramidCorrelationView class
-      ImageView< PixelMask<Vector2i> > disp_image = vw::stereo::pyramid_correlate( 
+    else { // Use quantile based filtering
+
+      // The quantiles need the whole image, so first write the
+      // unfiltered disparity to disk, tile by tile. Then gather the
+      // distribution of disparities from it and filter it, also tile
+      // by tile, so that memory use stays bounded for large images.
+      string unfiltered_file = opt.out_prefix + "-D_sub_unfiltered.tif";
+      ScopedFileRemover remover(unfiltered_file);
+      vw::cartography::block_write_gdal_image(
+          unfiltered_file,
+          vw::stereo::pyramid_correlate( // Compute image correlation using the PyramidCorrelationView class
                   left_sub, right_sub,
                   left_mask_sub, right_mask_sub,
                   vw::stereo::PREFILTER_LOG, stereo_settings().slogW,
                   search_range, kernel_size, cost_mode,
                   corr_timeout, seconds_per_op,
                   stereo_settings().xcorr_threshold, stereo_settings().corr_max_levels
-              );
-
-      vw::cartography::write_gdal_image( // Write to disk while removing outliers
-          opt.out_prefix + "-D_sub.tif",
-          rm_outliers_using_quantiles( // Throw out individual pixels that are far from any neighbors
-              disp_image,
-              stereo_settings().rm_quantile_percentile, stereo_settings().rm_quantile_multiple
-          ),
+              ),
           opt,
           TerminalProgressCallback("asp", "\t--> Low-resolution disparity:")
       );
+
+      filter_disparity_using_quantiles(unfiltered_file, opt.out_prefix + "-D_sub.tif",
+                                       stereo_settings().rm_quantile_percentile,
+                                       stereo_settings().rm_quantile_multiple, opt,
+                                       TerminalProgressCallback("asp", "\t--> Quantile filtering:"));
     }
 
   }else if ( stereo_settings().seed_mode == 2 ) {
@@ -177,6 +199,117 @@ void produce_lowres_disparity( ASPGlobalOptions & opt ) {
   read_search_range(opt);
 } // End produce_lowres_disparity
 
+/// The SPICE kernels named in the label of an ISIS cube, as paths such
+/// as $mro/kernels/ck/file.bc, with the mission directories resolved
+/// under $ISIS3DATA. Only the files which exist are returned. The
+/// label is the text at the start of the cube, up to its "End" line.
+vector<string> isis_kernel_files(string const& cube){
+
+  vector<string> kernels;
+  const char* isis_data = getenv("ISIS3DATA");
+  std::ifstream fh(cube.c_str(), std::ios::binary);
+  string line;
+  size_t label_len = 0;
+  while (label_len < (1 << 20) && std::getline(fh, line)){
+    label_len += line.size() + 1;
+    if (line == "End" || line == "End\r")
+      break;
+    for (size_t pos = line.find('$'); pos != string::npos; pos = line.find('$', pos + 1)){
+      size_t end = pos + 1;
+      while (end < line.size() && line[end] != ' ' && line[end] != ',' && line[end] != '"' &&
+             line[end] != ')' && line[end] != '\r')
+        end++;
+      string path = line.substr(pos + 1, end - pos - 1);
+      size_t slash = path.find('/');
+      if (slash == string::npos || slash == 0 || isis_data == NULL)
+        continue;
+      string file = string(isis_data) + "/" + path;
+      if (fs::exists(file) && std::find(kernels.begin(), kernels.end(), file) == kernels.end())
+        kernels.push_back(file);
+    }
+  }
+  return kernels;
+}
+
+/// Find the files and settings which determine D_sub and D_sub_spread,
+/// for use as the key of the low-resolution cache. Return false if
+/// the seed mode does not produce D_sub here.
+bool lowres_cache_inputs(ASPGlobalOptions const& opt,
+                         vector<string> & files, string & settings){
+
+  files.clear();
+  ostringstream os;
+  os.precision(17);
+  int seed_mode = stereo_settings().seed_mode;
+  os << "seed_mode=" << seed_mode
+     << " L_size=" << file_image_size(opt.out_prefix + "-L.tif");
+
+  files.push_back(opt.out_prefix + "-L_sub.tif");
+  if (seed_mode == 1){
+    files.push_back(opt.out_prefix + "-R_sub.tif");
+    files.push_back(opt.out_prefix + "-lMask_sub.tif");
+    files.push_back(opt.out_prefix + "-rMask_sub.tif");
+    os << " search_range="   << stereo_settings().search_range
+       << " seed_pad="       << stereo_settings().seed_percent_pad
+       << " kernel="         << stereo_settings().corr_kernel
+       << " prefilter_LOG="  << stereo_settings().slogW
+       << " corr_timeout="   << stereo_settings().corr_timeout
+       << " xcorr_threshold="<< stereo_settings().xcorr_threshold
+       << " max_levels="     << stereo_settings().corr_max_levels
+       << " rm_threshold="   << stereo_settings().rm_threshold
+       << " rm_min_matches=" << stereo_settings().rm_min_matches
+       << " rm_quantile="    << stereo_settings().rm_quantile_percentile
+       << " "                << stereo_settings().rm_quantile_multiple;
+  }else if (seed_mode == 2){
+    // The cameras may live in the images, as for ISIS cubes, and the
+    // sub-sampled images have none of that, so the images themselves
+    // are in the key then, with the SPICE kernels their labels name.
+    // Large files are hashed from samples, see file_checksum().
+    files.push_back(stereo_settings().disparity_estimation_dem);
+    string image_files[2]  = {opt.in_file1,  opt.in_file2};
+    string camera_files[2] = {opt.cam_file1, opt.cam_file2};
+    for (int i = 0; i < 2; i++){
+      if (camera_files[i] != "" && camera_files[i] != image_files[i] && fs::exists(camera_files[i]))
+        files.push_back(camera_files[i]);
+      else if (fs::exists(image_files[i]))
+        files.push_back(image_files[i]);
+      string camera = camera_files[i] != "" ? camera_files[i] : image_files[i];
+      if (boost::iends_with(camera, ".cub")){
+        vector<string> kernels = isis_kernel_files(camera);
+        files.insert(files.end(), kernels.begin(), kernels.end());
+      }
+    }
+    // The adjustments can be overwritten by another bundle_adjust run
+    // into the same prefix, so their contents must be in the key.
+    std::string ba_prefix = stereo_settings().bundle_adjust_prefix;
+    if (ba_prefix != ""){
+      std::string adjust_file1 = asp::bundle_adjust_file_name(ba_prefix, opt.in_file1, opt.cam_file1);
+      std::string adjust_file2 = asp::bundle_adjust_file_name(ba_prefix, opt.in_file2, opt.cam_file2);
+      if (fs::exists(adjust_file1))
+        files.push_back(adjust_file1);
+      if (fs::exists(adjust_file2))
+        files.push_back(adjust_file2);
+    }
+    os << " session="   << opt.session->name()
+       << " dem_error=" << stereo_settings().disparity_estimation_dem_error
+       << " alignment=" << stereo_settings().alignment_method
+       << " ba_prefix=" << stereo_settings().bundle_adjust_prefix;
+    const char* isis_data = getenv("ISIS3DATA");
+    if (isis_data != NULL)
+      os << " isis3data=" << isis_data;
+  }else{
+    return false;
+  }
+
+  if (fs::exists(opt.out_prefix + "-align-L.exr"))
+    files.push_back(opt.out_prefix + "-align-L.exr");
+  if (fs::exists(opt.out_prefix + "-align-R.exr"))
+    files.push_back(opt.out_prefix + "-align-R.exr");
+
+  settings = os.str();
+  return true;
+}
+
 /// The first step of correlation computation.
 void lowres_correlation( ASPGlobalOptions & opt ) {
 
@@ -261,6 +394,9 @@ void lowres_correlation( ASPGlobalOptions & opt ) {
   DiskImageView<vw::uint8> Lmask(opt.out_prefix + "-lMask.tif"),
                            Rmask(opt.out_prefix + "-rMask.tif");
 
+  // Set if the low-resolution cache is in use
+  string cache_key, cache_settings;
+
   // Performing disparity on sub images
   if ( stereo_settings().seed_mode > 0 ) {
 
@@ -286,20 +422,63 @@ void lowres_correlation( ASPGlobalOptions & opt ) {
       rebuild = true;
     }
 
+    // Look in the low-resolution cache before computing D_sub
+    string cache_dir = stereo_settings().lowres_cache_dir;
+    vector<string> cache_files;
+    if (!cache_dir.empty() && rebuild &&
+        lowres_cache_inputs(opt, cache_files, cache_settings)){
+      cache_key = lowres_cache_key(cache_files, cache_settings);
+
+      // D_sub_spread is produced in seed mode 2. In seed mode 1 it is
+      // an optional input and must be left alone.
+      vector<string> suffixes(1, "-D_sub.tif");
+      if (stereo_settings().seed_mode == 2)
+        suffixes.push_back("-D_sub_spread.tif");
+      if (fetch_from_lowres_cache(cache_dir, cache_key, opt.out_prefix, suffixes)){
+        vw_out() << "\t--> Low-resolution cache hit: " << cache_dir << "/" << cache_key << "\n";
+        read_search_range(opt);
+      }else{
+        vw_out() << "\t--> Low-resolution cache miss: " << cache_key << "\n";
+        produce_lowres_disparity( opt );
+        store_in_lowres_cache(cache_dir, cache_key, cache_settings, opt.out_prefix, suffixes);
+      }
+      rebuild = false;
+    }
+
     if ( rebuild )
       produce_lowres_disparity( opt );
-    else
+    else if (cache_key.empty())
       vw_out() << "\t--> Using cached low-resolution disparity: " << sub_disp_file << "\n";
   }
 
   // Create the local homographies based on D_sub
   if (stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography){
-    string local_hom_file = opt.out_prefix + "-local_hom.txt";
+    string local_hom_file = local_homographies_file(opt.out_prefix);
     try {
-      ImageView<Matrix3x3> local_hom;
-      read_local_homographies(local_hom_file, local_hom);
+      LocalHomographies local_hom(local_hom_file);
     } catch (vw::IOErr const& e) {
-      create_local_homographies(opt);
+
+      // The local homographies depend only on D_sub and the tiling
+      string hom_key, hom_settings;
+      if (!cache_key.empty()){
+        ostringstream os;
+        os << cache_key << " local_hom tile_size=" << ASPGlobalOptions::corr_tile_size();
+        hom_settings = cache_settings + " " + os.str();
+        hom_key = lowres_cache_key(vector<string>(), os.str());
+      }
+      vector<string> suffixes(1, "-local_hom.bin");
+      if (!hom_key.empty() &&
+          fetch_from_lowres_cache(stereo_settings().lowres_cache_dir, hom_key,
+                                  opt.out_prefix, suffixes)){
+        vw_out() << "\t--> Local homographies cache hit: " << hom_key << "\n";
+      }else{
+        if (!hom_key.empty())
+          vw_out() << "\t--> Local homographies cache miss: " << hom_key << "\n";
+        create_local_homographies(opt);
+        if (!hom_key.empty())
+          store_in_lowres_cache(stereo_settings().lowres_cache_dir, hom_key, hom_settings,
+                                opt.out_prefix, suffixes);
+      }
     }
   }
 
@@ -317,7 +496,7 @@ class SeededCorrelatorView : public ImageViewBase<SeededCorrelatorView> {
   DiskImageView<vw::uint8> m_right_mask;
   ImageViewRef<PixelMask<Vector2i> > m_sub_disp;
   ImageViewRef<PixelMask<Vector2i> > m_sub_disp_spread;
-  ImageView<Matrix3x3> const& m_local_hom;
+  LocalHomographies const& m_local_hom;
 
   // Settings
   Vector2  m_upscale_factor;
@@ -342,7 +521,7 @@ public:
                         MaskType              const& right_mask,
                         DispSeedImageType     const& sub_disp,
                         DispSeedImageType     const& sub_disp_spread,
-                        ImageView<Matrix3x3>  const& local_hom,
+                        LocalHomographies     const& local_hom,
                         BBox2i   trans_crop_win,
                         Vector2i const& kernel_size,
                         stereo::CostFunctionType cost_mode,
@@ -404,134 +583,244 @@ public:
     return disparity;
   } // End function prerasterize
 
-  /// The function that does all the work
-  inline prerasterize_type prerasterize_helper(BBox2i const& bbox) const {
-
-    bool use_local_homography = stereo_settings().use_local_homography;
+  /// Scale a low-res search range to full resolution, after padding
+  /// it to account for the low-res disparity being integer-valued.
+  BBox2f scale_search_range(BBox2f range) const {
+    range = grow_bbox_to_int(range);
+    // Expand the range by 1. This is necessary since m_sub_disp is
+    // integer-valued, and perhaps the search range was supposed to be
+    // a fraction of integer bigger.
+    range.expand(1);
+    range.min() = floor(elem_prod(range.min(), m_upscale_factor));
+    range.max() = ceil (elem_prod(range.max(), m_upscale_factor));
+    return range;
+  }
 
-    Matrix<double> lowres_hom  = math::identity_matrix<3>();
-    Matrix<double> fullres_hom = math::identity_matrix<3>();
-    ImageViewRef<InputPixelType> right_trans_img;
-    ImageViewRef<vw::uint8     > right_trans_mask;
+  /// Find the search range for the given region of the left image
+  /// from the min and max of D_sub, expanded by D_sub_spread. If
+  /// robust_range is not null, also find the range after discarding
+  /// the outliers, and whether the disparities form separate clusters.
+  BBox2f find_search_range(BBox2i const& bbox, Matrix<double> const& lowres_hom,
+                           BBox2f * robust_range, bool * multimodal) const {
 
+    bool use_local_homography = stereo_settings().use_local_homography;
     bool do_round = true; // round integer disparities after transform
 
-    // User strategies
+    // The low-res version of bbox
+    BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
+                      elem_quot(bbox.max(), m_upscale_factor) );
+    seed_bbox.expand(1);
+    seed_bbox.crop( m_seed_bbox );
+    VW_OUT(DebugMessage, "stereo") << "Getting disparity range for : " << seed_bbox << "\n";
+    DispSeedImageType disparity_in_box = crop( m_sub_disp, seed_bbox );
+
     BBox2f local_search_range;
-    if ( stereo_settings().seed_mode > 0 ) {
+    if (!use_local_homography){
+      local_search_range = stereo::get_disparity_range( disparity_in_box );
+    }else{
+      local_search_range = stereo::get_disparity_range
+        (transform_disparities(do_round, seed_bbox,
+                               lowres_hom, disparity_in_box));
+    }
+
+    bool has_sub_disp_spread = ( m_sub_disp_spread.cols() != 0 &&
+                                 m_sub_disp_spread.rows() != 0 );
+    // Sanity check: If m_sub_disp_spread was provided, it better have the same size as sub_disp.
+    if ( has_sub_disp_spread &&
+         m_sub_disp_spread.cols() != m_sub_disp.cols() &&
+         m_sub_disp_spread.rows() != m_sub_disp.rows() ){
+      vw_throw( ArgumentErr() << "stereo_corr: D_sub and D_sub_spread must have equal sizes.\n");
+    }
 
-      // The low-res version of bbox
-      BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
-			elem_quot(bbox.max(), m_upscale_factor) );
-      seed_bbox.expand(1);
-      seed_bbox.crop( m_seed_bbox );
-      VW_OUT(DebugMessage, "stereo") << "Getting disparity range for : " << seed_bbox << "\n";
-      DispSeedImageType disparity_in_box = crop( m_sub_disp, seed_bbox );
+    // The low-res disparity minus and plus its spread
+    ImageView<PixelMask<Vector2i> > lower_disp, upper_disp;
+    if (has_sub_disp_spread){
+      // Expand the disparity range by m_sub_disp_spread.
+      DispSeedImageType spread_in_box = crop( m_sub_disp_spread, seed_bbox );
 
       if (!use_local_homography){
-        local_search_range = stereo::get_disparity_range( disparity_in_box );
-      }else{ // seed_mode == 0
-        int ts = ASPGlobalOptions::corr_tile_size();
-        lowres_hom = m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts);
-        local_search_range = stereo::get_disparity_range
-          (transform_disparities(do_round, seed_bbox,
-			     lowres_hom, disparity_in_box));
-      }
-
-      bool has_sub_disp_spread = ( m_sub_disp_spread.cols() != 0 &&
-			                             m_sub_disp_spread.rows() != 0 );
-      // Sanity check: If m_sub_disp_spread was provided, it better have the same size as sub_disp.
-      if ( has_sub_disp_spread &&
-           m_sub_disp_spread.cols() != m_sub_disp.cols() &&
-           m_sub_disp_spread.rows() != m_sub_disp.rows() ){
-        vw_throw( ArgumentErr() << "stereo_corr: D_sub and D_sub_spread must have equal sizes.\n");
+        BBox2f spread = stereo::get_disparity_range( spread_in_box );
+        local_search_range.min() -= spread.max();
+        local_search_range.max() += spread.max();
+        if (robust_range != NULL){
+          lower_disp = disparity_in_box - spread_in_box;
+          upper_disp = disparity_in_box + spread_in_box;
+        }
+      }else{
+        upper_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
+                                           disparity_in_box + spread_in_box);
+        lower_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
+                                           disparity_in_box - spread_in_box);
+        BBox2f upper_range = stereo::get_disparity_range(upper_disp);
+        BBox2f lower_range = stereo::get_disparity_range(lower_disp);
+
+        local_search_range = upper_range;
+        local_search_range.grow(lower_range);
       }
-
-      if (has_sub_disp_spread){
-        // Expand the disparity range by m_sub_disp_spread.
-        DispSeedImageType spread_in_box = crop( m_sub_disp_spread, seed_bbox );
-
-        if (!use_local_homography){
-          BBox2f spread = stereo::get_disparity_range( spread_in_box );
-          local_search_range.min() -= spread.max();
-          local_search_range.max() += spread.max();
-        }else{
-          DispSeedImageType upper_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
-                                                               disparity_in_box + spread_in_box);
-          DispSeedImageType lower_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
-                                                               disparity_in_box - spread_in_box);
-          BBox2f upper_range = stereo::get_disparity_range(upper_disp);
-          BBox2f lower_range = stereo::get_disparity_range(lower_disp);
-
-          local_search_range = upper_range;
-          local_search_range.grow(lower_range);
+    }else if (robust_range != NULL){
+      if (!use_local_homography)
+        lower_disp = disparity_in_box;
+      else
+        lower_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
+                                           disparity_in_box);
+      upper_disp = lower_disp;
+    } //endif has_sub_disp_spread
+
+    if (robust_range != NULL){
+      std::vector<DispRangeSample> samples;
+      for (int row = 0; row < lower_disp.rows(); row++){
+        for (int col = 0; col < lower_disp.cols(); col++){
+          if (!is_valid(lower_disp(col, row)) || !is_valid(upper_disp(col, row)))
+            continue;
+          Vector2i l = lower_disp(col, row).child(), u = upper_disp(col, row).child();
+          samples.push_back(DispRangeSample(Vector2f(l[0], l[1]), Vector2f(u[0], u[1])));
         }
-      } //endif has_sub_disp_spread
-
-      if (use_local_homography){
-        Vector3 upscale(     m_upscale_factor[0],     m_upscale_factor[1], 1 );
-        Vector3 dnscale( 1.0/m_upscale_factor[0], 1.0/m_upscale_factor[1], 1 );
-        fullres_hom = diagonal_matrix(upscale)*lowres_hom*diagonal_matrix(dnscale);
-
-        ImageViewRef< PixelMask<InputPixelType> >
-          right_trans_masked_img
-          = transform (copy_mask( m_right_image.impl(),
-			          create_mask(m_right_mask.impl()) ),
-	               HomographyTransform(fullres_hom),
-	               m_left_image.impl().cols(), m_left_image.impl().rows());
-        right_trans_img  = apply_mask(right_trans_masked_img);
-        right_trans_mask = channel_cast_rescale<uint8>(select_channel(right_trans_masked_img, 1));
-      } //endif use_local_homography
-
-      local_search_range = grow_bbox_to_int(local_search_range);
-      // Expand local_search_range by 1. This is necessary since
-      // m_sub_disp is integer-valued, and perhaps the search
-      // range was supposed to be a fraction of integer bigger.
-      local_search_range.expand(1);
-      
-      // Scale the search range to full-resolution
-      local_search_range.min() = floor(elem_prod(local_search_range.min(),m_upscale_factor));
-      local_search_range.max() = ceil (elem_prod(local_search_range.max(),m_upscale_factor));
-
-      VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView("
-				     << bbox << ") search range "
-				     << local_search_range << " vs "
-				     << stereo_settings().search_range << "\n";
-
-    } else{
-      local_search_range = stereo_settings().search_range;
-      VW_OUT(DebugMessage,"stereo") << "Searching with "
-				    << stereo_settings().search_range << "\n";
+      }
+      double percentile = stereo_settings().corr_range_percentile;
+      if (samples.empty()){
+        *robust_range = local_search_range;
+        *multimodal   = false;
+      }else{
+        *robust_range = robust_disparity_range(samples, percentile);
+        // The gap must be bigger than the padding added when scaling
+        // the range to full resolution.
+        double min_gap = 4.0;
+        *multimodal   = is_multimodal(samples, percentile, min_gap);
+      }
+      *robust_range = scale_search_range(*robust_range);
     }
 
-    // Now we are ready to actually perform correlation
-    if (use_local_homography){
+    return scale_search_range(local_search_range);
+  }
+
+  /// Correlate the given region of the left image with the given search range.
+  ImageView<pixel_type> correlate(BBox2i const& bbox, BBox2f const& search_range,
+                                  Matrix<double> const& fullres_hom) const {
+
+    ImageView<pixel_type> disparity;
+    if (stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography){
+      ImageViewRef< PixelMask<InputPixelType> >
+        right_trans_masked_img
+        = transform (copy_mask( m_right_image.impl(),
+                                create_mask(m_right_mask.impl()) ),
+                     HomographyTransform(fullres_hom),
+                     m_left_image.impl().cols(), m_left_image.impl().rows());
+      ImageViewRef<InputPixelType> right_trans_img  = apply_mask(right_trans_masked_img);
+      ImageViewRef<vw::uint8> right_trans_mask
+        = channel_cast_rescale<uint8>(select_channel(right_trans_masked_img, 1));
+
       typedef vw::stereo::PyramidCorrelationView<ImageType, ImageViewRef<InputPixelType>, 
                                              MaskType,  ImageViewRef<vw::uint8     > > CorrView;
       CorrView corr_view( m_left_image,   right_trans_img,
                           m_left_mask,    right_trans_mask,
                           static_cast<vw::stereo::PrefilterModeType>(stereo_settings().pre_filter_mode),
                           stereo_settings().slogW,
-                          local_search_range,
+                          search_range,
                           m_kernel_size,  m_cost_mode,
                           m_corr_timeout, m_seconds_per_op,
                           stereo_settings().xcorr_threshold,
                           stereo_settings().corr_max_levels );
-      return corr_view.prerasterize(bbox);
+      disparity = crop(corr_view.prerasterize(bbox), bbox);
     }else{
       typedef vw::stereo::PyramidCorrelationView<ImageType, ImageType, MaskType, MaskType > CorrView;
       CorrView corr_view( m_left_image,   m_right_image,
                           m_left_mask,    m_right_mask,
                           static_cast<vw::stereo::PrefilterModeType>(stereo_settings().pre_filter_mode),
                           stereo_settings().slogW,
-                          local_search_range,
+                          search_range,
                           m_kernel_size,  m_cost_mode,
                           m_corr_timeout, m_seconds_per_op,
                           stereo_settings().xcorr_threshold,
                           stereo_settings().corr_max_levels );
-      return corr_view.prerasterize(bbox);
+      disparity = crop(corr_view.prerasterize(bbox), bbox);
     }
-    
+    return disparity;
+  }
+
+  /// Correlate a region of the tile with a search range robust to
+  /// outliers in D_sub. If the low-res disparities in the region form
+  /// separate clusters, split the region in four, as then each piece
+  /// can be searched over a smaller range.
+  void correlate_robustly(BBox2i const& tile_bbox, BBox2i const& bbox, int depth,
+                          Matrix<double> const& lowres_hom,
+                          Matrix<double> const& fullres_hom,
+                          ImageView<pixel_type> & tile_disparity) const {
+
+    BBox2f robust_range;
+    bool multimodal = false;
+    BBox2f minmax_range = find_search_range(bbox, lowres_hom, &robust_range, &multimodal);
+
+    // Don't split into pieces smaller than what the correlation
+    // kernel and the low-res disparity can resolve.
+    const int max_depth = 2;
+    int min_size = std::max(4*std::max(m_kernel_size[0], m_kernel_size[1]),
+                            int(8*std::max(m_upscale_factor[0], m_upscale_factor[1])));
+    if (multimodal && depth < max_depth &&
+        bbox.width() >= 2*min_size && bbox.height() >= 2*min_size){
+      search_range_stats().add_split();
+      int half_cols = bbox.width()/2, half_rows = bbox.height()/2;
+      for (int i = 0; i < 2; i++){
+        for (int j = 0; j < 2; j++){
+          Vector2i min = bbox.min() + Vector2i(i*half_cols, j*half_rows);
+          Vector2i max(i == 0 ? min.x() + half_cols : bbox.max().x(),
+                       j == 0 ? min.y() + half_rows : bbox.max().y());
+          correlate_robustly(tile_bbox, BBox2i(min, max), depth + 1,
+                             lowres_hom, fullres_hom, tile_disparity);
+        }
+      }
+      return;
+    }
+
+    Stopwatch sw;
+    sw.start();
+    ImageView<pixel_type> disparity = correlate(bbox, robust_range, fullres_hom);
+    sw.stop();
+    search_range_stats().add_tile(double(bbox.width())*bbox.height(),
+                                  grow_bbox_to_int(minmax_range),
+                                  grow_bbox_to_int(robust_range),
+                                  sw.elapsed_seconds());
+
+    crop(tile_disparity, bbox - tile_bbox.min()) = disparity;
+  }
+
+  /// The function that does all the work
+  inline prerasterize_type prerasterize_helper(BBox2i const& bbox) const {
+
+    bool use_local_homography = stereo_settings().use_local_homography;
+
+    Matrix<double> lowres_hom  = math::identity_matrix<3>();
+    Matrix<double> fullres_hom = math::identity_matrix<3>();
+    if ( stereo_settings().seed_mode > 0 && use_local_homography ){
+      int ts = ASPGlobalOptions::corr_tile_size();
+      lowres_hom = m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts);
+      Vector3 upscale(     m_upscale_factor[0],     m_upscale_factor[1], 1 );
+      Vector3 dnscale( 1.0/m_upscale_factor[0], 1.0/m_upscale_factor[1], 1 );
+      fullres_hom = diagonal_matrix(upscale)*lowres_hom*diagonal_matrix(dnscale);
+    }
+
+    ImageView<pixel_type> disparity;
+    if ( stereo_settings().seed_mode > 0 && stereo_settings().corr_range_percentile > 0 ){
+      disparity.set_size(bbox.width(), bbox.height());
+      correlate_robustly(bbox, bbox, 0, lowres_hom, fullres_hom, disparity);
+    }else{
+      // User strategies
+      BBox2f local_search_range;
+      if ( stereo_settings().seed_mode > 0 ) {
+        local_search_range = find_search_range(bbox, lowres_hom, NULL, NULL);
+        VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView("
+                                       << bbox << ") search range "
+                                       << local_search_range << " vs "
+                                       << stereo_settings().search_range << "\n";
+      } else{
+        local_search_range = stereo_settings().search_range;
+        VW_OUT(DebugMessage,"stereo") << "Searching with "
+                                      << stereo_settings().search_range << "\n";
+      }
+      disparity = correlate(bbox, local_search_range, fullres_hom);
+    }
+
+    return prerasterize_type(disparity, -bbox.min().x(), -bbox.min().y(),
+                             cols(), rows());
   } // End function prerasterize_helper
 
   template <class DestT>
@@ -582,26 +871,24 @@ void stereo_correlation( ASPGlobalOptions& opt ) {
   std::string spread_file = opt.out_prefix+"-D_sub_spread.tif";
   
   if ( stereo_settings().seed_mode > 0 )
-    sub_disp = DiskImageView<PixelMask<Vector2i> >(dsub_file);
+    sub_disp = read_lowres_disparity(dsub_file);
   ImageViewRef<PixelMask<Vector2i> > sub_disp_spread;
   if ( stereo_settings().seed_mode == 2 ||  stereo_settings().seed_mode == 3 ){
     // D_sub_spread is mandatory for seed_mode 2 and 3.
-    sub_disp_spread = DiskImageView<PixelMask<Vector2i> >(spread_file);
+    sub_disp_spread = read_lowres_disparity(spread_file);
   }else if ( stereo_settings().seed_mode == 1 ){
     // D_sub_spread is optional for seed_mode 1, we use it only if it is provided.
     if (fs::exists(spread_file)) {
       try {
-        sub_disp_spread = DiskImageView<PixelMask<Vector2i> >(spread_file);
+        sub_disp_spread = read_lowres_disparity(spread_file);
       }
       catch (...) {}
     }
   }
 
-  ImageView<Matrix3x3> local_hom;
-  if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography ){
-    string local_hom_file = opt.out_prefix + "-local_hom.txt";
-    read_local_homographies(local_hom_file, local_hom);
-  }
+  LocalHomographies local_hom;
+  if ( stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography )
+    local_hom = read_local_homographies(opt.out_prefix);
 
   stereo::CostFunctionType cost_mode;
   if      (stereo_settings().cost_mode == 0) cost_mode = stereo::ABSOLUTE_DIFFERENCE;
@@ -650,15 +937,25 @@ void stereo_correlation( ASPGlobalOptions& opt ) {
 			      has_nodata, nodata, opt,
 			      TerminalProgressCallback("asp", "\t--> Correlation :") );
 
+  search_range_stats().report();
+
   vw_out() << "\n[ " << current_posix_time_string() << " ] : CORRELATION FINISHED \n";
 
 } // End function stereo_correlation
 
+/// Correlation as done for each tile by the workers of parallel_stereo
+void correlation_stage(std::string const& output_prefix, std::vector<ASPGlobalOptions> & opt_vec) {
+  stereo_correlation( opt_vec[0] );
+}
+
 int main(int argc, char* argv[]) {
 
   try {
     xercesc::XMLPlatformUtils::Initialize();
 
+    Stopwatch setup;
+    setup.start();
+
     stereo_register_sessions();
 
     bool verbose = false;
@@ -666,16 +963,19 @@ int main(int argc, char* argv[]) {
     string output_prefix;
     asp::parse_multiview(argc, argv, CorrelationDescription(),
 			 verbose, output_prefix, opt_vec);
-    ASPGlobalOptions opt = opt_vec[0];
 
     // Integer correlator requires large tiles
     //---------------------------------------------------------
     int ts = ASPGlobalOptions::corr_tile_size();
-    opt.raster_tile_size = Vector2i(ts, ts);
+    opt_vec[0].raster_tile_size = Vector2i(ts, ts);
+    setup.stop();
 
     // Internal Processes
     //---------------------------------------------------------
-    stereo_correlation( opt );
+    if (stereo_settings().worker_queue.empty())
+      stereo_correlation( opt_vec[0] );
+    else
+      run_tile_worker(opt_vec, setup.elapsed_seconds(), correlation_stage);
   
     xercesc::XMLPlatformUtils::Terminate();
   } ASP_STANDARD_CATCHES;
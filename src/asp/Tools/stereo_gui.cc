@@ -162,11 +162,10 @@ int main(int argc, char* argv[]) {
     }
 
     if (stereo_settings().create_image_pyramids_only) {
-      // Just create the image pyramids and exit.
-      for (size_t i = 0; i < images.size(); i++) {
-        vw::gui::imageData img;
-        img.read(images[i], opt_vec[0], stereo_settings().use_georef);
-      }
+      // Just create the image pyramids and exit. The cache links made
+      // for them are no longer in use after that.
+      vw::gui::PyramidCacheLinksGuard links_guard;
+      vw::gui::build_image_pyramids(images, opt_vec[0]);
       return 0;
     }
 
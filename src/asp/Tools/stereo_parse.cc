@@ -26,6 +26,7 @@
 #include <asp/Sessions/ResourceLoader.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
+#include <asp/Core/TilePlan.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
 using namespace vw;
@@ -167,6 +168,36 @@ int main( int argc, char* argv[] ) {
       }
     }
 
+    // Split L.tif into tiles of about equal correlation cost, for
+    // parallel_stereo. This needs the low-res disparity as well.
+    if (stereo_settings().plan_tiles > 0) {
+      std::string d_sub_file    = opt.out_prefix + "-D_sub.tif";
+      std::string spread_file   = opt.out_prefix + "-D_sub_spread.tif";
+      std::string mask_sub_file = opt.out_prefix + "-lMask_sub.tif";
+      if (!fs::exists(left_image_file) || !fs::exists(d_sub_file))
+        vw_throw(ArgumentErr() << "Cannot plan the tiles without " << left_image_file
+                               << " and " << d_sub_file << ".\n");
+
+      ImageView<PixelMask<Vector2i> > d_sub, d_sub_spread;
+      read_image(d_sub, d_sub_file);
+      if (fs::exists(spread_file))
+        read_image(d_sub_spread, spread_file);
+      ImageView<uint8> left_mask_sub;
+      if (fs::exists(mask_sub_file))
+        read_image(left_mask_sub, mask_sub_file);
+
+      Vector2i left_size = file_image_size(left_image_file);
+      int block_size = std::max(ASPGlobalOptions::corr_tile_size()/4, 64);
+      ImageView<double> costs
+        = correlation_block_costs(d_sub, d_sub_spread, left_mask_sub, left_size,
+                                  transformed_window, block_size);
+      std::vector<BBox2i> tiles;
+      std::vector<double> tile_costs;
+      plan_tiles(costs, block_size, left_size, transformed_window,
+                 stereo_settings().plan_tiles, tiles, tile_costs);
+      write_tile_plan(opt.out_prefix + "-tile-plan.txt", left_size, tiles, tile_costs);
+    }
+
     xercesc::XMLPlatformUtils::Terminate();
   } ASP_STANDARD_CATCHES;
 
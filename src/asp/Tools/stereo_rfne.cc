@@ -26,6 +26,7 @@
 #include <vw/Stereo/EMSubpixelCorrelatorView.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <asp/Core/LocalHomography.h>
+#include <asp/Core/SubpixelRefinement.h>
 #include <asp/Sessions/StereoSession.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
@@ -187,7 +188,7 @@ class PerTileRfne: public ImageViewBase<PerTileRfne<Image1T, Image2T, SeedDispT>
   ImageViewRef<uint8>  m_right_mask;
   SeedDispT            m_integer_disp;
   SeedDispT            m_sub_disp;
-  ImageView<Matrix3x3> m_local_hom;
+  LocalHomographies    m_local_hom;
   ASPGlobalOptions const&       m_opt;
   Vector2              m_upscale_factor;
 
@@ -197,7 +198,7 @@ public:
                ImageViewRef <uint8>     const& right_mask,
                ImageViewBase<SeedDispT> const& integer_disp,
                ImageViewBase<SeedDispT> const& sub_disp,
-               ImageView    <Matrix3x3> const& local_hom,
+               LocalHomographies        const& local_hom,
                ASPGlobalOptions const& opt):
     m_left_image(left_image.impl()), m_right_image(right_image.impl()),
     m_right_mask(right_mask),
@@ -241,6 +242,8 @@ public:
 
     ImageView<pixel_type> tile_disparity;
     bool verbose = false;
+    bool use_tile_engine = stereo_settings().subpixel_tile_engine &&
+      tile_engine_supports_subpixel_mode(stereo_settings().subpixel_mode);
     if (stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography){
 
       int ts = ASPGlobalOptions::corr_tile_size();
@@ -262,14 +265,24 @@ public:
         = apply_mask(right_trans_masked_img);
 
 
-      tile_disparity = crop(refine_disparity(m_left_image, right_trans_img,
-                                             m_integer_disp, m_opt, verbose), bbox);
+      if (use_tile_engine){
+        bool has_homography = true;
+        tile_disparity = refine_tile(m_left_image.impl(), right_trans_img,
+                                     m_integer_disp.impl(), bbox, has_homography);
+      }else{
+        tile_disparity = crop(refine_disparity(m_left_image, right_trans_img,
+                                               m_integer_disp, m_opt, verbose), bbox);
+      }
 
       // Must undo the local homography transform
       bool do_round = false; // don't round floating point disparities
       tile_disparity = transform_disparities(do_round, bbox, inverse(fullres_hom),
                                              tile_disparity);
 
+    }else if (use_tile_engine){
+      bool has_homography = false;
+      tile_disparity = refine_tile(m_left_image.impl(), m_right_image.impl(),
+                                   m_integer_disp.impl(), bbox, has_homography);
     }else{
       tile_disparity = crop(refine_disparity(m_left_image, m_right_image,
                                              m_integer_disp, m_opt, verbose), bbox);
@@ -305,7 +318,7 @@ per_tile_rfne( ImageViewBase<Image1T> const& left,
                ImageViewRef<uint8> const& right_mask,
                ImageViewBase<SeedDispT> const& integer_disp,
                ImageViewBase<SeedDispT> const& sub_disp,
-               ImageView<Matrix3x3> const& local_hom,
+               LocalHomographies const& local_hom,
                ASPGlobalOptions const& opt) {
   typedef PerTileRfne<Image1T, Image2T, SeedDispT> return_type;
   return return_type( left.impl(), right.impl(), right_mask,
@@ -318,7 +331,7 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
   ImageViewRef<uint8> left_mask, right_mask;
   ImageViewRef<PixelMask<Vector2i> > integer_disp;
   ImageViewRef<PixelMask<Vector2i> > sub_disp;
-  ImageView<Matrix3x3> local_hom;
+  LocalHomographies local_hom;
   string left_image_file  = opt.out_prefix+"-L.tif";
   string right_image_file = opt.out_prefix+"-R.tif";
   string left_mask_file  = opt.out_prefix+"-lMask.tif";
@@ -332,10 +345,8 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
     integer_disp = DiskImageView< PixelMask<Vector2i> >(opt.out_prefix + "-D.tif");
     if ( stereo_settings().seed_mode > 0 &&
          stereo_settings().use_local_homography ){
-      sub_disp = DiskImageView<PixelMask<Vector2i> >(opt.out_prefix+"-D_sub.tif");
-
-      string local_hom_file = opt.out_prefix + "-local_hom.txt";
-      read_local_homographies(local_hom_file, local_hom);
+      sub_disp  = read_lowres_disparity(opt.out_prefix+"-D_sub.tif");
+      local_hom = read_local_homographies(opt.out_prefix);
     }
 
   } catch (IOErr const& e) {
@@ -372,6 +383,13 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
   ImageView<PixelGray<float>    > left_dummy(1, 1), right_dummy(1, 1);
   ImageView<PixelMask<Vector2i> > dummy_disp(1, 1);
   refine_disparity(left_dummy, right_dummy, dummy_disp, opt, verbose);
+  if (stereo_settings().subpixel_tile_engine){
+    if (tile_engine_supports_subpixel_mode(stereo_settings().subpixel_mode))
+      vw_out() << "\t--> Using the tile refinement engine.\n";
+    else
+      vw_out() << "\t--> The tile refinement engine does not support subpixel mode "
+               << stereo_settings().subpixel_mode << ", ignoring it.\n";
+  }
 
   ImageViewRef< PixelMask<Vector2f> > refined_disp
     = per_tile_rfne(left_image, right_image, right_mask,
@@ -388,6 +406,13 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
                               has_left_georef, left_georef,
                               has_nodata, nodata, opt,
                               TerminalProgressCallback("asp", "\t--> Refinement :") );
+
+  rfne_timing_stats().report();
+}
+
+/// Refinement as done for each tile by the workers of parallel_stereo
+void refinement_stage(std::string const& output_prefix, std::vector<ASPGlobalOptions> & opt_vec) {
+  stereo_refinement( opt_vec[0] );
 }
 
 int main(int argc, char* argv[]) {
@@ -398,6 +423,9 @@ int main(int argc, char* argv[]) {
     vw_out() << "\n[ " << current_posix_time_string()
              << " ] : Stage 2 --> REFINEMENT \n";
 
+    Stopwatch setup;
+    setup.start();
+
     stereo_register_sessions();
 
     bool verbose = false;
@@ -405,16 +433,19 @@ int main(int argc, char* argv[]) {
     string output_prefix;
     asp::parse_multiview(argc, argv, SubpixelDescription(),
                          verbose, output_prefix, opt_vec);
-    ASPGlobalOptions opt = opt_vec[0];
 
     // Subpixel refinement uses smaller tiles.
     //---------------------------------------------------------
     int ts = ASPGlobalOptions::rfne_tile_size();
-    opt.raster_tile_size = Vector2i(ts, ts);
+    opt_vec[0].raster_tile_size = Vector2i(ts, ts);
+    setup.stop();
 
     // Internal Processes
     //---------------------------------------------------------
-    stereo_refinement( opt );
+    if (stereo_settings().worker_queue.empty())
+      stereo_refinement( opt_vec[0] );
+    else
+      run_tile_worker(opt_vec, setup.elapsed_seconds(), refinement_stage);
 
     vw_out() << "\n[ " << current_posix_time_string()
              << " ] : REFINEMENT FINISHED \n";
@@ -26,9 +26,11 @@
 #include <vw/InterestPoint/InterestData.h>
 
 #include <asp/Camera/RPCModel.h>
+#include <asp/Camera/RPCStereoModel.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Tools/jitter_adjust.h>
 #include <asp/Tools/ccd_adjust.h>
+#include <asp/Core/ChunkedPointCloud.h>
 
 // We must have the implementations of all sessions for triangulation
 #include <asp/Sessions/StereoSessionFactory.h>
@@ -67,6 +69,12 @@ class StereoTXAndErrorView : public ImageViewBase<StereoTXAndErrorView<Disparity
   bool         m_is_map_projected;
   typedef typename DisparityImageT::pixel_type DPixelT;
 
+  // For RPC cameras, all pixels in a tile are triangulated at once
+  // when the tile is prerasterized, and the results are kept here.
+  boost::shared_ptr<RPCStereoModel>     m_rpc_model;
+  boost::shared_ptr< ImageView<Vector6> > m_tile;
+  BBox2i m_tile_box;
+
 public:
 
   typedef Vector6 pixel_type;
@@ -77,11 +85,14 @@ public:
   StereoTXAndErrorView( vector<DisparityImageT> const& disparity_maps,
                         vector<TXT>             const& transforms,
                         StereoModelT            const& stereo_model,
-                        bool is_map_projected) :
+                        bool is_map_projected,
+                        boost::shared_ptr<RPCStereoModel> rpc_model
+                          = boost::shared_ptr<RPCStereoModel>()) :
     m_disparity_maps(disparity_maps),
     m_transforms(transforms),
     m_stereo_model(stereo_model),
-    m_is_map_projected(is_map_projected) {
+    m_is_map_projected(is_map_projected),
+    m_rpc_model(rpc_model) {
 
     // Sanity check
     for (int p = 1; p < (int)m_disparity_maps.size(); p++){
@@ -100,14 +111,29 @@ public:
   /// Compute the 3D coordinate corresponding to a pixel location.
   /// - p is not actually used here, it should always be zero!
   inline result_type operator()( size_t i, size_t j, size_t p=0 ) const {
-      
-    // For each input image, de-warp the pixel in to the native camera coordinates
+
+    if (m_tile && m_tile_box.contains(Vector2i(i, j)))
+      return (*m_tile)(i - m_tile_box.min().x(), j - m_tile_box.min().y());
+
+    vector<Vector2> pixVec;
+    camera_pixels(i, j, pixVec);
+
+    // Compute the location of the 3D point observed by each input pixel
+    Vector3 errorVec;
+    pixel_type result;
+    subvector(result,0,3) = m_stereo_model(pixVec, errorVec);
+    subvector(result,3,3) = errorVec;
+    return result; // Contains location and error vector
+  }
+
+  /// For each input image, de-warp the pixel in to the native camera coordinates
+  void camera_pixels( size_t i, size_t j, vector<Vector2> & pixVec ) const {
     int num_disp = m_disparity_maps.size();
-    vector<Vector2> pixVec(num_disp + 1);
+    pixVec.resize(num_disp + 1);
     pixVec[0] = m_transforms[0].reverse(Vector2(i,j)); // De-warp "left" pixel
     for (int c = 0; c < num_disp; c++){
       Vector2 pix;
-      DPixelT disp = m_disparity_maps[c](i,j,p); // Disparity value at this pixel
+      DPixelT disp = m_disparity_maps[c](i,j); // Disparity value at this pixel
       if (is_valid(disp)) // De-warp the "right" pixel
         pix = m_transforms[c+1].reverse( Vector2(i,j) + stereo::DispHelper(disp) );
       else // Insert flag values
@@ -115,18 +141,45 @@ public:
                       std::numeric_limits<double>::quiet_NaN());
       pixVec[c+1] = pix;
     }
-
-    // Compute the location of the 3D point observed by each input pixel
-    Vector3 errorVec;
-    pixel_type result;
-    subvector(result,0,3) = m_stereo_model(pixVec, errorVec);
-    subvector(result,3,3) = errorVec;
-    return result; // Contains location and error vector
   }
 
   typedef StereoTXAndErrorView<ImageViewRef<DPixelT>, TXT, StereoModelT> prerasterize_type;
   inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
-    return PreRasterHelper( bbox, m_transforms );
+    prerasterize_type view = PreRasterHelper( bbox, m_transforms );
+    if (m_rpc_model)
+      view.triangulate_tile(bbox);
+    return view;
+  }
+
+  /// Triangulate all pixels in the box with the batch RPC calls. The
+  /// pixels are visited row by row, so each ray solve starts from the
+  /// solution for its neighbor.
+  void triangulate_tile( BBox2i const& bbox ) {
+    int num_cams = m_disparity_maps.size() + 1;
+    vector< vector<Vector2> > pixVecs(num_cams);
+    vector<Vector2> pixVec;
+    for (int j = bbox.min().y(); j < bbox.max().y(); j++){
+      for (int i = bbox.min().x(); i < bbox.max().x(); i++){
+        camera_pixels(i, j, pixVec);
+        for (int c = 0; c < num_cams; c++)
+          pixVecs[c].push_back(pixVec[c]);
+      }
+    }
+
+    vector<Vector3> points, errorVecs;
+    (*m_rpc_model)(pixVecs, points, errorVecs);
+
+    m_tile = boost::shared_ptr< ImageView<Vector6> >
+      (new ImageView<Vector6>(bbox.width(), bbox.height()));
+    size_t k = 0;
+    for (int row = 0; row < bbox.height(); row++){
+      for (int col = 0; col < bbox.width(); col++){
+        subvector((*m_tile)(col, row), 0, 3) = points[k];
+        subvector((*m_tile)(col, row), 3, 3) = errorVecs[k];
+        k++;
+      }
+    }
+    m_tile_box = bbox;
   }
   template <class DestT>
   inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
@@ -151,7 +204,8 @@ private:
         disparity_cropviews.push_back(cropview_clip);
       }
 
-      return prerasterize_type(disparity_cropviews, transforms, m_stereo_model, m_is_map_projected);
+      return prerasterize_type(disparity_cropviews, transforms, m_stereo_model, m_is_map_projected,
+                               m_rpc_model);
     }
 
     // Code for MAP-PROJECTED session types.
@@ -190,7 +244,8 @@ private:
       transforms_copy[p+1].reverse_bbox(right_bbox); // As a side effect this call makes transforms_copy create a local cache we want later
     }
 
-    return prerasterize_type(disparity_cropviews, transforms_copy, m_stereo_model, m_is_map_projected);
+    return prerasterize_type(disparity_cropviews, transforms_copy, m_stereo_model, m_is_map_projected,
+                             m_rpc_model);
   } // End function PreRasterHelper() DGMapRPC version
 
 }; // End class StereoTXAndErrorView
@@ -201,27 +256,21 @@ StereoTXAndErrorView<DisparityT, TXT, StereoModelT>
 stereo_error_triangulate( vector<DisparityT> const& disparities,
                           vector<TXT>        const& transforms,
                           StereoModelT       const& model,
-                          bool is_map_projected ) {
+                          bool is_map_projected,
+                          boost::shared_ptr<RPCStereoModel> rpc_model ) {
 
   typedef StereoTXAndErrorView<DisparityT, TXT, StereoModelT> result_type;
-  return result_type( disparities, transforms, model, is_map_projected );
+  return result_type( disparities, transforms, model, is_map_projected, rpc_model );
 }
 
 /// Bin the disparities, and from each bin get a disparity value.
 /// This will create a correspondence from the left to right image,
 /// which we save in the match format
 template <class DisparityT, class TXT>
-void compute_matches_from_disp(vector<DisparityT> const& disparities,
-                               vector<TXT>        const& transforms,
-                               std::string        const& match_file) {
-
-  VW_ASSERT( disparities.size() == 1 && transforms.size() == 2,
-               vw::ArgumentErr() << "Expecting two images and one disparity.\n" );
-  DisparityT const& disp = disparities[0]; // pull the disparity
-
-  // Transforms to compensate for alignment
-  TXT left_trans  = transforms[0];
-  TXT right_trans = transforms[1];
+void compute_matches_from_disp(DisparityT  const& disp,
+                               TXT         const& left_trans,
+                               TXT         const& right_trans,
+                               std::string const& match_file) {
 
   std::vector<vw::ip::InterestPoint> left_ip, right_ip;
 
@@ -306,6 +355,7 @@ namespace asp{
   template <class ImageT>
   void save_point_cloud(Vector3 const& shift, ImageT const& point_cloud,
                         string const& point_cloud_file,
+                        bool single_threaded_cameras,
                         ASPGlobalOptions const& opt){
 
     vw_out() << "Writing point cloud: " << point_cloud_file << "\n";
@@ -315,8 +365,28 @@ namespace asp{
     bool has_nodata = false;
     double nodata = -std::numeric_limits<float>::max(); // smallest float
 
+    if (stereo_settings().save_chunked_point_cloud){
+      if (stereo_settings().save_double_precision_point_cloud)
+        vw_throw(ArgumentErr() << "Cannot save a chunked point cloud in double precision.\n");
+
+      // The points are always quantized, even without a shift
+      double rounding_error = stereo_settings().point_cloud_rounding_error;
+      if (norm_2(shift) > 0)
+        rounding_error = asp::get_rounding_error(shift, rounding_error);
+      else if (rounding_error <= 0)
+        rounding_error = asp::APPROX_ONE_MM;
+
+      // ISIS does not support multi-threading
+      int num_threads = single_threaded_cameras ? 1 : opt.num_threads;
+      asp::write_chunked_point_cloud
+        ( point_cloud_file, shift, rounding_error, point_cloud,
+          has_georef, georef, opt.raster_tile_size[0], num_threads,
+          TerminalProgressCallback("asp", "\t--> Triangulating: "));
+      return;
+    }
+
     // TODO: Replace this with with a function call!
-    if ( (opt.session->name() == "isis") || (opt.session->name() == "isismapisis")){
+    if (single_threaded_cameras){
       // ISIS does not support multi-threading
       asp::write_approx_gdal_image
         ( point_cloud_file, shift,
@@ -361,13 +431,17 @@ namespace asp{
   Vector3 find_point_cloud_center(Vector2i const& tile_size,
                                   ImageViewRef<Vector6> const& point_cloud){
 
-    // Compute the point cloud in a tile around the center of the
-    // cloud. Find the median of all the points in that cloud.  That
-    // will be the cloud center. If the tile is too small, spiral away
-    // from the center adding other tiles.  Keep the tiles aligned to a
-    // multiple of tile_size, for consistency with how the point cloud
-    // is written to disk later on.
-
+    // Compute the point cloud at a sparse grid of pixels in a tile
+    // around the center of the cloud. Find the median of all the
+    // points found.  That will be the cloud center. If the tile has
+    // too few points, spiral away from the center adding other tiles.
+    // Keep the tiles aligned to a multiple of tile_size, for
+    // consistency with how the point cloud is written to disk later
+    // on. Triangulating only the grid pixels makes this cheap enough
+    // to do once before the tiles of parallel_stereo, which all then
+    // use this center.
+
+    const int samples_per_side = 32;
     int numx = (int)ceil(point_cloud.cols()/double(tile_size[0]));
     int numy = (int)ceil(point_cloud.rows()/double(tile_size[1]));
 
@@ -391,11 +465,14 @@ namespace asp{
           // Crop to the cloud area actually having points
           box.crop(stereo_settings().trans_crop_win);
 
-          // Triangulate in the existing box
-          ImageView<Vector6> cropped_cloud = crop(point_cloud, box);
-          for (int px = 0; px < cropped_cloud.cols(); px++){
-            for (int py = 0; py < cropped_cloud.rows(); py++){
-              Vector3 xyz = subvector(cropped_cloud(px, py), 0, 3);
+          // Triangulate at the grid pixels in the existing box
+          if (box.width() <= 0 || box.height() <= 0)
+            continue;
+          int step_x = std::max(1, box.width() /samples_per_side);
+          int step_y = std::max(1, box.height()/samples_per_side);
+          for (int px = box.min().x(); px < box.max().x(); px += step_x){
+            for (int py = box.min().y(); py < box.max().y(); py += step_y){
+              Vector3 xyz = subvector(point_cloud(px, py), 0, 3);
               if (xyz == Vector3())
                 continue;
               points.push_back(xyz);
@@ -512,15 +589,30 @@ void stereo_triangulation( string          const& output_prefix,
     if (stereo_settings().image_lines_per_piecewise_adjustment > 0 &&
         !stereo_settings().skip_computing_piecewise_adjustments){
 
-      std::string match_file = output_prefix + "-disp.match";
-      compute_matches_from_disp(disparity_maps, transforms, match_file);
+      // The left image is matched with each of the others
+      std::map< std::pair<int, int>, std::string> match_files;
+      for (int p = 0; p < (int)disparity_maps.size(); p++) {
+        std::string match_file = output_prefix + "-disp.match";
+        if (disparity_maps.size() > 1)
+          match_file = output_prefix + "-disp-" + vw::num_to_str(p + 1) + ".match";
+        compute_matches_from_disp(disparity_maps[p], transforms[0], transforms[p + 1],
+                                  match_file);
+        match_files[std::pair<int, int>(0, p + 1)] = match_file;
+      }
 
+      // Ceres evaluates the residuals in its threads, and each one
+      // projects into the cameras. ISIS cameras keep state in the
+      // ISIS library and cannot be used from several threads at once,
+      // so then the solver is single-threaded.
       int num_threads = opt_vec[0].num_threads;
-      if (opt_vec[0].session->name() == "isis" || opt_vec[0].session->name() == "isismapisis")
-        num_threads = 1;
+      for (size_t c = 0; c < cameras.size(); c++) {
+        if (asp::is_single_threaded_camera(cameras[c].get()))
+          num_threads = 1;
+      }
       asp::jitter_adjust(image_files, camera_files, cameras,
 			 output_prefix, opt_vec[0].session->name(),
-			 match_file,  num_threads);
+			 match_files,  num_threads);
+      // Solving for the CCD offsets is not finished, so it is not done.
       //asp::ccd_adjust(image_files, camera_files, cameras, output_prefix,
       //                match_file,  num_threads);
     }
@@ -551,16 +643,30 @@ void stereo_triangulation( string          const& output_prefix,
     // Strip the smart pointers and form the stereo model
     std::vector<const vw::camera::CameraModel *> camera_ptrs;
     int num_cams = cameras.size();
+    bool single_threaded_cameras = false;
     for (int c = 0; c < num_cams; c++) {
       camera_ptrs.push_back(cameras[c].get());
+      if (asp::is_single_threaded_camera(cameras[c].get()))
+        single_threaded_cameras = true;
     }
     StereoModelT stereo_model( camera_ptrs, stereo_settings().use_least_squares );
 
+    // If all cameras are RPC, without adjustments, the rays for each
+    // tile can be found in one batch, which is much faster.
+    bool all_rpc = !stereo_settings().use_least_squares;
+    for (int c = 0; c < num_cams; c++)
+      all_rpc = all_rpc && (dynamic_cast<const RPCModel*>(camera_ptrs[c]) != NULL);
+    boost::shared_ptr<RPCStereoModel> rpc_model;
+    if (all_rpc) {
+      vw_out() << "\t--> Using batched RPC triangulation." << endl;
+      rpc_model = boost::shared_ptr<RPCStereoModel>(new RPCStereoModel(camera_ptrs));
+    }
+
     // Apply radius function and stereo model in one go
     vw_out() << "\t--> Generating a 3D point cloud." << endl;
     ImageViewRef<Vector6> point_cloud = per_pixel_filter
       (stereo_error_triangulate
-       (disparity_maps, transforms, stereo_model, is_map_projected),
+       (disparity_maps, transforms, stereo_model, is_map_projected, rpc_model),
        universe_radius_func);
 
     // If we crop the left and right images, at each run we must
@@ -573,10 +679,16 @@ void stereo_triangulation( string          const& output_prefix,
     Vector3 cloud_center = Vector3();
     if (!stereo_settings().save_double_precision_point_cloud){
       string cloud_center_file = output_prefix + "-PC-center.txt";
-      if (!read_point(cloud_center_file, cloud_center) || crop_left_and_right){
+      bool have_center = read_point(cloud_center_file, cloud_center);
+      if (!have_center || crop_left_and_right){
         if (!stereo_settings().skip_point_cloud_center_comp) {
           cloud_center = find_point_cloud_center(opt_vec[0].raster_tile_size, point_cloud);
           write_point(cloud_center_file, cloud_center);
+        }else if (!have_center){
+          // The tiles of parallel_stereo must all use the same center,
+          // so that their clouds share the same point offset.
+          vw_throw( ArgumentErr() << "Could not read the point cloud center from "
+                    << cloud_center_file << ", yet its computation was skipped.\n" );
         }
       }
     }
@@ -591,6 +703,8 @@ void stereo_triangulation( string          const& output_prefix,
     // dimensions as L.tif, for the sake of point2dem.
     BBox2i cbox = stereo_settings().trans_crop_win;
     string point_cloud_file = output_prefix + "-PC.tif";
+    if (stereo_settings().save_chunked_point_cloud)
+      point_cloud_file = output_prefix + "-PC.pcc";
     if (stereo_settings().compute_error_vector){
 
       if (num_cams > 2)
@@ -602,13 +716,13 @@ void stereo_triangulation( string          const& output_prefix,
       save_point_cloud(cloud_center,
                        crop(edge_extend(crop_pc, ZeroEdgeExtension()),
                             bounding_box(point_cloud) - cbox.min()),
-                       point_cloud_file, opt_vec[0]);
+                       point_cloud_file, single_threaded_cameras, opt_vec[0]);
     }else{
       ImageViewRef<Vector4> crop_pc = crop(point_and_error_norm(point_cloud), cbox);
       save_point_cloud(cloud_center,
                        crop(edge_extend(crop_pc, ZeroEdgeExtension()),
                             bounding_box(point_cloud) - cbox.min()),
-                       point_cloud_file, opt_vec[0]);
+                       point_cloud_file, single_threaded_cameras, opt_vec[0]);
     } // End if/else
 
     // Must print this at the end, as it contains statistics on the number of rejected points.
@@ -622,6 +736,53 @@ void stereo_triangulation( string          const& output_prefix,
 } // End function stereo_triangulation()
 
 
+/// Triangulate the stereo pairs, which must share the left image. Done
+/// once per tile by the workers of parallel_stereo.
+void triangulation_stage(std::string const& output_prefix, std::vector<ASPGlobalOptions> & opt_vec) {
+
+  // Keep only those stereo pairs for which filtered disparity exists
+  vector<ASPGlobalOptions> opt_vec_new;
+  for (int p = 0; p < (int)opt_vec.size(); p++){
+    if (fs::exists(opt_vec[p].out_prefix+"-F.tif"))
+      opt_vec_new.push_back(opt_vec[p]);
+  }
+  opt_vec = opt_vec_new;
+  if (opt_vec.empty())
+    vw_throw( ArgumentErr() << "No valid F.tif files found.\n" );
+
+  // Triangulation uses small tiles.
+  //---------------------------------------------------------
+  int ts = ASPGlobalOptions::tri_tile_size();
+  for (int s = 0; s < (int)opt_vec.size(); s++)
+    opt_vec[s].raster_tile_size = Vector2i(ts, ts);
+
+  // Internal Processes
+  //---------------------------------------------------------
+
+  // TODO: De-template these classes!
+
+#define INSTANTIATE(T,NAME) if ( opt_vec[0].session->name() == NAME ) { \
+    stereo_triangulation<T>(output_prefix, opt_vec); }
+
+  INSTANTIATE(StereoSessionPinhole,           "pinhole"           );
+  INSTANTIATE(StereoSessionNadirPinhole,      "nadirpinhole"      );
+  INSTANTIATE(StereoSessionRPC,               "rpc"               );
+  INSTANTIATE(StereoSessionDG,                "dg"                );
+  INSTANTIATE(StereoSessionDGMapRPC,          "dgmaprpc"          );
+  INSTANTIATE(StereoSessionRPCMapRPC,         "rpcmaprpc"         );
+  INSTANTIATE(StereoSessionPinholeMapPinhole, "pinholemappinhole" );
+  INSTANTIATE(StereoSessionSpot,              "spot5"             );
+  INSTANTIATE(StereoSessionSpot5MapRPC,       "spot5maprpc"       );
+  INSTANTIATE(StereoSessionASTER,             "aster"             );
+  INSTANTIATE(StereoSessionASTERMapRPC,       "astermaprpc"       );
+#if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
+  INSTANTIATE(StereoSessionIsis,         "isis"                   );
+  INSTANTIATE(StereoSessionIsisMapIsis,  "isismapisis"            );
+#endif
+
+#undef INSTANTIATE
+}
+
 int main( int argc, char* argv[] ) {
 
   try {
@@ -629,6 +790,9 @@ int main( int argc, char* argv[] ) {
 
     vw_out() << "\n[ " << current_posix_time_string() << " ] : Stage 4 --> TRIANGULATION \n";
 
+    Stopwatch setup;
+    setup.start();
+
     stereo_register_sessions();
 
     // Unlike other stereo executables, triangulation can handle multiple images and cameras.
@@ -644,48 +808,12 @@ int main( int argc, char* argv[] ) {
       asp::log_to_file(argc, argv, opt_vec[0].stereo_default_filename,
                        output_prefix);
     }
+    setup.stop();
 
-    // Keep only those stereo pairs for which filtered disparity exists
-    vector<ASPGlobalOptions> opt_vec_new;
-    for (int p = 0; p < (int)opt_vec.size(); p++){
-      if (fs::exists(opt_vec[p].out_prefix+"-F.tif"))
-        opt_vec_new.push_back(opt_vec[p]);
-    }
-    opt_vec = opt_vec_new;
-    if (opt_vec.empty())
-      vw_throw( ArgumentErr() << "No valid F.tif files found.\n" );
-
-    // Triangulation uses small tiles.
-    //---------------------------------------------------------
-    int ts = ASPGlobalOptions::tri_tile_size();
-    for (int s = 0; s < (int)opt_vec.size(); s++)
-      opt_vec[s].raster_tile_size = Vector2i(ts, ts);
-
-    // Internal Processes
-    //---------------------------------------------------------
-
-   // TODO: De-template these classes!
-
-#define INSTANTIATE(T,NAME) if ( opt_vec[0].session->name() == NAME ) { \
-      stereo_triangulation<T>(output_prefix, opt_vec); }
-
-    INSTANTIATE(StereoSessionPinhole,           "pinhole"           );
-    INSTANTIATE(StereoSessionNadirPinhole,      "nadirpinhole"      );
-    INSTANTIATE(StereoSessionRPC,               "rpc"               );
-    INSTANTIATE(StereoSessionDG,                "dg"                );
-    INSTANTIATE(StereoSessionDGMapRPC,          "dgmaprpc"          );
-    INSTANTIATE(StereoSessionRPCMapRPC,         "rpcmaprpc"         );
-    INSTANTIATE(StereoSessionPinholeMapPinhole, "pinholemappinhole" );
-    INSTANTIATE(StereoSessionSpot,              "spot5"             );
-    INSTANTIATE(StereoSessionSpot5MapRPC,       "spot5maprpc"       );
-    INSTANTIATE(StereoSessionASTER,             "aster"             );
-    INSTANTIATE(StereoSessionASTERMapRPC,       "astermaprpc"       );
-#if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
-    INSTANTIATE(StereoSessionIsis,         "isis"                   );
-    INSTANTIATE(StereoSessionIsisMapIsis,  "isismapisis"            );
-#endif
-
-#undef INSTANTIATE
+    if (stereo_settings().worker_queue.empty())
+      triangulation_stage(output_prefix, opt_vec);
+    else
+      run_tile_worker(opt_vec, setup.elapsed_seconds(), triangulation_stage);
 
     vw_out() << "\n[ " << current_posix_time_string() << " ] : TRIANGULATION FINISHED \n";
 